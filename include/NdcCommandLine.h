@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETD_INCLUDE_NDC_COMMAND_LINE_H
+#define NETD_INCLUDE_NDC_COMMAND_LINE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Splits one line of an "ndc -f" batch into the arguments of the command it runs.
+//
+// Arguments are separated by spaces or tabs. Double quotes group characters, including spaces,
+// into a single argument, and a backslash makes the character after it literal. A line whose first
+// non-blank character is '#' is a comment. Blank lines and comments produce no arguments.
+//
+// Returns false if a quote is not closed or the line ends with a backslash. This is shared by ndc
+// and by the ndc wrapper so that the wrapper checks exactly the commands that ndc runs.
+inline bool splitNdcCommandLine(std::string_view line, std::vector<std::string>* words) {
+    words->clear();
+    const size_t start = line.find_first_not_of(" \t\r\n");
+    if (start == std::string_view::npos || line[start] == '#') return true;
+
+    std::string word;
+    bool inWord = false;
+    bool quoted = false;
+    for (size_t i = start; i < line.size(); i++) {
+        const char c = line[i];
+        if (c == '\\') {
+            if (++i == line.size()) return false;
+            word += line[i];
+            inWord = true;
+        } else if (c == '"') {
+            quoted = !quoted;
+            inWord = true;
+        } else if (!quoted && (c == ' ' || c == '\t' || c == '\r' || c == '\n')) {
+            if (inWord) words->push_back(std::move(word));
+            word.clear();
+            inWord = false;
+        } else {
+            word += c;
+            inWord = true;
+        }
+    }
+    if (quoted) return false;
+    if (inWord) words->push_back(std::move(word));
+    return true;
+}
+
+#endif  // NETD_INCLUDE_NDC_COMMAND_LINE_H
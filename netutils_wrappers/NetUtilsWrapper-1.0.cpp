@@ -14,20 +14,27 @@
  * limitations under the License.
  */
 
+#include <mutex>
 #include <regex>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include <libgen.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
+#include <android-base/file.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 
 #define LOG_TAG "NetUtilsWrapper"
 #include <log/log.h>
 
+#include "NdcCommandLine.h"
 #include "NetUtilsWrapper.h"
 
 #define SYSTEM_DIRNAME  "/system/bin/"
@@ -40,7 +47,7 @@
 #define VENDOR_CHAIN "(oem_.*|nm_.*|qcom_.*)"
 
 // List of net utils wrapped by this program
-// The list MUST be in descending order of string length
+// The list MUST be in descending order of string length, and in the same order as the Program bits
 const char *netcmds[] = {
     "ip6tables",
     "iptables",
@@ -50,36 +57,66 @@ const char *netcmds[] = {
     nullptr,
 };
 
-// List of regular expressions of expected commands.
-const char *EXPECTED_REGEXPS[] = {
+// Regular expressions of expected commands, and the programs in netcmds that they can match.
+const std::vector<ExpectedCommand> EXPECTED_COMMANDS = {
 #define CMD "^" SYSTEM_DIRNAME
     // Create, delete, and manage OEM networks.
-    CMD "ndc network (create|destroy) (oem|handle)[0-9]+( |$)",
-    CMD "ndc network interface (add|remove) (oem|handle)[0-9]+ " VENDOR_IFACE,
-    CMD "ndc network route (add|remove) (oem|handle)[0-9]+ ",
-    CMD "ndc ipfwd (enable|disable) ",
-    CMD "ndc ipfwd (add|remove) .*" VENDOR_IFACE,
+    {NDC, CMD "ndc network (create|destroy) (oem|handle)[0-9]+( |$)"},
+    {NDC, CMD "ndc network interface (add|remove) (oem|handle)[0-9]+ " VENDOR_IFACE},
+    {NDC, CMD "ndc network route (add|remove) (oem|handle)[0-9]+ "},
+    {NDC, CMD "ndc ipfwd (enable|disable) "},
+    {NDC, CMD "ndc ipfwd (add|remove) .*" VENDOR_IFACE},
 
     // Manage vendor iptables rules.
-    CMD "ip(6)?tables -w.* (-A|-C|-D|-F|-I|-N|-X) " VENDOR_CHAIN,
-    CMD "ip(6)?tables -w.* (-i|-o) " VENDOR_IFACE,
+    {IPTABLES | IP6TABLES, CMD "ip(6)?tables -w.* (-A|-C|-D|-F|-I|-N|-X) " VENDOR_CHAIN},
+    {IPTABLES | IP6TABLES, CMD "ip(6)?tables -w.* (-i|-o) " VENDOR_IFACE},
 
     // Manage IPsec state.
-    CMD "ip xfrm .*",
+    {IP, CMD "ip xfrm .*"},
 
     // Manage vendor interfaces.
-    CMD "tc .* dev " VENDOR_IFACE,
-    CMD "ip( -4| -6)? (addr|address) (add|del|delete|flush).* dev " VENDOR_IFACE,
+    {TC, CMD "tc .* dev " VENDOR_IFACE},
+    {IP, CMD "ip( -4| -6)? (addr|address) (add|del|delete|flush).* dev " VENDOR_IFACE},
 
     // Other activities observed on current devices. In future releases, these should be supported
     // in a way that is less likely to interfere with general Android networking behaviour.
-    CMD "tc qdisc del dev root",
-    CMD "ip(6)?tables -w .* -j " VENDOR_CHAIN,
-    CMD "iptables -w -t mangle -[AD] PREROUTING -m socket --nowildcard --restore-skmark -j ACCEPT",
-    CMD "ndc network interface (add|remove) oem[0-9]+$",  // Invalid command: no interface removed.
+    {TC, CMD "tc qdisc del dev root"},
+    {IPTABLES | IP6TABLES, CMD "ip(6)?tables -w .* -j " VENDOR_CHAIN},
+    {IPTABLES, CMD "iptables -w -t mangle -[AD] PREROUTING -m socket --nowildcard "
+                   "--restore-skmark -j ACCEPT"},
+    // Invalid command: no interface removed.
+    {NDC, CMD "ndc network interface (add|remove) oem[0-9]+$"},
 #undef CMD
 };
 
+uint32_t getProgram(const std::string& fullCmd) {
+    // Every expected command starts with the path of a program in netcmds followed by a space.
+    const std::string_view path = std::string_view(fullCmd).substr(0, fullCmd.find(' '));
+    if (!android::base::StartsWith(path, SYSTEM_DIRNAME)) return 0;
+    const std::string_view name = path.substr(strlen(SYSTEM_DIRNAME));
+    for (int i = 0; netcmds[i]; ++i) {
+        if (name == netcmds[i]) return 1 << i;
+    }
+    return 0;
+}
+
+std::regex makeExpectedCommandRegex(uint32_t program) {
+    // A command is expected if any of the expressions matches, so they can all be searched for at
+    // once as alternatives of a single expression.
+    std::vector<std::string> alternatives;
+    for (const ExpectedCommand& expected : EXPECTED_COMMANDS) {
+        if (expected.programs & program) {
+            alternatives.push_back(std::string("(") + expected.regexp + ")");
+        }
+    }
+    if (alternatives.empty()) {
+        // Matches nothing.
+        alternatives.push_back("$^.");
+    }
+    return std::regex(android::base::Join(alternatives, '|'),
+                      std::regex_constants::extended | std::regex_constants::nosubs);
+}
+
 bool checkExpectedCommand(int argc, char **argv) {
     static bool loggedError = false;
     std::vector<const char*> allArgs(argc);
@@ -87,9 +124,17 @@ bool checkExpectedCommand(int argc, char **argv) {
         allArgs[i] = argv[i];
     }
     std::string fullCmd = android::base::Join(allArgs, ' ');
-    for (size_t i = 0; i < ARRAY_SIZE(EXPECTED_REGEXPS); i++) {
-        const std::regex expectedRegexp(EXPECTED_REGEXPS[i], std::regex_constants::extended);
-        if (std::regex_search(fullCmd, expectedRegexp)) {
+
+    // Each invocation of the wrapper checks a single command, so only compile the expressions for
+    // the program it runs. Keep them in case the caller checks more commands.
+    static std::once_flag compileOnce[ARRAY_SIZE(netcmds) - 1];
+    static std::regex expectedRegexps[ARRAY_SIZE(netcmds) - 1];
+    const uint32_t program = getProgram(fullCmd);
+    if (program != 0) {
+        const int i = __builtin_ctz(program);
+        std::call_once(compileOnce[i],
+                       [&] { expectedRegexps[i] = makeExpectedCommandRegex(program); });
+        if (std::regex_search(fullCmd, expectedRegexps[i])) {
             return true;
         }
     }
@@ -101,6 +146,62 @@ bool checkExpectedCommand(int argc, char **argv) {
     return false;
 }
 
+bool checkExpectedNdcBatch(const std::string& contents) {
+    int lineNumber = 0;
+    for (const std::string& line : android::base::Split(contents, "\n")) {
+        lineNumber++;
+        std::vector<std::string> words;
+        if (!splitNdcCommandLine(line, &words)) {
+            ALOGI("Unterminated quote or escape on line %d of ndc batch", lineNumber);
+            fprintf(stderr, LOG_TAG ": Unterminated quote or escape on line %d\n", lineNumber);
+            return false;
+        }
+        if (words.empty()) continue;
+
+        std::vector<char*> argv = {const_cast<char*>(SYSTEM_DIRNAME "ndc")};
+        for (std::string& word : words) {
+            // Commands are matched with their arguments joined by spaces, so an argument that is
+            // empty or contains a space could pass for a different number of arguments.
+            if (word.empty() || word.find_first_of(" \t") != std::string::npos) {
+                ALOGI("Unexpected argument on line %d of ndc batch: \"%s\"", lineNumber,
+                      word.c_str());
+                fprintf(stderr, LOG_TAG ": Unexpected argument on line %d: \"%s\"\n", lineNumber,
+                        word.c_str());
+                return false;
+            }
+            argv.push_back(word.data());
+        }
+        if (!checkExpectedCommand(argv.size(), argv.data())) return false;
+    }
+    return true;
+}
+
+namespace {
+
+// Runs "ndc -f <path>" if every command in the batch is expected. ndc reads the commands that were
+// checked from a memfd, so they cannot be changed between the check and the run. Only returns if
+// the batch was rejected or could not be run.
+void execNdcBatch(char* cmd, const char* path) {
+    std::string contents;
+    const bool read = strcmp(path, "-") ? android::base::ReadFileToString(path, &contents)
+                                        : android::base::ReadFdToString(STDIN_FILENO, &contents);
+    if (!read) {
+        perror(path);
+        return;
+    }
+    if (!checkExpectedNdcBatch(contents)) return;
+
+    android::base::unique_fd fd(memfd_create("ndc-batch", MFD_CLOEXEC));
+    if (fd == -1 || !android::base::WriteStringToFd(contents, fd) ||
+        lseek(fd, 0, SEEK_SET) == -1 || dup2(fd, STDIN_FILENO) == -1) {
+        perror("memfd");
+        return;
+    }
+    char* args[] = {cmd, const_cast<char*>("-f"), const_cast<char*>("-"), nullptr};
+    execv(cmd, args);
+}
+
+}  // namespace
 
 // This is the only gateway for vendor programs to reach net utils.
 int doMain(int argc, char **argv) {
@@ -123,7 +224,10 @@ int doMain(int argc, char **argv) {
                 exit(EXIT_FAILURE);
             }
             argv[0] = cmd;
-            if (checkExpectedCommand(argc, argv)) {
+            if (!strcmp(basename, "ndc") && argc == 3 && !strcmp(argv[1], "-f")) {
+                // Each command in the batch is checked instead of the ndc command line.
+                execNdcBatch(cmd, argv[2]);
+            } else if (checkExpectedCommand(argc, argv)) {
                 execv(cmd, argv);
             }
         }
@@ -14,7 +14,39 @@
  * limitations under the License.
  */
 
+#include <stdint.h>
+
+#include <regex>
+#include <string>
+#include <vector>
+
 #define ARRAY_SIZE(x) (sizeof((x)) / (sizeof(((x)[0]))))
 
+// The net utils wrapped by this program, as bits.
+enum Program : uint32_t {
+    IP6TABLES = 1 << 0,
+    IPTABLES = 1 << 1,
+    NDC = 1 << 2,
+    TC = 1 << 3,
+    IP = 1 << 4,
+};
+
+struct ExpectedCommand {
+    uint32_t programs;
+    const char* regexp;
+};
+
+extern const std::vector<ExpectedCommand> EXPECTED_COMMANDS;
+
 int doMain(int argc, char *argv[]);
 bool checkExpectedCommand(int argc, char **argv);
+
+// Returns true if every command in |contents|, the input of "ndc -f", is an expected ndc command.
+// Lines are split into arguments as ndc splits them.
+bool checkExpectedNdcBatch(const std::string& contents);
+
+// Returns the Program that fullCmd runs, or 0 if it does not run a wrapped program.
+uint32_t getProgram(const std::string& fullCmd);
+
+// Returns a single expression that matches the expected commands of |program|.
+std::regex makeExpectedCommandRegex(uint32_t program);
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <regex>
+#include <string>
+#include <vector>
+
+#include <android-base/strings.h>
+#include <benchmark/benchmark.h>
+
+#include "NetUtilsWrapper.h"
+
+namespace {
+
+// Commands run through the wrappers by vendor scripts at boot.
+const std::vector<std::string> VENDOR_COMMANDS = {
+    "/system/bin/ndc network create oem1",
+    "/system/bin/ndc network interface add oem1 rmnet_data0",
+    "/system/bin/ndc network route add oem1 rmnet_data0 10.0.0.0/8",
+    "/system/bin/ndc ipfwd add wlan0 rmnet_data0",
+    "/system/bin/iptables -w -N oem_mangle_post",
+    "/system/bin/iptables -w -t mangle -A oem_mangle_post -o rmnet_data0 -j MARK --set-mark 1",
+    "/system/bin/iptables -w -t filter -I FORWARD -o ccmni0 -j nm_fwd",
+    "/system/bin/iptables -w -t mangle -A PREROUTING -m socket --nowildcard --restore-skmark -j ACCEPT",
+    "/system/bin/ip6tables -w -t mangle -I PREROUTING -i rmnet_data0 -j qcom_qos_filter_post",
+    "/system/bin/ip6tables -w -A INPUT -j qcom_foo",
+    "/system/bin/ip -4 addr add 192.0.2.1/24 dev rmnet_data3",
+    "/system/bin/ip xfrm state",
+    "/system/bin/tc qdisc add dev rmnet_data0 root handle 1: htb",
+    "/system/bin/tc qdisc del dev root",
+    "/system/bin/iptables -w -A OUTPUT -o wlan0 -j DROP",  // Rejected.
+};
+
+std::vector<std::vector<char*>> makeArgvs(std::vector<std::vector<std::string>>* pieces) {
+    std::vector<std::vector<char*>> argvs;
+    for (const std::string& cmd : VENDOR_COMMANDS) {
+        pieces->push_back(android::base::Split(cmd, " "));
+    }
+    for (std::vector<std::string>& cmdPieces : *pieces) {
+        std::vector<char*>& argv = argvs.emplace_back();
+        for (std::string& piece : cmdPieces) argv.push_back(piece.data());
+    }
+    return argvs;
+}
+
+// What each invocation of the wrapper used to do: compile the expressions one by one until one
+// of them matches.
+void BM_IndividualRegexps(benchmark::State& state) {
+    for (auto _ : state) {  // NOLINT(clang-analyzer-deadcode.DeadStores)
+        for (const std::string& cmd : VENDOR_COMMANDS) {
+            bool matched = false;
+            for (const ExpectedCommand& expected : EXPECTED_COMMANDS) {
+                const std::regex re(expected.regexp, std::regex_constants::extended);
+                if (std::regex_search(cmd, re)) {
+                    matched = true;
+                    break;
+                }
+            }
+            benchmark::DoNotOptimize(matched);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * VENDOR_COMMANDS.size());
+}
+BENCHMARK(BM_IndividualRegexps);
+
+// What each invocation of the wrapper does now: compile one expression for its program.
+void BM_CombinedRegexCold(benchmark::State& state) {
+    for (auto _ : state) {  // NOLINT(clang-analyzer-deadcode.DeadStores)
+        for (const std::string& cmd : VENDOR_COMMANDS) {
+            const std::regex re = makeExpectedCommandRegex(getProgram(cmd));
+            benchmark::DoNotOptimize(std::regex_search(cmd, re));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * VENDOR_COMMANDS.size());
+}
+BENCHMARK(BM_CombinedRegexCold);
+
+// Checking commands once the expressions are compiled.
+void BM_CombinedRegexWarm(benchmark::State& state) {
+    std::vector<std::vector<std::string>> pieces;
+    std::vector<std::vector<char*>> argvs = makeArgvs(&pieces);
+    for (auto _ : state) {  // NOLINT(clang-analyzer-deadcode.DeadStores)
+        for (std::vector<char*>& argv : argvs) {
+            benchmark::DoNotOptimize(checkExpectedCommand(argv.size(), argv.data()));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * VENDOR_COMMANDS.size());
+}
+BENCHMARK(BM_CombinedRegexWarm);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <regex>
 #include <string>
 #include <vector>
 
@@ -57,19 +58,118 @@ std::vector<Command> COMMANDS = {
     {VALID,   "/system/bin/ip xfrm state"},
 };
 
+// Commands seen on vendor devices, and others that are close to them.
+std::vector<std::string> VENDOR_COMMANDS = {
+    "/system/bin/ndc network create oem1",
+    "/system/bin/ndc network create oem12 VPN",
+    "/system/bin/ndc network destroy handle123",
+    "/system/bin/ndc network create wlan0",
+    "/system/bin/ndc network route add oem1 rmnet_data0 10.0.0.0/8",
+    "/system/bin/ndc network route add 100 rmnet_data0 10.0.0.0/8",
+    "/system/bin/ndc ipfwd enable tethering",
+    "/system/bin/ndc ipfwd add wlan0 rmnet_data0",
+    "/system/bin/ndc ipfwd add wlan0 wlan1",
+    "/system/bin/ndc interface setcfg rmnet_data0 up",
+    "/system/bin/iptables -w -N oem_mangle_post",
+    "/system/bin/iptables -w -t mangle -A oem_mangle_post -o rmnet_data0 -j MARK --set-mark 1",
+    "/system/bin/iptables -w -t filter -I FORWARD -o ccmni0 -j nm_fwd",
+    "/system/bin/iptables -w -t mangle -A PREROUTING -m socket --nowildcard --restore-skmark -j ACCEPT",
+    "/system/bin/ip6tables -w -t mangle -A PREROUTING -m socket --nowildcard --restore-skmark -j ACCEPT",
+    "/system/bin/iptables -w -A INPUT -i wwan0 -p tcp --dport 22 -j DROP",
+    "/system/bin/iptables -w -A OUTPUT -o wlan0 -j DROP",
+    "/system/bin/iptables -A qcom_foo -j DROP",
+    "/system/bin/ip6tables -w -D nm_pre_ip6 -j ACCEPT",
+    "/system/bin/ip -4 addr add 192.0.2.1/24 dev rmnet_data3",
+    "/system/bin/ip address flush dev cc3mni1",
+    "/system/bin/ip -6 addr flush dev wlan0",
+    "/system/bin/ip route add default dev rmnet_data0",
+    "/system/bin/ip xfrm policy flush",
+    "/system/bin/tc qdisc add dev rmnet_data0 root handle 1: htb",
+    "/system/bin/tc filter add dev wlan0 parent 1: u32",
+    "/system/bin/ping 8.8.8.8",
+    "/system/bin/ipconfig dev rmnet_data0",
+    "/vendor/bin/ip xfrm state",
+    "/system/bin/ip",
+    "",
+};
+
+void toArgv(const std::string& cmdString, std::vector<std::string>* pieces, char** argv) {
+    *pieces = android::base::Split(cmdString, " ");
+    ASSERT_LE(pieces->size(), MAX_ARGS);
+    for (size_t i = 0; i < pieces->size(); i++) {
+        argv[i] = const_cast<char*>((*pieces)[i].c_str());
+    }
+}
+
 TEST(NetUtilsWrapperTest10, TestCommands) {
     // Overwritten by each test case.
     char *argv[MAX_ARGS];
 
     for (const Command& cmd : COMMANDS) {
-        std::vector<std::string> pieces = android::base::Split(cmd.cmdString, " ");
-        ASSERT_LE(pieces.size(), ARRAY_SIZE(argv));
-        for (size_t i = 0; i < pieces.size(); i++) {
-            argv[i] = const_cast<char*>(pieces[i].c_str());
-        }
+        std::vector<std::string> pieces;
+        toArgv(cmd.cmdString, &pieces, argv);
         EXPECT_EQ(cmd.valid, checkExpectedCommand(pieces.size(), argv)) <<
             "Expected command to be " <<
             (cmd.valid ? "valid" : "invalid") << ", but was " <<
             (cmd.valid ? "invalid" : "valid") << ": '" << cmd.cmdString << "'";
     }
 }
+
+TEST(NetUtilsWrapperTest10, TestSameAsIndividualRegexps) {
+    // Overwritten by each test case.
+    char *argv[MAX_ARGS];
+
+    std::vector<std::string> cmdStrings = VENDOR_COMMANDS;
+    for (const Command& cmd : COMMANDS) {
+        cmdStrings.push_back(cmd.cmdString);
+    }
+    for (const std::string& cmdString : cmdStrings) {
+        // Check each expression on its own, regardless of program, as the wrapper used to.
+        bool expected = false;
+        for (const ExpectedCommand& cmd : EXPECTED_COMMANDS) {
+            const std::regex re(cmd.regexp, std::regex_constants::extended);
+            expected |= std::regex_search(cmdString, re);
+        }
+
+        std::vector<std::string> pieces;
+        toArgv(cmdString, &pieces, argv);
+        EXPECT_EQ(expected, checkExpectedCommand(pieces.size(), argv)) << "'" << cmdString << "'";
+    }
+}
+
+TEST(NetUtilsWrapperTest10, TestGetProgram) {
+    EXPECT_EQ(IP6TABLES, getProgram("/system/bin/ip6tables -w -F nm_pre_ip4"));
+    EXPECT_EQ(IPTABLES, getProgram("/system/bin/iptables -w -F nm_pre_ip4"));
+    EXPECT_EQ(NDC, getProgram("/system/bin/ndc network create oem1"));
+    EXPECT_EQ(TC, getProgram("/system/bin/tc qdisc del dev root"));
+    EXPECT_EQ(IP, getProgram("/system/bin/ip xfrm state"));
+    EXPECT_EQ(IP, getProgram("/system/bin/ip"));
+    EXPECT_EQ(0U, getProgram("/system/bin/ipconfig dev rmnet_data0"));
+    EXPECT_EQ(0U, getProgram("/vendor/bin/ip xfrm state"));
+    EXPECT_EQ(0U, getProgram("ip xfrm state"));
+    EXPECT_EQ(0U, getProgram(""));
+}
+
+TEST(NetUtilsWrapperTest10, TestNdcBatch) {
+    EXPECT_TRUE(checkExpectedNdcBatch(""));
+    EXPECT_TRUE(checkExpectedNdcBatch(
+            "# Comments and blank lines are skipped.\n"
+            "\n"
+            "network create oem1\n"
+            "network interface add oem1 rmnet_data0\n"
+            "  network route add oem1 rmnet_data0 10.0.0.0/8\n"
+            "network route add \"oem1\" rmnet_data0 10.1.0.0/16\n"));
+
+    // A single unexpected command rejects the whole batch.
+    EXPECT_FALSE(checkExpectedNdcBatch(
+            "network create oem1\n"
+            "network route add 100 rmnet_data0 10.0.0.0/8\n"));
+    EXPECT_FALSE(checkExpectedNdcBatch("interface setcfg rmnet_data0 up\n"));
+    EXPECT_FALSE(checkExpectedNdcBatch("network create oem1\n-f /data/local/tmp/cmds\n"));
+
+    // Quotes cannot hide arguments from the check.
+    EXPECT_FALSE(checkExpectedNdcBatch("\"network create oem1\" interface setcfg wlan0 up\n"));
+    EXPECT_FALSE(checkExpectedNdcBatch("network create \"\" oem1\n"));
+    EXPECT_FALSE(checkExpectedNdcBatch("network \"create oem1\n"));
+    EXPECT_FALSE(checkExpectedNdcBatch("network create oem1\\"));
+}
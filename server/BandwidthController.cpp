@@ -52,6 +52,7 @@
 #include "Controllers.h"
 #include "FirewallController.h" /* For makeCriticalCommands */
 #include "Fwmark.h"
+#include "IptablesParser.h"
 #include "NetdConstants.h"
 #include "android/net/INetd.h"
 
@@ -70,15 +71,17 @@ using android::base::Join;
 using android::base::StartsWith;
 using android::base::StringAppendF;
 using android::base::StringPrintf;
+using android::net::BootRuleset;
 using android::net::FirewallController;
 using android::net::INetd::CLAT_MARK;
+using android::net::LineTokenizer;
+using android::net::parseNewChain;
 using android::netdutils::StatusOr;
 using android::netdutils::UniqueFile;
 
 namespace {
 
 const char ALERT_GLOBAL_NAME[] = "globalAlert";
-const std::string NEW_CHAIN_COMMAND = "-N ";
 
 /**
  * Some comments about the rules:
@@ -260,17 +263,21 @@ std::vector<std::string> getBasicAccountingCommands() {
 BandwidthController::BandwidthController() {
 }
 
-void BandwidthController::flushCleanTables(bool doClean) {
+void BandwidthController::flushCleanTables(bool doClean, BootRuleset* rules) {
     /* Flush and remove the bw_costly_<iface> tables */
-    flushExistingCostlyTables(doClean);
+    flushExistingCostlyTables(doClean, rules);
 
     std::string commands = Join(IPT_FLUSH_COMMANDS, '\n');
-    iptablesRestoreFunction(V4V6, commands, nullptr);
+    if (rules != nullptr) {
+        rules->add(V4V6, commands);
+    } else {
+        iptablesRestoreFunction(V4V6, commands, nullptr);
+    }
 }
 
-int BandwidthController::setupIptablesHooks() {
+int BandwidthController::setupIptablesHooks(BootRuleset* rules) {
     /* flush+clean is allowed to fail */
-    flushCleanTables(true);
+    flushCleanTables(true, rules);
     return 0;
 }
 
@@ -689,7 +696,7 @@ int BandwidthController::removeCostlyAlert(const std::string& costName, int64_t*
     return 0;
 }
 
-void BandwidthController::flushExistingCostlyTables(bool doClean) {
+void BandwidthController::flushExistingCostlyTables(bool doClean, BootRuleset* rules) {
     std::string fullCmd = "*filter\n-S\nCOMMIT\n";
     std::string ruleList;
 
@@ -699,28 +706,28 @@ void BandwidthController::flushExistingCostlyTables(bool doClean) {
         return;
     }
     /* ... then flush/clean both ip4 and ip6 iptables. */
-    parseAndFlushCostlyTables(ruleList, doClean);
+    parseAndFlushCostlyTables(ruleList, doClean, rules);
 }
 
-void BandwidthController::parseAndFlushCostlyTables(const std::string& ruleList, bool doRemove) {
-    std::stringstream stream(ruleList);
-    std::string rule;
+void BandwidthController::parseAndFlushCostlyTables(const std::string& ruleList, bool doRemove,
+                                                    BootRuleset* rules) {
+    LineTokenizer lines(ruleList);
+    std::string_view rule;
     std::vector<std::string> clearCommands = { "*filter" };
-    std::string chainName;
+    std::string_view chainName;
 
     // Find and flush all rules starting with "-N bw_costly_<iface>" except "-N bw_costly_shared".
-    while (std::getline(stream, rule, '\n')) {
-        if (!StartsWith(rule, NEW_CHAIN_COMMAND)) continue;
-        chainName = rule.substr(NEW_CHAIN_COMMAND.size());
-        ALOGV("parse chainName=<%s> orig line=<%s>", chainName.c_str(), rule.c_str());
+    while (lines.next(&rule)) {
+        if (!parseNewChain(rule, &chainName)) continue;
 
-        if (!StartsWith(chainName, "bw_costly_") || chainName == std::string("bw_costly_shared")) {
+        if (!StartsWith(chainName, "bw_costly_") || chainName == "bw_costly_shared") {
             continue;
         }
 
-        clearCommands.push_back(StringPrintf(":%s -", chainName.c_str()));
+        const std::string chain(chainName);
+        clearCommands.push_back(StringPrintf(":%s -", chain.c_str()));
         if (doRemove) {
-            clearCommands.push_back(StringPrintf("-X %s", chainName.c_str()));
+            clearCommands.push_back(StringPrintf("-X %s", chain.c_str()));
         }
     }
 
@@ -730,6 +737,12 @@ void BandwidthController::parseAndFlushCostlyTables(const std::string& ruleList,
     }
 
     clearCommands.push_back("COMMIT\n");
+    if (rules != nullptr) {
+        // The costly chains are still referenced by the bw_* chains until the rest of the boot
+        // rules flush those, so they are removed in the same transaction.
+        rules->add(V4V6, Join(clearCommands, '\n'));
+        return;
+    }
     iptablesRestoreFunction(V4V6, Join(clearCommands, '\n'), nullptr);
 }
 
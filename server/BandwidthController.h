@@ -23,6 +23,7 @@
 #include <vector>
 #include <mutex>
 
+#include "BootRuleset.h"
 #include "NetdConstants.h"
 
 class BandwidthController {
@@ -31,7 +32,8 @@ public:
 
     BandwidthController();
 
-    int setupIptablesHooks();
+    // If |rules| is not null, the rules are queued in it instead of being installed.
+    int setupIptablesHooks(android::net::BootRuleset* rules = nullptr);
 
     int enableBandwidthControl();
     int enableDataSaver(bool enable);
@@ -99,15 +101,16 @@ public:
      * If doClean then remove the tables also.
      * Deals with both ip4 and ip6 tables.
      */
-    void flushExistingCostlyTables(bool doClean);
-    static void parseAndFlushCostlyTables(const std::string& ruleList, bool doRemove);
+    void flushExistingCostlyTables(bool doClean, android::net::BootRuleset* rules = nullptr);
+    static void parseAndFlushCostlyTables(const std::string& ruleList, bool doRemove,
+                                          android::net::BootRuleset* rules = nullptr);
 
     /*
      * Attempt to flush our tables.
      * If doClean then remove them also.
      * Deals with both ip4 and ip6 tables.
      */
-    void flushCleanTables(bool doClean);
+    void flushCleanTables(bool doClean, android::net::BootRuleset* rules = nullptr);
 
     // For testing.
     friend class BandwidthControllerTest;
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BinderTelemetry.h"
+
+#include <algorithm>
+#include <bit>
+#include <cinttypes>
+#include <utility>
+
+#include <android-base/stringprintf.h>
+
+using android::base::StringPrintf;
+using android::netdutils::DumpWriter;
+using android::netdutils::ScopedIndent;
+using std::chrono::microseconds;
+
+namespace android::net {
+
+namespace {
+
+std::atomic<uint64_t> sNextId = 0;
+
+// Only called by the thread that owns the counter.
+void increment(std::atomic<uint64_t>* counter) {
+    counter->store(counter->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+std::string bucketBound(size_t bucket) {
+    if (bucket == BinderTelemetry::kNumBuckets - 1) {
+        return StringPrintf(">=%" PRIu64 "us", uint64_t{1} << (bucket - 1));
+    }
+    return StringPrintf("<%" PRIu64 "us", uint64_t{1} << bucket);
+}
+
+// Returns the upper bound of the bucket that holds the |percent|th percentile.
+std::string percentile(const BinderTelemetry::Histogram& histogram, uint64_t count,
+                       uint64_t percent) {
+    // The smallest number of samples that is at least |percent|% of |count|.
+    const uint64_t rank = std::max<uint64_t>(1, (count * percent + 99) / 100);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < histogram.size(); i++) {
+        seen += histogram[i];
+        if (seen >= rank) return bucketBound(i);
+    }
+    return "-";
+}
+
+std::string summarize(const BinderTelemetry::Histogram& histogram, uint64_t count) {
+    return StringPrintf("p50%s p90%s p99%s", percentile(histogram, count, 50).c_str(),
+                        percentile(histogram, count, 90).c_str(),
+                        percentile(histogram, count, 99).c_str());
+}
+
+}  // namespace
+
+BinderTelemetry::BinderTelemetry(std::vector<std::string> methodNames)
+    : mId(sNextId++), mNames(std::move(methodNames)) {}
+
+size_t BinderTelemetry::bucket(microseconds duration) {
+    if (duration.count() <= 0) return 0;
+    const size_t width = std::bit_width(static_cast<uint64_t>(duration.count()));
+    return std::min(width, kNumBuckets - 1);
+}
+
+BinderTelemetry::Counters* BinderTelemetry::countersForThisThread() {
+    thread_local std::vector<std::pair<uint64_t, Counters*>> tCounters;
+    for (const auto& [id, counters] : tCounters) {
+        if (id == mId) return counters;
+    }
+
+    // Value-initialized, so every counter starts at 0.
+    Shard shard = std::make_unique<Counters[]>(mNames.size() + 1);
+    Counters* counters = shard.get();
+    {
+        std::lock_guard guard(mLock);
+        mShards.push_back(std::move(shard));
+    }
+    tCounters.emplace_back(mId, counters);
+    return counters;
+}
+
+void BinderTelemetry::record(size_t method, microseconds lockWait, microseconds execution,
+                             bool error) {
+    Counters& counters = countersForThisThread()[std::min(method, mNames.size())];
+    increment(&counters.calls);
+    if (error) increment(&counters.errors);
+    increment(&counters.lockWait[bucket(lockWait)]);
+    increment(&counters.execution[bucket(execution)]);
+}
+
+std::vector<BinderTelemetry::MethodStats> BinderTelemetry::snapshot() const {
+    std::vector<MethodStats> methods(mNames.size() + 1);
+    {
+        std::lock_guard guard(mLock);
+        for (const Shard& shard : mShards) {
+            for (size_t i = 0; i < methods.size(); i++) {
+                const Counters& counters = shard[i];
+                MethodStats& method = methods[i];
+                method.calls += counters.calls.load(std::memory_order_relaxed);
+                method.errors += counters.errors.load(std::memory_order_relaxed);
+                for (size_t b = 0; b < kNumBuckets; b++) {
+                    method.lockWait[b] += counters.lockWait[b].load(std::memory_order_relaxed);
+                    method.execution[b] += counters.execution[b].load(std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    std::vector<MethodStats> called;
+    for (size_t i = 0; i < methods.size(); i++) {
+        if (methods[i].calls == 0) continue;
+        if (i == mNames.size()) {
+            methods[i].name = "other";
+        } else if (mNames[i].empty()) {
+            methods[i].name = StringPrintf("#%zu", i);
+        } else {
+            methods[i].name = mNames[i];
+        }
+        called.push_back(std::move(methods[i]));
+    }
+    return called;
+}
+
+void BinderTelemetry::dump(DumpWriter& dw) const {
+    ScopedIndent indent(dw);
+    dw.println("Binder calls:");
+    ScopedIndent indentMethods(dw);
+    for (const MethodStats& method : snapshot()) {
+        dw.println("%s: calls=%" PRIu64 " errors=%" PRIu64 " lock wait %s, execution %s",
+                   method.name.c_str(), method.calls, method.errors,
+                   summarize(method.lockWait, method.calls).c_str(),
+                   summarize(method.execution, method.calls).c_str());
+    }
+}
+
+}  // namespace android::net
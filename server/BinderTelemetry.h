@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <android-base/thread_annotations.h>
+#include <netdutils/DumpWriter.h>
+
+namespace android::net {
+
+// Call counts, error counts and latency histograms of the methods of a binder service.
+//
+// Each thread records into counters of its own, so recording takes no lock and binder threads do
+// not contend with each other. The counters of all threads are added up when they are read.
+class BinderTelemetry {
+  public:
+    // Bucket 0 counts durations under 1us, and bucket i counts durations in [2^(i-1), 2^i) us.
+    // The last bucket also counts everything longer.
+    static constexpr size_t kNumBuckets = 24;
+    typedef std::array<uint64_t, kNumBuckets> Histogram;
+
+    struct MethodStats {
+        std::string name;
+        uint64_t calls = 0;
+        uint64_t errors = 0;
+        // Time spent waiting for locks, and the rest of the time the call took.
+        Histogram lockWait{};
+        Histogram execution{};
+    };
+
+    // |methodNames| names the methods by index. Methods without a name are shown by index, and
+    // indices past the end are all recorded as one "other" method.
+    explicit BinderTelemetry(std::vector<std::string> methodNames);
+    BinderTelemetry(const BinderTelemetry&) = delete;
+    BinderTelemetry& operator=(const BinderTelemetry&) = delete;
+
+    void record(size_t method, std::chrono::microseconds lockWait,
+                std::chrono::microseconds execution, bool error) EXCLUDES(mLock);
+
+    // Returns the methods that were called at least once, in index order, followed by "other".
+    std::vector<MethodStats> snapshot() const EXCLUDES(mLock);
+    void dump(netdutils::DumpWriter& dw) const EXCLUDES(mLock);
+
+    static size_t bucket(std::chrono::microseconds duration);
+
+  private:
+    struct Counters {
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> errors;
+        std::array<std::atomic<uint64_t>, kNumBuckets> lockWait;
+        std::array<std::atomic<uint64_t>, kNumBuckets> execution;
+    };
+
+    // The counters of one thread, one per method plus one for "other". Only that thread writes
+    // them, so they are updated with plain loads and stores rather than read-modify-writes.
+    typedef std::unique_ptr<Counters[]> Shard;
+
+    Counters* countersForThisThread() EXCLUDES(mLock);
+
+    // Distinguishes instances in the thread-local cache of shards, even if one is destroyed and
+    // another is created at the same address.
+    const uint64_t mId;
+    const std::vector<std::string> mNames;
+
+    mutable std::mutex mLock;
+    // Shards of threads that have exited are kept, so that their calls are still counted.
+    std::vector<Shard> mShards GUARDED_BY(mLock);
+};
+
+}  // namespace android::net
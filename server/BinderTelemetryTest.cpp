@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * BinderTelemetryTest.cpp - unit tests for BinderTelemetry.cpp
+ */
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <netdutils/NetNativeTestBase.h>
+
+#include "BinderTelemetry.h"
+
+using namespace std::chrono_literals;
+
+namespace android::net {
+
+class BinderTelemetryTest : public NetNativeTestBase {};
+
+TEST_F(BinderTelemetryTest, Buckets) {
+    EXPECT_EQ(0U, BinderTelemetry::bucket(0us));
+    EXPECT_EQ(1U, BinderTelemetry::bucket(1us));
+    EXPECT_EQ(2U, BinderTelemetry::bucket(2us));
+    EXPECT_EQ(2U, BinderTelemetry::bucket(3us));
+    EXPECT_EQ(3U, BinderTelemetry::bucket(4us));
+    EXPECT_EQ(11U, BinderTelemetry::bucket(1500us));
+    EXPECT_EQ(BinderTelemetry::kNumBuckets - 1, BinderTelemetry::bucket(1h));
+}
+
+TEST_F(BinderTelemetryTest, Record) {
+    BinderTelemetry telemetry({"a", "", "c"});
+    telemetry.record(0, 0us, 100us, false);
+    telemetry.record(0, 5us, 3us, true);
+    telemetry.record(1, 0us, 0us, false);
+    telemetry.record(7, 0us, 0us, false);
+
+    const std::vector<BinderTelemetry::MethodStats> stats = telemetry.snapshot();
+    ASSERT_EQ(3U, stats.size());
+
+    EXPECT_EQ("a", stats[0].name);
+    EXPECT_EQ(2U, stats[0].calls);
+    EXPECT_EQ(1U, stats[0].errors);
+    EXPECT_EQ(1U, stats[0].lockWait[0]);
+    EXPECT_EQ(1U, stats[0].lockWait[BinderTelemetry::bucket(5us)]);
+    EXPECT_EQ(1U, stats[0].execution[BinderTelemetry::bucket(100us)]);
+    EXPECT_EQ(1U, stats[0].execution[BinderTelemetry::bucket(3us)]);
+
+    // Unnamed methods are shown by index, and unknown ones are counted together.
+    EXPECT_EQ("#1", stats[1].name);
+    EXPECT_EQ("other", stats[2].name);
+}
+
+TEST_F(BinderTelemetryTest, ThreadsAreMerged) {
+    BinderTelemetry telemetry({"a"});
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([&telemetry] {
+            for (int j = 0; j < 1000; j++) telemetry.record(0, 0us, 1us, j % 10 == 0);
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+
+    // Calls made by threads that have exited are still counted.
+    const std::vector<BinderTelemetry::MethodStats> stats = telemetry.snapshot();
+    ASSERT_EQ(1U, stats.size());
+    EXPECT_EQ(4000U, stats[0].calls);
+    EXPECT_EQ(400U, stats[0].errors);
+    EXPECT_EQ(4000U, stats[0].execution[1]);
+}
+
+TEST_F(BinderTelemetryTest, InstancesAreSeparate) {
+    auto first = std::make_unique<BinderTelemetry>(std::vector<std::string>{"a"});
+    first->record(0, 0us, 0us, false);
+    first.reset();
+
+    BinderTelemetry second({"a"});
+    EXPECT_TRUE(second.snapshot().empty());
+    second.record(0, 0us, 0us, false);
+    EXPECT_EQ(1U, second.snapshot()[0].calls);
+}
+
+}  // namespace android::net
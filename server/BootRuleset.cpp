@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BootRuleset"
+
+#include "BootRuleset.h"
+
+#include <errno.h>
+
+#include <algorithm>
+
+#include <android-base/strings.h>
+#include <log/log.h>
+
+namespace android::net {
+
+using base::Split;
+using base::StartsWith;
+using base::Trim;
+
+int BootRuleset::add(IptablesTarget target, const std::string& commands) {
+    // Parse everything before queuing anything, so that a malformed script is not half applied.
+    std::vector<Table> blocks;
+    bool inTable = false;
+    for (const std::string& rawLine : Split(commands, "\n")) {
+        const std::string line = Trim(rawLine);
+        if (line.empty() || StartsWith(line, "#")) continue;
+
+        if (StartsWith(line, "*") && !inTable) {
+            blocks.push_back({.name = line.substr(1)});
+            inTable = true;
+        } else if (line == "COMMIT" && inTable) {
+            inTable = false;
+        } else if (inTable && !StartsWith(line, "*")) {
+            blocks.back().commands.push_back(line);
+        } else {
+            ALOGE("Unexpected line in iptables-restore script: %s", line.c_str());
+            return -EINVAL;
+        }
+    }
+    if (inTable) {
+        ALOGE("Missing COMMIT for table %s", blocks.back().name.c_str());
+        return -EINVAL;
+    }
+
+    for (const IptablesTarget family : {V4, V6}) {
+        if (target != family && target != V4V6) continue;
+        std::vector<Table>& familyTables = tables(family);
+        for (const Table& block : blocks) {
+            auto it = std::find_if(familyTables.begin(), familyTables.end(),
+                                   [&](const Table& t) { return t.name == block.name; });
+            if (it == familyTables.end()) {
+                familyTables.push_back({.name = block.name});
+                it = familyTables.end() - 1;
+            }
+            it->commands.insert(it->commands.end(), block.commands.begin(), block.commands.end());
+        }
+    }
+    return 0;
+}
+
+std::string BootRuleset::script(IptablesTarget target) const {
+    std::string script;
+    for (const Table& table : tables(target)) {
+        script += "*" + table.name + "\n";
+        for (const std::string& command : table.commands) {
+            script += command + "\n";
+        }
+        script += "COMMIT\n";
+    }
+    return script;
+}
+
+size_t BootRuleset::size(IptablesTarget target) const {
+    size_t size = 0;
+    for (const Table& table : tables(target)) {
+        size += table.commands.size();
+    }
+    return size;
+}
+
+}  // namespace android::net
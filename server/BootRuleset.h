@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "NetdConstants.h"
+
+namespace android::net {
+
+// The iptables rules that netd installs at startup, collected from every controller so that they
+// can be installed with one iptables-restore transaction per IP family instead of several per
+// controller.
+//
+// Commands are added as iptables-restore scripts made of "*table ... COMMIT" blocks. The commands
+// for each table are merged in the order they were added, which has the same result as running
+// the scripts one after the other, except that a command that fails aborts the whole transaction.
+class BootRuleset {
+  public:
+    // Queues |commands| for |target|. Returns 0, or -EINVAL if |commands| is not a sequence of
+    // complete table blocks, in which case nothing is queued.
+    int add(IptablesTarget target, const std::string& commands);
+
+    // Returns the merged script for |target|, which must be V4 or V6. Returns "" if no commands
+    // were queued for it.
+    std::string script(IptablesTarget target) const;
+
+    // Returns the number of commands queued for |target|, which must be V4 or V6.
+    size_t size(IptablesTarget target) const;
+
+  private:
+    struct Table {
+        std::string name;
+        std::vector<std::string> commands;
+    };
+
+    std::vector<Table>& tables(IptablesTarget target) {
+        return (target == V4) ? mV4Tables : mV6Tables;
+    }
+    const std::vector<Table>& tables(IptablesTarget target) const {
+        return (target == V4) ? mV4Tables : mV6Tables;
+    }
+
+    std::vector<Table> mV4Tables;
+    std::vector<Table> mV6Tables;
+};
+
+}  // namespace android::net
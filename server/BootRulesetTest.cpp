@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * BootRulesetTest.cpp - unit tests for BootRuleset.cpp
+ */
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <netdutils/NetNativeTestBase.h>
+
+#include "BootRuleset.h"
+
+namespace android::net {
+
+class BootRulesetTest : public NetNativeTestBase {};
+
+TEST_F(BootRulesetTest, Empty) {
+    BootRuleset rules;
+    EXPECT_EQ("", rules.script(V4));
+    EXPECT_EQ("", rules.script(V6));
+    EXPECT_EQ(0U, rules.size(V4));
+}
+
+TEST_F(BootRulesetTest, MergesTablesInOrder) {
+    BootRuleset rules;
+    EXPECT_EQ(0, rules.add(V4V6,
+                           "*filter\n"
+                           ":fw_INPUT -\n"
+                           "COMMIT\n"
+                           "*mangle\n"
+                           ":bw_mangle_POSTROUTING -\n"
+                           "COMMIT\n"));
+    EXPECT_EQ(0, rules.add(V4,
+                           "*nat\n"
+                           ":tetherctrl_nat_POSTROUTING -\n"
+                           "COMMIT\n"
+                           "*filter\n"
+                           "-A fw_INPUT -j DROP\n"
+                           "COMMIT\n"));
+    EXPECT_EQ(0, rules.add(V6, "*filter\n-6 -A fw_OUTPUT ! -o lo -s ::1 -j DROP\nCOMMIT\n"));
+
+    EXPECT_EQ("*filter\n"
+              ":fw_INPUT -\n"
+              "-A fw_INPUT -j DROP\n"
+              "COMMIT\n"
+              "*mangle\n"
+              ":bw_mangle_POSTROUTING -\n"
+              "COMMIT\n"
+              "*nat\n"
+              ":tetherctrl_nat_POSTROUTING -\n"
+              "COMMIT\n",
+              rules.script(V4));
+    EXPECT_EQ("*filter\n"
+              ":fw_INPUT -\n"
+              "-6 -A fw_OUTPUT ! -o lo -s ::1 -j DROP\n"
+              "COMMIT\n"
+              "*mangle\n"
+              ":bw_mangle_POSTROUTING -\n"
+              "COMMIT\n",
+              rules.script(V6));
+    EXPECT_EQ(4U, rules.size(V4));
+    EXPECT_EQ(3U, rules.size(V6));
+}
+
+TEST_F(BootRulesetTest, MalformedScriptsAreRejected) {
+    BootRuleset rules;
+    EXPECT_EQ(-EINVAL, rules.add(V4V6, "*filter\n:fw_INPUT -\n"));
+    EXPECT_EQ(-EINVAL, rules.add(V4V6, ":fw_INPUT -\nCOMMIT\n"));
+    EXPECT_EQ(-EINVAL, rules.add(V4V6, "*filter\n*mangle\nCOMMIT\n"));
+    EXPECT_EQ(-EINVAL, rules.add(V4V6, "*filter\nCOMMIT\n-A fw_INPUT -j DROP\n"));
+    EXPECT_EQ("", rules.script(V4));
+    EXPECT_EQ("", rules.script(V6));
+}
+
+}  // namespace android::net
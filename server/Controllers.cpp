@@ -15,10 +15,11 @@
  */
 
 #include <cinttypes>
-#include <regex>
+#include <map>
 #include <set>
 #include <string>
 
+#include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <netdutils/Stopwatch.h>
@@ -26,11 +27,15 @@
 #define LOG_TAG "Netd"
 #include <log/log.h>
 
+#include "BootRuleset.h"
 #include "ConnmarkFlags.h"
 #include "Controllers.h"
 #include "IdletimerController.h"
+#include "IptablesParser.h"
 #include "NetworkController.h"
 #include "RouteController.h"
+#include "StartupTaskGraph.h"
+#include "SysctlCache.h"
 #include "XfrmController.h"
 #include "oem_iptables_hook.h"
 
@@ -53,6 +58,12 @@ namespace {
 static constexpr char CONNMARK_MANGLE_INPUT[] = "connmark_mangle_INPUT";
 static constexpr char CONNMARK_MANGLE_OUTPUT[] = "connmark_mangle_OUTPUT";
 
+// Most tasks that Controllers::init() can run at the same time.
+static constexpr size_t kStartupThreads = 3;
+
+// How long reads of sysctls that netd does not write are cached, in milliseconds. 0 disables it.
+static constexpr char kSysctlCacheTtlProperty[] = "persist.netd.sysctl_cache_ttl_ms";
+
 /**
  * List of module chains to be created, along with explicit ordering. ORDERING
  * IS CRITICAL, AND SHOULD BE TRIPLE-CHECKED WITH EACH CHANGE.
@@ -113,10 +124,53 @@ static const std::vector<const char*> NAT_POSTROUTING = {
         TetherController::LOCAL_NAT_POSTROUTING,
 };
 
-// Commands to create child chains and to match created chains in iptables -S output. Keep in sync.
+struct ParentChain {
+    IptablesTarget target;
+    const char* table;
+    const char* name;
+    const std::vector<const char*>& childChains;
+    // Whether netd owns the whole chain. Chains that vendor code modifies directly are not flushed.
+    bool exclusive;
+};
+
+// Where the module chains above are hooked in, in the order they are created. The names of the
+// non-exclusive parent chains of each family must be distinct, because initChildChains() lists
+// them all with a single command.
+static const ParentChain PARENT_CHAINS[] = {
+        {V4V6, "filter", "INPUT", FILTER_INPUT, true},
+        {V4V6, "filter", "FORWARD", FILTER_FORWARD, true},
+        {V4V6, "raw", "PREROUTING", RAW_PREROUTING, true},
+        {V4V6, "mangle", "FORWARD", MANGLE_FORWARD, true},
+        {V4V6, "mangle", "INPUT", MANGLE_INPUT, true},
+        {V4V6, "mangle", "OUTPUT", MANGLE_OUTPUT, true},
+        {V4, "nat", "PREROUTING", NAT_PREROUTING, true},
+        {V4, "nat", "POSTROUTING", NAT_POSTROUTING, true},
+
+        {V4, "filter", "OUTPUT", FILTER_OUTPUT, false},
+        {V6, "filter", "OUTPUT", FILTER_OUTPUT, false},
+        {V4, "mangle", "POSTROUTING", MANGLE_POSTROUTING, false},
+        {V6, "mangle", "POSTROUTING", MANGLE_POSTROUTING, false},
+};
+
+// Command to create child chains. Created chains are matched in iptables -S output by
+// parseJumpRule(). Keep in sync.
 static const char* CHILD_CHAIN_TEMPLATE = "-A %s -j %s\n";
-static const std::regex CHILD_CHAIN_REGEX("^-A ([^ ]+) -j ([^ ]+)$",
-                                          std::regex_constants::extended);
+
+// Returns the child chains of every parent chain listed in |output|, keyed by parent chain.
+std::map<std::string, std::set<std::string>> parseChildChains(const std::string& output) {
+    std::map<std::string, std::set<std::string>> children;
+
+    // The only rules added by createChildChains are of the simple form "-A <parent> -j <child>".
+    // Find those rules and add each one's child chain to its parent's set.
+    LineTokenizer lines(output);
+    std::string_view rule, parent, child;
+    while (lines.next(&rule)) {
+        if (parseJumpRule(rule, &parent, &child)) {
+            children[std::string(parent)].emplace(child);
+        }
+    }
+    return children;
+}
 
 }  // namespace
 
@@ -146,25 +200,14 @@ std::set<std::string> Controllers::findExistingChildChains(const IptablesTarget
         return existing;
     }
 
-    // The only rules added by createChildChains are of the simple form "-A <parent> -j <child>".
-    // Find those rules and add each one's child chain to existing.
-    std::smatch matches;
-    std::stringstream stream(output);
-    std::string rule;
-    while (std::getline(stream, rule, '\n')) {
-        if (std::regex_search(rule, matches, CHILD_CHAIN_REGEX) && matches[1] == parentChain) {
-            existing.insert(matches[2]);
-        }
-    }
-
-    return existing;
+    return parseChildChains(output)[parentChain];
 }
 
 /* static */
-void Controllers::createChildChains(IptablesTarget target, const char* table,
-                                    const char* parentChain,
-                                    const std::vector<const char*>& childChains,
-                                    bool exclusive) {
+std::string Controllers::makeChildChainsCommand(const char* table, const char* parentChain,
+                                                const std::vector<const char*>& childChains,
+                                                bool exclusive,
+                                                const std::set<std::string>& existingChildChains) {
     std::string command = StringPrintf("*%s\n", table);
 
     // We cannot just clear all the chains we create because vendor code modifies filter OUTPUT and
@@ -179,14 +222,11 @@ void Controllers::createChildChains(IptablesTarget target, const char* table,
     //   regards to the vendor rules.
     //
     // TODO: Make all chains exclusive once vendor code uses the oem_* rules.
-    std::set<std::string> existingChildChains;
     if (exclusive) {
         // Just running ":chain -" flushes user-defined chains, but not built-in chains like INPUT.
         // Since at this point we don't know if parentChain is a built-in chain, do both.
         StringAppendF(&command, ":%s -\n", parentChain);
         StringAppendF(&command, "-F %s\n", parentChain);
-    } else {
-        existingChildChains = findExistingChildChains(target, table, parentChain);
     }
 
     for (const auto& childChain : childChains) {
@@ -198,7 +238,20 @@ void Controllers::createChildChains(IptablesTarget target, const char* table,
         }
     }
     command += "COMMIT\n";
-    execIptablesRestore(target, command);
+    return command;
+}
+
+/* static */
+void Controllers::createChildChains(IptablesTarget target, const char* table,
+                                    const char* parentChain,
+                                    const std::vector<const char*>& childChains,
+                                    bool exclusive) {
+    std::set<std::string> existingChildChains;
+    if (!exclusive) {
+        existingChildChains = findExistingChildChains(target, table, parentChain);
+    }
+    execIptablesRestore(target, makeChildChainsCommand(table, parentChain, childChains, exclusive,
+                                                       existingChildChains));
 }
 
 Controllers::Controllers()
@@ -217,7 +270,14 @@ Controllers::Controllers()
                                           args.timestampNs);
               },
               &iptablesRestoreCtrl) {
-    InterfaceController::initializeAll();
+    gSysctlCache.setTtl(std::chrono::milliseconds(
+            android::base::GetUintProperty<uint32_t>(kSysctlCacheTtlProperty, 0)));
+
+    Stopwatch s;
+    const SysctlBatch::Stats stats = InterfaceController::initializeAll();
+    gLog.info("Initializing InterfaceController: %" PRId64
+              "us (%zu sysctls written, %zu unchanged, %zu failed, %zu skipped)",
+              s.getTimeAndResetUs(), stats.written, stats.unchanged, stats.failed, stats.skipped);
 }
 
 void Controllers::initChildChains() {
@@ -232,22 +292,41 @@ void Controllers::initChildChains() {
      */
 
     // Create chains for child modules.
-    createChildChains(V4V6, "filter", "INPUT", FILTER_INPUT, true);
-    createChildChains(V4V6, "filter", "FORWARD", FILTER_FORWARD, true);
-    createChildChains(V4V6, "raw", "PREROUTING", RAW_PREROUTING, true);
-    createChildChains(V4V6, "mangle", "FORWARD", MANGLE_FORWARD, true);
-    createChildChains(V4V6, "mangle", "INPUT", MANGLE_INPUT, true);
-    createChildChains(V4V6, "mangle", "OUTPUT", MANGLE_OUTPUT, true);
-    createChildChains(V4, "nat", "PREROUTING", NAT_PREROUTING, true);
-    createChildChains(V4, "nat", "POSTROUTING", NAT_POSTROUTING, true);
-
-    createChildChains(V4, "filter", "OUTPUT", FILTER_OUTPUT, false);
-    createChildChains(V6, "filter", "OUTPUT", FILTER_OUTPUT, false);
-    createChildChains(V4, "mangle", "POSTROUTING", MANGLE_POSTROUTING, false);
-    createChildChains(V6, "mangle", "POSTROUTING", MANGLE_POSTROUTING, false);
+    for (const ParentChain& parent : PARENT_CHAINS) {
+        createChildChains(parent.target, parent.table, parent.name, parent.childChains,
+                          parent.exclusive);
+    }
+}
+
+/* static */
+void Controllers::initChildChains(BootRuleset* rules) {
+    for (const IptablesTarget family : {V4, V6}) {
+        // List all the non-exclusive parent chains of this family in one go.
+        std::string listCommand;
+        for (const ParentChain& parent : PARENT_CHAINS) {
+            if (!parent.exclusive && parent.target == family) {
+                StringAppendF(&listCommand, "*%s\n-S %s\nCOMMIT\n", parent.table, parent.name);
+            }
+        }
+        std::string output;
+        if (!listCommand.empty() &&
+            execIptablesRestoreWithOutput(family, listCommand, &output) == -1) {
+            ALOGE("Error listing non-exclusive parent chains");
+        }
+        std::map<std::string, std::set<std::string>> existing = parseChildChains(output);
+
+        const std::set<std::string> none;
+        for (const ParentChain& parent : PARENT_CHAINS) {
+            if (parent.target != family && parent.target != V4V6) continue;
+            rules->add(family, makeChildChainsCommand(parent.table, parent.name, parent.childChains,
+                                                      parent.exclusive,
+                                                      parent.exclusive ? none
+                                                                       : existing[parent.name]));
+        }
+    }
 }
 
-static void setupConnmarkIptablesHooks() {
+static void setupConnmarkIptablesHooks(BootRuleset* rules = nullptr) {
     // Rules to store parts of the fwmark (namely: netId, explicitlySelected, protectedFromVpn,
     // permission) in connmark.
     // Only saves the mark if no mark has been set before.
@@ -268,31 +347,34 @@ static void setupConnmarkIptablesHooks() {
             "-A connmark_mangle_OUTPUT -m connmark --mark 0/0x000FFFFF "
             "-j CONNMARK --save-mark --ctmask 0x000FFFFF --nfmask 0x000FFFFF\n"
             "COMMIT\n");
-    execIptablesRestore(V4V6, cmd);
+    if (rules != nullptr) {
+        rules->add(V4V6, cmd);
+    } else {
+        execIptablesRestore(V4V6, cmd);
+    }
 }
 
 void Controllers::initIptablesRules() {
+    // Collect the static rules of every module and install them in one transaction per family.
+    // The time taken by each module is the time taken to compute its rules.
     Stopwatch s;
-    initChildChains();
+    BootRuleset rules;
+    initChildChains(&rules);
     gLog.info("Creating child chains: %" PRId64 "us", s.getTimeAndResetUs());
 
-    // Let each module setup their child chains
-    setupOemIptablesHook();
-    gLog.info("Setting up OEM hooks: %" PRId64 "us", s.getTimeAndResetUs());
-
     /* When enabled, DROPs all packets except those matching rules. */
-    firewallCtrl.setupIptablesHooks();
+    firewallCtrl.setupIptablesHooks(&rules);
     gLog.info("Setting up FirewallController hooks: %" PRId64 "us", s.getTimeAndResetUs());
 
     /* Does DROPs in FORWARD by default */
-    tetherCtrl.setupIptablesHooks();
+    tetherCtrl.setupIptablesHooks(&rules);
     gLog.info("Setting up TetherController hooks: %" PRId64 "us", s.getTimeAndResetUs());
 
     /*
      * Does REJECT in INPUT, OUTPUT. Does counting also.
      * No DROP/REJECT allowed later in netfilter-flow hook order.
      */
-    bandwidthCtrl.setupIptablesHooks();
+    bandwidthCtrl.setupIptablesHooks(&rules);
     gLog.info("Setting up BandwidthController hooks: %" PRId64 "us", s.getTimeAndResetUs());
 
     /*
@@ -305,43 +387,127 @@ void Controllers::initIptablesRules() {
     /*
      * Add rules for detecting IPv6/IPv4 TCP/UDP connections with TLS/DTLS header
      */
-    strictCtrl.setupIptablesHooks();
+    strictCtrl.setupIptablesHooks(&rules);
     gLog.info("Setting up StrictController hooks: %" PRId64 "us", s.getTimeAndResetUs());
 
     /*
      * Add rules for storing netid in connmark.
      */
+    setupConnmarkIptablesHooks(&rules);
+    gLog.info("Setting up connmark hooks: %" PRId64 "us", s.getTimeAndResetUs());
+
+    const int v4Ret = execIptablesRestore(V4, rules.script(V4));
+    const int v6Ret = execIptablesRestore(V6, rules.script(V6));
+    gLog.info("Installing boot ruleset (%zu IPv4 rules, %zu IPv6 rules): %" PRId64 "us",
+              rules.size(V4), rules.size(V6), s.getTimeAndResetUs());
+    if (v4Ret != 0 || v6Ret != 0) {
+        // A single bad rule aborts the whole transaction. Install the rules one module at a time,
+        // so that the other modules still get theirs and the log shows which module failed.
+        gLog.error("Failed to install boot ruleset (IPv4: %d, IPv6: %d), retrying per module",
+                   v4Ret, v6Ret);
+        initIptablesRulesPerModule();
+    }
+
+    // OEM rules go in the oem_* chains created above, so they must be installed after them.
+    setupOemIptablesHook();
+    gLog.info("Setting up OEM hooks: %" PRId64 "us", s.getTimeAndResetUs());
+}
+
+void Controllers::initIptablesRulesPerModule() {
+    Stopwatch s;
+    initChildChains();
+    gLog.info("Creating child chains: %" PRId64 "us", s.getTimeAndResetUs());
+
+    if (int ret = firewallCtrl.setupIptablesHooks()) {
+        gLog.error("Failed to set up FirewallController hooks (%s)", strerror(-ret));
+    }
+    gLog.info("Setting up FirewallController hooks: %" PRId64 "us", s.getTimeAndResetUs());
+
+    if (int ret = tetherCtrl.setupIptablesHooks()) {
+        gLog.error("Failed to set up TetherController hooks (%s)", strerror(-ret));
+    }
+    gLog.info("Setting up TetherController hooks: %" PRId64 "us", s.getTimeAndResetUs());
+
+    bandwidthCtrl.setupIptablesHooks();
+    gLog.info("Setting up BandwidthController hooks: %" PRId64 "us", s.getTimeAndResetUs());
+
+    idletimerCtrl.setupIptablesHooks();
+    gLog.info("Setting up IdletimerController hooks: %" PRId64 "us", s.getTimeAndResetUs());
+
+    if (int ret = strictCtrl.setupIptablesHooks()) {
+        gLog.error("Failed to set up StrictController hooks (%s)", strerror(-ret));
+    }
+    gLog.info("Setting up StrictController hooks: %" PRId64 "us", s.getTimeAndResetUs());
+
     setupConnmarkIptablesHooks();
     gLog.info("Setting up connmark hooks: %" PRId64 "us", s.getTimeAndResetUs());
 }
 
 void Controllers::init() {
-    initIptablesRules();
-    Stopwatch s;
+    // iptables, routing rules and XFRM state are independent of each other, so initialize them in
+    // parallel. Each failure keeps its own exit status, and a failure is only reported once the
+    // tasks already running have finished.
+    StartupTaskGraph tasks(kStartupThreads);
+
+    const auto iptables = tasks.add("Setting up iptables rules", [this] {
+        initIptablesRules();
+        return 0;
+    });
+
+    tasks.add("Enabling bandwidth control", [this] {
+        if (int ret = bandwidthCtrl.enableBandwidthControl()) {
+            gLog.error("Failed to initialize BandwidthController (%s)", strerror(-ret));
+            // A failure to init almost definitely means that iptables failed to load
+            // our static ruleset, which then basically means network accounting will not work.
+            // As such simply exit netd.  This may crash loop the system, but by failing
+            // to bootup we will trigger rollback and thus this offers us protection against
+            // a mainline update breaking things.
+            return 1;
+        }
+        return 0;
+    }, {iptables});
 
-    if (int ret = bandwidthCtrl.enableBandwidthControl()) {
-        gLog.error("Failed to initialize BandwidthController (%s)", strerror(-ret));
-        // A failure to init almost definitely means that iptables failed to load
-        // our static ruleset, which then basically means network accounting will not work.
-        // As such simply exit netd.  This may crash loop the system, but by failing
-        // to bootup we will trigger rollback and thus this offers us protection against
-        // a mainline update breaking things.
-        exit(1);
+    tasks.add("Initializing RouteController", [] {
+        if (int ret = RouteController::Init(NetworkController::LOCAL_NET_ID)) {
+            gLog.error("Failed to initialize RouteController (%s)", strerror(-ret));
+            return 2;
+        }
+        return 0;
+    });
+
+    tasks.add("Initializing XfrmController", [] {
+        netdutils::Status xStatus = XfrmController::Init();
+        if (!isOk(xStatus)) {
+            gLog.error("Failed to initialize XfrmController (%s)",
+                       netdutils::toString(xStatus).c_str());
+            return 3;
+        }
+        return 0;
+    });
+
+    Stopwatch s;
+    const int exitStatus = tasks.run();
+    const int64_t totalUs = s.getTimeAndResetUs();
+
+    for (size_t id = 0; id < tasks.size(); id++) {
+        const StartupTaskGraph::Timing& timing = tasks.timing(id);
+        if (!timing.ran) continue;
+        gLog.info("%s: %" PRId64 "us (started at %" PRId64 "us)", timing.name.c_str(),
+                  static_cast<int64_t>(timing.duration.count()),
+                  static_cast<int64_t>(timing.start.count()));
+    }
+    std::vector<std::string> path;
+    int64_t pathUs = 0;
+    for (const auto id : tasks.criticalPath()) {
+        path.push_back(tasks.timing(id).name);
+        pathUs += tasks.timing(id).duration.count();
     }
-    gLog.info("Enabling bandwidth control: %" PRId64 "us", s.getTimeAndResetUs());
+    gLog.info("Initializing controllers: %" PRId64 "us, critical path %" PRId64 "us (%s)", totalUs,
+              pathUs, Join(path, " -> ").c_str());
 
-    if (int ret = RouteController::Init(NetworkController::LOCAL_NET_ID)) {
-        gLog.error("Failed to initialize RouteController (%s)", strerror(-ret));
-        exit(2);
+    if (exitStatus != 0) {
+        exit(exitStatus);
     }
-    gLog.info("Initializing RouteController: %" PRId64 "us", s.getTimeAndResetUs());
-
-    netdutils::Status xStatus = XfrmController::Init();
-    if (!isOk(xStatus)) {
-        gLog.error("Failed to initialize XfrmController (%s)", netdutils::toString(xStatus).c_str());
-        exit(3);
-    };
-    gLog.info("Initializing XfrmController: %" PRId64 "us", s.getTimeAndResetUs());
 }
 
 Controllers* gCtls = nullptr;
@@ -18,6 +18,7 @@
 #define _CONTROLLERS_H__
 
 #include "BandwidthController.h"
+#include "BootRuleset.h"
 #include "EventReporter.h"
 #include "FirewallController.h"
 #include "IdletimerController.h"
@@ -55,10 +56,19 @@ class Controllers {
   private:
     friend class ControllersTest;
     void initIptablesRules();
+    // Installs the boot rules with one or more transactions per module, as a fallback for when
+    // the single transaction per family fails.
+    void initIptablesRulesPerModule();
     static void initChildChains();
+    // Queues the commands of initChildChains() in |rules| instead of running them.
+    static void initChildChains(BootRuleset* rules);
     static std::set<std::string> findExistingChildChains(const IptablesTarget target,
                                                          const char* table,
                                                          const char* parentChain);
+    static std::string makeChildChainsCommand(const char* table, const char* parentChain,
+                                              const std::vector<const char*>& childChains,
+                                              bool exclusive,
+                                              const std::set<std::string>& existingChildChains);
     static void createChildChains(IptablesTarget target, const char* table, const char* parentChain,
                                   const std::vector<const char*>& childChains, bool exclusive);
     static int (*execIptablesRestore)(IptablesTarget, const std::string&);
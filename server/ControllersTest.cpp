@@ -42,6 +42,7 @@ class ControllersTest : public IptablesBaseTest {
 
   protected:
     void initChildChains() { Controllers::initChildChains(); };
+    void initChildChains(BootRuleset* rules) { Controllers::initChildChains(rules); };
     std::set<std::string> findExistingChildChains(IptablesTarget a, const char* b, const char*c) {
         return Controllers::findExistingChildChains(a, b, c);
     }
@@ -278,5 +279,100 @@ TEST_F(ControllersTest, TestInitIptablesRules) {
     expectIptablesRestoreCommands(ExpectedIptablesCommands{});
 }
 
+TEST_F(ControllersTest, TestInitChildChainsBootRuleset) {
+    // The non-exclusive parent chains of each family are listed in one command. Pretend that IPv6
+    // already has some of our rules, as if we crashed and restarted.
+    sIptablesRestoreOutput.push_back("");
+    sIptablesRestoreOutput.push_back(
+            "-P OUTPUT ACCEPT\n"
+            "-A OUTPUT -j oem_out\n"
+            "-A OUTPUT -o r_rmnet_data8 -p udp -m udp --dport 1900 -j DROP\n"
+            "-P POSTROUTING ACCEPT\n"
+            "-A POSTROUTING -j bw_mangle_POSTROUTING\n"
+            "-A POSTROUTING -j qcom_qos_reset_POSTROUTING\n");
+    const std::string listCommand =
+            "*filter\n"
+            "-S OUTPUT\n"
+            "COMMIT\n"
+            "*mangle\n"
+            "-S POSTROUTING\n"
+            "COMMIT\n";
+
+    BootRuleset rules;
+    initChildChains(&rules);
+    expectIptablesRestoreCommands({{V4, listCommand}, {V6, listCommand}});
+
+    // Nothing existed on IPv4, so every child chain is added to its parent.
+    const std::string v4 = rules.script(V4);
+    for (const char* rule : {"-A OUTPUT -j oem_out\n", "-A POSTROUTING -j bw_mangle_POSTROUTING\n",
+                             "-A POSTROUTING -j tetherctrl_nat_POSTROUTING\n"}) {
+        EXPECT_NE(std::string::npos, v4.find(rule)) << rule;
+    }
+
+    // On IPv6, the rules that exist are not added again. mangle OUTPUT is exclusive, so it is
+    // always flushed and filled even though filter OUTPUT has a parent chain of the same name.
+    EXPECT_EQ("*filter\n"
+              ":INPUT -\n"
+              "-F INPUT\n"
+              ":oem_in -\n"
+              "-A INPUT -j oem_in\n"
+              ":bw_INPUT -\n"
+              "-A INPUT -j bw_INPUT\n"
+              ":fw_INPUT -\n"
+              "-A INPUT -j fw_INPUT\n"
+              ":FORWARD -\n"
+              "-F FORWARD\n"
+              ":oem_fwd -\n"
+              "-A FORWARD -j oem_fwd\n"
+              ":fw_FORWARD -\n"
+              "-A FORWARD -j fw_FORWARD\n"
+              ":bw_FORWARD -\n"
+              "-A FORWARD -j bw_FORWARD\n"
+              ":tetherctrl_FORWARD -\n"
+              "-A FORWARD -j tetherctrl_FORWARD\n"
+              ":oem_out -\n"
+              ":fw_OUTPUT -\n"
+              "-A OUTPUT -j fw_OUTPUT\n"
+              ":st_OUTPUT -\n"
+              "-A OUTPUT -j st_OUTPUT\n"
+              ":bw_OUTPUT -\n"
+              "-A OUTPUT -j bw_OUTPUT\n"
+              "COMMIT\n"
+              "*raw\n"
+              ":PREROUTING -\n"
+              "-F PREROUTING\n"
+              ":idletimer_raw_PREROUTING -\n"
+              "-A PREROUTING -j idletimer_raw_PREROUTING\n"
+              ":bw_raw_PREROUTING -\n"
+              "-A PREROUTING -j bw_raw_PREROUTING\n"
+              ":tetherctrl_raw_PREROUTING -\n"
+              "-A PREROUTING -j tetherctrl_raw_PREROUTING\n"
+              "COMMIT\n"
+              "*mangle\n"
+              ":FORWARD -\n"
+              "-F FORWARD\n"
+              ":tetherctrl_mangle_FORWARD -\n"
+              "-A FORWARD -j tetherctrl_mangle_FORWARD\n"
+              ":INPUT -\n"
+              "-F INPUT\n"
+              ":connmark_mangle_INPUT -\n"
+              "-A INPUT -j connmark_mangle_INPUT\n"
+              ":wakeupctrl_mangle_INPUT -\n"
+              "-A INPUT -j wakeupctrl_mangle_INPUT\n"
+              ":routectrl_mangle_INPUT -\n"
+              "-A INPUT -j routectrl_mangle_INPUT\n"
+              ":OUTPUT -\n"
+              "-F OUTPUT\n"
+              ":connmark_mangle_OUTPUT -\n"
+              "-A OUTPUT -j connmark_mangle_OUTPUT\n"
+              ":oem_mangle_post -\n"
+              "-A POSTROUTING -j oem_mangle_post\n"
+              ":bw_mangle_POSTROUTING -\n"
+              ":idletimer_mangle_POSTROUTING -\n"
+              "-A POSTROUTING -j idletimer_mangle_POSTROUTING\n"
+              "COMMIT\n",
+              rules.script(V6));
+}
+
 }  // namespace net
 }  // namespace android
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "EventLog.h"
+
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cinttypes>
+
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+
+#include "NetdConstants.h"
+
+using android::base::StringPrintf;
+using android::netdutils::DumpWriter;
+
+namespace android::net {
+
+namespace {
+
+constexpr size_t kStrWords = EventLog::kMaxStrSize / sizeof(uint64_t);
+
+int64_t nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1'000'000'000LL + ts.tv_nsec;
+}
+
+std::string formatTime(int64_t timeNs) {
+    const time_t seconds = timeNs / 1'000'000'000;
+    tm local;
+    localtime_r(&seconds, &local);
+    char buf[32];
+    strftime(buf, sizeof(buf), "%m-%d %H:%M:%S", &local);
+    return StringPrintf("%s.%03" PRId64, buf, (timeNs / 1'000'000) % 1000);
+}
+
+const char* targetName(int64_t target) {
+    switch (target) {
+        case V4:
+            return "v4";
+        case V6:
+            return "v6";
+        case V4V6:
+            return "v4v6";
+        default:
+            return "?";
+    }
+}
+
+}  // namespace
+
+EventLog gEventLog(1024);
+
+EventLog::EventLog(size_t capacity)
+    : mCapacity(capacity), mSlots(std::make_unique<Slot[]>(capacity)) {}
+
+void EventLog::log(NetdEvent event, const Args& args) {
+    const uint64_t index = mNext.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = mSlots[index % mCapacity];
+
+    std::array<uint64_t, kStrWords> str{};
+    const size_t strSize = std::min(args.str.size(), kMaxStrSize);
+    memcpy(str.data(), args.str.data(), strSize);
+
+    slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.timeNs.store(nowNs(), std::memory_order_relaxed);
+    slot.event.store(static_cast<uint16_t>(event), std::memory_order_relaxed);
+    slot.literal.store(args.literal, std::memory_order_relaxed);
+    slot.strSize.store(strSize, std::memory_order_relaxed);
+    for (size_t i = 0; i < kStrWords; i++) {
+        slot.str[i].store(str[i], std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < kMaxInts; i++) {
+        slot.ints[i].store(args.ints[i], std::memory_order_relaxed);
+    }
+    slot.seq.store(2 * (index + 1), std::memory_order_release);
+}
+
+void EventLog::forEachRecord(const std::function<void(const Record&)>& fn) const {
+    const uint64_t next = mNext.load(std::memory_order_relaxed);
+    for (uint64_t index = (next > mCapacity) ? next - mCapacity : 0; index < next; index++) {
+        const Slot& slot = mSlots[index % mCapacity];
+        const uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq != 2 * (index + 1)) continue;
+
+        Record record;
+        record.timeNs = slot.timeNs.load(std::memory_order_relaxed);
+        record.event = static_cast<NetdEvent>(slot.event.load(std::memory_order_relaxed));
+        record.literal = slot.literal.load(std::memory_order_relaxed);
+        const size_t strSize = std::min<size_t>(slot.strSize.load(std::memory_order_relaxed),
+                                                kMaxStrSize);
+        std::array<uint64_t, kStrWords> str;
+        for (size_t i = 0; i < kStrWords; i++) {
+            str[i] = slot.str[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < kMaxInts; i++) {
+            record.ints[i] = slot.ints[i].load(std::memory_order_relaxed);
+        }
+
+        // Skip the record if a writer started overwriting it while it was being copied.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != seq) continue;
+
+        record.str.assign(reinterpret_cast<const char*>(str.data()), strSize);
+        fn(record);
+    }
+}
+
+std::string EventLog::format(const Record& record) {
+    const auto& ints = record.ints;
+    const std::string str = base::StringReplace(record.str, "\n", "\\n", true);
+    std::string text;
+    switch (record.event) {
+        case NetdEvent::BINDER_CALL:
+            text = StringPrintf("%s%s <%" PRId64 "us, lock wait %" PRId64 "us>",
+                                record.literal ? record.literal : "binder call",
+                                ints[3] ? " -> error" : "", ints[1], ints[2]);
+            break;
+        case NetdEvent::IPTABLES_RESTORE:
+            text = StringPrintf("iptables-restore %s [%s...] %" PRId64 " bytes -> %" PRId64
+                                " <%" PRId64 "us>",
+                                targetName(ints[0]), str.c_str(), ints[1], ints[3], ints[2]);
+            break;
+        case NetdEvent::DNSMASQ_COMMAND:
+            text = StringPrintf("Sending update msg to dnsmasq [%s...] %" PRId64 " bytes",
+                                str.c_str(), ints[0]);
+            break;
+        default:
+            text = StringPrintf("unknown event %d", static_cast<int>(record.event));
+            break;
+    }
+    return formatTime(record.timeNs) + " " + text;
+}
+
+void EventLog::dump(DumpWriter& dw) const {
+    forEachRecord([&dw](const Record& record) { dw.println(format(record)); });
+}
+
+}  // namespace android::net
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <netdutils/DumpWriter.h>
+
+namespace android::net {
+
+// Events recorded in an EventLog. The arguments of each are formatted by EventLog::format().
+enum class NetdEvent : uint16_t {
+    // ints: method index, duration in us, lock wait in us, error (0 or 1). literal: method name.
+    BINDER_CALL = 1,
+    // ints: IptablesTarget, command size, duration in us, result. str: first line of the command.
+    IPTABLES_RESTORE,
+    // ints: command size. str: start of the command.
+    DNSMASQ_COMMAND,
+};
+
+// A fixed-size ring of binary log records, for paths that are too hot to format a string for
+// gLog. Logging a record is a handful of stores and takes no lock. Records are only formatted
+// when they are dumped. Once the ring is full, each new record overwrites the oldest.
+class EventLog {
+  public:
+    static constexpr size_t kMaxInts = 4;
+    static constexpr size_t kMaxStrSize = 16;
+
+    struct Args {
+        // Must outlive the log, like a string literal.
+        const char* literal = nullptr;
+        // Copied, and truncated to kMaxStrSize bytes.
+        std::string_view str;
+        std::array<int64_t, kMaxInts> ints{};
+    };
+
+    struct Record {
+        // CLOCK_REALTIME, so that records can be compared with logcat.
+        int64_t timeNs;
+        NetdEvent event;
+        const char* literal;
+        std::string str;
+        std::array<int64_t, kMaxInts> ints;
+    };
+
+    explicit EventLog(size_t capacity);
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+
+    void log(NetdEvent event, const Args& args);
+
+    // Calls |fn| for each record still in the ring, oldest first. Records that are being
+    // overwritten while this runs are skipped.
+    void forEachRecord(const std::function<void(const Record&)>& fn) const;
+
+    void dump(netdutils::DumpWriter& dw) const;
+
+    static std::string format(const Record& record);
+
+  private:
+    // A record, stored as words so that a reader can copy it while a writer overwrites it. The
+    // reader can tell that happened because |seq| changes.
+    struct Slot {
+        // 2 * (index + 1) once the record with that index is complete, odd while it is written.
+        std::atomic<uint64_t> seq;
+        std::atomic<int64_t> timeNs;
+        std::atomic<uint16_t> event;
+        std::atomic<const char*> literal;
+        std::atomic<uint8_t> strSize;
+        std::array<std::atomic<uint64_t>, kMaxStrSize / sizeof(uint64_t)> str;
+        std::array<std::atomic<int64_t>, kMaxInts> ints;
+    };
+
+    const size_t mCapacity;
+    const std::unique_ptr<Slot[]> mSlots;
+    std::atomic<uint64_t> mNext = 0;
+};
+
+// Used for hot paths in place of gLog.
+extern EventLog gEventLog;
+
+}  // namespace android::net
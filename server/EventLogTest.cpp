@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * EventLogTest.cpp - unit tests for EventLog.cpp
+ */
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/strings.h>
+#include <gtest/gtest.h>
+
+#include <netdutils/NetNativeTestBase.h>
+
+#include "EventLog.h"
+#include "NetdConstants.h"
+
+using android::base::EndsWith;
+
+namespace android::net {
+
+class EventLogTest : public NetNativeTestBase {
+  protected:
+    static std::vector<std::string> formatAll(const EventLog& log) {
+        std::vector<std::string> lines;
+        log.forEachRecord([&lines](const EventLog::Record& record) {
+            lines.push_back(EventLog::format(record));
+        });
+        return lines;
+    }
+};
+
+TEST_F(EventLogTest, Format) {
+    EventLog log(8);
+    log.log(NetdEvent::BINDER_CALL, {.literal = "networkCreate", .ints = {3, 120, 7, 1}});
+    log.log(NetdEvent::IPTABLES_RESTORE, {.str = "*filter", .ints = {V4V6, 200, 1500, 0}});
+    log.log(NetdEvent::DNSMASQ_COMMAND, {.str = "update_ifaces:wl", .ints = {30}});
+
+    const std::vector<std::string> lines = formatAll(log);
+    ASSERT_EQ(3U, lines.size());
+    EXPECT_TRUE(EndsWith(lines[0], " networkCreate -> error <120us, lock wait 7us>"));
+    EXPECT_TRUE(EndsWith(lines[1], " iptables-restore v4v6 [*filter...] 200 bytes -> 0 <1500us>"));
+    EXPECT_TRUE(EndsWith(lines[2], " Sending update msg to dnsmasq [update_ifaces:wl...] 30 bytes"));
+}
+
+TEST_F(EventLogTest, StringsAreCopiedAndTruncated) {
+    EventLog log(8);
+    std::string command = "update_ifaces:wlan0:rndis0\nmore";
+    log.log(NetdEvent::DNSMASQ_COMMAND, {.str = command});
+    command.assign(command.size(), 'x');
+
+    std::vector<EventLog::Record> records;
+    log.forEachRecord([&records](const EventLog::Record& r) { records.push_back(r); });
+    ASSERT_EQ(1U, records.size());
+    EXPECT_EQ("update_ifaces:wl", records[0].str);
+
+    log.log(NetdEvent::DNSMASQ_COMMAND, {.str = "a\nb"});
+    EXPECT_TRUE(EndsWith(formatAll(log)[1], "[a\\nb...] 0 bytes"));
+}
+
+TEST_F(EventLogTest, OldestRecordsAreOverwritten) {
+    EventLog log(4);
+    for (int i = 0; i < 10; i++) {
+        log.log(NetdEvent::DNSMASQ_COMMAND, {.ints = {i}});
+    }
+
+    std::vector<int64_t> sizes;
+    log.forEachRecord(
+            [&sizes](const EventLog::Record& record) { sizes.push_back(record.ints[0]); });
+    EXPECT_EQ((std::vector<int64_t>{6, 7, 8, 9}), sizes);
+}
+
+TEST_F(EventLogTest, ConcurrentWriters) {
+    constexpr int kThreads = 4;
+    constexpr int kRecordsPerThread = 10000;
+    EventLog log(64);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&log, t] {
+            for (int i = 0; i < kRecordsPerThread; i++) {
+                log.log(NetdEvent::IPTABLES_RESTORE,
+                        {.str = "abcdefghijklmnop", .ints = {t, i, t, i}});
+            }
+        });
+    }
+    // Records read while they are written must be skipped, never torn.
+    for (int i = 0; i < 100; i++) {
+        log.forEachRecord([](const EventLog::Record& record) {
+            EXPECT_EQ("abcdefghijklmnop", record.str);
+            EXPECT_EQ(record.ints[0], record.ints[2]);
+            EXPECT_EQ(record.ints[1], record.ints[3]);
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+
+    size_t count = 0;
+    log.forEachRecord([&count](const EventLog::Record&) { count++; });
+    EXPECT_EQ(64U, count);
+}
+
+}  // namespace android::net
@@ -68,8 +68,8 @@ FirewallController::FirewallController(void) {
     mIfaceRules = {};
 }
 
-int FirewallController::setupIptablesHooks(void) {
-    return flushRules();
+int FirewallController::setupIptablesHooks(BootRuleset* rules) {
+    return flushRules(rules);
 }
 
 int FirewallController::setFirewallType(FirewallType ftype) {
@@ -95,7 +95,7 @@ int FirewallController::setFirewallType(FirewallType ftype) {
     return res ? -EREMOTEIO : 0;
 }
 
-int FirewallController::flushRules() {
+int FirewallController::flushRules(BootRuleset* rules) {
     std::string command =
             "*filter\n"
             ":fw_INPUT -\n"
@@ -104,6 +104,9 @@ int FirewallController::flushRules() {
             "-6 -A fw_OUTPUT ! -o lo -s ::1 -j DROP\n"
             "COMMIT\n";
 
+    if (rules != nullptr) {
+        return rules->add(V4V6, command);
+    }
     return (execIptablesRestore(V4V6, command.c_str()) == 0) ? 0 : -EREMOTEIO;
 }
 
@@ -23,6 +23,7 @@
 #include <string>
 #include <vector>
 
+#include "BootRuleset.h"
 #include "NetdConstants.h"
 
 namespace android {
@@ -40,7 +41,8 @@ class FirewallController {
 public:
   FirewallController();
 
-  int setupIptablesHooks(void);
+  // If |rules| is not null, the rules are queued in it instead of being installed.
+  int setupIptablesHooks(BootRuleset* rules = nullptr);
 
   int setFirewallType(FirewallType);
   int resetFirewall(void);
@@ -69,7 +71,7 @@ protected:
 private:
   FirewallType mFirewallType;
   std::set<std::string> mIfaceRules;
-  int flushRules(void);
+  int flushRules(BootRuleset* rules = nullptr);
 };
 
 }  // namespace net
@@ -145,19 +145,39 @@ int IdletimerController::modifyInterfaceIdletimer(IptOp op, const char *iface,
         return -1;
     }
 
-    const char *addRemove = (op == IptOpAdd) ? "-A" : "-D";
-    std::vector<std::string> cmds = {
-            "*raw",
-            StringPrintf("%s %s -i %s -j IDLETIMER --timeout %u --label %s --send_nl_msg",
-                         addRemove, LOCAL_RAW_PREROUTING, iface, timeout, classLabel),
-            "COMMIT",
-            "*mangle",
-            StringPrintf("%s %s -o %s -j IDLETIMER --timeout %u --label %s --send_nl_msg",
-                         addRemove, LOCAL_MANGLE_POSTROUTING, iface, timeout, classLabel),
-            "COMMIT\n",
-    };
-
-    return (execIptablesRestore(V4V6, Join(cmds, '\n')) == 0) ? 0 : -EREMOTEIO;
+    std::vector<int> results;
+    modifyInterfaceIdletimers({{op == IptOpAdd, iface, timeout, classLabel}}, &results);
+    return results[0];
+}
+
+void IdletimerController::modifyInterfaceIdletimers(const std::vector<Change>& changes,
+                                                    std::vector<int>* results) {
+    std::vector<std::string> raw = {"*raw"};
+    std::vector<std::string> mangle = {"*mangle"};
+    results->assign(changes.size(), 0);
+    for (size_t i = 0; i < changes.size(); i++) {
+        const Change& change = changes[i];
+        if (!isIfaceName(change.iface)) {
+            (*results)[i] = -ENOENT;
+            continue;
+        }
+        const char *addRemove = change.add ? "-A" : "-D";
+        raw.push_back(StringPrintf("%s %s -i %s -j IDLETIMER --timeout %u --label %s --send_nl_msg",
+                                   addRemove, LOCAL_RAW_PREROUTING, change.iface.c_str(),
+                                   change.timeout, change.classLabel.c_str()));
+        mangle.push_back(StringPrintf(
+                "%s %s -o %s -j IDLETIMER --timeout %u --label %s --send_nl_msg", addRemove,
+                LOCAL_MANGLE_POSTROUTING, change.iface.c_str(), change.timeout,
+                change.classLabel.c_str()));
+    }
+    if (raw.size() == 1) return;
+
+    raw.push_back("COMMIT");
+    mangle.push_back("COMMIT\n");
+    if (execIptablesRestore(V4V6, Join(raw, '\n') + "\n" + Join(mangle, '\n')) == 0) return;
+    for (size_t i = 0; i < changes.size(); i++) {
+        if ((*results)[i] == 0) (*results)[i] = -EREMOTEIO;
+    }
 }
 
 int IdletimerController::addInterfaceIdletimer(const char *iface,
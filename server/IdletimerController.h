@@ -18,6 +18,9 @@
 
 #include <stdint.h>
 
+#include <string>
+#include <vector>
+
 #include "NetdConstants.h"
 
 class IdletimerController {
@@ -30,6 +33,18 @@ public:
                               const char *classLabel);
     int removeInterfaceIdletimer(const char *iface, uint32_t timeout,
                                  const char *classLabel);
+
+    struct Change {
+        bool add;
+        std::string iface;
+        uint32_t timeout;
+        std::string classLabel;
+    };
+    // Adds and removes the idletimers of |changes| in a single iptables-restore transaction.
+    // |results| receives 0 or a negative errno for each change. Changes on invalid interface names
+    // fail with -ENOENT and are left out of the transaction. The others succeed or fail together:
+    // a single rule that cannot be added or removed fails them all with -EREMOTEIO.
+    void modifyInterfaceIdletimers(const std::vector<Change>& changes, std::vector<int>* results);
     bool setupIptablesHooks();
 
     static const char* LOCAL_RAW_PREROUTING;
@@ -32,6 +32,13 @@ protected:
     IdletimerControllerTest() {
         IdletimerController::execIptablesRestore = fakeExecIptablesRestore;
     }
+    void failIptablesRestore() {
+        IdletimerController::execIptablesRestore = [](IptablesTarget target,
+                                                      const std::string& commands) {
+            fakeExecIptablesRestore(target, commands);
+            return -1;
+        };
+    }
     IdletimerController mIt;
 };
 
@@ -72,3 +79,41 @@ TEST_F(IdletimerControllerTest, TestAddRemove) {
     mIt.removeInterfaceIdletimer("wlan0", 12345, "hello");
     expectIptablesRestoreCommands(expected);
 }
+
+TEST_F(IdletimerControllerTest, TestModifyInterfaceIdletimers) {
+    const std::vector<IdletimerController::Change> changes = {
+            {true, "wlan0", 12345, "hello"},
+            {true, "wlan0/../lo", 10, "bad"},
+            {false, "rmnet_data0", 5, "world"},
+    };
+    const std::vector<std::string> cmds = {
+            "*raw",
+            "-A idletimer_raw_PREROUTING -i wlan0 -j IDLETIMER"
+            " --timeout 12345 --label hello --send_nl_msg",
+            "-D idletimer_raw_PREROUTING -i rmnet_data0 -j IDLETIMER"
+            " --timeout 5 --label world --send_nl_msg",
+            "COMMIT",
+            "*mangle",
+            "-A idletimer_mangle_POSTROUTING -o wlan0 -j IDLETIMER"
+            " --timeout 12345 --label hello --send_nl_msg",
+            "-D idletimer_mangle_POSTROUTING -o rmnet_data0 -j IDLETIMER"
+            " --timeout 5 --label world --send_nl_msg",
+            "COMMIT\n",
+    };
+
+    std::vector<int> results;
+    mIt.modifyInterfaceIdletimers(changes, &results);
+    expectIptablesRestoreCommands({Join(cmds, '\n')});
+    EXPECT_EQ((std::vector<int>{0, -ENOENT, 0}), results);
+
+    // A failed transaction fails every change that was in it.
+    failIptablesRestore();
+    mIt.modifyInterfaceIdletimers(changes, &results);
+    expectIptablesRestoreCommands({Join(cmds, '\n')});
+    EXPECT_EQ((std::vector<int>{-EREMOTEIO, -ENOENT, -EREMOTEIO}), results);
+
+    // Nothing is run if no change is valid.
+    mIt.modifyInterfaceIdletimers({changes[1]}, &results);
+    expectIptablesRestoreCommands(ExpectedIptablesCommands{});
+    EXPECT_EQ((std::vector<int>{-ENOENT}), results);
+}
@@ -14,20 +14,22 @@
  * limitations under the License.
  */
 
-#include <dirent.h>
+#include <arpa/inet.h>
 #include <errno.h>
 #include <malloc.h>
 #include <net/if.h>
 #include <net/if_arp.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <functional>
+#include <mutex>
+#include <vector>
 
 #define LOG_TAG "InterfaceController"
-#include <android-base/file.h>
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
-#include <android-base/strings.h>
 #include <linux/if_ether.h>
 #include <log/log.h>
 #include <netutils/ifc.h>
@@ -38,12 +40,13 @@
 #include <netdutils/Syscalls.h>
 
 #include "InterfaceController.h"
+#include "NetlinkCommands.h"
 #include "RouteController.h"
+#include "SysctlCache.h"
 
-using android::base::ReadFileToString;
 using android::base::StringPrintf;
-using android::base::Trim;
-using android::base::WriteStringToFile;
+using android::net::gSysctlCache;
+using android::net::SysctlBatch;
 using android::netdutils::isOk;
 using android::netdutils::makeSlice;
 using android::netdutils::sSyscalls;
@@ -103,43 +106,13 @@ inline bool isInterfaceName(const char *name) {
 int writeValueToPath(
         const char* dirname, const char* subdirname, const char* basename,
         const char* value) {
-    std::string path(StringPrintf("%s/%s/%s", dirname, subdirname, basename));
-    return WriteStringToFile(value, path) ? 0 : -EREMOTEIO;
-}
-
-// Run @fn on each interface as well as 'default' in the path @dirname.
-void forEachInterface(
-        const std::string& dirname,
-        const std::function<void(const std::string& path, const std::string& iface)>& fn) {
-    // Run on default, which controls the behavior of any interfaces that are created in the future.
-    fn(dirname, "default");
-    DIR* dir = opendir(dirname.c_str());
-    if (!dir) {
-        ALOGE("Can't list %s: %s", dirname.c_str(), strerror(errno));
-        return;
-    }
-    while (true) {
-        const dirent *ent = readdir(dir);
-        if (!ent) {
-            break;
-        }
-        if ((ent->d_type != DT_DIR) || !isInterfaceName(ent->d_name)) {
-            continue;
-        }
-        fn(dirname, ent->d_name);
-    }
-    closedir(dir);
-}
-
-void setOnAllInterfaces(const char* dirname, const char* basename, const char* value) {
-    auto fn = [basename, value](const std::string& path, const std::string& iface) {
-        writeValueToPath(path.c_str(), iface.c_str(), basename, value);
-    };
-    forEachInterface(dirname, fn);
+    SysctlBatch batch;
+    batch.add(StringPrintf("%s/%s", dirname, subdirname), {{basename, value}});
+    return batch.apply() == 0 ? 0 : -EREMOTEIO;
 }
 
-void setIPv6UseOutgoingInterfaceAddrsOnly(const char *value) {
-    setOnAllInterfaces(ipv6_proc_path, "use_oif_addrs_only", value);
+void setIPv6UseOutgoingInterfaceAddrsOnly(SysctlBatch* batch, const char* value) {
+    batch->addForEachInterface(ipv6_proc_path, {{"use_oif_addrs_only", value}});
 }
 
 std::string getParameterPathname(
@@ -157,19 +130,13 @@ std::string getParameterPathname(
     return StringPrintf("%s/%s/%s/%s/%s", proc_net_path, family, which, interface, parameter);
 }
 
-void setAcceptIPv6RIO(int min, int max) {
-    auto fn = [min, max](const std::string& prefix, const std::string& iface) {
-        int rv = writeValueToPath(prefix.c_str(), iface.c_str(), "accept_ra_rt_info_min_plen",
-                                  std::to_string(min).c_str());
-        if (rv != 0) {
-            // Only update max_plen if the write to min_plen succeeded. This ordering will prevent
-            // RIOs from being accepted unless both min and max are written successfully.
-            return;
-        }
-        writeValueToPath(prefix.c_str(), iface.c_str(), "accept_ra_rt_info_max_plen",
-                         std::to_string(max).c_str());
-    };
-    forEachInterface(ipv6_proc_path, fn);
+void setAcceptIPv6RIO(SysctlBatch* batch, int min, int max) {
+    // Only update max_plen if the write to min_plen succeeded. This ordering will prevent RIOs
+    // from being accepted unless both min and max are written successfully.
+    batch->addForEachInterface(ipv6_proc_path,
+                               {{"accept_ra_rt_info_min_plen", std::to_string(min)},
+                                {"accept_ra_rt_info_max_plen", std::to_string(max)}},
+                               true /* stopOnError */);
 }
 
 // Ideally this function would return StatusOr<std::string>, however
@@ -193,7 +160,11 @@ Status setProperty(const std::string& key, const std::string& val) {
 
 namespace android {
 namespace net {
-std::mutex InterfaceController::mutex;
+std::shared_mutex& InterfaceController::lockFor(const std::string& ifName) {
+    static constexpr size_t kNumLocks = 16;
+    static std::shared_mutex locks[kNumLocks];
+    return locks[std::hash<std::string>()(ifName) % kNumLocks];
+}
 
 android::netdutils::Status InterfaceController::enableStablePrivacyAddresses(
         const std::string& iface,
@@ -233,31 +204,37 @@ android::netdutils::Status InterfaceController::enableStablePrivacyAddresses(
     return setProperty(kStableSecretProperty, secret);
 }
 
-void InterfaceController::initializeAll() {
+SysctlBatch::Stats InterfaceController::initializeAll() {
+    // All the settings below are applied in one batch, which lists each conf directory once.
+    SysctlBatch batch;
+
     // Initial IPv6 settings.
     // By default, accept_ra is set to 1 (accept RAs unless forwarding is on) on all interfaces.
     // This causes RAs to work or not work based on whether forwarding is on, and causes routes
     // learned from RAs to go away when forwarding is turned on. Make this behaviour predictable
     // by always setting accept_ra to 2.
-    setAcceptRA("2");
+    setAcceptRA(&batch, "2");
 
     // Accept RIOs with prefix length in the closed interval [48, 64].
-    setAcceptIPv6RIO(kRouteInfoMinPrefixLen, kRouteInfoMaxPrefixLen);
+    setAcceptIPv6RIO(&batch, kRouteInfoMinPrefixLen, kRouteInfoMaxPrefixLen);
 
-    setAcceptRARouteTable(-RouteController::ROUTE_TABLE_OFFSET_FROM_INDEX);
+    setAcceptRARouteTable(&batch, -RouteController::ROUTE_TABLE_OFFSET_FROM_INDEX);
 
     // Enable optimistic DAD for IPv6 addresses on all interfaces.
-    setIPv6OptimisticMode("1");
+    setIPv6OptimisticMode(&batch, "1");
 
     // Reduce the ARP/ND base reachable time from the default (30sec) to 15sec.
-    setBaseReachableTimeMs(15 * 1000);
+    setBaseReachableTimeMs(&batch, 15 * 1000);
 
     // When sending traffic via a given interface use only addresses configured
     // on that interface as possible source addresses.
-    setIPv6UseOutgoingInterfaceAddrsOnly("1");
+    setIPv6UseOutgoingInterfaceAddrsOnly(&batch, "1");
 
     // Ensure that ICMP redirects are rejected globally on all interfaces.
-    disableIcmpRedirects();
+    disableIcmpRedirects(&batch);
+
+    batch.apply();
+    return batch.stats();
 }
 
 int InterfaceController::setEnableIPv6(const char *interface, const int on) {
@@ -334,8 +311,8 @@ int InterfaceController::setIPv6PrivacyExtensions(const char *interface, const i
     return writeValueToPath(ipv6_proc_path, interface, "use_tempaddr", on ? "2" : "0");
 }
 
-void InterfaceController::setAcceptRA(const char *value) {
-    setOnAllInterfaces(ipv6_proc_path, "accept_ra", value);
+void InterfaceController::setAcceptRA(SysctlBatch* batch, const char* value) {
+    batch->addForEachInterface(ipv6_proc_path, {{"accept_ra", value}});
 }
 
 // |tableOrOffset| is interpreted as:
@@ -344,9 +321,9 @@ void InterfaceController::setAcceptRA(const char *value) {
 //     If < 0: automatic. The absolute value is intepreted as an offset and added to the interface
 //             ID to get the table. If it's set to -1000, routes from interface ID 5 will go into
 //             table 1005, etc.
-void InterfaceController::setAcceptRARouteTable(int tableOrOffset) {
+void InterfaceController::setAcceptRARouteTable(SysctlBatch* batch, int tableOrOffset) {
     std::string value(StringPrintf("%d", tableOrOffset));
-    setOnAllInterfaces(ipv6_proc_path, "accept_ra_rt_table", value.c_str());
+    batch->addForEachInterface(ipv6_proc_path, {{"accept_ra_rt_table", value}});
 }
 
 int InterfaceController::setMtu(const char *interface, const char *mtu)
@@ -371,12 +348,21 @@ int InterfaceController::delAddress(const char *interface,
 }
 
 int InterfaceController::disableIcmpRedirects() {
-    int rv = 0;
-    rv |= writeValueToPath(ipv4_proc_path, "all", "accept_redirects", "0");
-    rv |= writeValueToPath(ipv6_proc_path, "all", "accept_redirects", "0");
-    setOnAllInterfaces(ipv4_proc_path, "accept_redirects", "0");
-    setOnAllInterfaces(ipv6_proc_path, "accept_redirects", "0");
-    return rv;
+    SysctlBatch batch;
+    const size_t first = disableIcmpRedirects(&batch);
+    batch.apply();
+    // As before, only the "all" settings are reported. Interfaces can go away at any time.
+    const int rv = batch.result(first);
+    return rv != 0 ? rv : batch.result(first + 1);
+}
+
+size_t InterfaceController::disableIcmpRedirects(SysctlBatch* batch) {
+    const size_t first = batch->add(StringPrintf("%s/all", ipv4_proc_path),
+                                    {{"accept_redirects", "0"}});
+    batch->add(StringPrintf("%s/all", ipv6_proc_path), {{"accept_redirects", "0"}});
+    batch->addForEachInterface(ipv4_proc_path, {{"accept_redirects", "0"}});
+    batch->addForEachInterface(ipv6_proc_path, {{"accept_redirects", "0"}});
+    return first;
 }
 
 int InterfaceController::getParameter(
@@ -386,11 +372,7 @@ int InterfaceController::getParameter(
     if (path.empty()) {
         return -errno;
     }
-    if (ReadFileToString(path, value)) {
-        *value = Trim(*value);
-        return 0;
-    }
-    return -errno;
+    return gSysctlCache.read(path, value);
 }
 
 int InterfaceController::setParameter(
@@ -400,18 +382,20 @@ int InterfaceController::setParameter(
     if (path.empty()) {
         return -errno;
     }
-    return WriteStringToFile(value, path) ? 0 : -errno;
+    SysctlBatch batch;
+    batch.add(path, value);
+    return batch.apply();
 }
 
-void InterfaceController::setBaseReachableTimeMs(unsigned int millis) {
+void InterfaceController::setBaseReachableTimeMs(SysctlBatch* batch, unsigned int millis) {
     std::string value(StringPrintf("%u", millis));
-    setOnAllInterfaces(ipv4_neigh_conf_dir, "base_reachable_time_ms", value.c_str());
-    setOnAllInterfaces(ipv6_neigh_conf_dir, "base_reachable_time_ms", value.c_str());
+    batch->addForEachInterface(ipv4_neigh_conf_dir, {{"base_reachable_time_ms", value}});
+    batch->addForEachInterface(ipv6_neigh_conf_dir, {{"base_reachable_time_ms", value}});
 }
 
-void InterfaceController::setIPv6OptimisticMode(const char *value) {
-    setOnAllInterfaces(ipv6_proc_path, "optimistic_dad", value);
-    setOnAllInterfaces(ipv6_proc_path, "use_optimistic", value);
+void InterfaceController::setIPv6OptimisticMode(SysctlBatch* batch, const char* value) {
+    batch->addForEachInterface(ipv6_proc_path,
+                               {{"optimistic_dad", value}, {"use_optimistic", value}});
 }
 
 namespace {
@@ -421,109 +405,348 @@ std::string hwAddrToStr(unsigned char* hwaddr) {
                         hwaddr[4], hwaddr[5]);
 }
 
-int ipv4NetmaskToPrefixLength(in_addr_t mask) {
-    int prefixLength = 0;
-    uint32_t m = ntohl(mask);
-    while (m & (1 << 31)) {
-        prefixLength++;
-        m = m << 1;
-    }
-    return prefixLength;
-}
-
 std::string toStdString(const String16& s) {
     return std::string(String8(s.c_str()));
 }
 
-}  // namespace
+// The INetd flag names are String16 constants. Convert them once instead of on every call.
+struct InterfaceFlagNames {
+    const std::string up = toStdString(INetd::IF_STATE_UP());
+    const std::string down = toStdString(INetd::IF_STATE_DOWN());
+    const std::string broadcast = toStdString(INetd::IF_FLAG_BROADCAST());
+    const std::string loopback = toStdString(INetd::IF_FLAG_LOOPBACK());
+    const std::string pointToPoint = toStdString(INetd::IF_FLAG_POINTOPOINT());
+    const std::string running = toStdString(INetd::IF_FLAG_RUNNING());
+    const std::string multicast = toStdString(INetd::IF_FLAG_MULTICAST());
+};
 
-Status InterfaceController::setCfg(const InterfaceConfigurationParcel& cfg) {
-    const auto& sys = sSyscalls.get();
-    ASSIGN_OR_RETURN(auto fd, sys.socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0));
-    struct ifreq ifr = {
-            .ifr_addr = {.sa_family = AF_INET},  // Clear the IPv4 address.
-    };
-    strlcpy(ifr.ifr_name, cfg.ifName.c_str(), IFNAMSIZ);
+const InterfaceFlagNames& flagNames() {
+    static const InterfaceFlagNames sFlagNames;
+    return sFlagNames;
+}
 
-    // Make sure that clear IPv4 address before set flag
-    // SIOCGIFFLAGS might override ifr and caused clear IPv4 addr ioctl error
-    RETURN_IF_NOT_OK(sys.ioctl(fd, SIOCSIFADDR, &ifr));
+std::vector<std::string> flagsToStrings(unsigned flags) {
+    const InterfaceFlagNames& names = flagNames();
+    std::vector<std::string> result;
+    result.push_back(flags & IFF_UP ? names.up : names.down);
 
-    if (!cfg.flags.empty()) {
-        RETURN_IF_NOT_OK(sys.ioctl(fd, SIOCGIFFLAGS, &ifr));
-        uint16_t flags = ifr.ifr_flags;
+    if (flags & IFF_BROADCAST) result.push_back(names.broadcast);
+    if (flags & IFF_LOOPBACK) result.push_back(names.loopback);
+    if (flags & IFF_POINTOPOINT) result.push_back(names.pointToPoint);
+    if (flags & IFF_RUNNING) result.push_back(names.running);
+    if (flags & IFF_MULTICAST) result.push_back(names.multicast);
+    return result;
+}
 
-        for (const auto& flag : cfg.flags) {
-            if (flag == toStdString(INetd::IF_STATE_UP())) {
-                ifr.ifr_flags = ifr.ifr_flags | IFF_UP;
-            } else if (flag == toStdString(INetd::IF_STATE_DOWN())) {
-                ifr.ifr_flags = (ifr.ifr_flags & (~IFF_UP));
-            }
-        }
+// What the kernel reports about a link and its primary IPv4 address.
+struct InterfaceState {
+    int linkResult = -EIO;  // 0 or negative errno from RTM_GETLINK
+    int ifIndex = 0;
+    unsigned flags = 0;
+    unsigned char hwAddr[ETH_ALEN] = {};
+    bool hasIpv4Addr = false;
+    in_addr ipv4Addr = {};
+    int prefixLength = 0;
+};
 
-        if (ifr.ifr_flags != flags) {
-            RETURN_IF_NOT_OK(sys.ioctl(fd, SIOCSIFFLAGS, &ifr));
+// The rtnetlink socket used for interface configuration. It is opened on first use and reopened
+// after a failed exchange, which discards any responses that were not read.
+std::mutex sRtNetlinkLock;
+int sRtNetlinkSock = -1;
+
+Status sendRtNetlinkBatch(NetlinkBatch* batch, const NetlinkBatch::ResponseCallback& callback,
+                          std::vector<int>* results) {
+    std::lock_guard guard(sRtNetlinkLock);
+    if (sRtNetlinkSock < 0) {
+        int sock = openNetlinkSocket(NETLINK_ROUTE);
+        if (sock < 0) {
+            return statusFromErrno(-sock, "Failed to open rtnetlink socket");
         }
+        sRtNetlinkSock = sock;
     }
 
-    if (int ret = ifc_add_address(cfg.ifName.c_str(), cfg.ipv4Addr.c_str(), cfg.prefixLength)) {
-        return statusFromErrno(-ret, "Failed to add addr");
+    if (int ret = batch->send(sRtNetlinkSock, callback, results)) {
+        close(sRtNetlinkSock);
+        sRtNetlinkSock = -1;
+        return statusFromErrno(-ret, "rtnetlink exchange failed");
     }
+    return ok;
+}
+
+// Fetches the link and its IPv4 addresses in one exchange. The address dump cannot be filtered by
+// interface, so addresses of other links are skipped. As with SIOCGIFADDR, the primary address is
+// the first one whose label is the interface name, which excludes aliases such as "eth0:1".
+Status getInterfaceState(const std::string& ifName, InterfaceState* state) {
+    ifinfomsg ifInfo = {.ifi_family = AF_UNSPEC};
+    rtattr ifNameAttr = {static_cast<uint16_t>(RTA_LENGTH(ifName.size() + 1)), IFLA_IFNAME};
+    uint8_t padding[RTA_ALIGNTO] = {};
+    iovec linkIov[] = {
+            {nullptr, 0},
+            {&ifInfo, sizeof(ifInfo)},
+            {&ifNameAttr, sizeof(ifNameAttr)},
+            {const_cast<char*>(ifName.c_str()), ifName.size() + 1},
+            {padding, RTA_ALIGN(ifName.size() + 1) - (ifName.size() + 1)},
+    };
+    ifaddrmsg addrMsg = {.ifa_family = AF_INET};
+    iovec addrIov[] = {
+            {nullptr, 0},
+            {&addrMsg, sizeof(addrMsg)},
+    };
+
+    NetlinkBatch batch;
+    batch.add(RTM_GETLINK, NETLINK_REQUEST_FLAGS, linkIov, ARRAY_SIZE(linkIov));
+    batch.add(RTM_GETADDR, NETLINK_DUMP_FLAGS, addrIov, ARRAY_SIZE(addrIov));
+
+    // The kernel answers the requests in order, so the link is known before any address arrives.
+    const auto onResponse = [&ifName, state](size_t, nlmsghdr* nlh) {
+        if (nlh->nlmsg_type == RTM_NEWLINK) {
+            const ifinfomsg* ifi = reinterpret_cast<ifinfomsg*>(NLMSG_DATA(nlh));
+            state->ifIndex = ifi->ifi_index;
+            state->flags = ifi->ifi_flags;
+            int len = IFLA_PAYLOAD(nlh);
+            for (rtattr* rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+                if (rta->rta_type == IFLA_ADDRESS) {
+                    memcpy(state->hwAddr, RTA_DATA(rta), std::min<size_t>(RTA_PAYLOAD(rta), ETH_ALEN));
+                }
+            }
+        } else if (nlh->nlmsg_type == RTM_NEWADDR) {
+            const ifaddrmsg* ifa = reinterpret_cast<ifaddrmsg*>(NLMSG_DATA(nlh));
+            if (state->hasIpv4Addr || state->ifIndex == 0 ||
+                static_cast<int>(ifa->ifa_index) != state->ifIndex) {
+                return;
+            }
+            const in_addr* local = nullptr;
+            bool isPrimaryLabel = true;
+            int len = IFA_PAYLOAD(nlh);
+            for (rtattr* rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+                if (rta->rta_type == IFA_LOCAL && RTA_PAYLOAD(rta) >= sizeof(in_addr)) {
+                    local = reinterpret_cast<const in_addr*>(RTA_DATA(rta));
+                } else if (rta->rta_type == IFA_LABEL) {
+                    isPrimaryLabel = ifName == reinterpret_cast<const char*>(RTA_DATA(rta));
+                }
+            }
+            if (local != nullptr && isPrimaryLabel) {
+                state->hasIpv4Addr = true;
+                state->ipv4Addr = *local;
+                state->prefixLength = ifa->ifa_prefixlen;
+            }
+        }
+    };
 
+    std::vector<int> results;
+    RETURN_IF_NOT_OK(sendRtNetlinkBatch(&batch, onResponse, &results));
+    state->linkResult = results[0];
+    if (results[1] != 0) {
+        return statusFromErrno(-results[1], "Failed to dump IPv4 addresses");
+    }
     return ok;
 }
 
-StatusOr<InterfaceConfigurationParcel> InterfaceController::getCfg(const std::string& ifName) {
-    struct in_addr addr = {};
-    int prefixLength = 0;
-    unsigned char hwaddr[ETH_ALEN] = {};
-    unsigned flags = 0;
-    InterfaceConfigurationParcel cfgResult;
+}  // namespace
 
-    const auto& sys = sSyscalls.get();
-    ASSIGN_OR_RETURN(auto fd, sys.socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0));
+Status InterfaceController::setCfg(const InterfaceConfigurationParcel& cfg) {
+    InterfaceState state;
+    RETURN_IF_NOT_OK(getInterfaceState(cfg.ifName, &state));
+    if (state.linkResult != 0) {
+        return statusFromErrno(-state.linkResult, "Failed to get link " + cfg.ifName);
+    }
 
-    struct ifreq ifr = {};
-    strlcpy(ifr.ifr_name, ifName.c_str(), IFNAMSIZ);
+    // Parse the new address up front, so that nothing changes if it is invalid.
+    sockaddr_storage addr = {};
+    size_t addrLen;
+    uint8_t family;
+    if (inet_pton(AF_INET, cfg.ipv4Addr.c_str(), &addr) == 1) {
+        family = AF_INET;
+        addrLen = sizeof(in_addr);
+    } else if (inet_pton(AF_INET6, cfg.ipv4Addr.c_str(), &addr) == 1) {
+        family = AF_INET6;
+        addrLen = sizeof(in6_addr);
+    } else {
+        return statusFromErrno(EINVAL, "Failed to add addr");
+    }
+    if (cfg.prefixLength < 0 || cfg.prefixLength > static_cast<int>(addrLen * 8)) {
+        return statusFromErrno(EINVAL, "Failed to add addr");
+    }
 
-    if (isOk(sys.ioctl(fd, SIOCGIFADDR, &ifr))) {
-        addr.s_addr = ((struct sockaddr_in*) &ifr.ifr_addr)->sin_addr.s_addr;
+    // The same steps as before, in one batch: clear the primary IPv4 address, update IFF_UP if
+    // needed, then add the new address.
+    NetlinkBatch batch;
+    std::vector<const char*> steps;
+
+    ifaddrmsg delMsg = {
+            .ifa_family = AF_INET,
+            .ifa_prefixlen = static_cast<uint8_t>(state.prefixLength),
+            .ifa_index = static_cast<uint32_t>(state.ifIndex),
+    };
+    rtattr delLocalAttr = {RTA_LENGTH(sizeof(in_addr)), IFA_LOCAL};
+    iovec delIov[] = {
+            {nullptr, 0},
+            {&delMsg, sizeof(delMsg)},
+            {&delLocalAttr, sizeof(delLocalAttr)},
+            {&state.ipv4Addr, sizeof(state.ipv4Addr)},
+    };
+    if (state.hasIpv4Addr) {
+        batch.add(RTM_DELADDR, NETLINK_REQUEST_FLAGS, delIov, ARRAY_SIZE(delIov));
+        steps.push_back("Failed to clear addr");
     }
 
-    if (isOk(sys.ioctl(fd, SIOCGIFNETMASK, &ifr))) {
-        prefixLength =
-                ipv4NetmaskToPrefixLength(((struct sockaddr_in*) &ifr.ifr_addr)->sin_addr.s_addr);
+    unsigned flags = state.flags;
+    for (const auto& flag : cfg.flags) {
+        if (flag == flagNames().up) {
+            flags |= IFF_UP;
+        } else if (flag == flagNames().down) {
+            flags &= ~IFF_UP;
+        }
+    }
+    ifinfomsg linkMsg = {
+            .ifi_family = AF_UNSPEC,
+            .ifi_index = state.ifIndex,
+            .ifi_flags = flags & IFF_UP,
+            .ifi_change = IFF_UP,
+    };
+    iovec linkIov[] = {
+            {nullptr, 0},
+            {&linkMsg, sizeof(linkMsg)},
+    };
+    if (flags != state.flags) {
+        batch.add(RTM_NEWLINK, NETLINK_REQUEST_FLAGS, linkIov, ARRAY_SIZE(linkIov));
+        steps.push_back("Failed to set flags");
     }
 
-    if (isOk(sys.ioctl(fd, SIOCGIFFLAGS, &ifr))) {
-        flags = ifr.ifr_flags;
+    // Like ifc_add_address, replace any matching address and set the IPv4 broadcast address.
+    ifaddrmsg addMsg = {
+            .ifa_family = family,
+            .ifa_prefixlen = static_cast<uint8_t>(cfg.prefixLength),
+            .ifa_index = static_cast<uint32_t>(state.ifIndex),
+    };
+    rtattr addLocalAttr = {static_cast<uint16_t>(RTA_LENGTH(addrLen)), IFA_LOCAL};
+    rtattr broadcastAttr = {RTA_LENGTH(sizeof(in_addr)), IFA_BROADCAST};
+    const in_addr_t addr4 = reinterpret_cast<const in_addr*>(&addr)->s_addr;
+    const in_addr_t hostMask = cfg.prefixLength >= 32 ? 0 : htonl(0xffffffffU >> cfg.prefixLength);
+    in_addr broadcast = {.s_addr = addr4 | hostMask};
+    const bool isIpv4 = family == AF_INET;
+    iovec addIov[] = {
+            {nullptr, 0},
+            {&addMsg, sizeof(addMsg)},
+            {&addLocalAttr, sizeof(addLocalAttr)},
+            {&addr, addrLen},
+            {&broadcastAttr, isIpv4 ? sizeof(broadcastAttr) : 0},
+            {&broadcast, isIpv4 ? sizeof(broadcast) : 0},
+    };
+    batch.add(RTM_NEWADDR, NETLINK_REQUEST_FLAGS | NLM_F_CREATE | NLM_F_REPLACE, addIov,
+              ARRAY_SIZE(addIov));
+    steps.push_back("Failed to add addr");
+
+    std::vector<int> results;
+    RETURN_IF_NOT_OK(sendRtNetlinkBatch(&batch, [](size_t, nlmsghdr*) {}, &results));
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results[i] != 0) {
+            return statusFromErrno(-results[i], steps[i]);
+        }
     }
 
-    // ETH_ALEN is for ARPHRD_ETHER, it is better to check the sa_family.
-    // However, we keep old design for the consistency.
-    if (isOk(sys.ioctl(fd, SIOCGIFHWADDR, &ifr))) {
-        memcpy((void*) hwaddr, &ifr.ifr_hwaddr.sa_data, ETH_ALEN);
-    } else {
-        ALOGW("Failed to retrieve HW addr for %s (%s)", ifName.c_str(), strerror(errno));
+    return ok;
+}
+
+StatusOr<InterfaceConfigurationParcel> InterfaceController::getCfg(const std::string& ifName) {
+    InterfaceState state;
+    RETURN_IF_NOT_OK(getInterfaceState(ifName, &state));
+    // As before, a link that cannot be found is reported as down with no address.
+    if (state.linkResult != 0) {
+        ALOGW("Failed to get link %s (%s)", ifName.c_str(), strerror(-state.linkResult));
     }
 
+    InterfaceConfigurationParcel cfgResult;
     cfgResult.ifName = ifName;
-    cfgResult.hwAddr = hwAddrToStr(hwaddr);
-    cfgResult.ipv4Addr = std::string(inet_ntoa(addr));
-    cfgResult.prefixLength = prefixLength;
-    cfgResult.flags.push_back(flags & IFF_UP ? toStdString(INetd::IF_STATE_UP())
-                                             : toStdString(INetd::IF_STATE_DOWN()));
-
-    if (flags & IFF_BROADCAST) cfgResult.flags.push_back(toStdString(INetd::IF_FLAG_BROADCAST()));
-    if (flags & IFF_LOOPBACK) cfgResult.flags.push_back(toStdString(INetd::IF_FLAG_LOOPBACK()));
-    if (flags & IFF_POINTOPOINT)
-        cfgResult.flags.push_back(toStdString(INetd::IF_FLAG_POINTOPOINT()));
-    if (flags & IFF_RUNNING) cfgResult.flags.push_back(toStdString(INetd::IF_FLAG_RUNNING()));
-    if (flags & IFF_MULTICAST) cfgResult.flags.push_back(toStdString(INetd::IF_FLAG_MULTICAST()));
+    cfgResult.hwAddr = hwAddrToStr(state.hwAddr);
+    cfgResult.ipv4Addr = std::string(inet_ntoa(state.ipv4Addr));
+    cfgResult.prefixLength = state.prefixLength;
+    cfgResult.flags = flagsToStrings(state.flags);
 
     return cfgResult;
 }
 
+StatusOr<std::vector<InterfaceSnapshot>> InterfaceController::getCfgAll() {
+    std::vector<InterfaceSnapshot> snapshots;
+    // Position of each interface in |snapshots|, by ifindex.
+    std::map<int, size_t> positions;
+
+    // Two exchanges, because the kernel refuses a second dump on a socket while the first one is
+    // still in progress.
+    ifinfomsg linkMsg = {.ifi_family = AF_UNSPEC};
+    iovec linkIov[] = {
+            {nullptr, 0},
+            {&linkMsg, sizeof(linkMsg)},
+    };
+    NetlinkBatch linkDump;
+    linkDump.add(RTM_GETLINK, NETLINK_DUMP_FLAGS, linkIov, ARRAY_SIZE(linkIov));
+    const auto onLink = [&snapshots, &positions](size_t, nlmsghdr* nlh) {
+        if (nlh->nlmsg_type != RTM_NEWLINK) return;
+        const ifinfomsg* ifi = reinterpret_cast<ifinfomsg*>(NLMSG_DATA(nlh));
+        InterfaceSnapshot snapshot = {.ifIndex = ifi->ifi_index};
+        unsigned char hwAddr[ETH_ALEN] = {};
+        int len = IFLA_PAYLOAD(nlh);
+        for (rtattr* rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+            if (rta->rta_type == IFLA_IFNAME) {
+                snapshot.ifName = reinterpret_cast<const char*>(RTA_DATA(rta));
+            } else if (rta->rta_type == IFLA_MTU && RTA_PAYLOAD(rta) >= sizeof(uint32_t)) {
+                snapshot.mtu = *reinterpret_cast<const uint32_t*>(RTA_DATA(rta));
+            } else if (rta->rta_type == IFLA_ADDRESS) {
+                memcpy(hwAddr, RTA_DATA(rta), std::min<size_t>(RTA_PAYLOAD(rta), ETH_ALEN));
+            }
+        }
+        snapshot.hwAddr = hwAddrToStr(hwAddr);
+        snapshot.flags = flagsToStrings(ifi->ifi_flags);
+        positions[snapshot.ifIndex] = snapshots.size();
+        snapshots.push_back(std::move(snapshot));
+    };
+    std::vector<int> results;
+    RETURN_IF_NOT_OK(sendRtNetlinkBatch(&linkDump, onLink, &results));
+    if (results[0] != 0) {
+        return statusFromErrno(-results[0], "Failed to dump links");
+    }
+
+    ifaddrmsg addrMsg = {.ifa_family = AF_UNSPEC};
+    iovec addrIov[] = {
+            {nullptr, 0},
+            {&addrMsg, sizeof(addrMsg)},
+    };
+    NetlinkBatch addrDump;
+    addrDump.add(RTM_GETADDR, NETLINK_DUMP_FLAGS, addrIov, ARRAY_SIZE(addrIov));
+    const auto onAddr = [&snapshots, &positions](size_t, nlmsghdr* nlh) {
+        if (nlh->nlmsg_type != RTM_NEWADDR) return;
+        const ifaddrmsg* ifa = reinterpret_cast<ifaddrmsg*>(NLMSG_DATA(nlh));
+        const auto it = positions.find(ifa->ifa_index);
+        // Skip addresses of links that appeared after the link dump.
+        if (it == positions.end()) return;
+        // For IPv4, IFA_LOCAL is the address of the interface and IFA_ADDRESS may be the peer.
+        const void* addr = nullptr;
+        int len = IFA_PAYLOAD(nlh);
+        for (rtattr* rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+            if (rta->rta_type == IFA_LOCAL || (rta->rta_type == IFA_ADDRESS && addr == nullptr)) {
+                addr = RTA_DATA(rta);
+            }
+        }
+        char addrStr[INET6_ADDRSTRLEN];
+        if (addr == nullptr || !inet_ntop(ifa->ifa_family, addr, addrStr, sizeof(addrStr))) {
+            return;
+        }
+        snapshots[it->second].addresses.push_back(
+                StringPrintf("%s/%d", addrStr, ifa->ifa_prefixlen));
+    };
+    RETURN_IF_NOT_OK(sendRtNetlinkBatch(&addrDump, onAddr, &results));
+    if (results[0] != 0) {
+        return statusFromErrno(-results[0], "Failed to dump addresses");
+    }
+
+    // The link dump is usually, but not necessarily, in ifindex order.
+    std::sort(snapshots.begin(), snapshots.end(),
+              [](const InterfaceSnapshot& a, const InterfaceSnapshot& b) {
+                  return a.ifIndex < b.ifIndex;
+              });
+    return snapshots;
+}
+
 int InterfaceController::clearAddrs(const std::string& ifName) {
     return ifc_clear_addresses(ifName.c_str());
 }
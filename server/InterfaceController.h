@@ -19,20 +19,37 @@
 
 #include <functional>
 #include <map>
+#include <shared_mutex>
 #include <string>
+#include <vector>
 
 #include <android/net/InterfaceConfigurationParcel.h>
 #include <netdutils/Status.h>
 #include <netdutils/StatusOr.h>
 
+#include "SysctlBatch.h"
+
 namespace android {
 namespace net {
 
 class StablePrivacyTest;
 
+// The configuration of one interface, as returned by InterfaceController::getCfgAll().
+struct InterfaceSnapshot {
+    std::string ifName;
+    int ifIndex = 0;
+    int mtu = 0;
+    // IF_STATE_UP or IF_STATE_DOWN, followed by the IF_FLAG_* names of the flags that are set.
+    std::vector<std::string> flags;
+    std::string hwAddr;
+    // Every IPv4 and IPv6 address, as "address/prefixlength".
+    std::vector<std::string> addresses;
+};
+
 class InterfaceController {
 public:
-    static void initializeAll();
+    // Applies the initial sysctl settings to every interface. Returns what was written.
+    static SysctlBatch::Stats initializeAll();
 
     static int setEnableIPv6(const char* ifName, const int on);
     static android::netdutils::Status setIPv6AddrGenMode(const std::string& ifName, int mode);
@@ -44,22 +61,30 @@ public:
     static int addAddress(const char* ifName, const char* addrString, int prefixLength);
     static int delAddress(const char* ifName, const char* addrString, int prefixLength);
     static int disableIcmpRedirects();
+    // Queues the writes of disableIcmpRedirects() on |batch| instead of applying them. Returns the
+    // index of the first one.
+    static size_t disableIcmpRedirects(SysctlBatch* batch);
     static android::netdutils::Status setCfg(const InterfaceConfigurationParcel& cfg);
     static android::netdutils::StatusOr<InterfaceConfigurationParcel> getCfg(
             const std::string& ifName);
+    // Returns every interface, in ifindex order, from one link dump and one address dump.
+    static android::netdutils::StatusOr<std::vector<InterfaceSnapshot>> getCfgAll();
     static int clearAddrs(const std::string& ifName);
 
     // Read and write values in files of the form:
     //     /proc/sys/net/<family>/<which>/<ifName>/<parameter>
     //
     // NOTE: getParameter() trims whitespace so the caller does not need extra
-    // code to crop trailing newlines, for example.
+    // code to crop trailing newlines, for example. Values are read through gSysctlCache.
     static int getParameter(const char* family, const char* which, const char* ifName,
                             const char* parameter, std::string* value);
     static int setParameter(const char* family, const char* which, const char* ifName,
                             const char* parameter, const char* value);
 
-    static std::mutex mutex;
+    // Returns the lock that serializes configuration changes to |ifName|. RPCs that only read an
+    // interface's configuration take it shared. Interfaces share a fixed number of locks, so two
+    // interfaces may occasionally share one.
+    static std::shared_mutex& lockFor(const std::string& ifName);
 
   private:
     friend class android::net::StablePrivacyTest;
@@ -74,10 +99,10 @@ public:
             const std::string& ifName, const GetPropertyFn& getProperty,
             const SetPropertyFn& setProperty);
 
-    static void setAcceptRA(const char* value);
-    static void setAcceptRARouteTable(int tableOrOffset);
-    static void setBaseReachableTimeMs(unsigned int millis);
-    static void setIPv6OptimisticMode(const char* value);
+    static void setAcceptRA(SysctlBatch* batch, const char* value);
+    static void setAcceptRARouteTable(SysctlBatch* batch, int tableOrOffset);
+    static void setBaseReachableTimeMs(SysctlBatch* batch, unsigned int millis);
+    static void setIPv6OptimisticMode(SysctlBatch* batch, const char* value);
 
     InterfaceController() = delete;
     ~InterfaceController() = delete;
@@ -18,6 +18,8 @@
 #include <net/if.h>
 #include <sys/types.h>
 
+#include <algorithm>
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
@@ -211,5 +213,65 @@ TEST_F(GetIfaceListTest, IfaceExist) {
     freeifaddrs(ifaddr);
 }
 
+class InterfaceCfgTest : public NetNativeTestBase {};
+
+TEST_F(InterfaceCfgTest, GetCfgLoopback) {
+    const auto cfg = InterfaceController::getCfg("lo");
+    ASSERT_EQ(ok, cfg.status());
+    EXPECT_EQ("lo", cfg.value().ifName);
+    EXPECT_EQ("127.0.0.1", cfg.value().ipv4Addr);
+    EXPECT_EQ(8, cfg.value().prefixLength);
+    EXPECT_EQ("00:00:00:00:00:00", cfg.value().hwAddr);
+    const auto& flags = cfg.value().flags;
+    EXPECT_THAT(flags, testing::Contains("up"));
+    EXPECT_THAT(flags, testing::Contains("loopback"));
+}
+
+TEST_F(InterfaceCfgTest, GetCfgNonexistentInterface) {
+    // A missing interface is reported as down with no address rather than as an error.
+    const auto cfg = InterfaceController::getCfg("nosuchiface0");
+    ASSERT_EQ(ok, cfg.status());
+    EXPECT_EQ("0.0.0.0", cfg.value().ipv4Addr);
+    EXPECT_EQ(0, cfg.value().prefixLength);
+    EXPECT_EQ(std::vector<std::string>{"down"}, cfg.value().flags);
+}
+
+TEST_F(InterfaceCfgTest, GetCfgAllMatchesGetCfg) {
+    const auto snapshots = InterfaceController::getCfgAll();
+    ASSERT_EQ(ok, snapshots.status());
+    StatusOr<std::vector<std::string>> ifaceNames = getIfaceNames();
+    ASSERT_EQ(ok, ifaceNames.status());
+    EXPECT_EQ(ifaceNames.value().size(), snapshots.value().size());
+    EXPECT_TRUE(std::is_sorted(snapshots.value().begin(), snapshots.value().end(),
+                               [](const InterfaceSnapshot& a, const InterfaceSnapshot& b) {
+                                   return a.ifIndex < b.ifIndex;
+                               }));
+
+    for (const InterfaceSnapshot& snapshot : snapshots.value()) {
+        EXPECT_EQ(if_nametoindex(snapshot.ifName.c_str()), static_cast<unsigned>(snapshot.ifIndex));
+        const auto cfg = InterfaceController::getCfg(snapshot.ifName);
+        ASSERT_EQ(ok, cfg.status());
+        EXPECT_EQ(cfg.value().hwAddr, snapshot.hwAddr);
+        EXPECT_EQ(cfg.value().flags, snapshot.flags);
+        if (cfg.value().ipv4Addr != "0.0.0.0") {
+            const std::string primary =
+                    cfg.value().ipv4Addr + "/" + std::to_string(cfg.value().prefixLength);
+            EXPECT_THAT(snapshot.addresses, testing::Contains(primary));
+        }
+    }
+}
+
+TEST_F(InterfaceCfgTest, SetCfgInvalidAddress) {
+    InterfaceConfigurationParcel cfg;
+    cfg.ifName = "lo";
+    cfg.ipv4Addr = "not.an.address";
+    cfg.prefixLength = 8;
+    EXPECT_EQ(EINVAL, InterfaceController::setCfg(cfg).code());
+
+    cfg.ipv4Addr = "127.0.0.1";
+    cfg.prefixLength = 33;
+    EXPECT_EQ(EINVAL, InterfaceController::setCfg(cfg).code());
+}
+
 }  // namespace net
 }  // namespace android
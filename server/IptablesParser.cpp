@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "IptablesParser.h"
+
+#include <algorithm>
+#include <charconv>
+
+namespace android::net {
+
+namespace {
+
+constexpr std::string_view kFieldSeparators = " \t";
+
+}  // namespace
+
+bool LineTokenizer::next(std::string_view* line) {
+    if (mRest.empty()) return false;
+    const size_t end = mRest.find('\n');
+    if (end == std::string_view::npos) {
+        *line = mRest;
+        mRest = {};
+    } else {
+        *line = mRest.substr(0, end);
+        mRest.remove_prefix(end + 1);
+    }
+    return true;
+}
+
+bool FieldTokenizer::next(std::string_view* field) {
+    const size_t start = mRest.find_first_not_of(kFieldSeparators);
+    if (start == std::string_view::npos) {
+        mRest = {};
+        return false;
+    }
+    mRest.remove_prefix(start);
+    const size_t end = std::min(mRest.find_first_of(kFieldSeparators), mRest.size());
+    *field = mRest.substr(0, end);
+    mRest.remove_prefix(end);
+    return true;
+}
+
+bool parseJumpRule(std::string_view line, std::string_view* parent, std::string_view* child) {
+    // iptables separates the words of a rule with exactly one space.
+    constexpr std::string_view kAppend = "-A ";
+    constexpr std::string_view kJump = " -j ";
+    if (line.substr(0, kAppend.size()) != kAppend) return false;
+    line.remove_prefix(kAppend.size());
+
+    const size_t jump = line.find(kJump);
+    if (jump == 0 || jump == std::string_view::npos) return false;
+    const std::string_view p = line.substr(0, jump);
+    const std::string_view c = line.substr(jump + kJump.size());
+    if (p.find(' ') != std::string_view::npos || c.empty() || c.find(' ') != std::string_view::npos) {
+        return false;
+    }
+    *parent = p;
+    *child = c;
+    return true;
+}
+
+bool parseNewChain(std::string_view line, std::string_view* chain) {
+    constexpr std::string_view kNewChain = "-N ";
+    if (line.substr(0, kNewChain.size()) != kNewChain) return false;
+    *chain = line.substr(kNewChain.size());
+    return true;
+}
+
+bool parseCounter(std::string_view field, int64_t* value) {
+    const char* end = field.data() + field.size();
+    if (field.empty() || field[0] < '0' || field[0] > '9') return false;
+    const auto [ptr, ec] = std::from_chars(field.data(), end, *value);
+    return ec == std::errc() && ptr == end;
+}
+
+}  // namespace android::net
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string_view>
+
+namespace android::net {
+
+// Readers for the output of iptables, such as the rules printed by "-S" or the counters printed by
+// "-nvx -L". They do not copy: the string_views they return point into the text being read.
+
+// Splits text into lines. A newline at the end of the text does not start another line.
+class LineTokenizer {
+  public:
+    explicit LineTokenizer(std::string_view text) : mRest(text) {}
+
+    // Sets |line| to the next line, without its newline. Returns false at the end of the text.
+    bool next(std::string_view* line);
+
+  private:
+    std::string_view mRest;
+};
+
+// Splits a line into fields separated by spaces or tabs.
+class FieldTokenizer {
+  public:
+    explicit FieldTokenizer(std::string_view line) : mRest(line) {}
+
+    // Sets |field| to the next field. Returns false if there are no more fields.
+    bool next(std::string_view* field);
+
+  private:
+    std::string_view mRest;
+};
+
+// Parses a line of "-S" output of the form "-A <parent> -j <child>", with nothing else in it.
+// These are the rules that hook netd's child chains into their parents.
+bool parseJumpRule(std::string_view line, std::string_view* parent, std::string_view* child);
+
+// Parses a line of "-S" output of the form "-N <chain>".
+bool parseNewChain(std::string_view line, std::string_view* chain);
+
+// Parses a field that consists only of decimal digits.
+bool parseCounter(std::string_view field, int64_t* value);
+
+}  // namespace android::net
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IptablesParserTest.cpp - unit tests for IptablesParser.cpp
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <netdutils/NetNativeTestBase.h>
+
+#include "IptablesParser.h"
+
+using testing::ElementsAre;
+
+namespace android::net {
+
+class IptablesParserTest : public NetNativeTestBase {
+  protected:
+    static std::vector<std::string_view> lines(std::string_view text) {
+        std::vector<std::string_view> result;
+        LineTokenizer tokenizer(text);
+        std::string_view line;
+        while (tokenizer.next(&line)) result.push_back(line);
+        return result;
+    }
+
+    static std::vector<std::string_view> fields(std::string_view line) {
+        std::vector<std::string_view> result;
+        FieldTokenizer tokenizer(line);
+        std::string_view field;
+        while (tokenizer.next(&field)) result.push_back(field);
+        return result;
+    }
+};
+
+TEST_F(IptablesParserTest, Lines) {
+    EXPECT_THAT(lines(""), ElementsAre());
+    EXPECT_THAT(lines("a"), ElementsAre("a"));
+    EXPECT_THAT(lines("a\n"), ElementsAre("a"));
+    EXPECT_THAT(lines("a\n\nb"), ElementsAre("a", "", "b"));
+    EXPECT_THAT(lines("\n"), ElementsAre(""));
+}
+
+TEST_F(IptablesParserTest, Fields) {
+    EXPECT_THAT(fields(""), ElementsAre());
+    EXPECT_THAT(fields("  \t "), ElementsAre());
+    EXPECT_THAT(fields("      26     2373 RETURN     all  --  wlan0\trmnet0  ::/0"),
+                ElementsAre("26", "2373", "RETURN", "all", "--", "wlan0", "rmnet0", "::/0"));
+}
+
+TEST_F(IptablesParserTest, JumpRule) {
+    std::string_view parent, child;
+    EXPECT_TRUE(parseJumpRule("-A OUTPUT -j oem_out", &parent, &child));
+    EXPECT_EQ("OUTPUT", parent);
+    EXPECT_EQ("oem_out", child);
+
+    // Anything other than exactly "-A <parent> -j <child>" is not one of our rules.
+    for (const char* line : {
+                 "-P OUTPUT ACCEPT",
+                 "-N oem_out",
+                 "-A OUTPUT -o r_rmnet_data8 -p udp -m udp --dport 1900 -j DROP",
+                 "-A OUTPUT -j oem_out ",
+                 "-A OUTPUT -j ",
+                 "-A  -j oem_out",
+                 "-I OUTPUT -j oem_out",
+                 " -A OUTPUT -j oem_out",
+         }) {
+        EXPECT_FALSE(parseJumpRule(line, &parent, &child)) << line;
+    }
+}
+
+TEST_F(IptablesParserTest, NewChain) {
+    std::string_view chain;
+    EXPECT_TRUE(parseNewChain("-N bw_costly_rmnet_data0", &chain));
+    EXPECT_EQ("bw_costly_rmnet_data0", chain);
+    EXPECT_FALSE(parseNewChain("-A bw_costly_shared -j RETURN", &chain));
+    EXPECT_FALSE(parseNewChain("-P INPUT ACCEPT", &chain));
+}
+
+TEST_F(IptablesParserTest, Counter) {
+    int64_t value;
+    EXPECT_TRUE(parseCounter("1708806", &value));
+    EXPECT_EQ(1708806, value);
+    EXPECT_TRUE(parseCounter("0", &value));
+    EXPECT_EQ(0, value);
+    for (const char* field : {"", "-1", "+1", "12k", "RETURN", "99999999999999999999"}) {
+        EXPECT_FALSE(parseCounter(field, &value)) << field;
+    }
+}
+
+}  // namespace android::net
@@ -22,14 +22,19 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <chrono>
+
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
 #include <netdutils/Syscalls.h>
 
 #include "Controllers.h"
+#include "EventLog.h"
 #include "NetdConstants.h"
 
+using android::net::NetdEvent;
+using android::net::gEventLog;
 using android::netdutils::StatusOr;
 using android::netdutils::sSyscalls;
 
@@ -342,6 +347,7 @@ int IptablesRestoreController::execute(const IptablesTarget target, const std::s
         output->clear();
     }
 
+    const auto start = std::chrono::steady_clock::now();
     int res = 0;
     if (target == V4 || target == V4V6) {
         res |= sendCommand(IPTABLES_PROCESS, command, output);
@@ -349,6 +355,11 @@ int IptablesRestoreController::execute(const IptablesTarget target, const std::s
     if (target == V6 || target == V4V6) {
         res |= sendCommand(IP6TABLES_PROCESS, command, output);
     }
+    const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+    gEventLog.log(NetdEvent::IPTABLES_RESTORE,
+                  {.str = std::string_view(command).substr(0, command.find('\n')),
+                   .ints = {target, static_cast<int64_t>(command.size()), duration.count(), res}});
     return res;
 }
 
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LockStats.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <mutex>
+
+using android::netdutils::DumpWriter;
+using android::netdutils::ScopedIndent;
+using std::chrono::microseconds;
+
+namespace android::net {
+
+namespace {
+
+std::mutex sRegistryLock;
+
+thread_local uint64_t tWaitUs = 0;
+
+std::vector<const LockStats*>& registry() {
+    // Never destroyed, because LockStats objects may still be used while static objects are being
+    // destroyed.
+    static auto* stats = new std::vector<const LockStats*>();
+    return *stats;
+}
+
+void updateMax(std::atomic<uint64_t>* max, uint64_t value) {
+    uint64_t current = max->load(std::memory_order_relaxed);
+    while (value > current &&
+           !max->compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t average(microseconds total, uint64_t count) {
+    return count ? total.count() / count : 0;
+}
+
+}  // namespace
+
+LockStats::LockStats(const char* lockName, const char* caller)
+    : mLockName(lockName), mCaller(caller) {
+    std::lock_guard guard(sRegistryLock);
+    registry().push_back(this);
+}
+
+void LockStats::record(microseconds wait, microseconds hold) {
+    tWaitUs += wait.count();
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    mTotalWaitUs.fetch_add(wait.count(), std::memory_order_relaxed);
+    mTotalHoldUs.fetch_add(hold.count(), std::memory_order_relaxed);
+    updateMax(&mMaxWaitUs, wait.count());
+    updateMax(&mMaxHoldUs, hold.count());
+}
+
+microseconds LockStats::threadWaitTime() {
+    return microseconds(tWaitUs);
+}
+
+LockStats::Snapshot LockStats::snapshot() const {
+    // The counters are read one by one, so they may be slightly out of step with each other.
+    return {
+            .lockName = mLockName,
+            .caller = mCaller,
+            .count = mCount.load(std::memory_order_relaxed),
+            .totalWait = microseconds(mTotalWaitUs.load(std::memory_order_relaxed)),
+            .maxWait = microseconds(mMaxWaitUs.load(std::memory_order_relaxed)),
+            .totalHold = microseconds(mTotalHoldUs.load(std::memory_order_relaxed)),
+            .maxHold = microseconds(mMaxHoldUs.load(std::memory_order_relaxed)),
+    };
+}
+
+std::vector<LockStats::Snapshot> LockStats::snapshotAll() {
+    std::vector<Snapshot> snapshots;
+    {
+        std::lock_guard guard(sRegistryLock);
+        for (const LockStats* stats : registry()) {
+            Snapshot snapshot = stats->snapshot();
+            if (snapshot.count > 0) snapshots.push_back(std::move(snapshot));
+        }
+    }
+    std::stable_sort(snapshots.begin(), snapshots.end(),
+                     [](const Snapshot& a, const Snapshot& b) { return a.totalWait > b.totalWait; });
+    return snapshots;
+}
+
+void LockStats::dumpAll(DumpWriter& dw) {
+    ScopedIndent indent(dw);
+    dw.println("Lock statistics (wait and hold times in us):");
+    ScopedIndent indentStats(dw);
+    for (const Snapshot& s : snapshotAll()) {
+        dw.println("%s in %s: count=%" PRIu64 " wait avg=%" PRIu64 " max=%" PRId64
+                   " total=%" PRId64 " hold avg=%" PRIu64 " max=%" PRId64 " total=%" PRId64,
+                   s.lockName.c_str(), s.caller.c_str(), s.count, average(s.totalWait, s.count),
+                   static_cast<int64_t>(s.maxWait.count()),
+                   static_cast<int64_t>(s.totalWait.count()), average(s.totalHold, s.count),
+                   static_cast<int64_t>(s.maxHold.count()),
+                   static_cast<int64_t>(s.totalHold.count()));
+    }
+}
+
+}  // namespace android::net
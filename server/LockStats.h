@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <netdutils/DumpWriter.h>
+
+namespace android::net {
+
+// How long one caller waited for and held one lock. Meant to be a static local at each place that
+// takes the lock, so that dumpsys netd shows which RPCs keep binder threads waiting.
+class LockStats {
+  public:
+    struct Snapshot {
+        std::string lockName;
+        std::string caller;
+        uint64_t count;
+        std::chrono::microseconds totalWait;
+        std::chrono::microseconds maxWait;
+        std::chrono::microseconds totalHold;
+        std::chrono::microseconds maxHold;
+    };
+
+    // Registers this object. It must never be destroyed.
+    LockStats(const char* lockName, const char* caller);
+    LockStats(const LockStats&) = delete;
+    LockStats& operator=(const LockStats&) = delete;
+
+    void record(std::chrono::microseconds wait, std::chrono::microseconds hold);
+    Snapshot snapshot() const;
+
+    // Returns how long the calling thread has waited for locks recorded by any LockStats, in
+    // total. Subtracting two readings gives the wait of the code that ran in between.
+    static std::chrono::microseconds threadWaitTime();
+
+    // Returns every registered LockStats that was recorded at least once, most waited for first.
+    static std::vector<Snapshot> snapshotAll();
+    static void dumpAll(netdutils::DumpWriter& dw);
+
+  private:
+    const char* const mLockName;
+    const char* const mCaller;
+    std::atomic<uint64_t> mCount = 0;
+    std::atomic<uint64_t> mTotalWaitUs = 0;
+    std::atomic<uint64_t> mMaxWaitUs = 0;
+    std::atomic<uint64_t> mTotalHoldUs = 0;
+    std::atomic<uint64_t> mMaxHoldUs = 0;
+};
+
+// Like std::lock_guard, or std::shared_lock if Shared is true, but records into a LockStats how
+// long it took to get the lock and how long it was held.
+template <typename Mutex, bool Shared = false>
+class TimedLockGuard {
+  public:
+    TimedLockGuard(Mutex& mutex, LockStats* stats) : mMutex(mutex), mStats(stats) {
+        const Clock::time_point start = Clock::now();
+        if constexpr (Shared) {
+            mMutex.lock_shared();
+        } else {
+            mMutex.lock();
+        }
+        mAcquired = Clock::now();
+        mWait = mAcquired - start;
+    }
+
+    ~TimedLockGuard() {
+        const Clock::duration hold = Clock::now() - mAcquired;
+        if constexpr (Shared) {
+            mMutex.unlock_shared();
+        } else {
+            mMutex.unlock();
+        }
+        using std::chrono::duration_cast;
+        using std::chrono::microseconds;
+        mStats->record(duration_cast<microseconds>(mWait), duration_cast<microseconds>(hold));
+    }
+
+    TimedLockGuard(const TimedLockGuard&) = delete;
+    TimedLockGuard& operator=(const TimedLockGuard&) = delete;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    Mutex& mMutex;
+    LockStats* const mStats;
+    Clock::time_point mAcquired;
+    Clock::duration mWait;
+};
+
+template <typename Mutex>
+using TimedSharedLockGuard = TimedLockGuard<Mutex, true>;
+
+}  // namespace android::net
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * LockStatsTest.cpp - unit tests for LockStats.cpp
+ */
+
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include <netdutils/NetNativeTestBase.h>
+
+#include "LockStats.h"
+
+using namespace std::chrono_literals;
+using std::chrono::microseconds;
+
+namespace android::net {
+
+class LockStatsTest : public NetNativeTestBase {
+  protected:
+    static const LockStats::Snapshot* find(const std::vector<LockStats::Snapshot>& snapshots,
+                                           const std::string& caller) {
+        for (const LockStats::Snapshot& snapshot : snapshots) {
+            if (snapshot.caller == caller) return &snapshot;
+        }
+        return nullptr;
+    }
+};
+
+TEST_F(LockStatsTest, Record) {
+    static LockStats stats("lock", "Record");
+    stats.record(10us, 100us);
+    stats.record(30us, 50us);
+
+    const LockStats::Snapshot snapshot = stats.snapshot();
+    EXPECT_EQ("lock", snapshot.lockName);
+    EXPECT_EQ(2U, snapshot.count);
+    EXPECT_EQ(40us, snapshot.totalWait);
+    EXPECT_EQ(30us, snapshot.maxWait);
+    EXPECT_EQ(150us, snapshot.totalHold);
+    EXPECT_EQ(100us, snapshot.maxHold);
+}
+
+TEST_F(LockStatsTest, SnapshotAllSkipsUnusedAndSortsByWait) {
+    static LockStats unused("lock", "Unused");
+    static LockStats shortWait("lock", "ShortWait");
+    static LockStats longWait("lock", "LongWait");
+    shortWait.record(1us, 1us);
+    longWait.record(1000000us, 1us);
+
+    const std::vector<LockStats::Snapshot> snapshots = LockStats::snapshotAll();
+    EXPECT_EQ(nullptr, find(snapshots, "Unused"));
+    ASSERT_NE(nullptr, find(snapshots, "ShortWait"));
+    ASSERT_NE(nullptr, find(snapshots, "LongWait"));
+    EXPECT_LT(find(snapshots, "LongWait"), find(snapshots, "ShortWait"));
+}
+
+TEST_F(LockStatsTest, TimedLockGuard) {
+    static LockStats stats("mutex", "TimedLockGuard");
+    std::mutex mutex;
+    {
+        TimedLockGuard guard(mutex, &stats);
+        EXPECT_FALSE(mutex.try_lock());
+        std::this_thread::sleep_for(5ms);
+    }
+    EXPECT_TRUE(mutex.try_lock());
+    mutex.unlock();
+
+    const LockStats::Snapshot snapshot = stats.snapshot();
+    EXPECT_EQ(1U, snapshot.count);
+    EXPECT_GE(snapshot.maxHold, 5ms);
+}
+
+TEST_F(LockStatsTest, TimedSharedLockGuard) {
+    static LockStats stats("mutex", "TimedSharedLockGuard");
+    std::shared_mutex mutex;
+    {
+        TimedSharedLockGuard<std::shared_mutex> guard1(mutex, &stats);
+        TimedSharedLockGuard<std::shared_mutex> guard2(mutex, &stats);
+        EXPECT_FALSE(mutex.try_lock());
+    }
+    EXPECT_TRUE(mutex.try_lock());
+    mutex.unlock();
+    EXPECT_EQ(2U, stats.snapshot().count);
+}
+
+TEST_F(LockStatsTest, WaitIsRecorded) {
+    static LockStats stats("mutex", "WaitIsRecorded");
+    std::mutex mutex;
+    mutex.lock();
+    microseconds threadWait;
+    std::thread waiter([&] {
+        { TimedLockGuard guard(mutex, &stats); }
+        threadWait = LockStats::threadWaitTime();
+    });
+    std::this_thread::sleep_for(10ms);
+    mutex.unlock();
+    waiter.join();
+    EXPECT_GE(stats.snapshot().maxWait, 10ms);
+    EXPECT_EQ(stats.snapshot().maxWait, threadWait);
+}
+
+}  // namespace android::net
@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <linux/if.h>
 #include <netinet/in.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -35,11 +36,13 @@
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <android/multinetwork.h>
+#include <com/android/internal/net/IOemNetd.h>
 #include <netdutils/ResponseCode.h>
 #include <netdutils/Status.h>
 #include <netdutils/StatusOr.h>
 #include <netutils/ifc.h>
 
+#include "NdcCommandLine.h"
 #include "NetdConstants.h"
 #include "NetworkController.h"
 #include "Permission.h"
@@ -49,6 +52,9 @@
 using android::base::Join;
 using android::base::StringPrintf;
 using android::binder::Status;
+using com::android::internal::net::IdletimerChangeParcel;
+using com::android::internal::net::IOemNetd;
+using com::android::internal::net::RouteParcel;
 
 #define PARSE_INT_RETURN_IF_FAIL(cli, label, intLabel, errMsg, addErrno)         \
     do {                                                                         \
@@ -161,6 +167,170 @@ int NdcDispatcher::dispatchCommand(int argc, char** argv) {
     return 0;
 }
 
+int NdcDispatcher::dispatchBatchLine(int lineNumber, const std::vector<std::string>& words) {
+    std::vector<char*> argv;
+    for (const std::string& word : words) {
+        argv.push_back(const_cast<char*>(word.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    mNdc.startCommand(lineNumber);
+    dispatchCommand(words.size(), argv.data());
+    return mNdc.failed() ? 1 : 0;
+}
+
+int NdcDispatcher::flushBatchedRoutes(std::vector<BatchedRoute>* routes) {
+    int failures = 0;
+    std::vector<int32_t> results;
+    Status status = Status::fromExceptionCode(Status::EX_UNSUPPORTED_OPERATION);
+    if (routes->size() > 1) {
+        sp<IBinder> binder;
+        if (mNetd->getOemNetd(&binder).isOk() && binder != nullptr) {
+            std::vector<RouteParcel> parcels;
+            for (const BatchedRoute& route : *routes) {
+                RouteParcel parcel;
+                parcel.ifName = route.words[4];
+                parcel.destination = route.words[5];
+                parcel.nextHop = route.words.size() > 6 ? route.words[6] : "";
+                parcel.mtu = 0;
+                parcels.push_back(std::move(parcel));
+            }
+            status = interface_cast<IOemNetd>(binder)->networkAddRoutes(routes->front().netId,
+                                                                         parcels, &results);
+        }
+    }
+
+    if (!status.isOk() && status.exceptionCode() != Status::EX_SERVICE_SPECIFIC) {
+        // A single route, or a netd without networkAddRoutes.
+        for (const BatchedRoute& route : *routes) {
+            failures += dispatchBatchLine(route.lineNumber, route.words);
+        }
+    } else {
+        // Report each route as "network route add" would have.
+        for (size_t i = 0; i < routes->size(); i++) {
+            mNdc.startCommand((*routes)[i].lineNumber);
+            int error = status.serviceSpecificErrorCode();
+            if (status.isOk()) error = (i < results.size()) ? results[i] : EIO;
+            if (error) {
+                errno = error;
+                mNdc.sendMsg(ResponseCode::OperationFailed, "addRoute() failed", true);
+                failures++;
+            } else {
+                mNdc.sendMsg(ResponseCode::CommandOkay, "success", false);
+            }
+        }
+    }
+    routes->clear();
+    return failures;
+}
+
+int NdcDispatcher::flushBatchedIdletimers(std::vector<BatchedIdletimer>* idletimers) {
+    int failures = 0;
+    std::vector<int32_t> results;
+    Status status = Status::fromExceptionCode(Status::EX_UNSUPPORTED_OPERATION);
+    if (idletimers->size() > 1) {
+        sp<IBinder> binder;
+        if (mNetd->getOemNetd(&binder).isOk() && binder != nullptr) {
+            std::vector<IdletimerChangeParcel> parcels;
+            for (const BatchedIdletimer& idletimer : *idletimers) {
+                IdletimerChangeParcel parcel;
+                parcel.add = (idletimer.words[1] == "add");
+                parcel.ifName = idletimer.words[2];
+                parcel.timeout = idletimer.timeout;
+                parcel.classLabel = idletimer.words[4];
+                parcels.push_back(std::move(parcel));
+            }
+            status = interface_cast<IOemNetd>(binder)->idletimerModifyInterfaces(parcels,
+                                                                                 &results);
+        }
+    }
+
+    if (!status.isOk() && status.exceptionCode() != Status::EX_SERVICE_SPECIFIC) {
+        // A single command, or a netd without idletimerModifyInterfaces.
+        for (const BatchedIdletimer& idletimer : *idletimers) {
+            failures += dispatchBatchLine(idletimer.lineNumber, idletimer.words);
+        }
+    } else {
+        // Report each command as "idletimer add" or "idletimer remove" would have.
+        for (size_t i = 0; i < idletimers->size(); i++) {
+            const bool add = ((*idletimers)[i].words[1] == "add");
+            mNdc.startCommand((*idletimers)[i].lineNumber);
+            int error = status.serviceSpecificErrorCode();
+            if (status.isOk()) error = (i < results.size()) ? results[i] : EIO;
+            if (error) {
+                mNdc.sendMsg(ResponseCode::OperationFailed,
+                             add ? "Failed to add interface" : "Failed to remove interface", false);
+                failures++;
+            } else {
+                mNdc.sendMsg(ResponseCode::CommandOkay, add ? "Add success" : "Remove success",
+                             false);
+            }
+        }
+    }
+    idletimers->clear();
+    return failures;
+}
+
+int NdcDispatcher::dispatchBatch(FILE* in) {
+    int failures = 0;
+    int lineNumber = 0;
+    char* line = nullptr;
+    size_t lineSize = 0;
+    std::vector<BatchedRoute> routes;
+    std::vector<BatchedIdletimer> idletimers;
+    while (getline(&line, &lineSize, in) != -1) {
+        lineNumber++;
+        std::vector<std::string> words;
+        if (!splitNdcCommandLine(line, &words)) {
+            mNdc.startCommand(lineNumber);
+            mNdc.sendMsg(ResponseCode::CommandSyntaxError, "Unterminated quote or escape", false);
+            failures++;
+            continue;
+        }
+        if (words.empty()) continue;
+
+        //    0      1    2     3         4           5            6
+        // network route add <netId> <interface> <destination> [nexthop]
+        //
+        // Consecutive route additions to the same network are sent to netd together.
+        const bool isRouteAdd = (words.size() == 6 || words.size() == 7) &&
+                                words[0] == "network" && words[1] == "route" && words[2] == "add";
+        const unsigned netId = isRouteAdd ? stringToNetId(words[3].c_str()) : NETID_UNSET;
+        if (!routes.empty() && (!isRouteAdd || netId != routes.front().netId)) {
+            failures += flushBatchedRoutes(&routes);
+        }
+
+        //     0           1          2         3        4
+        // idletimer <add|remove> <interface> <timeout> <label>
+        //
+        // Consecutive idletimer changes are sent to netd together. Lines with a bad timeout are
+        // left to IdletimerControlCmd, which reports the error.
+        int timeout = 0;
+        const bool isIdletimer = words.size() == 5 && words[0] == "idletimer" &&
+                                 (words[1] == "add" || words[1] == "remove") &&
+                                 android::base::ParseInt(words[3], &timeout);
+        if (!idletimers.empty() && !isIdletimer) {
+            failures += flushBatchedIdletimers(&idletimers);
+        }
+
+        if (isRouteAdd) {
+            routes.push_back({lineNumber, netId, std::move(words)});
+            continue;
+        }
+        if (isIdletimer) {
+            idletimers.push_back({lineNumber, timeout, std::move(words)});
+            continue;
+        }
+
+        failures += dispatchBatchLine(lineNumber, words);
+    }
+    failures += flushBatchedRoutes(&routes);
+    failures += flushBatchedIdletimers(&idletimers);
+    free(line);
+    mNdc.startCommand(0);
+    return failures;
+}
+
 NdcDispatcher::InterfaceCmd::InterfaceCmd() : NdcNetdCommand("interface") {}
 
 int NdcDispatcher::InterfaceCmd::runCommand(NdcClient* cli, int argc, char** argv) const {
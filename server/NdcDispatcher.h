@@ -18,6 +18,7 @@
 #define _NDC_DISPATCHER_H__
 
 #include <string>
+#include <vector>
 
 #include <android-base/logging.h>
 #include <android/net/IDnsResolver.h>
@@ -36,12 +37,27 @@ class NdcClient {
 
     int sendMsg(int code, const char* msg, bool addErrno) {
         if (addErrno) {
-            printf("%d 0 %s (%s)\n", code, msg, strerror(errno));
+            printf("%d %d %s (%s)\n", code, mSequence, msg, strerror(errno));
         } else {
-            printf("%d 0 %s\n", code, msg);
+            printf("%d %d %s\n", code, mSequence, msg);
         }
+        // Like the old netd socket protocol, 4xx and 5xx codes report that the command failed.
+        if (code >= 400 && code < 600) mFailed = true;
         return 0;
     }
+
+    // Starts the responses to a new command. In batch mode, |sequence| is the line number of the
+    // command, so that each response can be matched with the command it belongs to.
+    void startCommand(int sequence) {
+        mSequence = sequence;
+        mFailed = false;
+    }
+
+    bool failed() const { return mFailed; }
+
+  private:
+    int mSequence = 0;
+    bool mFailed = false;
 };
 
 class NdcNetdCommand {
@@ -72,9 +88,39 @@ class NdcDispatcher {
     NdcClient mNdc;
 
     int dispatchCommand(int argc, char** argv);
+    // Runs one command per line of |in|, all over the same binder connection, so that scripts
+    // that issue many commands do not start an ndc process for each. Consecutive route additions
+    // to the same network are sent to netd in one call, and so are consecutive idletimer changes,
+    // which netd applies in one iptables-restore. Lines are split as by splitNdcCommandLine().
+    // Returns the number of commands that failed.
+    int dispatchBatch(FILE* in);
     void registerCmd(NdcNetdCommand* cmd);
 
   private:
+    // A "network route add" command read by dispatchBatch().
+    struct BatchedRoute {
+        int lineNumber;
+        unsigned netId;
+        std::vector<std::string> words;
+    };
+
+    // Runs one command of a batch. Returns 1 if it failed, or 0.
+    int dispatchBatchLine(int lineNumber, const std::vector<std::string>& words);
+    // Adds |routes|, which are all for the same network, with one IOemNetd.networkAddRoutes call,
+    // and clears them. Returns the number of routes that failed.
+    int flushBatchedRoutes(std::vector<BatchedRoute>* routes);
+
+    // An "idletimer add" or "idletimer remove" command read by dispatchBatch().
+    struct BatchedIdletimer {
+        int lineNumber;
+        int timeout;
+        std::vector<std::string> words;
+    };
+
+    // Applies |idletimers| with one IOemNetd.idletimerModifyInterfaces call, and clears them.
+    // Returns the number of commands that failed.
+    int flushBatchedIdletimers(std::vector<BatchedIdletimer>* idletimers);
+
     std::vector<NdcNetdCommand*> mCommands;
 
     class InterfaceCmd : public NdcNetdCommand {
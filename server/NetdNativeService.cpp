@@ -16,14 +16,20 @@
 
 #define LOG_TAG "Netd"
 
+#include <algorithm>
+#include <chrono>
 #include <cinttypes>
+#include <functional>
+#include <mutex>
 #include <numeric>
 #include <set>
 #include <string>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 
 #include <android-base/file.h>
+#include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <binder/IPCThreadState.h>
@@ -36,15 +42,19 @@
 #include <utils/Errors.h>
 #include <utils/String16.h>
 
+#include "BinderTelemetry.h"
 #include "Controllers.h"
+#include "EventLog.h"
 #include "Fwmark.h"
 #include "InterfaceController.h"
+#include "LockStats.h"
 #include "NetdNativeService.h"
 #include "OemNetdListener.h"
 #include "Permission.h"
 #include "Process.h"
 #include "RouteController.h"
 #include "SockDiag.h"
+#include "SysctlCache.h"
 #include "UidRanges.h"
 #include "android/net/BnNetd.h"
 #include "binder_utils/BinderUtil.h"
@@ -60,6 +70,9 @@ using android::netdutils::DumpWriter;
 using android::netdutils::getIfaceNames;
 using android::netdutils::ScopedIndent;
 using android::os::ParcelFileDescriptor;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
 
 namespace android {
 namespace net {
@@ -75,11 +88,17 @@ const char OPT_SHORT[] = "--short";
         }                                                          \
     } while (0)
 
-#define NETD_LOCKING_RPC(lock, ... /* permissions */) \
-    ENFORCE_ANY_PERMISSION(__VA_ARGS__);              \
-    std::lock_guard _lock(lock);
+// Holds |lock| for the rest of the RPC, and records how long it waited for and held it.
+#define NETD_LOCKING_RPC(lock, ... /* permissions */)  \
+    ENFORCE_ANY_PERMISSION(__VA_ARGS__);               \
+    static LockStats _lockStats(#lock, __func__);      \
+    TimedLockGuard _lock(lock, &_lockStats);
 
-#define NETD_BIG_LOCK_RPC(... /* permissions */) NETD_LOCKING_RPC(gBigNetdLock, __VA_ARGS__)
+// Like NETD_LOCKING_RPC, but for RPCs that only read what |lock| protects.
+#define NETD_READ_LOCKING_RPC(lock, ... /* permissions */) \
+    ENFORCE_ANY_PERMISSION(__VA_ARGS__);                   \
+    static LockStats _lockStats(#lock, __func__);          \
+    TimedSharedLockGuard<std::remove_reference_t<decltype(lock)>> _lock(lock, &_lockStats);
 
 #define RETURN_BINDER_STATUS_IF_NOT_OK(logEntry, res) \
     do {                                              \
@@ -111,6 +130,154 @@ binder::Status asBinderStatus(const base::Result<T> result) {
                                                     result.error().message().c_str());
 }
 
+std::mutex gRejectNonSecureVpnLock;
+
+// Whether to log every binder call to gLog. Defaults to true except on user builds.
+const char LOG_BINDER_CALLS_PROPERTY[] = "persist.netd.log_binder_calls";
+
+#define NETD_METHOD(name) {BnNetd::TRANSACTION_##name, #name}
+
+// Names of the INetd methods by transaction code, for BinderTelemetry.
+// Method names by index, or nullptr for indices without a method. The names are literals, so they
+// can be logged to gEventLog.
+const std::vector<const char*>& methodNames() {
+    static const std::pair<uint32_t, const char*> methods[] = {
+        NETD_METHOD(isAlive),
+        NETD_METHOD(firewallReplaceUidChain),
+        NETD_METHOD(firewallSetFirewallType),
+        NETD_METHOD(firewallSetInterfaceRule),
+        NETD_METHOD(firewallSetUidRule),
+        NETD_METHOD(firewallEnableChildChain),
+        NETD_METHOD(firewallAddUidInterfaceRules),
+        NETD_METHOD(firewallRemoveUidInterfaceRules),
+        NETD_METHOD(bandwidthEnableDataSaver),
+        NETD_METHOD(bandwidthSetInterfaceQuota),
+        NETD_METHOD(bandwidthRemoveInterfaceQuota),
+        NETD_METHOD(bandwidthSetInterfaceAlert),
+        NETD_METHOD(bandwidthRemoveInterfaceAlert),
+        NETD_METHOD(bandwidthSetGlobalAlert),
+        NETD_METHOD(bandwidthAddNaughtyApp),
+        NETD_METHOD(bandwidthRemoveNaughtyApp),
+        NETD_METHOD(bandwidthAddNiceApp),
+        NETD_METHOD(bandwidthRemoveNiceApp),
+        NETD_METHOD(networkCreatePhysical),
+        NETD_METHOD(networkCreateVpn),
+        NETD_METHOD(networkCreate),
+        NETD_METHOD(networkDestroy),
+        NETD_METHOD(networkAddInterface),
+        NETD_METHOD(networkRemoveInterface),
+        NETD_METHOD(networkAddUidRanges),
+        NETD_METHOD(networkRemoveUidRanges),
+        NETD_METHOD(networkAddUidRangesParcel),
+        NETD_METHOD(networkRemoveUidRangesParcel),
+        NETD_METHOD(networkRejectNonSecureVpn),
+        NETD_METHOD(networkAddRouteParcel),
+        NETD_METHOD(networkUpdateRouteParcel),
+        NETD_METHOD(networkRemoveRouteParcel),
+        NETD_METHOD(networkAddRoute),
+        NETD_METHOD(networkRemoveRoute),
+        NETD_METHOD(networkAddLegacyRoute),
+        NETD_METHOD(networkRemoveLegacyRoute),
+        NETD_METHOD(networkSetDefault),
+        NETD_METHOD(networkClearDefault),
+        NETD_METHOD(networkSetPermissionForNetwork),
+        NETD_METHOD(networkSetPermissionForUser),
+        NETD_METHOD(networkClearPermissionForUser),
+        NETD_METHOD(networkSetProtectAllow),
+        NETD_METHOD(networkSetProtectDeny),
+        NETD_METHOD(networkAllowBypassVpnOnNetwork),
+        NETD_METHOD(networkGetDefault),
+        NETD_METHOD(networkCanProtect),
+        NETD_METHOD(trafficSetNetPermForUids),
+        NETD_METHOD(socketDestroy),
+        NETD_METHOD(setIPv6AddrGenMode),
+        NETD_METHOD(wakeupAddInterface),
+        NETD_METHOD(wakeupDelInterface),
+        NETD_METHOD(tetherApplyDnsInterfaces),
+        NETD_METHOD(tetherGetStats),
+        NETD_METHOD(tetherOffloadGetStats),
+        NETD_METHOD(tetherStart),
+        NETD_METHOD(tetherStartWithConfiguration),
+        NETD_METHOD(tetherStop),
+        NETD_METHOD(tetherIsEnabled),
+        NETD_METHOD(tetherInterfaceAdd),
+        NETD_METHOD(tetherInterfaceRemove),
+        NETD_METHOD(tetherInterfaceList),
+        NETD_METHOD(tetherDnsSet),
+        NETD_METHOD(tetherDnsList),
+        NETD_METHOD(tetherAddForward),
+        NETD_METHOD(tetherRemoveForward),
+        NETD_METHOD(tetherOffloadRuleAdd),
+        NETD_METHOD(tetherOffloadRuleRemove),
+        NETD_METHOD(tetherOffloadSetInterfaceQuota),
+        NETD_METHOD(tetherOffloadGetAndClearStats),
+        NETD_METHOD(interfaceAddAddress),
+        NETD_METHOD(interfaceDelAddress),
+        NETD_METHOD(interfaceGetList),
+        NETD_METHOD(interfaceGetCfg),
+        NETD_METHOD(interfaceSetCfg),
+        NETD_METHOD(interfaceSetIPv6PrivacyExtensions),
+        NETD_METHOD(interfaceClearAddrs),
+        NETD_METHOD(interfaceSetEnableIPv6),
+        NETD_METHOD(interfaceSetMtu),
+        NETD_METHOD(getProcSysNet),
+        NETD_METHOD(setProcSysNet),
+        NETD_METHOD(ipSecSetEncapSocketOwner),
+        NETD_METHOD(ipSecAllocateSpi),
+        NETD_METHOD(ipSecAddSecurityAssociation),
+        NETD_METHOD(ipSecDeleteSecurityAssociation),
+        NETD_METHOD(ipSecApplyTransportModeTransform),
+        NETD_METHOD(ipSecRemoveTransportModeTransform),
+        NETD_METHOD(ipSecAddSecurityPolicy),
+        NETD_METHOD(ipSecUpdateSecurityPolicy),
+        NETD_METHOD(ipSecDeleteSecurityPolicy),
+        NETD_METHOD(trafficSwapActiveStatsMap),
+        NETD_METHOD(ipSecAddTunnelInterface),
+        NETD_METHOD(ipSecUpdateTunnelInterface),
+        NETD_METHOD(ipSecRemoveTunnelInterface),
+        NETD_METHOD(ipSecMigrate),
+        NETD_METHOD(idletimerAddInterface),
+        NETD_METHOD(idletimerRemoveInterface),
+        NETD_METHOD(strictUidCleartextPenalty),
+        NETD_METHOD(clatdStart),
+        NETD_METHOD(clatdStop),
+        NETD_METHOD(ipfwdEnabled),
+        NETD_METHOD(ipfwdGetRequesterList),
+        NETD_METHOD(ipfwdEnableForwarding),
+        NETD_METHOD(ipfwdDisableForwarding),
+        NETD_METHOD(ipfwdAddInterfaceForward),
+        NETD_METHOD(ipfwdRemoveInterfaceForward),
+        NETD_METHOD(setTcpRWmemorySize),
+        NETD_METHOD(registerUnsolicitedEventListener),
+        NETD_METHOD(getOemNetd),
+        NETD_METHOD(getFwmarkForNetwork),
+        NETD_METHOD(setNetworkAllowlist),
+    };
+    static const std::vector<const char*>* names = [] {
+        auto* names = new std::vector<const char*>();
+        for (const auto& [code, name] : methods) {
+            const size_t index = code - IBinder::FIRST_CALL_TRANSACTION;
+            if (index >= names->size()) names->resize(index + 1, nullptr);
+            (*names)[index] = name;
+        }
+        return names;
+    }();
+    return *names;
+}
+
+#undef NETD_METHOD
+
+// Reads the status that the generated code wrote at the start of the reply.
+bool isReplyOk(Parcel* reply, uint32_t flags) {
+    if (reply == nullptr || (flags & IBinder::FLAG_ONEWAY)) return true;
+    const size_t position = reply->dataPosition();
+    reply->setDataPosition(0);
+    binder::Status status;
+    const bool ok = status.readFromParcel(*reply) == OK && status.isOk();
+    reply->setDataPosition(position);
+    return ok;
+}
+
 bool contains(const Vector<String16>& words, const String16& word) {
     for (const auto& w : words) {
         if (w == word) return true;
@@ -119,13 +286,70 @@ bool contains(const Vector<String16>& words, const String16& word) {
     return false;
 }
 
+// A part of the dumpsys output. Sections can be picked by name, e.g. "dumpsys netd tether log".
+struct DumpSection {
+    const char* name;
+    // What --short prints instead of the section, or nullptr if --short keeps the section.
+    const char* omitted;
+    std::function<void(DumpWriter&)> dump;
+};
+
+// Copies the entries of |log| before printing them, so that threads logging to it are not blocked
+// while the dump is written out.
+void dumpLog(DumpWriter& dw, const char* title, netdutils::Log& log) {
+    std::vector<std::string> entries;
+    log.forEachEntry([&entries](const std::string& entry) { entries.push_back(entry); });
+
+    ScopedIndent indentLog(dw);
+    dw.println(title);
+    ScopedIndent indentLogEntries(dw);
+    for (const std::string& entry : entries) {
+        dw.println(entry);
+    }
+}
+
 }  // namespace
 
 NetdNativeService::NetdNativeService() {
-    // register log callback to BnNetd::logFunc
-    BnNetd::logFunc = [](const auto& log) {
-        binderCallLogFn(log, [](const std::string& msg) { gLog.info("%s", msg.c_str()); });
-    };
+    // The generated code only formats the arguments and results of each call when there is a log
+    // callback, so leave it unset on user builds unless logging is asked for.
+    const bool isUserBuild = base::GetProperty("ro.build.type", "user") == "user";
+    if (base::GetBoolProperty(LOG_BINDER_CALLS_PROPERTY, !isUserBuild)) {
+        BnNetd::logFunc = [](const auto& log) {
+            binderCallLogFn(log, [](const std::string& msg) { gLog.info("%s", msg.c_str()); });
+        };
+    }
+}
+
+BinderTelemetry& NetdNativeService::telemetry() {
+    static BinderTelemetry* telemetry = [] {
+        std::vector<std::string> names;
+        for (const char* name : methodNames()) names.emplace_back(name ? name : "");
+        return new BinderTelemetry(names);
+    }();
+    return *telemetry;
+}
+
+status_t NetdNativeService::onTransact(uint32_t code, const Parcel& data, Parcel* reply,
+                                       uint32_t flags) {
+    if (code < FIRST_CALL_TRANSACTION || code > LAST_CALL_TRANSACTION) {
+        return BnNetd::onTransact(code, data, reply, flags);
+    }
+
+    const steady_clock::time_point start = steady_clock::now();
+    const microseconds waitBefore = LockStats::threadWaitTime();
+    const status_t ret = BnNetd::onTransact(code, data, reply, flags);
+    const microseconds total = duration_cast<microseconds>(steady_clock::now() - start);
+    const microseconds lockWait = LockStats::threadWaitTime() - waitBefore;
+
+    const bool error = ret != OK || !isReplyOk(reply, flags);
+    const size_t method = code - FIRST_CALL_TRANSACTION;
+    telemetry().record(method, lockWait, total - lockWait, error);
+    gEventLog.log(NetdEvent::BINDER_CALL,
+                  {.literal = method < methodNames().size() ? methodNames()[method] : nullptr,
+                   .ints = {static_cast<int64_t>(method), total.count(), lockWait.count(),
+                            error}});
+    return ret;
 }
 
 status_t NetdNativeService::start() {
@@ -150,7 +374,8 @@ status_t NetdNativeService::dump(int fd, const Vector<String16> &args) {
     }
 
     // This method does not grab any locks. If individual classes need locking
-    // their dump() methods MUST handle locking appropriately.
+    // their dump() methods MUST handle locking appropriately. The output goes to a pipe that may be
+    // read slowly, so they should copy their state under the lock and format it afterwards.
 
     DumpWriter dw(fd);
 
@@ -161,47 +386,75 @@ status_t NetdNativeService::dump(int fd, const Vector<String16> &args) {
       return NO_ERROR;
     }
 
-    process::dump(dw);
-    dw.blankline();
-    gCtls->netCtrl.dump(dw);
-    dw.blankline();
-
-    gCtls->xfrmCtrl.dump(dw);
-    dw.blankline();
-
-    gCtls->tetherCtrl.dump(dw);
-    dw.blankline();
+    const std::vector<DumpSection> sections = {
+            {"process", nullptr, [](DumpWriter& dw) { process::dump(dw); }},
+            {"network", nullptr, [](DumpWriter& dw) { gCtls->netCtrl.dump(dw); }},
+            {"xfrm", nullptr, [](DumpWriter& dw) { gCtls->xfrmCtrl.dump(dw); }},
+            {"tether", nullptr, [](DumpWriter& dw) { gCtls->tetherCtrl.dump(dw); }},
+            {"sysctl", nullptr, [](DumpWriter& dw) { gSysctlCache.dump(dw); }},
+            {"locks", nullptr, [](DumpWriter& dw) { LockStats::dumpAll(dw); }},
+            {"binder", nullptr, [](DumpWriter& dw) { telemetry().dump(dw); }},
+            {"log", "Log: <omitted>", [](DumpWriter& dw) { dumpLog(dw, "Log:", gLog); }},
+            {"events", "Events: <omitted>",
+             [](DumpWriter& dw) {
+                 ScopedIndent indentLog(dw);
+                 dw.println("Events:");
+                 ScopedIndent indentLogEntries(dw);
+                 gEventLog.dump(dw);
+             }},
+            {"unsolicited", "UnsolicitedLog: <omitted>",
+             [](DumpWriter& dw) { dumpLog(dw, "UnsolicitedLog:", gUnsolicitedLog); }},
+    };
 
-    {
-        ScopedIndent indentLog(dw);
-        if (contains(args, String16(OPT_SHORT))) {
-            dw.println("Log: <omitted>");
-        } else {
-            dw.println("Log:");
-            ScopedIndent indentLogEntries(dw);
-            gLog.forEachEntry([&dw](const std::string& entry) mutable { dw.println(entry); });
+    // Any other word names a section to dump. Without any, all are dumped. Options, such as the
+    // "-a" and "--dump-priority NORMAL" that dumpsys passes when dumping every service, and unknown
+    // words are ignored, so that netd is never left out of a bug report.
+    const bool isShort = contains(args, String16(OPT_SHORT));
+    std::vector<std::string> selected;
+    for (size_t i = 0; i < args.size(); i++) {
+        const std::string word(String8(args[i]).c_str());
+        if (word == "--dump-priority") {
+            i++;
+            continue;
         }
-        dw.blankline();
+        if (base::StartsWith(word, "-")) continue;
+        if (std::none_of(sections.begin(), sections.end(),
+                         [&word](const DumpSection& s) { return word == s.name; })) {
+            std::vector<std::string> names;
+            for (const DumpSection& section : sections) names.push_back(section.name);
+            dw.println("Ignoring unknown dump section %s. Sections: %s", word.c_str(),
+                       base::Join(names, ", ").c_str());
+            continue;
+        }
+        selected.push_back(word);
     }
 
-    {
-        ScopedIndent indentLog(dw);
-        if (contains(args, String16(OPT_SHORT))) {
-            dw.println("UnsolicitedLog: <omitted>");
+    std::vector<std::string> timings;
+    for (const DumpSection& section : sections) {
+        if (!selected.empty() &&
+            std::find(selected.begin(), selected.end(), section.name) == selected.end()) {
+            continue;
+        }
+
+        if (isShort && section.omitted != nullptr) {
+            ScopedIndent indentOmitted(dw);
+            dw.println(section.omitted);
         } else {
-            dw.println("UnsolicitedLog:");
-            ScopedIndent indentLogEntries(dw);
-            gUnsolicitedLog.forEachEntry(
-                    [&dw](const std::string& entry) mutable { dw.println(entry); });
+            const steady_clock::time_point start = steady_clock::now();
+            section.dump(dw);
+            const auto elapsed = duration_cast<microseconds>(steady_clock::now() - start);
+            timings.push_back(StringPrintf("%s=%lld", section.name,
+                                           static_cast<long long>(elapsed.count())));
         }
         dw.blankline();
     }
+    dw.println("Dump time per section (us): %s", base::Join(timings, " ").c_str());
 
     return NO_ERROR;
 }
 
 binder::Status NetdNativeService::isAlive(bool *alive) {
-    NETD_BIG_LOCK_RPC(PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    ENFORCE_NETWORK_STACK_PERMISSIONS();
 
     *alive = true;
 
@@ -358,12 +611,9 @@ binder::Status NetdNativeService::networkRemoveUidRangesParcel(const NativeUidRa
 
 binder::Status NetdNativeService::networkRejectNonSecureVpn(
         bool add, const std::vector<UidRangeParcel>& uidRangeArray) {
-    // TODO: elsewhere RouteController is only used from the tethering and network controllers, so
-    // it should be possible to use the same lock as NetworkController. However, every call through
-    // the CommandListener "network" command will need to hold this lock too, not just the ones that
-    // read/modify network internal state (that is sufficient for ::dump() because it doesn't
-    // look at routes, but it's not enough here).
-    NETD_BIG_LOCK_RPC(PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    // The rules are not netd state, so nothing else needs to be locked out. The lock only keeps
+    // concurrent adds and removes of the same ranges from interleaving.
+    NETD_LOCKING_RPC(gRejectNonSecureVpnLock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
     UidRanges uidRanges(uidRangeArray);
 
     int err;
@@ -432,7 +682,7 @@ void setTetherStatsParcelVecByInterface(std::vector<TetherStatsParcel>* tetherSt
 
 binder::Status NetdNativeService::tetherGetStats(
         std::vector<TetherStatsParcel>* tetherStatsParcelVec) {
-    NETD_LOCKING_RPC(gCtls->tetherCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    NETD_READ_LOCKING_RPC(gCtls->tetherCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
     const auto& statsList = gCtls->tetherCtrl.getTetherStats();
     if (!isOk(statsList)) {
         return asBinderStatus(statsList);
@@ -746,13 +996,13 @@ binder::Status NetdNativeService::clatdStop(const std::string& /* ifName */) {
 }
 
 binder::Status NetdNativeService::ipfwdEnabled(bool* status) {
-    NETD_LOCKING_RPC(gCtls->tetherCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    NETD_READ_LOCKING_RPC(gCtls->tetherCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
     *status = (gCtls->tetherCtrl.getIpfwdRequesterList().size() > 0) ? true : false;
     return binder::Status::ok();
 }
 
 binder::Status NetdNativeService::ipfwdGetRequesterList(std::vector<std::string>* requesterList) {
-    NETD_LOCKING_RPC(gCtls->tetherCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    NETD_READ_LOCKING_RPC(gCtls->tetherCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
     for (const auto& requester : gCtls->tetherCtrl.getIpfwdRequesterList()) {
         requesterList->push_back(requester);
     }
@@ -794,7 +1044,8 @@ std::string addCurlyBrackets(const std::string& s) {
 }  // namespace
 
 binder::Status NetdNativeService::interfaceGetList(std::vector<std::string>* interfaceListResult) {
-    NETD_LOCKING_RPC(InterfaceController::mutex, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    // Only lists interfaces in the kernel, so there is no netd state to lock.
+    ENFORCE_NETWORK_STACK_PERMISSIONS();
     const auto& ifaceList = getIfaceNames();
 
     interfaceListResult->clear();
@@ -814,7 +1065,8 @@ std::string interfaceConfigurationParcelToString(const InterfaceConfigurationPar
 
 binder::Status NetdNativeService::interfaceGetCfg(
         const std::string& ifName, InterfaceConfigurationParcel* interfaceGetCfgResult) {
-    NETD_LOCKING_RPC(InterfaceController::mutex, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    NETD_READ_LOCKING_RPC(InterfaceController::lockFor(ifName), PERM_NETWORK_STACK,
+                          PERM_MAINLINE_NETWORK_STACK);
     auto entry = gLog.newEntry().prettyFunction(__PRETTY_FUNCTION__).arg(ifName);
 
     const auto& cfgRes = InterfaceController::getCfg(ifName);
@@ -827,7 +1079,8 @@ binder::Status NetdNativeService::interfaceGetCfg(
 }
 
 binder::Status NetdNativeService::interfaceSetCfg(const InterfaceConfigurationParcel& cfg) {
-    NETD_LOCKING_RPC(InterfaceController::mutex, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    NETD_LOCKING_RPC(InterfaceController::lockFor(cfg.ifName), PERM_NETWORK_STACK,
+                     PERM_MAINLINE_NETWORK_STACK);
     auto entry = gLog.newEntry()
                          .prettyFunction(__PRETTY_FUNCTION__)
                          .arg(interfaceConfigurationParcelToString(cfg));
@@ -841,25 +1094,29 @@ binder::Status NetdNativeService::interfaceSetCfg(const InterfaceConfigurationPa
 
 binder::Status NetdNativeService::interfaceSetIPv6PrivacyExtensions(const std::string& ifName,
                                                                     bool enable) {
-    NETD_LOCKING_RPC(InterfaceController::mutex, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    NETD_LOCKING_RPC(InterfaceController::lockFor(ifName), PERM_NETWORK_STACK,
+                     PERM_MAINLINE_NETWORK_STACK);
     int res = InterfaceController::setIPv6PrivacyExtensions(ifName.c_str(), enable);
     return statusFromErrcode(res);
 }
 
 binder::Status NetdNativeService::interfaceClearAddrs(const std::string& ifName) {
-    NETD_LOCKING_RPC(InterfaceController::mutex, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    NETD_LOCKING_RPC(InterfaceController::lockFor(ifName), PERM_NETWORK_STACK,
+                     PERM_MAINLINE_NETWORK_STACK);
     int res = InterfaceController::clearAddrs(ifName.c_str());
     return statusFromErrcode(res);
 }
 
 binder::Status NetdNativeService::interfaceSetEnableIPv6(const std::string& ifName, bool enable) {
-    NETD_LOCKING_RPC(InterfaceController::mutex, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    NETD_LOCKING_RPC(InterfaceController::lockFor(ifName), PERM_NETWORK_STACK,
+                     PERM_MAINLINE_NETWORK_STACK);
     int res = InterfaceController::setEnableIPv6(ifName.c_str(), enable);
     return statusFromErrcode(res);
 }
 
 binder::Status NetdNativeService::interfaceSetMtu(const std::string& ifName, int32_t mtuValue) {
-    NETD_LOCKING_RPC(InterfaceController::mutex, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    NETD_LOCKING_RPC(InterfaceController::lockFor(ifName), PERM_NETWORK_STACK,
+                     PERM_MAINLINE_NETWORK_STACK);
     std::string mtu = std::to_string(mtuValue);
     int res = InterfaceController::setMtu(ifName.c_str(), mtu.c_str());
     return statusFromErrcode(res);
@@ -889,7 +1146,7 @@ binder::Status NetdNativeService::tetherStop() {
 }
 
 binder::Status NetdNativeService::tetherIsEnabled(bool* enabled) {
-    NETD_LOCKING_RPC(gCtls->tetherCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    NETD_READ_LOCKING_RPC(gCtls->tetherCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
     *enabled = gCtls->tetherCtrl.isTetheringStarted();
     return binder::Status::ok();
 }
@@ -907,7 +1164,7 @@ binder::Status NetdNativeService::tetherInterfaceRemove(const std::string& ifNam
 }
 
 binder::Status NetdNativeService::tetherInterfaceList(std::vector<std::string>* ifList) {
-    NETD_LOCKING_RPC(gCtls->tetherCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    NETD_READ_LOCKING_RPC(gCtls->tetherCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
     for (const auto& ifname : gCtls->tetherCtrl.getTetheredInterfaceList()) {
         ifList->push_back(ifname);
     }
@@ -922,7 +1179,7 @@ binder::Status NetdNativeService::tetherDnsSet(int32_t netId,
 }
 
 binder::Status NetdNativeService::tetherDnsList(std::vector<std::string>* dnsList) {
-    NETD_LOCKING_RPC(gCtls->tetherCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
+    NETD_READ_LOCKING_RPC(gCtls->tetherCtrl.lock, PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK);
     for (const auto& fwdr : gCtls->tetherCtrl.getDnsForwarders()) {
         dnsList->push_back(fwdr);
     }
@@ -22,6 +22,7 @@
 #include <binder/BinderService.h>
 #include <netdutils/Log.h>
 
+#include "BinderTelemetry.h"
 #include "android/net/BnNetd.h"
 
 namespace android {
@@ -34,6 +35,13 @@ class NetdNativeService : public BinderService<NetdNativeService>, public BnNetd
     static char const* getServiceName() { return "netd"; }
     virtual status_t dump(int fd, const Vector<String16> &args) override;
 
+    // Records every call in telemetry().
+    status_t onTransact(uint32_t code, const Parcel& data, Parcel* reply,
+                        uint32_t flags) override;
+
+    // Call counts, errors and latencies of the INetd methods.
+    static BinderTelemetry& telemetry();
+
     binder::Status isAlive(bool *alive) override;
 
     // Firewall commands.
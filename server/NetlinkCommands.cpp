@@ -22,6 +22,10 @@
 #include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <string>
+
 #define LOG_TAG "Netd"
 #include <log/log.h>
 
@@ -165,32 +169,15 @@ int rtNetlinkFlush(uint16_t getAction, uint16_t deleteAction, const char* what,
         return -EINVAL;
     }
 
-    int writeSock = openNetlinkSocket(NETLINK_ROUTE);
-    if (writeSock < 0) {
-        return writeSock;
-    }
-
-    NetlinkDumpCallback callback = [writeSock, deleteAction, shouldDelete, what] (nlmsghdr *nlh) {
+    // The kernel can't filter rule or route dumps by attribute, so dump everything and keep the
+    // payload of every object that matches. They are all deleted once the dump is complete.
+    std::vector<std::vector<uint8_t>> toDelete;
+    NetlinkDumpCallback callback = [&toDelete, &shouldDelete](nlmsghdr* nlh) {
         if (!shouldDelete(nlh)) return;
-
-        nlh->nlmsg_type = deleteAction;
-        nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
-        if (write(writeSock, nlh, nlh->nlmsg_len) == -1) {
-            ALOGE("Error writing flush request: %s", strerror(errno));
-            return;
-        }
-
-        int ret = recvNetlinkAck(writeSock);
-        // A flush works by dumping routes and deleting each route as it's returned, and it can
-        // fail if something else deletes the route between the dump and the delete. This can
-        // happen, for example, if an interface goes down while we're trying to flush its routes.
-        // So ignore ENOENT.
-        if (ret != 0 && ret != -ENOENT) {
-            ALOGW("Flushing %s: %s", what, strerror(-ret));
-        }
+        const uint8_t* payload = static_cast<const uint8_t*>(NLMSG_DATA(nlh));
+        toDelete.emplace_back(payload, payload + NLMSG_PAYLOAD(nlh, 0));
     };
 
-    int ret = 0;
     for (const int family : { AF_INET, AF_INET6 }) {
         // struct fib_rule_hdr and struct rtmsg are functionally identical.
         rtmsg rule = {
@@ -202,16 +189,68 @@ int rtNetlinkFlush(uint16_t getAction, uint16_t deleteAction, const char* what,
         };
         uint16_t flags = NETLINK_DUMP_FLAGS;
 
-        if ((ret = sendNetlinkRequest(getAction, flags, iov, ARRAY_SIZE(iov), &callback)) != 0) {
-            break;
+        if (int ret = sendNetlinkRequest(getAction, flags, iov, ARRAY_SIZE(iov), &callback)) {
+            return ret;
+        }
+    }
+    return rtNetlinkDelete(deleteAction, what, toDelete);
+}
+
+int rtNetlinkDelete(uint16_t deleteAction, const char* what,
+                    const std::vector<std::vector<uint8_t>>& payloads) {
+    if (payloads.empty()) {
+        return 0;
+    }
+
+    int sock = openNetlinkSocket(NETLINK_ROUTE);
+    if (sock < 0) {
+        return sock;
+    }
+
+    // Every delete is acked with a copy of the request, so bound the size of a batch to keep the
+    // responses well within the socket receive buffer.
+    constexpr size_t kMaxDeletesPerBatch = 128;
+    int ret = 0;
+    for (size_t start = 0; start < payloads.size() && ret == 0; start += kMaxDeletesPerBatch) {
+        NetlinkBatch batch;
+        for (size_t i = start; i < std::min(payloads.size(), start + kMaxDeletesPerBatch); ++i) {
+            iovec iov[] = {
+                { nullptr, 0 },
+                { const_cast<uint8_t*>(payloads[i].data()), payloads[i].size() },
+            };
+            batch.add(deleteAction, NETLINK_REQUEST_FLAGS, iov, ARRAY_SIZE(iov));
+        }
+
+        std::vector<int> results;
+        ret = batch.send(sock, [](size_t, nlmsghdr*) {}, &results);
+        for (int result : results) {
+            // A delete can fail if something else deletes the object between the dump and the
+            // delete. This can happen, for example, if an interface goes down while we're trying
+            // to flush its routes. So ignore ENOENT.
+            if (result != 0 && result != -ENOENT) {
+                ALOGW("Deleting %s: %s", what, strerror(-result));
+            }
         }
     }
 
-    close(writeSock);
+    close(sock);
 
     return ret;
 }
 
+std::string getRtmStringAttribute(const nlmsghdr* nlh, int attribute) {
+    uint32_t rta_len = RTM_PAYLOAD(nlh);
+    rtmsg *msg = reinterpret_cast<rtmsg *>(NLMSG_DATA(nlh));
+    rtattr *rta = reinterpret_cast<rtattr *> RTM_RTA(msg);
+    for (; RTA_OK(rta, rta_len); rta = RTA_NEXT(rta, rta_len)) {
+        if (rta->rta_type == attribute) {
+            const char* data = static_cast<const char*>(RTA_DATA(rta));
+            return std::string(data, strnlen(data, RTA_PAYLOAD(rta)));
+        }
+    }
+    return "";
+}
+
 uint32_t getRtmU32Attribute(const nlmsghdr* nlh, int attribute) {
     uint32_t rta_len = RTM_PAYLOAD(nlh);
     rtmsg *msg = reinterpret_cast<rtmsg *>(NLMSG_DATA(nlh));
@@ -224,5 +263,103 @@ uint32_t getRtmU32Attribute(const nlmsghdr* nlh, int attribute) {
     return 0;
 }
 
+namespace {
+
+// Large enough for any single link or address message, which a dump never splits.
+constexpr size_t kNetlinkBatchBufferSize = 32768;
+
+// Returns the first of |count| consecutive, non-zero sequence numbers.
+uint32_t allocateNetlinkSeqs(size_t count) {
+    static std::atomic<uint32_t> sNextSeq{1};
+    uint32_t first;
+    do {
+        first = sNextSeq.fetch_add(count);
+    } while (first == 0 || static_cast<uint32_t>(first + count) < first);
+    return first;
+}
+
+}  // namespace
+
+void NetlinkBatch::add(uint16_t action, uint16_t flags, iovec* iov, int iovlen) {
+    nlmsghdr nlmsg = {
+        .nlmsg_type = action,
+        .nlmsg_flags = static_cast<uint16_t>((flags & NLM_F_DUMP) ? flags : flags | NLM_F_ACK),
+    };
+    iov[0].iov_base = &nlmsg;
+    iov[0].iov_len = sizeof(nlmsg);
+    for (int i = 0; i < iovlen; ++i) {
+        nlmsg.nlmsg_len += iov[i].iov_len;
+    }
+
+    mOffsets.push_back(mBuffer.size());
+    for (int i = 0; i < iovlen; ++i) {
+        const uint8_t* data = static_cast<const uint8_t*>(iov[i].iov_base);
+        mBuffer.insert(mBuffer.end(), data, data + iov[i].iov_len);
+    }
+    mBuffer.resize(NLMSG_ALIGN(mBuffer.size()));
+    // Don't let pointers to the stack escape.
+    iov[0] = {nullptr, 0};
+}
+
+int NetlinkBatch::send(int sock, const ResponseCallback& callback, std::vector<int>* results) {
+    results->assign(mOffsets.size(), -EIO);
+    if (mOffsets.empty()) {
+        return 0;
+    }
+
+    // Number the requests consecutively, so that responses map straight back to their requests.
+    const uint32_t firstSeq = allocateNetlinkSeqs(mOffsets.size());
+    for (size_t i = 0; i < mOffsets.size(); ++i) {
+        reinterpret_cast<nlmsghdr*>(mBuffer.data() + mOffsets[i])->nlmsg_seq = firstSeq + i;
+    }
+
+    if (write(sock, mBuffer.data(), mBuffer.size()) == -1) {
+        int ret = -errno;
+        ALOGE("netlink batch write failed (%s)", strerror(-ret));
+        return ret;
+    }
+
+    std::vector<char> buf(kNetlinkBatchBufferSize);
+    size_t pending = mOffsets.size();
+    while (pending > 0) {
+        ssize_t bytesread = recv(sock, buf.data(), buf.size(), MSG_TRUNC);
+        if (bytesread < 0) {
+            int ret = -errno;
+            ALOGE("netlink batch recv failed (%s)", strerror(-ret));
+            return ret;
+        }
+        if (static_cast<size_t>(bytesread) > buf.size()) {
+            ALOGE("netlink batch response too large (%zd bytes)", bytesread);
+            return -EMSGSIZE;
+        }
+
+        uint32_t len = bytesread;
+        for (nlmsghdr* nlh = reinterpret_cast<nlmsghdr*>(buf.data()); NLMSG_OK(nlh, len);
+             nlh = NLMSG_NEXT(nlh, len)) {
+            // Skip responses to earlier exchanges on the same socket that were abandoned.
+            const size_t index = nlh->nlmsg_seq - firstSeq;
+            if (nlh->nlmsg_seq < firstSeq || index >= mOffsets.size()) continue;
+
+            switch (nlh->nlmsg_type) {
+                case NLMSG_DONE:
+                    // Newer kernels report dumps that fail part way through in NLMSG_DONE.
+                    (*results)[index] = (nlh->nlmsg_len >= NLMSG_LENGTH(sizeof(int)))
+                                                ? *reinterpret_cast<int*>(NLMSG_DATA(nlh))
+                                                : 0;
+                    pending--;
+                    break;
+                case NLMSG_ERROR:
+                    (*results)[index] = reinterpret_cast<nlmsgerr*>(NLMSG_DATA(nlh))->error;
+                    pending--;
+                    break;
+                default:
+                    callback(index, nlh);
+            }
+        }
+    }
+
+    return 0;
+}
+
 }  // namespace net
 }  // namespace android
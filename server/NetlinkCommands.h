@@ -17,6 +17,9 @@
 #pragma once
 
 #include <functional>
+#include <string>
+#include <vector>
+
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 
@@ -61,11 +64,48 @@ typedef std::function<bool(nlmsghdr *)> NetlinkDumpFilter;
 // Flushes netlink objects that take an rtmsg structure (FIB rules, routes...). |getAction| and
 // |deleteAction| specify the netlink message types, e.g., RTM_GETRULE and RTM_DELRULE.
 // |shouldDelete| specifies whether a given object should be deleted or not. |what| is a
-// human-readable name for the objects being flushed, e.g. "rules".
+// human-readable name for the objects being flushed, e.g. "rules". The objects are dumped first
+// and then deleted in as few netlink batches as possible.
 [[nodiscard]] int rtNetlinkFlush(uint16_t getAction, uint16_t deleteAction, const char* what,
                                  const NetlinkDumpFilter& shouldDelete);
 
+// Deletes rtnetlink objects given the payloads of their dump messages, as rtNetlinkFlush does.
+// Objects that no longer exist are ignored, and other failures are only logged. Returns negative
+// errno if the exchange with the kernel failed.
+[[nodiscard]] int rtNetlinkDelete(uint16_t deleteAction, const char* what,
+                                  const std::vector<std::vector<uint8_t>>& payloads);
+
 // Returns the value of the specific __u32 attribute, or 0 if the attribute was not present.
 uint32_t getRtmU32Attribute(const nlmsghdr *nlh, int attribute);
 
+// Returns the value of the specific string attribute, or "" if the attribute was not present.
+std::string getRtmStringAttribute(const nlmsghdr* nlh, int attribute);
+
+// Several netlink requests that are sent to the kernel in a single write. Responses are matched to
+// their requests by sequence number, so the same socket can be used for many batches.
+class NetlinkBatch {
+  public:
+    // Called for every response other than acks, errors and the end of dumps, with the index of
+    // the request that it answers.
+    typedef std::function<void(size_t index, nlmsghdr* nlh)> ResponseCallback;
+
+    // Appends a request. As with sendNetlinkRequest, iov[0] is replaced by the netlink header.
+    // Requests that are not dumps always ask for an ack, so that the end of every response can be
+    // found. A dump must be the last request in a batch: the kernel fails a dump request with
+    // EBUSY while an earlier dump on the same socket is still in progress.
+    void add(uint16_t action, uint16_t flags, iovec* iov, int iovlen);
+
+    size_t size() const { return mOffsets.size(); }
+
+    // Sends all requests on |sock| in one write and reads responses until every request has
+    // completed. |results| receives 0 or negative errno for each request. Returns negative errno
+    // if the exchange itself failed, in which case requests that did not complete are -EIO.
+    [[nodiscard]] int send(int sock, const ResponseCallback& callback, std::vector<int>* results);
+
+  private:
+    std::vector<uint8_t> mBuffer;
+    // Offset of each request in mBuffer.
+    std::vector<size_t> mOffsets;
+};
+
 }  // namespace android::net
@@ -32,6 +32,7 @@
 #include "NetlinkHandler.h"
 #include "NetlinkManager.h"
 #include "SockDiag.h"
+#include "SysctlCache.h"
 
 #include <charconv>
 
@@ -111,8 +112,12 @@ void NetlinkHandler::onEvent(NetlinkEvent *evt) {
         NetlinkEvent::Action action = evt->getAction();
         const char *iface = evt->findParam("INTERFACE") ?: "";
         if (action == NetlinkEvent::Action::kAdd) {
+            // A new interface starts with default sysctl values, even if one with the same name
+            // existed before.
+            gSysctlCache.invalidateInterface(iface);
             notifyInterfaceAdded(iface);
         } else if (action == NetlinkEvent::Action::kRemove) {
+            gSysctlCache.invalidateInterface(iface);
             notifyInterfaceRemoved(iface);
         } else if (action == NetlinkEvent::Action::kChange) {
             evt->dump();
@@ -656,6 +656,39 @@ int NetworkController::addRoute(unsigned netId, const char* interface, const cha
     return modifyRoute(netId, interface, destination, nexthop, ROUTE_ADD, legacy, uid, mtu);
 }
 
+int NetworkController::addRoutes(unsigned netId, const std::vector<RouteController::Route>& routes,
+                                 std::vector<int>* results) {
+    ScopedRLock lock(mRWLock);
+
+    if (!isValidNetworkLocked(netId)) {
+        ALOGE("no such netId %u", netId);
+        return -ENONET;
+    }
+
+    results->assign(routes.size(), 0);
+    std::vector<RouteController::Route> valid;
+    std::vector<size_t> validIndices;
+    for (size_t i = 0; i < routes.size(); i++) {
+        if (int ret = checkRouteInterfaceLocked(netId, routes[i].interface)) {
+            (*results)[i] = ret;
+            continue;
+        }
+        valid.push_back(routes[i]);
+        validIndices.push_back(i);
+    }
+
+    const RouteController::TableType tableType =
+            (netId == LOCAL_NET_ID) ? RouteController::LOCAL_NETWORK : RouteController::INTERFACE;
+    std::vector<int> validResults;
+    if (int ret = RouteController::addRoutes(valid, tableType, &validResults)) {
+        ALOGE("Could not send all routes of netId %u to the kernel: %s", netId, strerror(-ret));
+    }
+    for (size_t j = 0; j < validIndices.size(); j++) {
+        (*results)[validIndices[j]] = validResults[j];
+    }
+    return 0;
+}
+
 int NetworkController::updateRoute(unsigned netId, const char* interface, const char* destination,
                                    const char* nexthop, bool legacy, uid_t uid, int mtu) {
     return modifyRoute(netId, interface, destination, nexthop, ROUTE_UPDATE, legacy, uid, mtu);
@@ -742,34 +775,71 @@ int NetworkController::denyProtect(uid_t uid, unsigned netId) {
 }
 
 void NetworkController::dump(DumpWriter& dw) {
-    ScopedRLock lock(mRWLock);
+    // Copy the state under the lock and format it afterwards, so that RPCs are not blocked while
+    // the dump is written out.
+    struct NetworkInfo {
+        std::string description;
+        const char* permission;  // nullptr unless the network is physical.
+        std::string uidRanges;
+        std::string allowedUids;
+    };
+    unsigned defaultNetId;
+    std::vector<NetworkInfo> networks;
+    std::vector<std::pair<unsigned, unsigned>> ifindexToLastNetId;
+    std::vector<std::pair<std::string, std::string>> addressToIfindices;
+    std::vector<uid_t> systemUids;
+    std::vector<uid_t> networkUids;
+    std::vector<std::pair<uid_t, unsigned>> protectableUsers;
+    {
+        ScopedRLock lock(mRWLock);
+        defaultNetId = mDefaultNetId;
+        for (const auto& [_, network] : mNetworks) {
+            const char* permission = nullptr;
+            if (network->isPhysical()) {
+                permission = permissionToName(
+                        reinterpret_cast<PhysicalNetwork*>(network)->getPermission());
+            }
+            networks.push_back({network->toString(), permission, network->uidRangesToString(),
+                                network->allowedUidsToString()});
+        }
+        ifindexToLastNetId.assign(mIfindexToLastNetId.begin(), mIfindexToLastNetId.end());
+        for (const auto& [address, ifindices] : mAddressToIfindices) {
+            addressToIfindices.emplace_back(address, android::base::Join(ifindices, ", "));
+        }
+        for (const auto& [uid, permission] : mUsers) {
+            if ((permission & PERMISSION_SYSTEM) == PERMISSION_SYSTEM) {
+                systemUids.push_back(uid);
+            } else if ((permission & PERMISSION_NETWORK) == PERMISSION_NETWORK) {
+                networkUids.push_back(uid);
+            }
+        }
+        protectableUsers.assign(mProtectableUsers.begin(), mProtectableUsers.end());
+    }
 
     dw.incIndent();
     dw.println("NetworkController");
 
     dw.incIndent();
-    dw.println("Default network: %u", mDefaultNetId);
+    dw.println("Default network: %u", defaultNetId);
 
     dw.blankline();
     dw.println("Networks:");
     dw.incIndent();
-    for (const auto& i : mNetworks) {
-        Network* network = i.second;
-        dw.println(network->toString());
-        if (network->isPhysical()) {
+    for (const NetworkInfo& network : networks) {
+        dw.println(network.description);
+        if (network.permission) {
             dw.incIndent();
-            Permission permission = reinterpret_cast<PhysicalNetwork*>(network)->getPermission();
-            dw.println("Required permission: %s", permissionToName(permission));
+            dw.println("Required permission: %s", network.permission);
             dw.decIndent();
         }
-        if (const auto& str = network->uidRangesToString(); !str.empty()) {
+        if (!network.uidRanges.empty()) {
             dw.incIndent();
-            dw.println("Per-app UID ranges: %s", str.c_str());
+            dw.println("Per-app UID ranges: %s", network.uidRanges.c_str());
             dw.decIndent();
         }
-        if (const auto& str = network->allowedUidsToString(); !str.empty()) {
+        if (!network.allowedUids.empty()) {
             dw.incIndent();
-            dw.println("Allowed UID ranges: %s", str.c_str());
+            dw.println("Allowed UID ranges: %s", network.allowedUids.c_str());
             dw.decIndent();
         }
         dw.blankline();
@@ -779,7 +849,7 @@ void NetworkController::dump(DumpWriter& dw) {
     dw.blankline();
     dw.println("Interface <-> last network map:");
     dw.incIndent();
-    for (const auto& i : mIfindexToLastNetId) {
+    for (const auto& i : ifindexToLastNetId) {
         dw.println("Ifindex: %u NetId: %u", i.first, i.second);
     }
     dw.decIndent();
@@ -787,34 +857,27 @@ void NetworkController::dump(DumpWriter& dw) {
     dw.blankline();
     dw.println("Interface addresses:");
     dw.incIndent();
-    for (const auto& i : mAddressToIfindices) {
-        dw.println("address: %s ifindices: [%s]", i.first.c_str(),
-                android::base::Join(i.second, ", ").c_str());
+    for (const auto& i : addressToIfindices) {
+        dw.println("address: %s ifindices: [%s]", i.first.c_str(), i.second.c_str());
     }
     dw.decIndent();
 
     dw.blankline();
     dw.println("Permission of users:");
     dw.incIndent();
-    std::vector<uid_t> systemUids;
-    std::vector<uid_t> networkUids;
-    for (const auto& [uid, permission] : mUsers) {
-        if ((permission & PERMISSION_SYSTEM) == PERMISSION_SYSTEM) {
-            systemUids.push_back(uid);
-        } else if ((permission & PERMISSION_NETWORK) == PERMISSION_NETWORK) {
-            networkUids.push_back(uid);
-        }
-    }
     dw.println("NETWORK: %s", android::base::Join(networkUids, ", ").c_str());
     dw.println("SYSTEM: %s", android::base::Join(systemUids, ", ").c_str());
     dw.decIndent();
 
     dw.blankline();
     dw.println("Protectable users:");
-    for (auto it : mProtectableUsers) {
+    for (auto it : protectableUsers) {
         dw.println("[uid: %u : netId: %u]", it.first, it.second);
     }
 
+    dw.blankline();
+    RouteController::dump(dw);
+
     dw.decIndent();
 
     dw.decIndent();
@@ -957,6 +1020,19 @@ int NetworkController::checkUserNetworkAccessLocked(uid_t uid, unsigned netId) c
     return ((userPermission & networkPermission) == networkPermission) ? 0 : -EACCES;
 }
 
+int NetworkController::checkRouteInterfaceLocked(unsigned netId, const char* interface) const {
+    unsigned existingNetId = getNetworkForInterfaceLocked(interface);
+    if (existingNetId == NETID_UNSET) {
+        ALOGE("interface %s not assigned to any netId", interface);
+        return -ENODEV;
+    }
+    if (existingNetId != netId) {
+        ALOGE("interface %s assigned to netId %u, not %u", interface, existingNetId, netId);
+        return -ENOENT;
+    }
+    return 0;
+}
+
 int NetworkController::modifyRoute(unsigned netId, const char* interface, const char* destination,
                                    const char* nexthop, enum RouteOperation op, bool legacy,
                                    uid_t uid, int mtu) {
@@ -966,14 +1042,8 @@ int NetworkController::modifyRoute(unsigned netId, const char* interface, const
         ALOGE("no such netId %u", netId);
         return -ENONET;
     }
-    unsigned existingNetId = getNetworkForInterfaceLocked(interface);
-    if (existingNetId == NETID_UNSET) {
-        ALOGE("interface %s not assigned to any netId", interface);
-        return -ENODEV;
-    }
-    if (existingNetId != netId) {
-        ALOGE("interface %s assigned to netId %u, not %u", interface, existingNetId, netId);
-        return -ENOENT;
+    if (int ret = checkRouteInterfaceLocked(netId, interface)) {
+        return ret;
     }
 
     RouteController::TableType tableType;
@@ -22,6 +22,7 @@
 #include "NetdConstants.h"
 #include "Permission.h"
 #include "PhysicalNetwork.h"
+#include "RouteController.h"
 #include "UnreachableNetwork.h"
 #include "android/net/INetd.h"
 #include "netdutils/DumpWriter.h"
@@ -132,6 +133,12 @@ public:
     // |netId| is given only to sanity check that the interface has the correct netId.
     [[nodiscard]] int addRoute(unsigned netId, const char* interface, const char* destination,
                                const char* nexthop, bool legacy, uid_t uid, int mtu);
+    // Adds many non-legacy routes to |netId|, taking the lock once and sending them to the kernel
+    // in as few netlink exchanges as possible. |results| receives 0 or negative errno for each
+    // route. Returns negative errno if the network does not exist. A failed exchange only fails
+    // the routes it affected, since the routes in earlier exchanges were added.
+    [[nodiscard]] int addRoutes(unsigned netId, const std::vector<RouteController::Route>& routes,
+                                std::vector<int>* results);
     [[nodiscard]] int updateRoute(unsigned netId, const char* interface, const char* destination,
                                   const char* nexthop, bool legacy, uid_t uid, int mtu);
     [[nodiscard]] int removeRoute(unsigned netId, const char* interface, const char* destination,
@@ -172,6 +179,7 @@ public:
     [[nodiscard]] int createPhysicalNetworkLocked(unsigned netId, Permission permission,
                                                   bool local);
 
+    [[nodiscard]] int checkRouteInterfaceLocked(unsigned netId, const char* interface) const;
     [[nodiscard]] int modifyRoute(unsigned netId, const char* interface, const char* destination,
                                   const char* nexthop, RouteOperation op, bool legacy, uid_t uid,
                                   int mtu);
@@ -18,11 +18,67 @@
 
 #include "OemNetdListener.h"
 
+#include "Controllers.h"
+#include "InterfaceController.h"
+#include "NetdNativeService.h"
+#include "RouteController.h"
+#include "binder_utils/BinderUtil.h"
+#include "binder_utils/NetdPermissions.h"
+
+using android::net::BinderTelemetry;
+using android::net::gCtls;
+using android::net::InterfaceController;
+using android::net::InterfaceSnapshot;
+using android::net::NetdNativeService;
+using android::net::RouteController;
+using android::net::XfrmRekeyParams;
+using android::net::XfrmSaParams;
+using android::net::XfrmSaStats;
+using android::net::XfrmTunnelBundle;
+
 namespace com {
 namespace android {
 namespace internal {
 namespace net {
 
+namespace {
+
+::android::binder::Status checkNetworkStackPermissions() {
+    return checkAnyPermission({PERM_NETWORK_STACK, PERM_MAINLINE_NETWORK_STACK});
+}
+
+::android::binder::Status asBinderStatus(const ::android::netdutils::Status& status) {
+    if (isOk(status)) {
+        return ::android::binder::Status::ok();
+    }
+    return ::android::binder::Status::fromServiceSpecificError(status.code(), status.msg().c_str());
+}
+
+XfrmSaParams toXfrmSaParams(const IpSecTunnelSaParcel& sa) {
+    // The mode, marks and interface id are derived from the tunnel by XfrmController.
+    return {
+            .transformId = sa.transformId,
+            .sourceAddress = sa.sourceAddress,
+            .destinationAddress = sa.destinationAddress,
+            .underlyingNetId = sa.underlyingNetId,
+            .spi = sa.spi,
+            .authAlgo = sa.authAlgo,
+            .authKey = sa.authKey,
+            .authTruncBits = sa.authTruncBits,
+            .cryptAlgo = sa.cryptAlgo,
+            .cryptKey = sa.cryptKey,
+            .cryptTruncBits = sa.cryptTruncBits,
+            .aeadAlgo = sa.aeadAlgo,
+            .aeadKey = sa.aeadKey,
+            .aeadIcvBits = sa.aeadIcvBits,
+            .encapType = sa.encapType,
+            .encapLocalPort = sa.encapLocalPort,
+            .encapRemotePort = sa.encapRemotePort,
+    };
+}
+
+}  // namespace
+
 ::android::sp<::android::IBinder> OemNetdListener::getListener() {
     // Thread-safe initialization.
     static ::android::sp<OemNetdListener> listener = ::android::sp<OemNetdListener>::make();
@@ -42,6 +98,211 @@ namespace net {
     return ::android::binder::Status::ok();
 }
 
+::android::binder::Status OemNetdListener::tetherSwitchUpstream(
+        const std::string& oldExtIface, const std::string& newExtIface,
+        const std::vector<std::string>& downstreamIfaces) {
+    if (const auto status = checkNetworkStackPermissions(); !status.isOk()) return status;
+
+    // Hold the lock throughout, so that which downstreams already forward to the new upstream
+    // can't change before switchUpstream() runs.
+    std::lock_guard lock(gCtls->tetherCtrl.lock);
+    std::vector<std::string> added;
+    if (int ret = gCtls->tetherCtrl.checkSwitchUpstream(oldExtIface, newExtIface, downstreamIfaces,
+                                                        &added)) {
+        return statusFromErrcode(ret);
+    }
+
+    // Make before break: install the new ip forwarding rules before touching NAT, so that
+    // downstream traffic never hits a gap where neither upstream is routable. Downstreams that
+    // already forward to the new upstream have their rules already, and adding them again would
+    // leave a duplicate behind once forwarding is disabled.
+    std::vector<const char*> enabled;
+    for (const auto& intIface : added) {
+        if (int ret = RouteController::enableTethering(intIface.c_str(), newExtIface.c_str())) {
+            for (const char* iface : enabled) {
+                (void)RouteController::disableTethering(iface, newExtIface.c_str());
+            }
+            return statusFromErrcode(ret);
+        }
+        enabled.push_back(intIface.c_str());
+    }
+
+    const int ret = gCtls->tetherCtrl.switchUpstream(oldExtIface, newExtIface, downstreamIfaces);
+    if (ret != 0) {
+        for (const char* iface : enabled) {
+            (void)RouteController::disableTethering(iface, newExtIface.c_str());
+        }
+        return statusFromErrcode(ret);
+    }
+    for (const std::string& intIface :
+         std::set<std::string>(downstreamIfaces.begin(), downstreamIfaces.end())) {
+        // Ignore errors: the caller may never have enabled forwarding to the old upstream.
+        (void)RouteController::disableTethering(intIface.c_str(), oldExtIface.c_str());
+    }
+    return ::android::binder::Status::ok();
+}
+
+::android::binder::Status OemNetdListener::ipSecApplyTunnelBundle(
+        const IpSecTunnelBundleParcel& bundle) {
+    // Necessary locking done in IpSecService and kernel
+    if (const auto status = checkNetworkStackPermissions(); !status.isOk()) return status;
+
+    const XfrmTunnelBundle xfrmBundle = {
+            .deviceName = bundle.deviceName,
+            .localAddress = bundle.localAddress,
+            .remoteAddress = bundle.remoteAddress,
+            .ikey = bundle.ikey,
+            .okey = bundle.okey,
+            .interfaceId = bundle.interfaceId,
+            .selAddrFamilies = bundle.selAddrFamilies,
+            .outboundSa = toXfrmSaParams(bundle.outboundSa),
+            .inboundSa = toXfrmSaParams(bundle.inboundSa),
+    };
+    return asBinderStatus(gCtls->xfrmCtrl.ipSecApplyTunnelBundle(xfrmBundle));
+}
+
+::android::binder::Status OemNetdListener::ipSecGetSaStats(
+        int32_t markValue, int32_t markMask, int32_t xfrmInterfaceId,
+        std::vector<IpSecSaStatsParcel>* _aidl_return) {
+    if (const auto status = checkNetworkStackPermissions(); !status.isOk()) return status;
+
+    const auto sas = gCtls->xfrmCtrl.ipSecGetSaStats(markValue, markMask, xfrmInterfaceId);
+    if (!isOk(sas)) return asBinderStatus(sas.status());
+
+    _aidl_return->clear();
+    for (const XfrmSaStats& sa : sas.value()) {
+        IpSecSaStatsParcel parcel;
+        parcel.spi = sa.spi;
+        parcel.transformId = sa.transformId;
+        parcel.sourceAddress = sa.sourceAddress;
+        parcel.destinationAddress = sa.destinationAddress;
+        parcel.markValue = sa.mark.v;
+        parcel.markMask = sa.mark.m;
+        parcel.xfrmInterfaceId = sa.xfrmInterfaceId;
+        parcel.bytes = sa.bytes;
+        parcel.packets = sa.packets;
+        parcel.replayWindowSize = sa.replayWindowSize;
+        parcel.inSeq = sa.inSeq;
+        parcel.outSeq = sa.outSeq;
+        parcel.replayWindowDrops = sa.replayWindowDrops;
+        parcel.replayDrops = sa.replayDrops;
+        parcel.integrityFailures = sa.integrityFailures;
+        _aidl_return->push_back(std::move(parcel));
+    }
+    return ::android::binder::Status::ok();
+}
+
+::android::binder::Status OemNetdListener::ipSecRekey(const IpSecRekeyParcel& rekey) {
+    // Necessary locking done in IpSecService and kernel
+    if (const auto status = checkNetworkStackPermissions(); !status.isOk()) return status;
+
+    XfrmRekeyParams xfrmRekey = {
+            .newSa = toXfrmSaParams(rekey.newSa),
+            .oldTransformId = rekey.oldTransformId,
+            .oldSpi = rekey.oldSpi,
+            .direction = rekey.direction,
+            .selAddrFamilies = rekey.selAddrFamilies,
+            .gracePeriod = std::chrono::milliseconds(rekey.gracePeriodMs),
+    };
+    xfrmRekey.newSa.markValue = rekey.markValue;
+    xfrmRekey.newSa.markMask = rekey.markMask;
+    xfrmRekey.newSa.xfrmInterfaceId = rekey.xfrmInterfaceId;
+    return asBinderStatus(gCtls->xfrmCtrl.ipSecRekey(xfrmRekey));
+}
+
+::android::binder::Status OemNetdListener::interfaceGetCfgAll(
+        std::vector<InterfaceSnapshotParcel>* _aidl_return) {
+    if (const auto status = checkNetworkStackPermissions(); !status.isOk()) return status;
+
+    // Read-only, so the InterfaceController::lockFor() locks are not needed and do not serialize
+    // this against interface configuration.
+    const auto snapshots = InterfaceController::getCfgAll();
+    if (!isOk(snapshots)) return asBinderStatus(snapshots.status());
+
+    _aidl_return->clear();
+    for (const InterfaceSnapshot& snapshot : snapshots.value()) {
+        InterfaceSnapshotParcel parcel;
+        parcel.ifName = snapshot.ifName;
+        parcel.ifIndex = snapshot.ifIndex;
+        parcel.mtu = snapshot.mtu;
+        parcel.flags = snapshot.flags;
+        parcel.hwAddr = snapshot.hwAddr;
+        parcel.addresses = snapshot.addresses;
+        _aidl_return->push_back(std::move(parcel));
+    }
+    return ::android::binder::Status::ok();
+}
+
+::android::binder::Status OemNetdListener::getBinderStats(
+        std::vector<BinderMethodStatsParcel>* _aidl_return) {
+    if (const auto status = checkNetworkStackPermissions(); !status.isOk()) return status;
+
+    _aidl_return->clear();
+    for (const BinderTelemetry::MethodStats& stats : NetdNativeService::telemetry().snapshot()) {
+        BinderMethodStatsParcel parcel;
+        parcel.method = stats.name;
+        parcel.calls = stats.calls;
+        parcel.errors = stats.errors;
+        parcel.lockWaitHistogram.assign(stats.lockWait.begin(), stats.lockWait.end());
+        parcel.executionHistogram.assign(stats.execution.begin(), stats.execution.end());
+        _aidl_return->push_back(std::move(parcel));
+    }
+    return ::android::binder::Status::ok();
+}
+
+::android::binder::Status OemNetdListener::networkAddRoutes(int32_t netId,
+                                                           const std::vector<RouteParcel>& routes,
+                                                           std::vector<int32_t>* _aidl_return) {
+    // Public methods of NetworkController are thread-safe.
+    if (const auto status = checkNetworkStackPermissions(); !status.isOk()) return status;
+
+    std::vector<RouteController::Route> toAdd;
+    for (const RouteParcel& route : routes) {
+        toAdd.push_back({
+                .interface = route.ifName.c_str(),
+                .destination = route.destination.c_str(),
+                .nexthop = route.nextHop.empty() ? nullptr : route.nextHop.c_str(),
+                .mtu = route.mtu,
+        });
+    }
+    // Only fails if the network does not exist. Other errors, including failures to talk to the
+    // kernel partway through, are reported per route, since the routes before them were added.
+    std::vector<int> results;
+    if (int ret = gCtls->netCtrl.addRoutes(netId, toAdd, &results)) {
+        return statusFromErrcode(ret);
+    }
+
+    _aidl_return->clear();
+    for (const int result : results) {
+        _aidl_return->push_back(-result);
+    }
+    return ::android::binder::Status::ok();
+}
+
+::android::binder::Status OemNetdListener::idletimerModifyInterfaces(
+        const std::vector<IdletimerChangeParcel>& changes, std::vector<int32_t>* _aidl_return) {
+    if (const auto status = checkNetworkStackPermissions(); !status.isOk()) return status;
+
+    std::vector<IdletimerController::Change> toApply;
+    for (const IdletimerChangeParcel& change : changes) {
+        toApply.push_back({
+                .add = change.add,
+                .iface = change.ifName,
+                .timeout = static_cast<uint32_t>(change.timeout),
+                .classLabel = change.classLabel,
+        });
+    }
+    std::lock_guard lock(gCtls->idletimerCtrl.lock);
+    std::vector<int> results;
+    gCtls->idletimerCtrl.modifyInterfaceIdletimers(toApply, &results);
+
+    _aidl_return->clear();
+    for (const int result : results) {
+        _aidl_return->push_back(-result);
+    }
+    return ::android::binder::Status::ok();
+}
+
 void OemNetdListener::registerOemUnsolicitedEventListenerInternal(
         const ::android::sp<IOemNetdUnsolicitedEventListener>& listener) {
     std::lock_guard lock(mOemUnsolicitedMutex);
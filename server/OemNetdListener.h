@@ -19,10 +19,19 @@
 
 #include <map>
 #include <mutex>
+#include <string>
+#include <vector>
 
 #include <android-base/thread_annotations.h>
+#include "com/android/internal/net/BinderMethodStatsParcel.h"
 #include "com/android/internal/net/BnOemNetd.h"
 #include "com/android/internal/net/IOemNetdUnsolicitedEventListener.h"
+#include "com/android/internal/net/IdletimerChangeParcel.h"
+#include "com/android/internal/net/InterfaceSnapshotParcel.h"
+#include "com/android/internal/net/IpSecRekeyParcel.h"
+#include "com/android/internal/net/IpSecSaStatsParcel.h"
+#include "com/android/internal/net/IpSecTunnelBundleParcel.h"
+#include "com/android/internal/net/RouteParcel.h"
 
 namespace com {
 namespace android {
@@ -41,6 +50,25 @@ class OemNetdListener : public BnOemNetd {
     ::android::binder::Status isAlive(bool* alive) override;
     ::android::binder::Status registerOemUnsolicitedEventListener(
             const ::android::sp<IOemNetdUnsolicitedEventListener>& listener) override;
+    ::android::binder::Status tetherSwitchUpstream(
+            const std::string& oldExtIface, const std::string& newExtIface,
+            const std::vector<std::string>& downstreamIfaces) override;
+    ::android::binder::Status ipSecApplyTunnelBundle(
+            const IpSecTunnelBundleParcel& bundle) override;
+    ::android::binder::Status ipSecGetSaStats(int32_t markValue, int32_t markMask,
+                                              int32_t xfrmInterfaceId,
+                                              std::vector<IpSecSaStatsParcel>* _aidl_return) override;
+    ::android::binder::Status ipSecRekey(const IpSecRekeyParcel& rekey) override;
+    ::android::binder::Status interfaceGetCfgAll(
+            std::vector<InterfaceSnapshotParcel>* _aidl_return) override;
+    ::android::binder::Status getBinderStats(
+            std::vector<BinderMethodStatsParcel>* _aidl_return) override;
+    ::android::binder::Status networkAddRoutes(int32_t netId,
+                                               const std::vector<RouteParcel>& routes,
+                                               std::vector<int32_t>* _aidl_return) override;
+    ::android::binder::Status idletimerModifyInterfaces(
+            const std::vector<IdletimerChangeParcel>& changes,
+            std::vector<int32_t>* _aidl_return) override;
 
   private:
     std::mutex mOemUnsolicitedMutex;
@@ -114,13 +114,13 @@ int PhysicalNetwork::setPermission(Permission permission) {
     }
 
     destroySocketsLackingPermission(permission);
+    if (int ret = RouteController::modifyPhysicalNetworkPermission(mNetId, mInterfaces, mPermission,
+                                                                   permission, mIsLocalNetwork)) {
+        ALOGE("failed to change permission of netId %u from %x to %x", mNetId, mPermission,
+              permission);
+        return ret;
+    }
     for (const std::string& interface : mInterfaces) {
-        if (int ret = RouteController::modifyPhysicalNetworkPermission(
-                    mNetId, interface.c_str(), mPermission, permission, mIsLocalNetwork)) {
-            ALOGE("failed to change permission on interface %s of netId %u from %x to %x",
-                  interface.c_str(), mNetId, mPermission, permission);
-            return ret;
-        }
         invalidateRouteCache(interface);
     }
     if (mIsDefault) {
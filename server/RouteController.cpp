@@ -24,8 +24,16 @@
 #include <netdutils/InternetAddresses.h>
 #include <private/android_filesystem_config.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
 #include <map>
+#include <mutex>
+#include <set>
+#include <thread>
 
 #include "DummyNetwork.h"
 #include "Fwmark.h"
@@ -36,13 +44,16 @@
 #include <android-base/file.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 #include "log/log.h"
 #include "netid_client.h"
 #include "netutils/ifc.h"
 
 using android::base::StartsWith;
 using android::base::StringPrintf;
-using android::base::WriteStringToFile;
+using android::base::unique_fd;
+using android::base::WriteStringToFd;
+using android::netdutils::DumpWriter;
 using android::netdutils::IPPrefix;
 
 namespace android::net {
@@ -168,14 +179,14 @@ uint32_t RouteController::getRouteTableForInterfaceLocked(const char* interface,
     }
     index += RouteController::ROUTE_TABLE_OFFSET_FROM_INDEX;
     sInterfaceToTable[interface] = index;
+    publishInterfaceToTableLocked();
     return getRouteTableIndexFromGlobalRouteTableIndex(index, local);
 }
 
 uint32_t RouteController::getIfIndex(const char* interface) {
-    std::lock_guard lock(sInterfaceToTableLock);
-
-    auto iter = sInterfaceToTable.find(interface);
-    if (iter == sInterfaceToTable.end()) {
+    const auto snapshot = interfaceToTable();
+    auto iter = snapshot->find(interface);
+    if (iter == snapshot->end()) {
         ALOGE("getIfIndex: cannot find interface %s", interface);
         return 0;
     }
@@ -194,10 +205,24 @@ uint32_t RouteController::getIfIndex(const char* interface) {
 }
 
 uint32_t RouteController::getRouteTableForInterface(const char* interface, bool local) {
+    // Only take the lock if the interface doesn't have a table yet and one must be assigned.
+    const auto snapshot = interfaceToTable();
+    if (auto iter = snapshot->find(interface); iter != snapshot->end()) {
+        return getRouteTableIndexFromGlobalRouteTableIndex(iter->second, local);
+    }
     std::lock_guard lock(sInterfaceToTableLock);
     return getRouteTableForInterfaceLocked(interface, local);
 }
 
+void RouteController::publishInterfaceToTableLocked() {
+    std::atomic_store(&sInterfaceToTableSnapshot,
+                      std::make_shared<const InterfaceToTableMap>(sInterfaceToTable));
+}
+
+std::shared_ptr<const RouteController::InterfaceToTableMap> RouteController::interfaceToTable() {
+    return std::atomic_load(&sInterfaceToTableSnapshot);
+}
+
 void addTableName(uint32_t table, const std::string& name, std::string* contents) {
     char tableString[UINT32_STRLEN];
     snprintf(tableString, sizeof(tableString), "%u", table);
@@ -207,8 +232,7 @@ void addTableName(uint32_t table, const std::string& name, std::string* contents
     *contents += "\n";
 }
 
-// Doesn't return success/failure as the file is optional; it's okay if we fail to update it.
-void RouteController::updateTableNamesFile() {
+std::string RouteController::tableNamesFileContents() {
     std::string contents;
 
     addTableName(RT_TABLE_LOCAL, ROUTE_TABLE_NAME_LOCAL, &contents);
@@ -218,8 +242,7 @@ void RouteController::updateTableNamesFile() {
     addTableName(ROUTE_TABLE_LEGACY_NETWORK, ROUTE_TABLE_NAME_LEGACY_NETWORK, &contents);
     addTableName(ROUTE_TABLE_LEGACY_SYSTEM,  ROUTE_TABLE_NAME_LEGACY_SYSTEM,  &contents);
 
-    std::lock_guard lock(sInterfaceToTableLock);
-    for (const auto& [ifName, table] : sInterfaceToTable) {
+    for (const auto& [ifName, table] : *interfaceToTable()) {
         if (table <= ROUTE_TABLE_OFFSET_FROM_INDEX) {
             continue;
         }
@@ -230,11 +253,103 @@ void RouteController::updateTableNamesFile() {
         uint32_t offset = ROUTE_TABLE_OFFSET_FROM_INDEX_FOR_LOCAL - ROUTE_TABLE_OFFSET_FROM_INDEX;
         addTableName(offset + table, ifName + INTERFACE_LOCAL_SUFFIX, &contents);
     }
+    return contents;
+}
+
+namespace {
+
+// How long the writer thread waits before rewriting the file, so that a burst of interface changes
+// (e.g., when a network with several interfaces connects) results in a single write.
+constexpr auto TABLE_NAMES_WRITE_DELAY = std::chrono::milliseconds(100);
+
+// State shared with the writer thread. The members are protected by |lock|, but not annotated with
+// GUARDED_BY because the analysis cannot follow the lock into the condition variable predicates.
+struct TableNamesWriter {
+    std::mutex lock;
+    std::condition_variable cv;
+    bool started = false;
+    // Number of updates requested, and number of those that the file reflects.
+    uint64_t requested = 0;
+    uint64_t written = 0;
+};
+
+// Never destroyed, because the writer thread never exits and destroying a condition variable that
+// a thread is waiting on blocks forever.
+TableNamesWriter& tableNamesWriter() {
+    static auto* writer = new TableNamesWriter();
+    return *writer;
+}
+
+// Writes a temporary file and renames it over RT_TABLES_PATH, so that readers of the file never
+// see it partially written.
+bool writeTableNamesFileAtomically(const std::string& contents) {
+    const std::string tmpPath = std::string(RouteController::RT_TABLES_PATH) + ".tmp";
+    unique_fd fd(open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW,
+                      RT_TABLES_MODE));
+    if (fd == -1) {
+        ALOGE("failed to open %s (%s)", tmpPath.c_str(), strerror(errno));
+        return false;
+    }
+    // fchmod because the mode passed to open() is subject to the umask.
+    if (!WriteStringToFd(contents, fd) || fchmod(fd, RT_TABLES_MODE) == -1 ||
+        fchown(fd, AID_SYSTEM, AID_WIFI) == -1 || fsync(fd) == -1) {
+        ALOGE("failed to write to %s (%s)", tmpPath.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    fd.reset();
+    if (rename(tmpPath.c_str(), RouteController::RT_TABLES_PATH) == -1) {
+        ALOGE("failed to rename %s to %s (%s)", tmpPath.c_str(), RouteController::RT_TABLES_PATH,
+              strerror(errno));
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
 
-    if (!WriteStringToFile(contents, RT_TABLES_PATH, RT_TABLES_MODE, AID_SYSTEM, AID_WIFI)) {
-        ALOGE("failed to write to %s (%s)", RT_TABLES_PATH, strerror(errno));
+}  // namespace
+
+// Asks the writer thread to rewrite RT_TABLES_PATH from the current interface to table map.
+// Doesn't return success/failure as the file is optional; it's okay if we fail to update it.
+void RouteController::updateTableNamesFile() {
+    TableNamesWriter& writer = tableNamesWriter();
+    std::lock_guard guard(writer.lock);
+    writer.requested++;
+    writer.cv.notify_all();
+    if (writer.started) {
         return;
     }
+    writer.started = true;
+    std::thread([&writer] {
+        std::string lastContents;
+        std::unique_lock lock(writer.lock);
+        while (true) {
+            writer.cv.wait(lock, [&writer] { return writer.written < writer.requested; });
+            lock.unlock();
+            std::this_thread::sleep_for(TABLE_NAMES_WRITE_DELAY);
+            lock.lock();
+            const uint64_t requested = writer.requested;
+            lock.unlock();
+
+            // Callers publish their changes to the map before requesting an update, so the
+            // snapshot read here reflects every update up to |requested|.
+            const std::string contents = tableNamesFileContents();
+            if (contents != lastContents && writeTableNamesFileAtomically(contents)) {
+                lastContents = contents;
+            }
+
+            lock.lock();
+            writer.written = requested;
+            writer.cv.notify_all();
+        }
+    }).detach();
+}
+
+void RouteController::flushTableNamesFile() {
+    TableNamesWriter& writer = tableNamesWriter();
+    std::unique_lock lock(writer.lock);
+    const uint64_t requested = writer.requested;
+    writer.cv.wait(lock, [&writer, requested] { return writer.written >= requested; });
 }
 
 // Returns 0 on success or negative errno on failure.
@@ -253,22 +368,79 @@ int padInterfaceName(const char* input, char* name, size_t* length, uint16_t* pa
     return 0;
 }
 
-// Adds or removes a routing rule for IPv4 and IPv6.
+using IpRule = RouteController::IpRule;
+
+namespace {
+
+// Every rule that netd has added and not deleted since Init(), one per family. This is the rule set
+// that NetworkController's state requires, and is what repairRules() restores in the kernel.
+// sInstalledRulesLock is held while rules are sent, so that the kernel and the record only differ
+// by drift while the lock is not held.
+std::mutex sInstalledRulesLock;
+std::multiset<IpRule> sInstalledRules GUARDED_BY(sInstalledRulesLock);
+
+// Whether deleting |request| would delete |rule|. As in the kernel, fields of the request that are
+// not set match anything.
+bool deleteMatches(const IpRule& request, const IpRule& rule) {
+    return request.family == rule.family &&
+           (!request.priority || request.priority == rule.priority) &&
+           (!request.ruleType || request.ruleType == rule.ruleType) &&
+           (!request.table || request.table == rule.table) &&
+           (!request.fwmark || request.fwmark == rule.fwmark) &&
+           (!request.mask || request.mask == rule.mask) &&
+           (request.iif.empty() || request.iif == rule.iif) &&
+           (request.oif.empty() || request.oif == rule.oif) &&
+           (request.uidStart == INVALID_UID ||
+            (request.uidStart == rule.uidStart && request.uidEnd == rule.uidEnd));
+}
+
+// Records that the kernel applied |rule|, which is for a single family.
+void recordIpRuleLocked(uint16_t action, const IpRule& rule) REQUIRES(sInstalledRulesLock) {
+    if (action == RTM_NEWRULE) {
+        sInstalledRules.insert(rule);
+        return;
+    }
+    if (auto it = sInstalledRules.find(rule); it != sInstalledRules.end()) {
+        sInstalledRules.erase(it);
+        return;
+    }
+    auto it = std::find_if(sInstalledRules.begin(), sInstalledRules.end(),
+                           [&rule](const IpRule& installed) {
+                               return deleteMatches(rule, installed);
+                           });
+    if (it != sInstalledRules.end()) {
+        sInstalledRules.erase(it);
+    }
+}
+
+}  // namespace
+
+// Adds or removes a routing rule for IPv4 and IPv6, or only for |ipRule.family| if it is set.
 //
 // + If |table| is non-zero, the rule points at the specified routing table. Otherwise, the table is
 //   unspecified. An unspecified table is not allowed when creating an FR_ACT_TO_TBL rule.
 // + If |mask| is non-zero, the rule matches the specified fwmark and mask. Otherwise, |fwmark| is
 //   ignored.
-// + If |iif| is non-NULL, the rule matches the specified incoming interface.
-// + If |oif| is non-NULL, the rule matches the specified outgoing interface.
+// + If |iif| is not empty, the rule matches the specified incoming interface.
+// + If |oif| is not empty, the rule matches the specified outgoing interface.
 // + If |uidStart| and |uidEnd| are not INVALID_UID, the rule matches packets from UIDs in that
 //   range (inclusive). Otherwise, the rule matches packets from all UIDs.
 //
+// If |batch| is not null, the requests are appended to it instead of being sent, and only parsing
+// errors are returned.
+//
 // Returns 0 on success or negative errno on failure.
-[[nodiscard]] static int modifyIpRule(uint16_t action, int32_t priority, uint8_t ruleType,
-                                      uint32_t table, uint32_t fwmark, uint32_t mask,
-                                      const char* iif, const char* oif, uid_t uidStart,
-                                      uid_t uidEnd) {
+[[nodiscard]] static int modifyIpRule(uint16_t action, const IpRule& ipRule,
+                                      NetlinkBatch* batch = nullptr) {
+    int32_t priority = ipRule.priority;
+    uint32_t table = ipRule.table;
+    uint32_t fwmark = ipRule.fwmark;
+    uint32_t mask = ipRule.mask;
+    const char* iif = ipRule.iif.empty() ? IIF_NONE : ipRule.iif.c_str();
+    const char* oif = ipRule.oif.empty() ? OIF_NONE : ipRule.oif.c_str();
+    uid_t uidStart = ipRule.uidStart;
+    uid_t uidEnd = ipRule.uidEnd;
+
     if (priority < 0) {
         ALOGE("invalid IP-rule priority %d", priority);
         return -ERANGE;
@@ -302,7 +474,7 @@ int padInterfaceName(const char* input, char* name, size_t* length, uint16_t* pa
 
     // Assemble a rule request and put it in an array of iovec structures.
     fib_rule_hdr rule = {
-        .action = ruleType,
+        .action = ipRule.ruleType,
         // Note that here we're implicitly setting rule.table to 0. When we want to specify a
         // non-zero table, we do this via the FRATTR_TABLE attribute.
     };
@@ -341,22 +513,55 @@ int padInterfaceName(const char* input, char* name, size_t* length, uint16_t* pa
     };
 
     uint16_t flags = (action == RTM_NEWRULE) ? NETLINK_RULE_CREATE_FLAGS : NETLINK_REQUEST_FLAGS;
+    if (batch) {
+        for (const uint8_t family : AF_FAMILIES) {
+            if (ipRule.family != AF_UNSPEC && ipRule.family != family) continue;
+            rule.family = family;
+            batch->add(action, flags, iov, ARRAY_SIZE(iov));
+        }
+        return 0;
+    }
+
+    std::lock_guard lock(sInstalledRulesLock);
     for (size_t i = 0; i < ARRAY_SIZE(AF_FAMILIES); ++i) {
+        if (ipRule.family != AF_UNSPEC && ipRule.family != AF_FAMILIES[i]) {
+            continue;
+        }
         rule.family = AF_FAMILIES[i];
         if (int ret = sendNetlinkRequest(action, flags, iov, ARRAY_SIZE(iov), nullptr)) {
             if (!(action == RTM_DELRULE && ret == -ENOENT && priority == RULE_PRIORITY_TETHERING)) {
                 // Don't log when deleting a tethering rule that's not there. This matches the
-                // behaviour of clearTetheringRules, which ignores ENOENT in this case.
+                // behaviour of clearTetheringRules, which ignores ENOENT.
                 ALOGE("Error %s %s rule: %s", actionName(action), familyName(rule.family),
                       strerror(-ret));
             }
             return ret;
         }
+        IpRule applied = ipRule;
+        applied.family = rule.family;
+        recordIpRuleLocked(action, applied);
     }
 
     return 0;
 }
 
+[[nodiscard]] static int modifyIpRule(uint16_t action, int32_t priority, uint8_t ruleType,
+                                      uint32_t table, uint32_t fwmark, uint32_t mask,
+                                      const char* iif, const char* oif, uid_t uidStart,
+                                      uid_t uidEnd) {
+    return modifyIpRule(action, IpRule{
+                                        .priority = priority,
+                                        .ruleType = ruleType,
+                                        .table = table,
+                                        .fwmark = fwmark,
+                                        .mask = mask,
+                                        .iif = iif ? iif : "",
+                                        .oif = oif ? oif : "",
+                                        .uidStart = uidStart,
+                                        .uidEnd = uidEnd,
+                                });
+}
+
 [[nodiscard]] static int modifyIpRule(uint16_t action, int32_t priority, uint32_t table,
                                       uint32_t fwmark, uint32_t mask, const char* iif,
                                       const char* oif, uid_t uidStart, uid_t uidEnd) {
@@ -370,10 +575,12 @@ int padInterfaceName(const char* input, char* name, size_t* length, uint16_t* pa
                         INVALID_UID);
 }
 
-// Adds or deletes an IPv4 or IPv6 route.
+// Adds or deletes an IPv4 or IPv6 route. If |batch| is not null, the request is appended to it
+// instead of being sent, and only parsing errors are returned.
 // Returns 0 on success or negative errno on failure.
 int modifyIpRoute(uint16_t action, uint16_t flags, uint32_t table, const char* interface,
-                  const char* destination, const char* nexthop, uint32_t mtu, uint32_t priority) {
+                  const char* destination, const char* nexthop, uint32_t mtu, uint32_t priority,
+                  NetlinkBatch* batch) {
     // At least the destination must be non-null.
     if (!destination) {
         ALOGE("null destination");
@@ -465,6 +672,11 @@ int modifyIpRoute(uint16_t action, uint16_t flags, uint32_t table, const char* i
         flags &= ~NLM_F_EXCL;
     }
 
+    if (batch != nullptr) {
+        batch->add(action, flags, iov, ARRAY_SIZE(iov));
+        return 0;
+    }
+
     int ret = sendNetlinkRequest(action, flags, iov, ARRAY_SIZE(iov), nullptr);
     if (ret) {
         ALOGE("Error %s route %s -> %s %s to table %u: %s",
@@ -482,6 +694,13 @@ int modifyIpRoute(uint16_t action, uint16_t flags, uint32_t table, const char* i
 //   same interface.
 int modifyIncomingPacketMark(unsigned netId, const char* interface, Permission permission,
                              bool add) {
+    return modifyIncomingPacketMarks(netId, {interface}, permission, add);
+}
+
+int modifyIncomingPacketMarks(unsigned netId, const std::set<std::string>& interfaces,
+                              Permission permission, bool add) {
+    if (interfaces.empty()) return 0;
+
     Fwmark fwmark;
 
     fwmark.netId = netId;
@@ -491,11 +710,16 @@ int modifyIncomingPacketMark(unsigned netId, const char* interface, Permission p
 
     const uint32_t mask = Fwmark::getUidBillingMask() | Fwmark::getIngressCpuWakeupMask();
 
-    std::string cmd = StringPrintf(
-        "%s %s -i %s -j MARK --set-mark 0x%x/0x%x", add ? "-A" : "-D",
-        RouteController::LOCAL_MANGLE_INPUT, interface, fwmark.intValue, ~mask);
-    if (RouteController::iptablesRestoreCommandFunction(V4V6, "mangle", cmd, nullptr) != 0) {
-        ALOGE("failed to change iptables rule that sets incoming packet mark");
+    std::vector<std::string> cmds;
+    for (const std::string& interface : interfaces) {
+        cmds.push_back(StringPrintf("%s %s -i %s -j MARK --set-mark 0x%x/0x%x", add ? "-A" : "-D",
+                                    RouteController::LOCAL_MANGLE_INPUT, interface.c_str(),
+                                    fwmark.intValue, ~mask));
+    }
+    if (RouteController::iptablesRestoreCommandFunction(V4V6, "mangle",
+                                                        android::base::Join(cmds, '\n'),
+                                                        nullptr) != 0) {
+        ALOGE("failed to change iptables rules that set incoming packet marks");
         return -EREMOTEIO;
     }
 
@@ -578,9 +802,8 @@ int modifyIncomingPacketMark(unsigned netId, const char* interface, Permission p
 // Even though we check permissions at the time we set a netId into the fwmark of a socket, we need
 // to check it again in the rules here, because a network's permissions may have been updated via
 // modifyNetworkPermission().
-[[nodiscard]] static int modifyExplicitNetworkRule(unsigned netId, uint32_t table,
-                                                   Permission permission, uid_t uidStart,
-                                                   uid_t uidEnd, int32_t subPriority, bool add) {
+static IpRule explicitNetworkRule(unsigned netId, uint32_t table, Permission permission,
+                                  uid_t uidStart, uid_t uidEnd, int32_t subPriority) {
     Fwmark fwmark;
     Fwmark mask;
 
@@ -593,27 +816,53 @@ int modifyIncomingPacketMark(unsigned netId, const char* interface, Permission p
     fwmark.permission = permission;
     mask.permission = permission;
 
+    return {
+            .priority = RULE_PRIORITY_EXPLICIT_NETWORK + subPriority,
+            .table = table,
+            .fwmark = fwmark.intValue,
+            .mask = mask.intValue,
+            .iif = IIF_LOOPBACK,
+            .uidStart = uidStart,
+            .uidEnd = uidEnd,
+    };
+}
+
+[[nodiscard]] static int modifyExplicitNetworkRule(unsigned netId, uint32_t table,
+                                                   Permission permission, uid_t uidStart,
+                                                   uid_t uidEnd, int32_t subPriority, bool add) {
     return modifyIpRule(add ? RTM_NEWRULE : RTM_DELRULE,
-                        RULE_PRIORITY_EXPLICIT_NETWORK + subPriority, table, fwmark.intValue,
-                        mask.intValue, IIF_LOOPBACK, OIF_NONE, uidStart, uidEnd);
+                        explicitNetworkRule(netId, table, permission, uidStart, uidEnd,
+                                            subPriority));
+}
+
+// Applies |rules| in order, stopping at the first error.
+[[nodiscard]] static int modifyIpRules(uint16_t action, const std::vector<IpRule>& rules) {
+    for (const IpRule& rule : rules) {
+        if (int ret = modifyIpRule(action, rule)) {
+            return ret;
+        }
+    }
+    return 0;
 }
 
 // A rule to route traffic based on an local network.
 //
 // Supports apps that send traffic to local IPs without binding to a particular network.
 //
-[[nodiscard]] static int modifyLocalNetworkRule(uint32_t table, bool add) {
+static std::vector<IpRule> localNetworkRules(uint32_t table) {
     Fwmark fwmark;
     Fwmark mask;
 
     fwmark.explicitlySelected = false;
     mask.explicitlySelected = true;
 
-    if (const int ret = modifyIpRule(add ? RTM_NEWRULE : RTM_DELRULE, RULE_PRIORITY_LOCAL_NETWORK,
-                                     table, fwmark.intValue, mask.intValue, IIF_NONE, OIF_NONE,
-                                     INVALID_UID, INVALID_UID)) {
-        return ret;
-    }
+    std::vector<IpRule> rules;
+    rules.push_back({
+            .priority = RULE_PRIORITY_LOCAL_NETWORK,
+            .table = table,
+            .fwmark = fwmark.intValue,
+            .mask = mask.intValue,
+    });
 
     fwmark.explicitlySelected = true;
     mask.explicitlySelected = true;
@@ -621,38 +870,84 @@ int modifyIncomingPacketMark(unsigned netId, const char* interface, Permission p
     fwmark.netId = INetd::LOCAL_NET_ID;
     mask.netId = FWMARK_NET_ID_MASK;
 
-    return modifyIpRule(add ? RTM_NEWRULE : RTM_DELRULE, RULE_PRIORITY_EXPLICIT_NETWORK, table,
-                        fwmark.intValue, mask.intValue, IIF_LOOPBACK, OIF_NONE, INVALID_UID,
-                        INVALID_UID);
+    rules.push_back({
+            .priority = RULE_PRIORITY_EXPLICIT_NETWORK,
+            .table = table,
+            .fwmark = fwmark.intValue,
+            .mask = mask.intValue,
+            .iif = IIF_LOOPBACK,
+    });
+    return rules;
 }
 
 // A rule to route traffic based on a chosen outgoing interface.
 //
 // Supports apps that use SO_BINDTODEVICE or IP_PKTINFO options and the kernel that already knows
 // the outgoing interface (typically for link-local communications).
-[[nodiscard]] static int modifyOutputInterfaceRules(const char* interface, uint32_t table,
-                                                    Permission permission, uid_t uidStart,
-                                                    uid_t uidEnd, int32_t subPriority, bool add) {
+static std::vector<IpRule> outputInterfaceRules(const char* interface, uint32_t table,
+                                                Permission permission, uid_t uidStart,
+                                                uid_t uidEnd, int32_t subPriority) {
     Fwmark fwmark;
     Fwmark mask;
 
     fwmark.permission = permission;
     mask.permission = permission;
 
+    std::vector<IpRule> rules;
     // If this rule does not specify a UID range, then also add a corresponding high-priority rule
     // for root. This covers kernel-originated packets, TEEd packets and any local daemons that open
     // sockets as root.
     if (uidStart == INVALID_UID && uidEnd == INVALID_UID) {
-        if (int ret = modifyIpRule(add ? RTM_NEWRULE : RTM_DELRULE, RULE_PRIORITY_VPN_OVERRIDE_OIF,
-                                   table, FWMARK_NONE, MASK_NONE, IIF_LOOPBACK, interface,
-                                   UID_ROOT, UID_ROOT)) {
-            return ret;
+        rules.push_back({
+                .priority = RULE_PRIORITY_VPN_OVERRIDE_OIF,
+                .table = table,
+                .fwmark = FWMARK_NONE,
+                .mask = MASK_NONE,
+                .iif = IIF_LOOPBACK,
+                .oif = interface,
+                .uidStart = UID_ROOT,
+                .uidEnd = UID_ROOT,
+        });
+    }
+
+    rules.push_back({
+            .priority = RULE_PRIORITY_OUTPUT_INTERFACE + subPriority,
+            .table = table,
+            .fwmark = fwmark.intValue,
+            .mask = mask.intValue,
+            .iif = IIF_LOOPBACK,
+            .oif = interface,
+            .uidStart = uidStart,
+            .uidEnd = uidEnd,
+    });
+    return rules;
+}
+
+[[nodiscard]] static int modifyOutputInterfaceRules(const char* interface, uint32_t table,
+                                                    Permission permission, uid_t uidStart,
+                                                    uid_t uidEnd, int32_t subPriority, bool add) {
+    return modifyIpRules(add ? RTM_NEWRULE : RTM_DELRULE,
+                         outputInterfaceRules(interface, table, permission, uidStart, uidEnd,
+                                              subPriority));
+}
+
+// The rules of a physical network that don't depend on UIDs.
+static std::vector<IpRule> physicalNetworkRules(unsigned netId, const char* interface,
+                                                uint32_t table, Permission permission,
+                                                bool local) {
+    std::vector<IpRule> rules = {explicitNetworkRule(netId, table, permission, INVALID_UID,
+                                                     INVALID_UID,
+                                                     UidRanges::SUB_PRIORITY_HIGHEST)};
+    if (local) {
+        for (IpRule& rule : localNetworkRules(table)) {
+            rules.push_back(std::move(rule));
         }
     }
-
-    return modifyIpRule(add ? RTM_NEWRULE : RTM_DELRULE,
-                        RULE_PRIORITY_OUTPUT_INTERFACE + subPriority, table, fwmark.intValue,
-                        mask.intValue, IIF_LOOPBACK, interface, uidStart, uidEnd);
+    for (IpRule& rule : outputInterfaceRules(interface, table, PERMISSION_SYSTEM, INVALID_UID,
+                                             INVALID_UID, UidRanges::SUB_PRIORITY_HIGHEST)) {
+        rules.push_back(std::move(rule));
+    }
+    return rules;
 }
 
 int RouteController::modifyVpnLocalExclusionRule(bool add, const char* physicalInterface) {
@@ -721,48 +1016,53 @@ int RouteController::modifyVpnFallthroughRule(uint16_t action, unsigned vpnNetId
                         mask.intValue);
 }
 
-// Add rules to allow legacy routes added through the requestRouteToHost() API.
-[[nodiscard]] static int addLegacyRouteRules() {
+// Rules to allow legacy routes added through the requestRouteToHost() API.
+static std::vector<IpRule> legacyRouteRules() {
     Fwmark fwmark;
     Fwmark mask;
 
     fwmark.explicitlySelected = false;
     mask.explicitlySelected = true;
 
-    // Rules to allow legacy routes to override the default network.
-    if (int ret = modifyIpRule(RTM_NEWRULE, RULE_PRIORITY_LEGACY_SYSTEM, ROUTE_TABLE_LEGACY_SYSTEM,
-                               fwmark.intValue, mask.intValue)) {
-        return ret;
-    }
-    if (int ret = modifyIpRule(RTM_NEWRULE, RULE_PRIORITY_LEGACY_NETWORK,
-                               ROUTE_TABLE_LEGACY_NETWORK, fwmark.intValue, mask.intValue)) {
-        return ret;
-    }
-
-    fwmark.permission = PERMISSION_SYSTEM;
-    mask.permission = PERMISSION_SYSTEM;
-
-    // A rule to allow legacy routes from system apps to override VPNs.
-    return modifyIpRule(RTM_NEWRULE, RULE_PRIORITY_VPN_OVERRIDE_SYSTEM, ROUTE_TABLE_LEGACY_SYSTEM,
-                        fwmark.intValue, mask.intValue);
+    Fwmark systemFwmark = fwmark;
+    Fwmark systemMask = mask;
+    systemFwmark.permission = PERMISSION_SYSTEM;
+    systemMask.permission = PERMISSION_SYSTEM;
+
+    return {
+            // Rules to allow legacy routes to override the default network.
+            {.priority = RULE_PRIORITY_LEGACY_SYSTEM,
+             .table = ROUTE_TABLE_LEGACY_SYSTEM,
+             .fwmark = fwmark.intValue,
+             .mask = mask.intValue},
+            {.priority = RULE_PRIORITY_LEGACY_NETWORK,
+             .table = ROUTE_TABLE_LEGACY_NETWORK,
+             .fwmark = fwmark.intValue,
+             .mask = mask.intValue},
+            // A rule to allow legacy routes from system apps to override VPNs.
+            {.priority = RULE_PRIORITY_VPN_OVERRIDE_SYSTEM,
+             .table = ROUTE_TABLE_LEGACY_SYSTEM,
+             .fwmark = systemFwmark.intValue,
+             .mask = systemMask.intValue},
+    };
 }
 
-// Add rules to lookup the local network when specified explicitly or otherwise.
-[[nodiscard]] static int addLocalNetworkRules(unsigned localNetId) {
-    if (int ret = modifyExplicitNetworkRule(localNetId, ROUTE_TABLE_LOCAL_NETWORK, PERMISSION_NONE,
-                                            INVALID_UID, INVALID_UID,
-                                            UidRanges::SUB_PRIORITY_HIGHEST, ACTION_ADD)) {
-        return ret;
-    }
-
+// Rules to lookup the local network when specified explicitly or otherwise.
+static std::vector<IpRule> localNetworkBaseRules(unsigned localNetId) {
     Fwmark fwmark;
     Fwmark mask;
 
     fwmark.explicitlySelected = false;
     mask.explicitlySelected = true;
 
-    return modifyIpRule(RTM_NEWRULE, RULE_PRIORITY_LOCAL_NETWORK, ROUTE_TABLE_LOCAL_NETWORK,
-                        fwmark.intValue, mask.intValue);
+    return {
+            explicitNetworkRule(localNetId, ROUTE_TABLE_LOCAL_NETWORK, PERMISSION_NONE,
+                                INVALID_UID, INVALID_UID, UidRanges::SUB_PRIORITY_HIGHEST),
+            {.priority = RULE_PRIORITY_LOCAL_NETWORK,
+             .table = ROUTE_TABLE_LOCAL_NETWORK,
+             .fwmark = fwmark.intValue,
+             .mask = mask.intValue},
+    };
 }
 
 /* static */
@@ -802,13 +1102,12 @@ int RouteController::configureDummyNetwork() {
     return 0;
 }
 
-// Add an explicit unreachable rule close to the end of the prioriy list to make it clear that
-// relying on the kernel-default "from all lookup main" rule at priority 32766 is not intended
-// behaviour. We do flush the kernel-default rules at startup, but having an explicit unreachable
-// rule will hopefully make things even clearer.
-[[nodiscard]] static int addUnreachableRule() {
-    return modifyIpRule(RTM_NEWRULE, RULE_PRIORITY_UNREACHABLE, FR_ACT_UNREACHABLE, RT_TABLE_UNSPEC,
-                        MARK_UNSET, MARK_UNSET, IIF_NONE, OIF_NONE, INVALID_UID, INVALID_UID);
+// An explicit unreachable rule close to the end of the prioriy list to make it clear that relying
+// on the kernel-default "from all lookup main" rule at priority 32766 is not intended behaviour. We
+// do remove the kernel-default rules at startup, but having an explicit unreachable rule will
+// hopefully make things even clearer.
+static IpRule unreachableRule() {
+    return {.priority = RULE_PRIORITY_UNREACHABLE, .ruleType = FR_ACT_UNREACHABLE};
 }
 
 [[nodiscard]] static int modifyLocalNetwork(unsigned netId, const char* interface, bool add) {
@@ -916,22 +1215,8 @@ int RouteController::modifyPhysicalNetwork(unsigned netId, const char* interface
     if (int ret = modifyIncomingPacketMark(netId, interface, permission, add)) {
         return ret;
     }
-    if (int ret = modifyExplicitNetworkRule(netId, table, permission, INVALID_UID, INVALID_UID,
-                                            UidRanges::SUB_PRIORITY_HIGHEST, add)) {
-        return ret;
-    }
-    if (local) {
-        if (const int ret = modifyLocalNetworkRule(table, add)) {
-            return ret;
-        }
-    }
-    if (int ret = modifyOutputInterfaceRules(interface, table, PERMISSION_SYSTEM, INVALID_UID,
-                                             INVALID_UID,
-                                             UidRanges::SUB_PRIORITY_HIGHEST, add)) {
-        return ret;
-    }
-
-    return 0;
+    return modifyIpRules(add ? RTM_NEWRULE : RTM_DELRULE,
+                         physicalNetworkRules(netId, interface, table, permission, local));
 }
 
 int RouteController::modifyUidLocalNetworkRule(const char* interface, uid_t uidStart, uid_t uidEnd,
@@ -1127,32 +1412,31 @@ int RouteController::modifyTetheredNetwork(uint16_t action, const char* inputInt
                         inputInterface, OIF_NONE, INVALID_UID, INVALID_UID);
 }
 
+// Returns the table that routes of |tableType| through |interface| go to, or RT_TABLE_UNSPEC if
+// the interface has no table.
+uint32_t RouteController::getRouteTableForType(const char* interface, TableType tableType,
+                                               bool isLocal) {
+    switch (tableType) {
+        case RouteController::INTERFACE:
+            return getRouteTableForInterface(interface, isLocal);
+        case RouteController::LOCAL_NETWORK:
+            return ROUTE_TABLE_LOCAL_NETWORK;
+        case RouteController::LEGACY_NETWORK:
+            return ROUTE_TABLE_LEGACY_NETWORK;
+        case RouteController::LEGACY_SYSTEM:
+            return ROUTE_TABLE_LEGACY_SYSTEM;
+    }
+    return RT_TABLE_UNSPEC;
+}
+
 // Adds or removes an IPv4 or IPv6 route to the specified table.
 // Returns 0 on success or negative errno on failure.
 int RouteController::modifyRoute(uint16_t action, uint16_t flags, const char* interface,
                                  const char* destination, const char* nexthop, TableType tableType,
                                  int mtu, int priority, bool isLocal) {
-    uint32_t table;
-    switch (tableType) {
-        case RouteController::INTERFACE: {
-            table = getRouteTableForInterface(interface, isLocal);
-            if (table == RT_TABLE_UNSPEC) {
-                return -ESRCH;
-            }
-            break;
-        }
-        case RouteController::LOCAL_NETWORK: {
-            table = ROUTE_TABLE_LOCAL_NETWORK;
-            break;
-        }
-        case RouteController::LEGACY_NETWORK: {
-            table = ROUTE_TABLE_LEGACY_NETWORK;
-            break;
-        }
-        case RouteController::LEGACY_SYSTEM: {
-            table = ROUTE_TABLE_LEGACY_SYSTEM;
-            break;
-        }
+    const uint32_t table = getRouteTableForType(interface, tableType, isLocal);
+    if (table == RT_TABLE_UNSPEC) {
+        return -ESRCH;
     }
 
     int ret = modifyIpRoute(action, flags, table, interface, destination, nexthop, mtu, priority);
@@ -1194,34 +1478,289 @@ static void maybeModifyQdiscClsact(const char* interface, bool add) {
     return;
 }
 
+uint32_t getRulePriority(const nlmsghdr *nlh) {
+    return getRtmU32Attribute(nlh, FRA_PRIORITY);
+}
+
+// Deletes every tethering rule for |inputInterface|, whatever it points to.
 [[nodiscard]] static int clearTetheringRules(const char* inputInterface) {
-    int ret = 0;
-    while (ret == 0) {
-        ret = modifyIpRule(RTM_DELRULE, RULE_PRIORITY_TETHERING, 0, MARK_UNSET, MARK_UNSET,
-                           inputInterface, OIF_NONE, INVALID_UID, INVALID_UID);
+    NetlinkDumpFilter shouldDelete = [inputInterface](nlmsghdr* nlh) {
+        return getRulePriority(nlh) == RULE_PRIORITY_TETHERING &&
+               getRtmStringAttribute(nlh, FRA_IIFNAME) == inputInterface;
+    };
+    std::lock_guard lock(sInstalledRulesLock);
+    const int ret = rtNetlinkFlush(RTM_GETRULE, RTM_DELRULE, "tethering rules", shouldDelete);
+    std::erase_if(sInstalledRules, [inputInterface](const IpRule& rule) {
+        return rule.priority == RULE_PRIORITY_TETHERING && rule.iif == inputInterface;
+    });
+    return ret;
+}
+
+uint32_t getRouteTable(const nlmsghdr *nlh) {
+    return getRtmU32Attribute(nlh, RTA_TABLE);
+}
+
+namespace {
+
+// Returns |rules| with each rule for both families split into one rule per family, sorted and
+// without duplicates.
+std::vector<IpRule> perFamilyRules(const std::vector<IpRule>& rules) {
+    std::vector<IpRule> result;
+    for (const IpRule& rule : rules) {
+        for (const uint8_t family : AF_FAMILIES) {
+            if (rule.family != AF_UNSPEC && rule.family != family) continue;
+            result.push_back(rule);
+            result.back().family = family;
+        }
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+// Sends one request per rule in |rules| in a single netlink batch. |done| receives the rules that
+// the kernel applied. Deleting a rule that does not exist counts as success. The caller records the
+// rules in sInstalledRules if it should.
+// Returns 0 if every rule was applied, or the first error.
+int sendIpRules(int sock, uint16_t action, const std::vector<IpRule>& rules,
+                std::vector<IpRule>* done) REQUIRES(sInstalledRulesLock) {
+    done->clear();
+    NetlinkBatch batch;
+    for (const IpRule& rule : rules) {
+        if (int ret = modifyIpRule(action, rule, &batch)) {
+            return ret;
+        }
     }
 
-    if (ret == -ENOENT) {
-        return 0;
-    } else {
-        return ret;
+    std::vector<int> results;
+    int ret = batch.send(sock, [](size_t, nlmsghdr*) {}, &results);
+    for (size_t i = 0; i < rules.size(); i++) {
+        const int err = (action == RTM_DELRULE && results[i] == -ENOENT) ? 0 : results[i];
+        if (err == 0) {
+            done->push_back(rules[i]);
+            continue;
+        }
+        ALOGE("Error %s %s rule with priority %d: %s", actionName(action),
+              familyName(rules[i].family), rules[i].priority, strerror(-err));
+        if (ret == 0) ret = err;
     }
+    return ret;
 }
 
-uint32_t getRulePriority(const nlmsghdr *nlh) {
-    return getRtmU32Attribute(nlh, FRA_PRIORITY);
+// Sends |rules| and records the ones that the kernel applied.
+int sendAndRecordIpRulesLocked(int sock, uint16_t action, const std::vector<IpRule>& rules,
+                               std::vector<IpRule>* done) REQUIRES(sInstalledRulesLock) {
+    const int ret = sendIpRules(sock, action, rules, done);
+    for (const IpRule& rule : *done) {
+        recordIpRuleLocked(action, rule);
+    }
+    return ret;
 }
 
-uint32_t getRouteTable(const nlmsghdr *nlh) {
-    return getRtmU32Attribute(nlh, RTA_TABLE);
+// A rule read from the kernel.
+struct KernelRule {
+    IpRule rule;
+    // False if the rule uses selectors that IpRule can't represent, such as source prefixes.
+    bool representable;
+    // The dumped message, so that the rule can be deleted exactly as it is.
+    std::vector<uint8_t> payload;
+};
+
+KernelRule parseKernelRule(nlmsghdr* nlh) {
+    const auto* hdr = static_cast<const fib_rule_hdr*>(NLMSG_DATA(nlh));
+    const uint8_t* payload = static_cast<const uint8_t*>(NLMSG_DATA(nlh));
+    KernelRule kernelRule = {
+            .rule = {.priority = 0, .ruleType = hdr->action, .table = hdr->table,
+                     .family = hdr->family},
+            .representable = !hdr->dst_len && !hdr->src_len && !hdr->tos &&
+                             !(hdr->flags & FIB_RULE_INVERT),
+            .payload = std::vector<uint8_t>(payload, payload + NLMSG_PAYLOAD(nlh, 0)),
+    };
+
+    IpRule& rule = kernelRule.rule;
+    uint32_t len = NLMSG_PAYLOAD(nlh, sizeof(*hdr));
+    for (rtattr* rta = reinterpret_cast<rtattr*>(reinterpret_cast<uint8_t*>(NLMSG_DATA(nlh)) +
+                                                 NLMSG_ALIGN(sizeof(*hdr)));
+         RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        const void* data = RTA_DATA(rta);
+        const size_t size = RTA_PAYLOAD(rta);
+        switch (rta->rta_type) {
+            case FRA_PRIORITY:
+                rule.priority = *static_cast<const uint32_t*>(data);
+                break;
+            case FRA_TABLE:
+                rule.table = *static_cast<const uint32_t*>(data);
+                break;
+            case FRA_FWMARK:
+                rule.fwmark = *static_cast<const uint32_t*>(data);
+                break;
+            case FRA_FWMASK:
+                rule.mask = *static_cast<const uint32_t*>(data);
+                break;
+            case FRA_IIFNAME:
+                rule.iif.assign(static_cast<const char*>(data),
+                                strnlen(static_cast<const char*>(data), size));
+                break;
+            case FRA_OIFNAME:
+                rule.oif.assign(static_cast<const char*>(data),
+                                strnlen(static_cast<const char*>(data), size));
+                break;
+            case FRA_UID_RANGE: {
+                const auto* range = static_cast<const fib_rule_uid_range*>(data);
+                rule.uidStart = range->start;
+                rule.uidEnd = range->end;
+                break;
+            }
+            case FRA_PROTOCOL:
+                // Who added the rule, not what it matches.
+                break;
+            case FRA_SUPPRESS_PREFIXLEN:
+            case FRA_SUPPRESS_IFGROUP:
+                // The kernel dumps these on every rule, with all bits set when they are unset.
+                if (*static_cast<const uint32_t*>(data) != UINT32_MAX) {
+                    kernelRule.representable = false;
+                }
+                break;
+            default:
+                kernelRule.representable = false;
+                break;
+        }
+    }
+    return kernelRule;
 }
 
-[[nodiscard]] static int flushRules() {
-    NetlinkDumpFilter shouldDelete = [] (nlmsghdr *nlh) {
-        // Don't touch rules at priority 0 because by default they are used for local input.
-        return getRulePriority(nlh) != 0;
+struct RuleDriftStats {
+    uint64_t checks = 0;
+    uint64_t failures = 0;
+    uint64_t missing = 0;
+    uint64_t unexpected = 0;
+    size_t lastMissing = 0;
+    size_t lastUnexpected = 0;
+    int64_t lastLatencyUs = 0;
+};
+
+std::mutex sRuleDriftStatsLock;
+RuleDriftStats sRuleDriftStats GUARDED_BY(sRuleDriftStatsLock);
+
+// How often repairRules() runs after Init().
+constexpr auto RULE_REPAIR_INTERVAL = std::chrono::minutes(10);
+
+// Makes the kernel's rules with priorities accepted by |owned| match the rules in |desired| with
+// those priorities. |desired| holds one rule per family. The kernel is dumped once. Rules missing
+// from it are added in one batch before unexpected rules are deleted in another, and rules that
+// are already correct are not touched.
+int reconcileRulesLocked(const std::multiset<IpRule>& desired,
+                         const std::function<bool(uint32_t priority)>& owned)
+        REQUIRES(sInstalledRulesLock) {
+    const auto start = std::chrono::steady_clock::now();
+
+    std::multiset<IpRule> missing;
+    for (const IpRule& rule : desired) {
+        if (owned(rule.priority)) missing.insert(rule);
+    }
+    std::vector<std::vector<uint8_t>> unexpected;
+    NetlinkDumpCallback callback = [&missing, &unexpected, &owned](nlmsghdr* nlh) {
+        KernelRule kernelRule = parseKernelRule(nlh);
+        if (!owned(kernelRule.rule.priority)) return;
+        if (kernelRule.representable) {
+            if (auto it = missing.find(kernelRule.rule); it != missing.end()) {
+                missing.erase(it);
+                return;
+            }
+        }
+        unexpected.push_back(std::move(kernelRule.payload));
     };
-    return rtNetlinkFlush(RTM_GETRULE, RTM_DELRULE, "rules", shouldDelete);
+    int ret = 0;
+    for (const uint8_t family : AF_FAMILIES) {
+        fib_rule_hdr hdr = {.family = family};
+        iovec iov[] = {
+                {nullptr, 0},
+                {&hdr, sizeof(hdr)},
+        };
+        if ((ret = sendNetlinkRequest(RTM_GETRULE, NETLINK_DUMP_FLAGS, iov, ARRAY_SIZE(iov),
+                                      &callback))) {
+            break;
+        }
+    }
+
+    if (ret == 0) {
+        ret = openNetlinkSocket(NETLINK_ROUTE);
+    }
+    if (ret >= 0) {
+        const int sock = ret;
+        std::vector<IpRule> added;
+        ret = sendIpRules(sock, RTM_NEWRULE, std::vector<IpRule>(missing.begin(), missing.end()),
+                          &added);
+        close(sock);
+        if (int deleteRet = rtNetlinkDelete(RTM_DELRULE, "rules", unexpected); ret == 0) {
+            ret = deleteRet;
+        }
+    }
+    if (!missing.empty() || !unexpected.empty()) {
+        ALOGW("Rule drift: %zu missing, %zu unexpected", missing.size(), unexpected.size());
+    }
+
+    const int64_t latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                                      std::chrono::steady_clock::now() - start)
+                                      .count();
+    std::lock_guard lock(sRuleDriftStatsLock);
+    RuleDriftStats& stats = sRuleDriftStats;
+    stats.checks++;
+    if (ret != 0) stats.failures++;
+    stats.missing += missing.size();
+    stats.unexpected += unexpected.size();
+    stats.lastMissing = missing.size();
+    stats.lastUnexpected = unexpected.size();
+    stats.lastLatencyUs = latencyUs;
+    return ret;
+}
+
+}  // namespace
+
+int RouteController::repairRules() {
+    // Only consider rules in netd's range of priorities, in case something else added rules.
+    return repairRules(RULE_PRIORITY_VPN_OVERRIDE_SYSTEM, RULE_PRIORITY_UNREACHABLE);
+}
+
+int RouteController::repairRules(uint32_t firstPriority, uint32_t lastPriority) {
+    std::lock_guard lock(sInstalledRulesLock);
+    return reconcileRulesLocked(sInstalledRules, [firstPriority, lastPriority](uint32_t priority) {
+        return priority >= firstPriority && priority <= lastPriority;
+    });
+}
+
+void RouteController::getLastRuleDrift(size_t* missing, size_t* unexpected) {
+    std::lock_guard lock(sRuleDriftStatsLock);
+    *missing = sRuleDriftStats.lastMissing;
+    *unexpected = sRuleDriftStats.lastUnexpected;
+}
+
+// Repairs rule drift every RULE_REPAIR_INTERVAL, e.g., rules deleted by hand or by other processes.
+static void startRuleRepair() {
+    static std::once_flag started;
+    std::call_once(started, [] {
+        std::thread([] {
+            while (true) {
+                std::this_thread::sleep_for(RULE_REPAIR_INTERVAL);
+                if (int ret = RouteController::repairRules()) {
+                    ALOGE("Error repairing rules: %s", strerror(-ret));
+                }
+            }
+        }).detach();
+    });
+}
+
+// Replaces every rule in the kernel with |rules|, the rules that exist regardless of any network.
+// Unlike deleting all rules and adding |rules|, this leaves the rules that a previous instance of
+// netd added in place, so traffic never goes without a routing policy when netd restarts.
+[[nodiscard]] static int resetRules(const std::vector<IpRule>& rules) {
+    std::lock_guard lock(sInstalledRulesLock);
+    sInstalledRules.clear();
+    for (IpRule& rule : perFamilyRules(rules)) {
+        sInstalledRules.insert(std::move(rule));
+    }
+    // Don't touch rules at priority 0 because by default they are used for local input.
+    return reconcileRulesLocked(sInstalledRules, [](uint32_t priority) { return priority != 0; });
 }
 
 int RouteController::flushRoutes(uint32_t table) {
@@ -1259,24 +1798,22 @@ int RouteController::flushRoutes(const char* interface, bool local) {
     // Skip erasing local fake interface since it does not exist in sInterfaceToTable.
     if (ret == 0 && !local) {
         sInterfaceToTable.erase(interface);
+        publishInterfaceToTableLocked();
     }
 
     return ret;
 }
 
 int RouteController::Init(unsigned localNetId) {
-    if (int ret = flushRules()) {
-        return ret;
-    }
-    if (int ret = addLegacyRouteRules()) {
-        return ret;
-    }
-    if (int ret = addLocalNetworkRules(localNetId)) {
-        return ret;
+    std::vector<IpRule> rules = legacyRouteRules();
+    for (IpRule& rule : localNetworkBaseRules(localNetId)) {
+        rules.push_back(std::move(rule));
     }
-    if (int ret = addUnreachableRule()) {
+    rules.push_back(unreachableRule());
+    if (int ret = resetRules(rules)) {
         return ret;
     }
+    startRuleRepair();
     // Don't complain if we can't add the dummy network, since not all devices support it.
     configureDummyNetwork();
 
@@ -1290,6 +1827,7 @@ int RouteController::addInterfaceToLocalNetwork(unsigned netId, const char* inte
     }
     std::lock_guard lock(sInterfaceToTableLock);
     sInterfaceToTable[interface] = ROUTE_TABLE_LOCAL_NETWORK;
+    publishInterfaceToTableLocked();
     return 0;
 }
 
@@ -1299,6 +1837,7 @@ int RouteController::removeInterfaceFromLocalNetwork(unsigned netId, const char*
     }
     std::lock_guard lock(sInterfaceToTableLock);
     sInterfaceToTable.erase(interface);
+    publishInterfaceToTableLocked();
     return 0;
 }
 
@@ -1367,19 +1906,145 @@ int RouteController::removeInterfaceFromVirtualNetwork(unsigned netId, const cha
     return 0;
 }
 
-int RouteController::modifyPhysicalNetworkPermission(unsigned netId, const char* interface,
+namespace {
+
+struct RuleTransitionStats {
+    uint64_t transitions = 0;
+    uint64_t failures = 0;
+    uint64_t rulesAdded = 0;
+    uint64_t rulesDeleted = 0;
+    uint64_t rulesKept = 0;
+    int64_t lastLatencyUs = 0;
+    int64_t maxLatencyUs = 0;
+};
+
+std::mutex sRuleTransitionStatsLock;
+RuleTransitionStats sRuleTransitionStats GUARDED_BY(sRuleTransitionStatsLock);
+
+}  // namespace
+
+// Replaces the rules in |oldRules| with those in |newRules|. Rules that are in both are left alone.
+// All the rules to add are sent in one netlink batch, and only once they are all in place are the
+// rules to delete sent in a second batch. So every packet matches either the complete old set or
+// the complete new set. If either batch fails, whatever it and the batch before it changed is
+// undone, leaving the old rules in place.
+// Returns 0 on success or negative errno on failure.
+int RouteController::transitionRules(const std::vector<IpRule>& oldRules,
+                                     const std::vector<IpRule>& newRules) {
+    const auto start = std::chrono::steady_clock::now();
+
+    const std::vector<IpRule> oldSet = perFamilyRules(oldRules);
+    const std::vector<IpRule> newSet = perFamilyRules(newRules);
+    std::vector<IpRule> toAdd;
+    std::vector<IpRule> toDelete;
+    std::set_difference(newSet.begin(), newSet.end(), oldSet.begin(), oldSet.end(),
+                        std::back_inserter(toAdd));
+    std::set_difference(oldSet.begin(), oldSet.end(), newSet.begin(), newSet.end(),
+                        std::back_inserter(toDelete));
+
+    int ret = openNetlinkSocket(NETLINK_ROUTE);
+    if (ret >= 0) {
+        const int sock = ret;
+        std::vector<IpRule> added;
+        std::vector<IpRule> deleted;
+        std::vector<IpRule> undone;
+        std::lock_guard rulesLock(sInstalledRulesLock);
+        ret = sendAndRecordIpRulesLocked(sock, RTM_NEWRULE, toAdd, &added);
+        if (ret == 0) {
+            ret = sendAndRecordIpRulesLocked(sock, RTM_DELRULE, toDelete, &deleted);
+            if (ret != 0 &&
+                sendAndRecordIpRulesLocked(sock, RTM_NEWRULE, deleted, &undone) != 0) {
+                ALOGE("failed to restore %zu deleted rules", deleted.size() - undone.size());
+            }
+        }
+        if (ret != 0 && sendAndRecordIpRulesLocked(sock, RTM_DELRULE, added, &undone) != 0) {
+            ALOGE("failed to remove %zu added rules", added.size() - undone.size());
+        }
+        close(sock);
+    }
+
+    const int64_t latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                                      std::chrono::steady_clock::now() - start)
+                                      .count();
+    std::lock_guard lock(sRuleTransitionStatsLock);
+    RuleTransitionStats& stats = sRuleTransitionStats;
+    stats.transitions++;
+    if (ret != 0) {
+        stats.failures++;
+    } else {
+        stats.rulesAdded += toAdd.size();
+        stats.rulesDeleted += toDelete.size();
+        stats.rulesKept += oldSet.size() - toDelete.size();
+    }
+    stats.lastLatencyUs = latencyUs;
+    stats.maxLatencyUs = std::max(stats.maxLatencyUs, latencyUs);
+    return ret;
+}
+
+int RouteController::modifyPhysicalNetworkPermission(unsigned netId,
+                                                     const std::set<std::string>& interfaces,
                                                      Permission oldPermission,
                                                      Permission newPermission, bool local) {
     // Physical network rules either use permission bits or UIDs, but not both.
     // So permission changes don't affect any UID-based rules.
-    UidRangeMap emptyUidRangeMap;
-    // Add the new rules before deleting the old ones, to avoid race conditions.
-    if (int ret = modifyPhysicalNetwork(netId, interface, emptyUidRangeMap, newPermission,
-                                        ACTION_ADD, MODIFY_NON_UID_BASED_RULES, local)) {
+    std::vector<IpRule> oldRules;
+    std::vector<IpRule> newRules;
+    for (const std::string& interface : interfaces) {
+        uint32_t table = getRouteTableForInterface(interface.c_str(), false /* local */);
+        if (table == RT_TABLE_UNSPEC) {
+            return -ESRCH;
+        }
+        for (IpRule& rule :
+             physicalNetworkRules(netId, interface.c_str(), table, oldPermission, local)) {
+            oldRules.push_back(std::move(rule));
+        }
+        for (IpRule& rule :
+             physicalNetworkRules(netId, interface.c_str(), table, newPermission, local)) {
+            newRules.push_back(std::move(rule));
+        }
+    }
+
+    // Incoming packets are marked by iptables rules, not FIB rules. As with the FIB rules, add the
+    // new ones before deleting the old ones, to avoid race conditions. The rules for all the
+    // interfaces are changed in one iptables-restore transaction, so they either all change or
+    // none do.
+    if (int ret = modifyIncomingPacketMarks(netId, interfaces, newPermission, ACTION_ADD)) {
+        return ret;
+    }
+    if (int ret = transitionRules(oldRules, newRules)) {
+        (void)modifyIncomingPacketMarks(netId, interfaces, newPermission, ACTION_DEL);
         return ret;
     }
-    return modifyPhysicalNetwork(netId, interface, emptyUidRangeMap, oldPermission, ACTION_DEL,
-                                 MODIFY_NON_UID_BASED_RULES, local);
+    return modifyIncomingPacketMarks(netId, interfaces, oldPermission, ACTION_DEL);
+}
+
+void RouteController::dump(DumpWriter& dw) {
+    RuleTransitionStats stats;
+    {
+        std::lock_guard lock(sRuleTransitionStatsLock);
+        stats = sRuleTransitionStats;
+    }
+    dw.println("Rule transitions: %" PRIu64 " (%" PRIu64 " failed)", stats.transitions,
+               stats.failures);
+    dw.incIndent();
+    dw.println("Rules added: %" PRIu64 " deleted: %" PRIu64 " kept: %" PRIu64, stats.rulesAdded,
+               stats.rulesDeleted, stats.rulesKept);
+    dw.println("Latency: last %" PRId64 "us max %" PRId64 "us", stats.lastLatencyUs,
+               stats.maxLatencyUs);
+    dw.decIndent();
+
+    RuleDriftStats drift;
+    {
+        std::lock_guard lock(sRuleDriftStatsLock);
+        drift = sRuleDriftStats;
+    }
+    dw.println("Rule drift checks: %" PRIu64 " (%" PRIu64 " failed)", drift.checks,
+               drift.failures);
+    dw.incIndent();
+    dw.println("Rules missing: %" PRIu64 " unexpected: %" PRIu64, drift.missing, drift.unexpected);
+    dw.println("Last check: %zu missing, %zu unexpected, %" PRId64 "us", drift.lastMissing,
+               drift.lastUnexpected, drift.lastLatencyUs);
+    dw.decIndent();
 }
 
 int RouteController::addUsersToRejectNonSecureNetworkRule(const UidRanges& uidRanges) {
@@ -1447,6 +2112,74 @@ int RouteController::addRoute(const char* interface, const char* destination, co
     return 0;
 }
 
+int RouteController::addRoutes(const std::vector<Route>& routes, TableType tableType,
+                               std::vector<int>* results) {
+    // Every request asks for an ack that echoes it, so bound the size of a batch to keep the
+    // responses well within the socket receive buffer.
+    constexpr size_t kMaxRoutesPerBatch = 128;
+
+    results->assign(routes.size(), 0);
+    if (routes.empty()) return 0;
+
+    const int sock = openNetlinkSocket(NETLINK_ROUTE);
+    if (sock < 0) {
+        results->assign(routes.size(), sock);
+        return sock;
+    }
+
+    int ret = 0;
+    size_t end = 0;
+    for (size_t start = 0; start < routes.size() && ret == 0; start = end) {
+        end = std::min(routes.size(), start + kMaxRoutesPerBatch);
+        NetlinkBatch batch;
+        // The route that each request in |batch| adds. As in addRoute(), routes to local
+        // prefixes are added to the local table as well.
+        std::vector<size_t> requestRoutes;
+        for (size_t i = start; i < end; i++) {
+            const Route& route = routes[i];
+            const bool alsoLocal = isLocalRoute(tableType, route.destination, route.nexthop);
+            for (const bool isLocal : {false, true}) {
+                if (isLocal && !alsoLocal) break;
+                const uint32_t table = getRouteTableForType(route.interface, tableType, isLocal);
+                int err = (table == RT_TABLE_UNSPEC)
+                                  ? -ESRCH
+                                  : modifyIpRoute(RTM_NEWROUTE, NETLINK_ROUTE_CREATE_FLAGS, table,
+                                                  route.interface, route.destination,
+                                                  route.nexthop, route.mtu, 0 /* priority */,
+                                                  &batch);
+                if (err) {
+                    (*results)[i] = err;
+                    break;
+                }
+                requestRoutes.push_back(i);
+            }
+        }
+
+        std::vector<int> requestResults;
+        ret = batch.send(sock, [](size_t, nlmsghdr*) {}, &requestResults);
+        for (size_t j = 0; j < requestRoutes.size(); j++) {
+            const size_t i = requestRoutes[j];
+            // Trying to add a route that already exists shouldn't cause an error.
+            if ((*results)[i] == 0 && requestResults[j] != -EEXIST) {
+                (*results)[i] = requestResults[j];
+            }
+        }
+    }
+    close(sock);
+
+    for (size_t i = 0; i < routes.size(); i++) {
+        // Routes in or after a failed exchange may never have reached the kernel.
+        if (ret != 0 && (i >= end || (*results)[i] == -EIO)) {
+            (*results)[i] = ret;
+        }
+        if ((*results)[i] == 0) continue;
+        ALOGE("Error adding route %s -> %s %s: %s", routes[i].destination,
+              routes[i].nexthop ? routes[i].nexthop : "", routes[i].interface,
+              strerror(-(*results)[i]));
+    }
+    return ret;
+}
+
 int RouteController::removeRoute(const char* interface, const char* destination,
                                  const char* nexthop, TableType tableType, int priority) {
     if (int ret = modifyRoute(RTM_DELROUTE, NETLINK_REQUEST_FLAGS, interface, destination, nexthop,
@@ -1525,6 +2258,9 @@ int RouteController::removeUsersFromUnreachableNetwork(unsigned netId,
 
 // Protects sInterfaceToTable.
 std::mutex RouteController::sInterfaceToTableLock;
-std::map<std::string, uint32_t> RouteController::sInterfaceToTable;
+RouteController::InterfaceToTableMap RouteController::sInterfaceToTable;
+std::shared_ptr<const RouteController::InterfaceToTableMap>
+        RouteController::sInterfaceToTableSnapshot =
+                std::make_shared<const RouteController::InterfaceToTableMap>();
 
 }  // namespace android::net
@@ -22,11 +22,20 @@
 #include "Permission.h"
 
 #include <android-base/thread_annotations.h>
+#include <netdutils/DumpWriter.h>
 
+#include <linux/fib_rules.h>
 #include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
 
 namespace android::net {
 
@@ -85,6 +94,7 @@ constexpr int32_t RULE_PRIORITY_DEFAULT_NETWORK                   = 31000;
 constexpr int32_t RULE_PRIORITY_UNREACHABLE                       = 32000;
 // clang-format on
 
+class NetlinkBatch;
 class UidRanges;
 
 class RouteController {
@@ -107,6 +117,41 @@ public:
 
     [[nodiscard]] static int Init(unsigned localNetId);
 
+    // A FIB rule, as added or deleted by modifyIpRule().
+    struct IpRule {
+        int32_t priority;
+        uint8_t ruleType = FR_ACT_TO_TBL;
+        uint32_t table = RT_TABLE_UNSPEC;
+        // Only matched if |mask| is non-zero.
+        uint32_t fwmark = 0;
+        uint32_t mask = 0;
+        // Empty to match any interface.
+        std::string iif;
+        std::string oif;
+        uid_t uidStart = INVALID_UID;
+        uid_t uidEnd = INVALID_UID;
+        // AF_UNSPEC for a rule in both the IPv4 and the IPv6 rule tables.
+        uint8_t family = AF_UNSPEC;
+
+        auto tie() const {
+            return std::tie(priority, ruleType, table, fwmark, mask, iif, oif, uidStart, uidEnd,
+                            family);
+        }
+        bool operator<(const IpRule& other) const { return tie() < other.tie(); }
+        bool operator==(const IpRule& other) const { return tie() == other.tie(); }
+    };
+
+    static void dump(netdutils::DumpWriter& dw);
+
+    // Blocks until RT_TABLES_PATH reflects every interface change made so far. The file is
+    // normally rewritten in the background, shortly after the change.
+    static void flushTableNamesFile();
+
+    // Compares the kernel's rules in netd's range of priorities with the rules that netd has
+    // installed, and adds or deletes rules to remove any differences. Called periodically after
+    // Init(). Returns 0 on success or negative errno on failure.
+    [[nodiscard]] static int repairRules();
+
     // Returns an ifindex given the interface name, by looking up in sInterfaceToTable.
     // This is currently only used by NetworkController::addInterfaceToNetwork
     // and should probabaly be changed to passing the ifindex into RouteController instead.
@@ -114,7 +159,7 @@ public:
     // correspond to different interface indices over time. This way, even if the interface
     // index has changed, we can still free any map entries indexed by the ifindex that was
     // used to add them.
-    static uint32_t getIfIndex(const char* interface) EXCLUDES(sInterfaceToTableLock);
+    static uint32_t getIfIndex(const char* interface);
 
     [[nodiscard]] static int addInterfaceToLocalNetwork(unsigned netId, const char* interface);
     [[nodiscard]] static int removeInterfaceFromLocalNetwork(unsigned netId, const char* interface);
@@ -138,9 +183,11 @@ public:
                                                                const UidRangeMap& uidRangeMap,
                                                                bool excludeLocalRoutes);
 
-    [[nodiscard]] static int modifyPhysicalNetworkPermission(unsigned netId, const char* interface,
-                                                             Permission oldPermission,
-                                                             Permission newPermission, bool local);
+    // Changes the permission of a physical network on all of its |interfaces| at once. Only the
+    // rules that differ between the two permissions are added and deleted. See transitionRules().
+    [[nodiscard]] static int modifyPhysicalNetworkPermission(
+            unsigned netId, const std::set<std::string>& interfaces, Permission oldPermission,
+            Permission newPermission, bool local);
 
     [[nodiscard]] static int addUsersToVirtualNetwork(unsigned netId, const char* interface,
                                                       bool secure, const UidRangeMap& uidRangeMap,
@@ -163,6 +210,18 @@ public:
     [[nodiscard]] static int addRoute(const char* interface, const char* destination,
                                       const char* nexthop, TableType tableType, int mtu,
                                       int priority);
+    struct Route {
+        const char* interface;
+        const char* destination;
+        // As for addRoute().
+        const char* nexthop;
+        int mtu;
+    };
+    // Adds |routes| like addRoute() does, but with as few netlink exchanges as possible.
+    // |results| receives 0 or negative errno for each route. Returns negative errno if an exchange
+    // with the kernel failed.
+    [[nodiscard]] static int addRoutes(const std::vector<Route>& routes, TableType tableType,
+                                       std::vector<int>* results);
     [[nodiscard]] static int removeRoute(const char* interface, const char* destination,
                                          const char* nexthop, TableType tableType, int priority);
     [[nodiscard]] static int updateRoute(const char* interface, const char* destination,
@@ -209,8 +268,17 @@ public:
             "224.0.0.0/24"  // Link-local multicast; non-internet routable
     };
 
+    using InterfaceToTableMap = std::map<std::string, uint32_t>;
+
+    // Writers modify sInterfaceToTable under sInterfaceToTableLock and then publish a copy of it
+    // in sInterfaceToTableSnapshot. Readers load the snapshot and never take the lock. Interfaces
+    // come and go far less often than their tables are looked up.
     static std::mutex sInterfaceToTableLock;
-    static std::map<std::string, uint32_t> sInterfaceToTable GUARDED_BY(sInterfaceToTableLock);
+    static InterfaceToTableMap sInterfaceToTable GUARDED_BY(sInterfaceToTableLock);
+    static std::shared_ptr<const InterfaceToTableMap> sInterfaceToTableSnapshot;
+
+    static void publishInterfaceToTableLocked() REQUIRES(sInterfaceToTableLock);
+    static std::shared_ptr<const InterfaceToTableMap> interfaceToTable();
 
     static int configureDummyNetwork();
     [[nodiscard]] static int flushRoutes(const char* interface) EXCLUDES(sInterfaceToTableLock);
@@ -226,6 +294,7 @@ public:
                                      const UidRangeMap& uidRangeMap, Permission permission,
                                      bool add, bool modifyNonUidBasedRules, bool local);
     static int modifyUnreachableNetwork(unsigned netId, const UidRangeMap& uidRangeMap, bool add);
+    static uint32_t getRouteTableForType(const char* interface, TableType tableType, bool isLocal);
     static int modifyRoute(uint16_t action, uint16_t flags, const char* interface,
                            const char* destination, const char* nexthop, TableType tableType,
                            int mtu, int priority, bool isLocal);
@@ -236,7 +305,14 @@ public:
     static int modifyVirtualNetwork(unsigned netId, const char* interface,
                                     const UidRangeMap& uidRangeMap, bool secure, bool add,
                                     bool modifyNonUidBasedRules, bool excludeLocalRoutes);
-    static void updateTableNamesFile() EXCLUDES(sInterfaceToTableLock);
+    // Like repairRules(), but only for rules with priorities in [firstPriority, lastPriority].
+    [[nodiscard]] static int repairRules(uint32_t firstPriority, uint32_t lastPriority);
+    // The number of missing and unexpected rules that the last repair found.
+    static void getLastRuleDrift(size_t* missing, size_t* unexpected);
+    [[nodiscard]] static int transitionRules(const std::vector<IpRule>& oldRules,
+                                             const std::vector<IpRule>& newRules);
+    static void updateTableNamesFile();
+    static std::string tableNamesFileContents();
     static int modifyVpnLocalExclusionRule(bool add, const char* physicalInterface);
 
     static int modifyUidLocalNetworkRule(const char* interface, uid_t uidStart, uid_t uidEnd,
@@ -251,9 +327,12 @@ public:
 // functions public.
 [[nodiscard]] int modifyIpRoute(uint16_t action, uint16_t flags, uint32_t table,
                                 const char* interface, const char* destination, const char* nexthop,
-                                uint32_t mtu, uint32_t priority);
+                                uint32_t mtu, uint32_t priority, NetlinkBatch* batch = nullptr);
 uint32_t getRulePriority(const nlmsghdr *nlh);
 [[nodiscard]] int modifyIncomingPacketMark(unsigned netId, const char* interface,
                                            Permission permission, bool add);
+// Like modifyIncomingPacketMark, but for several interfaces in one iptables-restore transaction.
+[[nodiscard]] int modifyIncomingPacketMarks(unsigned netId, const std::set<std::string>& interfaces,
+                                            Permission permission, bool add);
 
 }  // namespace android::net
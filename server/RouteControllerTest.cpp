@@ -19,6 +19,8 @@
 #include <gtest/gtest.h>
 #include <fstream>
 
+#include <linux/fib_rules.h>
+
 #include "Fwmark.h"
 #include "IptablesBaseTest.h"
 #include "NetlinkCommands.h"
@@ -49,6 +51,67 @@ public:
         return RouteController::flushRoutes(a);
     }
 
+    int flushRoutes(const char* interface) {
+        return RouteController::flushRoutes(interface);
+    }
+
+    uint32_t getRouteTableForInterface(const char* interface, bool local) {
+        return RouteController::getRouteTableForInterface(interface, local);
+    }
+
+    int transitionRules(const std::vector<RouteController::IpRule>& oldRules,
+                        const std::vector<RouteController::IpRule>& newRules) {
+        return RouteController::transitionRules(oldRules, newRules);
+    }
+
+    int repairRules(uint32_t firstPriority, uint32_t lastPriority) {
+        return RouteController::repairRules(firstPriority, lastPriority);
+    }
+
+    void expectLastRuleDrift(size_t expectedMissing, size_t expectedUnexpected) {
+        size_t missing, unexpected;
+        RouteController::getLastRuleDrift(&missing, &unexpected);
+        EXPECT_EQ(expectedMissing, missing);
+        EXPECT_EQ(expectedUnexpected, unexpected);
+    }
+
+    // Adds or deletes a rule that looks up table 500, without telling RouteController.
+    static int modifyRuleBehindNetdsBack(uint16_t action, uint8_t family, uint32_t priority) {
+        struct {
+            rtattr rta;
+            uint32_t value;
+        } fraPriority = {{RTA_LENGTH(sizeof(uint32_t)), FRA_PRIORITY}, priority},
+          fraTable = {{RTA_LENGTH(sizeof(uint32_t)), FRA_TABLE}, 500};
+        fib_rule_hdr hdr = {.family = family, .action = FR_ACT_TO_TBL};
+        iovec iov[] = {
+                {nullptr, 0},
+                {&hdr, sizeof(hdr)},
+                {&fraPriority, sizeof(fraPriority)},
+                {&fraTable, sizeof(fraTable)},
+        };
+        uint16_t flags = (action == RTM_NEWRULE) ? NETLINK_RULE_CREATE_FLAGS
+                                                 : NETLINK_REQUEST_FLAGS;
+        return sendNetlinkRequest(action, flags, iov, ARRAY_SIZE(iov), nullptr);
+    }
+
+    // Returns how many IPv4 and IPv6 rules have the specified priority.
+    static int countRules(uint32_t priority) {
+        int count = 0;
+        NetlinkDumpCallback callback = [&count, priority](const nlmsghdr* nlh) {
+            if (getRulePriority(nlh) == priority) count++;
+        };
+        for (int family : {AF_INET, AF_INET6}) {
+            rtmsg rtm = {.rtm_family = static_cast<uint8_t>(family)};
+            iovec iov[] = {
+                    {nullptr, 0},
+                    {&rtm, sizeof(rtm)},
+            };
+            EXPECT_EQ(0, sendNetlinkRequest(RTM_GETRULE, NETLINK_DUMP_FLAGS, iov, ARRAY_SIZE(iov),
+                                            &callback));
+        }
+        return count;
+    }
+
     uint32_t static fakeIfaceNameToIndexFunction(const char* iface) {
         // "lo" is the same as the real one
         if (!strcmp(iface, "lo")) return LOOPBACK_IFINDEX;
@@ -113,6 +176,106 @@ TEST_F(RouteControllerTest, TestRouteFlush) {
                                "192.0.2.4/32", nullptr, 0 /* mtu */, 0 /* priority */));
 }
 
+TEST_F(RouteControllerTest, TestAddRoutes) {
+    std::vector<int> results;
+    EXPECT_EQ(0, RouteController::addRoutes(
+                         {
+                                 {"lo", "192.0.2.5/32", nullptr, 0 /* mtu */},
+                                 // Adding a route that already exists is not an error.
+                                 {"lo", "192.0.2.5/32", nullptr, 0 /* mtu */},
+                                 {"lo", "192.0.2.6/32", "unreachable", 0 /* mtu */},
+                                 {"lo", "192.0.2.7", nullptr, 0 /* mtu */},
+                                 {"netdtest_nonexistent", "192.0.2.8/32", nullptr, 0 /* mtu */},
+                         },
+                         RouteController::LOCAL_NETWORK, &results));
+    EXPECT_EQ((std::vector<int>{0, 0, 0, -EINVAL, -ENODEV}), results);
+
+    EXPECT_EQ(0, RouteController::removeRoute("lo", "192.0.2.5/32", nullptr,
+                                              RouteController::LOCAL_NETWORK, 0 /* priority */));
+    EXPECT_EQ(0, RouteController::removeRoute("lo", "192.0.2.6/32", "unreachable",
+                                              RouteController::LOCAL_NETWORK, 0 /* priority */));
+}
+
+TEST_F(RouteControllerTest, TestInterfaceToTable) {
+    EXPECT_EQ(0U, RouteController::getIfIndex(TEST_IFACE1));
+
+    const uint32_t table = TEST_IFACE1_INDEX + RouteController::ROUTE_TABLE_OFFSET_FROM_INDEX;
+    EXPECT_EQ(table, getRouteTableForInterface(TEST_IFACE1, false));
+    EXPECT_EQ(table - RouteController::ROUTE_TABLE_OFFSET_FROM_INDEX +
+                      RouteController::ROUTE_TABLE_OFFSET_FROM_INDEX_FOR_LOCAL,
+              getRouteTableForInterface(TEST_IFACE1, true));
+    EXPECT_EQ(TEST_IFACE1_INDEX, RouteController::getIfIndex(TEST_IFACE1));
+    EXPECT_EQ(0U, RouteController::getIfIndex(TEST_IFACE2));
+
+    EXPECT_EQ(0, flushRoutes(TEST_IFACE1));
+    EXPECT_EQ(0U, RouteController::getIfIndex(TEST_IFACE1));
+}
+
+TEST_F(RouteControllerTest, TestTransitionRules) {
+    // Pick priorities and a table that are not used by the system.
+    using IpRule = RouteController::IpRule;
+    const IpRule a = {.priority = 31501, .table = 500, .iif = "lo"};
+    const IpRule b = {.priority = 31502, .table = 500, .iif = "lo"};
+    const IpRule c = {.priority = 31503, .table = 500, .iif = "lo"};
+    const IpRule d = {.priority = 31504, .table = 500, .iif = "lo"};
+    // The kernel rejects UID ranges that end before they start.
+    const IpRule invalid = {.priority = 31505, .table = 500, .uidStart = 20, .uidEnd = 10};
+
+    ASSERT_EQ(0, transitionRules({}, {a, b}));
+    EXPECT_EQ(2, countRules(a.priority));
+    EXPECT_EQ(2, countRules(b.priority));
+
+    // Rules in both sets are not added again.
+    EXPECT_EQ(0, transitionRules({a, b}, {b, c}));
+    EXPECT_EQ(0, countRules(a.priority));
+    EXPECT_EQ(2, countRules(b.priority));
+    EXPECT_EQ(2, countRules(c.priority));
+
+    // If any new rule can't be added, the others are removed again and the old ones stay.
+    EXPECT_EQ(-EINVAL, transitionRules({b, c}, {d, invalid}));
+    EXPECT_EQ(2, countRules(b.priority));
+    EXPECT_EQ(2, countRules(c.priority));
+    EXPECT_EQ(0, countRules(d.priority));
+    EXPECT_EQ(0, countRules(invalid.priority));
+
+    EXPECT_EQ(0, transitionRules({b, c}, {}));
+    EXPECT_EQ(0, countRules(b.priority));
+    EXPECT_EQ(0, countRules(c.priority));
+}
+
+TEST_F(RouteControllerTest, TestRepairRules) {
+    using IpRule = RouteController::IpRule;
+    const IpRule a = {.priority = 31511, .table = 500};
+    const IpRule b = {.priority = 31512, .table = 500};
+    const uint32_t unexpectedPriority = 31513;
+
+    ASSERT_EQ(0, transitionRules({}, {a, b}));
+    EXPECT_EQ(0, repairRules(31511, 31513));
+    // Nothing has drifted, so nothing is touched.
+    expectLastRuleDrift(0, 0);
+    EXPECT_EQ(2, countRules(a.priority));
+    EXPECT_EQ(2, countRules(b.priority));
+
+    // Delete a rule that netd installed and add one that it didn't.
+    ASSERT_EQ(0, modifyRuleBehindNetdsBack(RTM_DELRULE, AF_INET, a.priority));
+    ASSERT_EQ(0, modifyRuleBehindNetdsBack(RTM_NEWRULE, AF_INET6, unexpectedPriority));
+    ASSERT_EQ(1, countRules(a.priority));
+    ASSERT_EQ(1, countRules(unexpectedPriority));
+
+    EXPECT_EQ(0, repairRules(31511, 31513));
+    expectLastRuleDrift(1, 1);
+    EXPECT_EQ(2, countRules(a.priority));
+    EXPECT_EQ(2, countRules(b.priority));
+    EXPECT_EQ(0, countRules(unexpectedPriority));
+
+    EXPECT_EQ(0, repairRules(31511, 31513));
+    expectLastRuleDrift(0, 0);
+
+    EXPECT_EQ(0, transitionRules({a, b}, {}));
+    EXPECT_EQ(0, countRules(a.priority));
+    EXPECT_EQ(0, countRules(b.priority));
+}
+
 TEST_F(RouteControllerTest, TestModifyIncomingPacketMark) {
   uint32_t mask = Fwmark::getUidBillingMask() | Fwmark::getIngressCpuWakeupMask();
 
@@ -132,6 +295,22 @@ TEST_F(RouteControllerTest, TestModifyIncomingPacketMark) {
       ~mask)});
 }
 
+TEST_F(RouteControllerTest, TestModifyIncomingPacketMarks) {
+    uint32_t mask = Fwmark::getUidBillingMask() | Fwmark::getIngressCpuWakeupMask();
+
+    static constexpr int TEST_NETID = 30;
+    EXPECT_EQ(0, modifyIncomingPacketMarks(TEST_NETID, {"netdtest0", "netdtest1"},
+                                           PERMISSION_NETWORK, true));
+    // Both rules are changed in a single iptables-restore transaction.
+    expectIptablesRestoreCommands({StringPrintf(
+            "-t mangle -A routectrl_mangle_INPUT -i netdtest0 -j MARK --set-mark 0x7001e/0x%x\n"
+            "-A routectrl_mangle_INPUT -i netdtest1 -j MARK --set-mark 0x7001e/0x%x",
+            ~mask, ~mask)});
+
+    EXPECT_EQ(0, modifyIncomingPacketMarks(TEST_NETID, {}, PERMISSION_NETWORK, false));
+    expectIptablesRestoreCommands(std::vector<std::string>{});
+}
+
 bool hasLocalInterfaceInRouteTable(const char* iface) {
     // Calculate the table index from interface index
     std::string index = std::to_string(RouteController::ROUTE_TABLE_OFFSET_FROM_INDEX_FOR_LOCAL +
@@ -140,6 +319,7 @@ bool hasLocalInterfaceInRouteTable(const char* iface) {
             index + " " + std::string(iface) + std::string(RouteController::INTERFACE_LOCAL_SUFFIX);
     std::string line;
 
+    RouteController::flushTableNamesFile();
     std::ifstream input(RouteController::RT_TABLES_PATH);
     while (std::getline(input, line)) {
         if (line.find(localIface) != std::string::npos) {
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "StartupTaskGraph"
+
+#include "StartupTaskGraph.h"
+
+#include <algorithm>
+#include <thread>
+
+#include <log/log.h>
+
+namespace android::net {
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
+StartupTaskGraph::TaskId StartupTaskGraph::add(const std::string& name, Task task,
+                                               const std::vector<TaskId>& deps) {
+    const TaskId id = mTasks.size();
+    for (const TaskId dep : deps) {
+        if (dep >= id) {
+            ALOGE("Task %s depends on a task that was not added yet", name.c_str());
+            abort();
+        }
+        mTasks[dep].dependents.push_back(id);
+    }
+    mTasks.push_back({
+            .task = std::move(task),
+            .deps = deps,
+            .pendingDeps = deps.size(),
+            .timing = {.name = name},
+    });
+    return id;
+}
+
+void StartupTaskGraph::worker() {
+    std::unique_lock lock(mLock);
+    while (true) {
+        // Stop once nothing can be started and nothing that is running can make a task ready.
+        mCv.wait(lock, [&]() REQUIRES(mLock) {
+            return (!mReady.empty() && !mFailed) || mRunning == 0;
+        });
+        if (mReady.empty() || mFailed) {
+            return;
+        }
+
+        // Start tasks in the order they were added, which is the order they used to run in.
+        const TaskId id = *mReady.begin();
+        mReady.erase(mReady.begin());
+        mRunning++;
+        Node& node = mTasks[id];
+
+        lock.unlock();
+        const steady_clock::time_point start = steady_clock::now();
+        const int status = node.task();
+        const steady_clock::time_point end = steady_clock::now();
+        lock.lock();
+
+        node.timing.ran = true;
+        node.timing.status = status;
+        node.timing.start = duration_cast<microseconds>(start - mStart);
+        node.timing.duration = duration_cast<microseconds>(end - start);
+        mRunning--;
+        if (status != 0) {
+            mFailed = true;
+        } else {
+            for (const TaskId dependent : node.dependents) {
+                if (--mTasks[dependent].pendingDeps == 0) mReady.insert(dependent);
+            }
+        }
+        mCv.notify_all();
+    }
+}
+
+int StartupTaskGraph::run() {
+    mStart = steady_clock::now();
+    {
+        std::lock_guard lock(mLock);
+        for (TaskId id = 0; id < mTasks.size(); id++) {
+            if (mTasks[id].pendingDeps == 0) mReady.insert(id);
+        }
+    }
+
+    std::vector<std::thread> threads;
+    const size_t numThreads = std::min(mMaxThreads, mTasks.size());
+    for (size_t i = 0; i < numThreads; i++) {
+        threads.emplace_back(&StartupTaskGraph::worker, this);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    for (const Node& node : mTasks) {
+        if (node.timing.ran && node.timing.status != 0) return node.timing.status;
+    }
+    return 0;
+}
+
+std::vector<StartupTaskGraph::TaskId> StartupTaskGraph::criticalPath() const {
+    // Dependencies always come before their dependents, so one pass in order is enough.
+    std::vector<microseconds> pathDuration(mTasks.size());
+    std::vector<TaskId> previous(mTasks.size(), mTasks.size());
+    TaskId last = mTasks.size();
+    for (TaskId id = 0; id < mTasks.size(); id++) {
+        for (const TaskId dep : mTasks[id].deps) {
+            if (previous[id] == mTasks.size() || pathDuration[dep] > pathDuration[previous[id]]) {
+                previous[id] = dep;
+            }
+        }
+        pathDuration[id] = mTasks[id].timing.duration;
+        if (previous[id] != mTasks.size()) pathDuration[id] += pathDuration[previous[id]];
+        if (last == mTasks.size() || pathDuration[id] >= pathDuration[last]) last = id;
+    }
+
+    std::vector<TaskId> path;
+    for (TaskId id = last; id != mTasks.size(); id = previous[id]) {
+        path.push_back(id);
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+}  // namespace android::net
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <android-base/thread_annotations.h>
+
+namespace android::net {
+
+// Runs the steps of netd startup on a bounded number of threads, starting each step as soon as
+// the steps it depends on have finished.
+//
+// A task returns 0 on success, or the status that netd should exit with. Once a task fails, no
+// more tasks are started. run() then waits for the running ones and returns the status of the
+// failed task that was added first, so the result does not depend on how the tasks were scheduled.
+class StartupTaskGraph {
+  public:
+    typedef size_t TaskId;
+    typedef std::function<int()> Task;
+
+    struct Timing {
+        std::string name;
+        bool ran = false;
+        int status = 0;
+        // Relative to the start of run().
+        std::chrono::microseconds start{0};
+        std::chrono::microseconds duration{0};
+    };
+
+    explicit StartupTaskGraph(size_t maxThreads) : mMaxThreads(maxThreads ? maxThreads : 1) {}
+
+    // Adds a task that starts after all of |deps|, which must have been added already.
+    TaskId add(const std::string& name, Task task, const std::vector<TaskId>& deps = {});
+
+    // Runs all the tasks and waits for them. Returns 0, or the status of the first failed task in
+    // the order the tasks were added. Must be called only once.
+    int run() EXCLUDES(mLock);
+
+    // Only valid after run().
+    const Timing& timing(TaskId id) const { return mTasks[id].timing; }
+    size_t size() const { return mTasks.size(); }
+
+    // The chain of dependent tasks that took the longest in total, first task first. Only valid
+    // after run().
+    std::vector<TaskId> criticalPath() const;
+
+  private:
+    struct Node {
+        Task task;
+        std::vector<TaskId> deps;
+        std::vector<TaskId> dependents;
+        size_t pendingDeps = 0;
+        Timing timing;
+    };
+
+    void worker() EXCLUDES(mLock);
+
+    const size_t mMaxThreads;
+    // Only changed by add() before run(), except for pendingDeps and timing, which are guarded by
+    // mLock while run() is in progress.
+    std::vector<Node> mTasks;
+    std::chrono::steady_clock::time_point mStart;
+
+    std::mutex mLock;
+    std::condition_variable mCv;
+    std::set<TaskId> mReady GUARDED_BY(mLock);
+    size_t mRunning GUARDED_BY(mLock) = 0;
+    bool mFailed GUARDED_BY(mLock) = false;
+};
+
+}  // namespace android::net
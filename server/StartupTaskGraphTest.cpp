@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * StartupTaskGraphTest.cpp - unit tests for StartupTaskGraph.cpp
+ */
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <netdutils/NetNativeTestBase.h>
+
+#include "StartupTaskGraph.h"
+
+using namespace std::chrono_literals;
+using testing::ElementsAre;
+
+namespace android::net {
+
+class StartupTaskGraphTest : public NetNativeTestBase {
+  protected:
+    StartupTaskGraph::Task record(const std::string& name, int status = 0) {
+        return [this, name, status] {
+            std::lock_guard lock(mLock);
+            mOrder.push_back(name);
+            return status;
+        };
+    }
+
+    std::mutex mLock;
+    std::vector<std::string> mOrder;
+};
+
+TEST_F(StartupTaskGraphTest, SingleThreadRunsTasksInOrder) {
+    StartupTaskGraph tasks(1);
+    const auto a = tasks.add("a", record("a"));
+    const auto b = tasks.add("b", record("b"));
+    tasks.add("c", record("c"), {b});
+    tasks.add("d", record("d"), {a});
+    EXPECT_EQ(0, tasks.run());
+    EXPECT_THAT(mOrder, ElementsAre("a", "b", "c", "d"));
+}
+
+TEST_F(StartupTaskGraphTest, IndependentTasksRunConcurrently) {
+    // Each task waits until the other has started, so they only finish if they run concurrently.
+    std::atomic<int> started = 0;
+    auto task = [&started] {
+        started++;
+        while (started < 2) std::this_thread::sleep_for(1ms);
+        return 0;
+    };
+    StartupTaskGraph tasks(2);
+    tasks.add("a", task);
+    tasks.add("b", task);
+    EXPECT_EQ(0, tasks.run());
+}
+
+TEST_F(StartupTaskGraphTest, DependentsWaitForDependencies) {
+    StartupTaskGraph tasks(4);
+    const auto a = tasks.add("a", record("a"));
+    const auto b = tasks.add("b", record("b"), {a});
+    tasks.add("c", record("c"), {a, b});
+    EXPECT_EQ(0, tasks.run());
+    EXPECT_THAT(mOrder, ElementsAre("a", "b", "c"));
+}
+
+TEST_F(StartupTaskGraphTest, FailureStopsNewTasks) {
+    StartupTaskGraph tasks(1);
+    const auto a = tasks.add("a", record("a", 1));
+    const auto b = tasks.add("b", record("b"), {a});
+    const auto c = tasks.add("c", record("c", 3));
+    EXPECT_EQ(1, tasks.run());
+    EXPECT_THAT(mOrder, ElementsAre("a"));
+    EXPECT_TRUE(tasks.timing(a).ran);
+    EXPECT_FALSE(tasks.timing(b).ran);
+    EXPECT_FALSE(tasks.timing(c).ran);
+}
+
+TEST_F(StartupTaskGraphTest, FirstAddedFailureWins) {
+    // b fails first, but a was added first.
+    StartupTaskGraph tasks(2);
+    tasks.add("a", [] {
+        std::this_thread::sleep_for(20ms);
+        return 1;
+    });
+    tasks.add("b", [] { return 2; });
+    EXPECT_EQ(1, tasks.run());
+}
+
+TEST_F(StartupTaskGraphTest, CriticalPath) {
+    StartupTaskGraph tasks(3);
+    const auto slow = tasks.add("slow", [] {
+        std::this_thread::sleep_for(30ms);
+        return 0;
+    });
+    const auto fast = tasks.add("fast", [] { return 0; });
+    const auto after = tasks.add("after", [] { return 0; }, {fast, slow});
+    tasks.add("alone", [] { return 0; });
+    EXPECT_EQ(0, tasks.run());
+    EXPECT_THAT(tasks.criticalPath(), ElementsAre(slow, after));
+    EXPECT_GE(tasks.timing(after).start, tasks.timing(slow).duration);
+}
+
+}  // namespace android::net
@@ -43,11 +43,12 @@ const char* StrictController::LOCAL_PENALTY_REJECT = "st_penalty_reject";
 
 using android::base::Join;
 using android::base::StringPrintf;
+using android::net::BootRuleset;
 
 StrictController::StrictController(void) {
 }
 
-int StrictController::setupIptablesHooks(void) {
+int StrictController::setupIptablesHooks(BootRuleset* rules) {
     char connmarkFlagAccept[16];
     char connmarkFlagReject[16];
     char connmarkFlagTestAccept[32];
@@ -61,7 +62,7 @@ int StrictController::setupIptablesHooks(void) {
             ConnmarkFlags::STRICT_RESOLVED_REJECT,
             ConnmarkFlags::STRICT_RESOLVED_REJECT);
 
-    resetChains();
+    resetChains(rules);
 
     int res = 0;
     std::vector<std::string> v4, v6;
@@ -129,8 +130,13 @@ int StrictController::setupIptablesHooks(void) {
     CMD_V4V6("-A %s -p udp -j %s", LOCAL_CLEAR_DETECT, LOCAL_CLEAR_CAUGHT);
     CMD_V4V6("COMMIT\n");
 
-    res |= execIptablesRestore(V4, Join(v4, '\n'));
-    res |= execIptablesRestore(V6, Join(v6, '\n'));
+    if (rules != nullptr) {
+        res |= rules->add(V4, Join(v4, '\n'));
+        res |= rules->add(V6, Join(v6, '\n'));
+    } else {
+        res |= execIptablesRestore(V4, Join(v4, '\n'));
+        res |= execIptablesRestore(V6, Join(v6, '\n'));
+    }
 
 #undef CMD_V4
 #undef CMD_V6
@@ -139,7 +145,7 @@ int StrictController::setupIptablesHooks(void) {
     return res ? -EREMOTEIO : 0;
 }
 
-int StrictController::resetChains(void) {
+int StrictController::resetChains(BootRuleset* rules) {
     // Flush any existing rules
 #define CLEAR_CHAIN(x) StringPrintf(":%s -", (x))
     std::vector<std::string> commandList = {
@@ -152,6 +158,9 @@ int StrictController::resetChains(void) {
         "COMMIT\n"
     };
     const std::string commands = Join(commandList, '\n');
+    if (rules != nullptr) {
+        return rules->add(V4V6, commands);
+    }
     return (execIptablesRestore(V4V6, commands) == 0) ? 0 : -EREMOTEIO;
 #undef CLEAR_CHAIN
 }
@@ -19,6 +19,7 @@
 
 #include <string>
 
+#include "BootRuleset.h"
 #include "NetdConstants.h"
 
 enum StrictPenalty { INVALID, ACCEPT, LOG, REJECT };
@@ -31,8 +32,9 @@ class StrictController {
 public:
     StrictController();
 
-    int setupIptablesHooks(void);
-    int resetChains(void);
+    // If |rules| is not null, the rules are queued in it instead of being installed.
+    int setupIptablesHooks(android::net::BootRuleset* rules = nullptr);
+    int resetChains(android::net::BootRuleset* rules = nullptr);
 
     int setUidCleartextPenalty(uid_t, StrictPenalty);
 
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SysctlBatch"
+
+#include "SysctlBatch.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <android-base/strings.h>
+#include <log/log.h>
+
+#include "SysctlCache.h"
+
+namespace android::net {
+
+using base::Trim;
+using base::unique_fd;
+
+namespace {
+
+bool isInterfaceDir(const dirent* ent) {
+    return ent->d_type == DT_DIR && strcmp(ent->d_name, ".") != 0 &&
+           strcmp(ent->d_name, "..") != 0 && strcmp(ent->d_name, "all") != 0 &&
+           strcmp(ent->d_name, "default") != 0;
+}
+
+// Whether |fd| already holds |value|. Sysctls end their contents with a newline, so surrounding
+// whitespace is ignored.
+bool holdsValue(int fd, const std::string& value) {
+    // Anything longer than the value plus a little whitespace cannot be equal to it.
+    char buf[256];
+    const size_t want = std::min(sizeof(buf), value.size() + 16);
+    const ssize_t len = pread(fd, buf, want, 0);
+    if (len < 0 || static_cast<size_t>(len) == want) {
+        return false;
+    }
+    return Trim(std::string(buf, len)) == Trim(value);
+}
+
+}  // namespace
+
+size_t SysctlBatch::getDir(const std::string& path) {
+    for (size_t i = 0; i < mDirs.size(); i++) {
+        if (mDirs[i].path == path) return i;
+    }
+    Dir dir = {.path = path};
+    dir.fd.reset(open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (dir.fd == -1) {
+        dir.error = -errno;
+    }
+    mDirs.push_back(std::move(dir));
+    return mDirs.size() - 1;
+}
+
+size_t SysctlBatch::add(const std::string& dir, const std::vector<Write>& writes,
+                        bool stopOnError) {
+    const size_t first = mEntries.size();
+    const size_t dirIndex = getDir(dir);
+    for (size_t i = 0; i < writes.size(); i++) {
+        mEntries.push_back({
+                .dir = dirIndex,
+                .path = writes[i].name,
+                .value = writes[i].value,
+                .continuesGroup = stopOnError && i > 0,
+        });
+    }
+    return first;
+}
+
+size_t SysctlBatch::add(const std::string& path, const std::string& value) {
+    const size_t slash = path.rfind('/');
+    if (slash == std::string::npos) {
+        return add(".", {{path, value}});
+    }
+    return add(path.substr(0, slash), {{path.substr(slash + 1), value}});
+}
+
+void SysctlBatch::addForEachInterface(const std::string& confDir,
+                                      const std::vector<Write>& writes, bool stopOnError) {
+    // "default" controls the behavior of any interfaces that are created in the future.
+    std::vector<std::string> ifaces = {"default"};
+    const size_t dirIndex = getDir(confDir);
+    const Dir& dir = mDirs[dirIndex];
+    // fdopendir() takes ownership of its fd, so list a duplicate and keep the original for openat.
+    DIR* listing = (dir.fd == -1) ? nullptr : fdopendir(fcntl(dir.fd, F_DUPFD_CLOEXEC, 0));
+    if (listing == nullptr) {
+        ALOGE("Can't list %s: %s", confDir.c_str(), strerror(dir.fd == -1 ? -dir.error : errno));
+    } else {
+        while (const dirent* ent = readdir(listing)) {
+            if (isInterfaceDir(ent)) ifaces.push_back(ent->d_name);
+        }
+        closedir(listing);
+    }
+
+    for (const std::string& iface : ifaces) {
+        for (size_t i = 0; i < writes.size(); i++) {
+            mEntries.push_back({
+                    .dir = dirIndex,
+                    .path = iface + "/" + writes[i].name,
+                    .value = writes[i].value,
+                    .continuesGroup = stopOnError && i > 0,
+            });
+        }
+    }
+}
+
+int SysctlBatch::applyEntry(const Entry& entry, bool* changed) const {
+    const Dir& dir = mDirs[entry.dir];
+    if (dir.fd == -1) {
+        return dir.error;
+    }
+
+    // Some sysctls are write-only. Those are always written.
+    bool readable = true;
+    unique_fd fd(openat(dir.fd, entry.path.c_str(), O_RDWR | O_CLOEXEC));
+    if (fd == -1 && errno == EACCES) {
+        readable = false;
+        fd.reset(openat(dir.fd, entry.path.c_str(), O_WRONLY | O_CLOEXEC));
+    }
+    if (fd == -1) {
+        return -errno;
+    }
+
+    if (readable && holdsValue(fd, entry.value)) {
+        *changed = false;
+        return 0;
+    }
+    const ssize_t len = pwrite(fd, entry.value.data(), entry.value.size(), 0);
+    if (len < 0) {
+        return -errno;
+    }
+    if (static_cast<size_t>(len) != entry.value.size()) {
+        return -EIO;
+    }
+    *changed = true;
+    return 0;
+}
+
+int SysctlBatch::apply() {
+    int firstError = 0;
+    bool groupFailed = false;
+    for (Entry& entry : mEntries) {
+        if (!entry.continuesGroup) {
+            groupFailed = false;
+        }
+        if (groupFailed) {
+            entry.result = -ECANCELED;
+            mStats.skipped++;
+            continue;
+        }
+
+        bool changed = false;
+        entry.result = applyEntry(entry, &changed);
+        const std::string path = mDirs[entry.dir].path + "/" + entry.path;
+        if (entry.result != 0) {
+            ALOGW("Failed to write %s to %s: %s", entry.value.c_str(), path.c_str(),
+                  strerror(-entry.result));
+            gSysctlCache.onWriteFailed(path);
+            mStats.failed++;
+            groupFailed = true;
+            if (firstError == 0) firstError = entry.result;
+        } else if (changed) {
+            gSysctlCache.onWritten(path);
+            mStats.written++;
+        } else {
+            gSysctlCache.onUnchanged(path, entry.value);
+            mStats.unchanged++;
+        }
+    }
+    return firstError;
+}
+
+}  // namespace android::net
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <errno.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+
+namespace android::net {
+
+// A set of writes to sysctl files such as /proc/sys/net/ipv6/conf/wlan0/accept_ra, applied in one
+// call and in the order they were added.
+//
+// Each directory is opened once per batch, and files are opened relative to it. A file that
+// already holds the new value is not written, so the kernel does not redo the work of a write that
+// changes nothing. Every file written is marked as owned by netd in gSysctlCache.
+class SysctlBatch {
+  public:
+    struct Write {
+        std::string name;
+        std::string value;
+    };
+
+    struct Stats {
+        size_t written = 0;
+        size_t unchanged = 0;
+        size_t failed = 0;
+        // Writes that were not attempted because an earlier write in the same group failed.
+        size_t skipped = 0;
+    };
+
+    // Queues |writes| to files in |dir|. If |stopOnError| is true, a failed write skips the rest
+    // of |writes|. Returns the index of the first queued write, for use with result().
+    size_t add(const std::string& dir, const std::vector<Write>& writes, bool stopOnError = false);
+
+    // Queues a write of |value| to the file at |path|. Returns its index.
+    size_t add(const std::string& path, const std::string& value);
+
+    // Queues |writes| for "default" and for every interface in |confDir|, for example
+    // /proc/sys/net/ipv6/conf. The directory is listed when this is called. |stopOnError| applies
+    // to each interface separately.
+    void addForEachInterface(const std::string& confDir, const std::vector<Write>& writes,
+                             bool stopOnError = false);
+
+    // Applies the queued writes. Returns 0 if every write succeeded or was not needed, or the
+    // negative errno of the first write that failed.
+    int apply();
+
+    // Returns 0 or the negative errno of the write at |index|. Only valid after apply().
+    int result(size_t index) const { return mEntries[index].result; }
+
+    size_t size() const { return mEntries.size(); }
+    const Stats& stats() const { return mStats; }
+
+  private:
+    struct Dir {
+        std::string path;
+        base::unique_fd fd;
+        int error = 0;  // negative errno if the directory could not be opened
+    };
+
+    struct Entry {
+        size_t dir;  // index into mDirs
+        std::string path;  // relative to the directory
+        std::string value;
+        bool continuesGroup;  // skipped if the previous write failed or was skipped
+        int result = -EIO;
+    };
+
+    size_t getDir(const std::string& path);
+    int applyEntry(const Entry& entry, bool* changed) const;
+
+    std::vector<Dir> mDirs;
+    std::vector<Entry> mEntries;
+    Stats mStats;
+};
+
+}  // namespace android::net
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SysctlBatchTest.cpp - unit tests for SysctlBatch.cpp
+ */
+
+#include <sys/stat.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include <netdutils/NetNativeTestBase.h>
+
+#include "SysctlBatch.h"
+
+using android::base::ReadFileToString;
+using android::base::WriteStringToFile;
+
+namespace android::net {
+
+class SysctlBatchTest : public NetNativeTestBase {
+  protected:
+    std::string path(const std::string& relative) const {
+        return std::string(mDir.path) + "/" + relative;
+    }
+
+    void makeDir(const std::string& relative) const {
+        ASSERT_EQ(0, mkdir(path(relative).c_str(), 0700));
+    }
+
+    void makeFile(const std::string& relative, const std::string& contents) const {
+        ASSERT_TRUE(WriteStringToFile(contents, path(relative)));
+    }
+
+    std::string contents(const std::string& relative) const {
+        std::string contents;
+        EXPECT_TRUE(ReadFileToString(path(relative), &contents));
+        return contents;
+    }
+
+    TemporaryDir mDir;
+};
+
+TEST_F(SysctlBatchTest, SkipsUnchangedValues) {
+    makeFile("accept_ra", "2\n");
+    makeFile("accept_dad", "1");
+
+    SysctlBatch batch;
+    batch.add(mDir.path, {{"accept_ra", "2"}, {"accept_dad", "0"}});
+    EXPECT_EQ(0, batch.apply());
+
+    EXPECT_EQ("2\n", contents("accept_ra"));
+    EXPECT_EQ("0", contents("accept_dad"));
+    EXPECT_EQ(1U, batch.stats().written);
+    EXPECT_EQ(1U, batch.stats().unchanged);
+}
+
+TEST_F(SysctlBatchTest, AppliesWritesInOrder) {
+    makeFile("disable_ipv6", "0");
+
+    // Both writes happen, because the second one is compared with the result of the first.
+    SysctlBatch batch;
+    batch.add(mDir.path, {{"disable_ipv6", "1"}, {"disable_ipv6", "0"}});
+    EXPECT_EQ(0, batch.apply());
+    EXPECT_EQ("0", contents("disable_ipv6"));
+    EXPECT_EQ(2U, batch.stats().written);
+}
+
+TEST_F(SysctlBatchTest, StopOnError) {
+    makeFile("first", "0");
+    makeFile("third", "0");
+    makeFile("other", "0");
+
+    SysctlBatch batch;
+    const size_t group = batch.add(mDir.path, {{"first", "1"}, {"missing", "1"}, {"third", "1"}},
+                                   true /* stopOnError */);
+    const size_t other = batch.add(path("other"), "1");
+    EXPECT_EQ(-ENOENT, batch.apply());
+
+    EXPECT_EQ(0, batch.result(group));
+    EXPECT_EQ(-ENOENT, batch.result(group + 1));
+    EXPECT_EQ(-ECANCELED, batch.result(group + 2));
+    EXPECT_EQ(0, batch.result(other));
+    EXPECT_EQ("1", contents("first"));
+    EXPECT_EQ("0", contents("third"));
+    EXPECT_EQ("1", contents("other"));
+    EXPECT_EQ(1U, batch.stats().failed);
+    EXPECT_EQ(1U, batch.stats().skipped);
+}
+
+TEST_F(SysctlBatchTest, ForEachInterface) {
+    for (const char* dir : {"all", "default", "wlan0", "rmnet0"}) {
+        makeDir(dir);
+        makeFile(std::string(dir) + "/accept_ra", "1");
+    }
+
+    SysctlBatch batch;
+    batch.addForEachInterface(mDir.path, {{"accept_ra", "2"}});
+    EXPECT_EQ(3U, batch.size());
+    EXPECT_EQ(0, batch.apply());
+
+    EXPECT_EQ("1", contents("all/accept_ra"));
+    EXPECT_EQ("2", contents("default/accept_ra"));
+    EXPECT_EQ("2", contents("wlan0/accept_ra"));
+    EXPECT_EQ("2", contents("rmnet0/accept_ra"));
+}
+
+TEST_F(SysctlBatchTest, MissingDirectory) {
+    SysctlBatch batch;
+    batch.add(path("nosuchdir"), {{"accept_ra", "2"}});
+    EXPECT_EQ(-ENOENT, batch.apply());
+    EXPECT_EQ(1U, batch.stats().failed);
+}
+
+}  // namespace android::net
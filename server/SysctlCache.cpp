@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SysctlCache.h"
+
+#include <errno.h>
+
+#include <cinttypes>
+#include <cstring>
+#include <string_view>
+
+#include <android-base/file.h>
+#include <android-base/strings.h>
+
+namespace android::net {
+
+using base::ReadFileToString;
+using base::Trim;
+using netdutils::DumpWriter;
+using netdutils::ScopedIndent;
+
+SysctlCache gSysctlCache;
+
+void SysctlCache::setTtl(std::chrono::milliseconds ttl) {
+    std::lock_guard guard(mLock);
+    mTtl = ttl;
+}
+
+int SysctlCache::read(const std::string& path, std::string* value) {
+    uint64_t changes;
+    {
+        std::lock_guard guard(mLock);
+        const auto it = mEntries.find(path);
+        if (it != mEntries.end() && it->second.known &&
+            (it->second.owned || now() - it->second.readTime < mTtl)) {
+            mHits++;
+            *value = it->second.value;
+            return 0;
+        }
+        mMisses++;
+        changes = mChanges;
+    }
+
+    // Read without holding the lock, so that a slow read does not block other callers.
+    std::string contents;
+    if (!ReadFileToString(path, &contents)) {
+        return -errno;
+    }
+    *value = Trim(contents);
+
+    std::lock_guard guard(mLock);
+    if (mChanges != changes) {
+        return 0;
+    }
+    auto it = mEntries.find(path);
+    if (it == mEntries.end()) {
+        if (mTtl.count() <= 0) {
+            return 0;
+        }
+        if (mUnownedEntries >= kMaxUnownedEntries) {
+            dropExpiredLocked();
+            if (mUnownedEntries >= kMaxUnownedEntries) return 0;
+        }
+        it = mEntries.emplace(path, Entry{.owned = false}).first;
+        mUnownedEntries++;
+    }
+    it->second.known = true;
+    it->second.value = *value;
+    it->second.readTime = now();
+    return 0;
+}
+
+void SysctlCache::dropExpiredLocked() {
+    const TimePoint cutoff = now() - mTtl;
+    for (auto it = mEntries.begin(); it != mEntries.end();) {
+        if (!it->second.owned && it->second.readTime <= cutoff) {
+            mUnownedEntries--;
+            it = mEntries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool SysctlCache::isChangedByKernel(const std::string& path) {
+    const std::string_view name = std::string_view(path).substr(path.rfind('/') + 1);
+    return name == "disable_ipv6" || name == "forwarding" ||
+           (name == "mtu" && path.find("/ipv6/conf/") != std::string::npos);
+}
+
+void SysctlCache::dropLocked(const std::string& path) {
+    const auto it = mEntries.find(path);
+    if (it == mEntries.end()) return;
+    if (!it->second.owned) mUnownedEntries--;
+    mEntries.erase(it);
+}
+
+void SysctlCache::onWritten(const std::string& path) {
+    std::lock_guard guard(mLock);
+    invalidateConfLocked(path);
+    mChanges++;
+    if (isChangedByKernel(path)) {
+        dropLocked(path);
+        return;
+    }
+    Entry& entry = mEntries[path];
+    if (!entry.owned && entry.known) {
+        // An existing entry for a file that was only read.
+        mUnownedEntries--;
+    }
+    entry = {.owned = true, .known = false};
+}
+
+void SysctlCache::invalidateConfLocked(const std::string& path) {
+    static constexpr std::string_view kConfAll = "/conf/all/";
+    const size_t pos = path.find(kConfAll);
+    if (pos == std::string::npos) return;
+    // E.g., "/proc/sys/net/ipv6/conf/".
+    const std::string confDir = path.substr(0, pos + strlen("/conf/"));
+    for (auto it = mEntries.lower_bound(confDir);
+         it != mEntries.end() && it->first.starts_with(confDir);) {
+        if (it->first == path) {
+            ++it;
+            continue;
+        }
+        if (!it->second.owned) mUnownedEntries--;
+        it = mEntries.erase(it);
+    }
+}
+
+void SysctlCache::onUnchanged(const std::string& path, const std::string& value) {
+    std::lock_guard guard(mLock);
+    mChanges++;
+    if (isChangedByKernel(path)) {
+        dropLocked(path);
+        return;
+    }
+    Entry& entry = mEntries[path];
+    if (!entry.owned && entry.known) {
+        mUnownedEntries--;
+    }
+    entry = {.owned = true, .known = true, .value = Trim(value), .readTime = now()};
+}
+
+void SysctlCache::onWriteFailed(const std::string& path) {
+    std::lock_guard guard(mLock);
+    if (mEntries.find(path) == mEntries.end()) return;
+    dropLocked(path);
+    mChanges++;
+}
+
+void SysctlCache::invalidateInterface(const std::string& ifName) {
+    const std::string component = "/" + ifName + "/";
+    std::lock_guard guard(mLock);
+    for (auto it = mEntries.begin(); it != mEntries.end();) {
+        if (it->first.find(component) == std::string::npos) {
+            ++it;
+            continue;
+        }
+        if (!it->second.owned) mUnownedEntries--;
+        it = mEntries.erase(it);
+    }
+    mChanges++;
+}
+
+SysctlCache::Stats SysctlCache::stats() const {
+    std::lock_guard guard(mLock);
+    return {
+            .hits = mHits,
+            .misses = mMisses,
+            .entries = mEntries.size(),
+            .owned = mEntries.size() - mUnownedEntries,
+    };
+}
+
+void SysctlCache::dump(DumpWriter& dw) const {
+    const Stats s = stats();
+    std::chrono::milliseconds ttl;
+    {
+        std::lock_guard guard(mLock);
+        ttl = mTtl;
+    }
+
+    ScopedIndent indentForSysctlCache(dw);
+    dw.println("SysctlCache");
+    ScopedIndent indentForStats(dw);
+    dw.println("TTL: %lldms", static_cast<long long>(ttl.count()));
+    dw.println("Entries: %zu (%zu owned)", s.entries, s.owned);
+    const uint64_t reads = s.hits + s.misses;
+    dw.println("Reads: %" PRIu64 ", hits: %" PRIu64 " (%.1f%%)", reads, s.hits,
+               reads ? 100.0 * s.hits / reads : 0.0);
+}
+
+}  // namespace android::net
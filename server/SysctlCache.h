@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <android-base/thread_annotations.h>
+#include <netdutils/DumpWriter.h>
+
+namespace android::net {
+
+// Recently read values of sysctl files, keyed by path.
+//
+// Files that netd writes itself are owned: once read, their value is served from the cache until
+// netd writes them again or their interface goes away. Other files are served from the cache for
+// the TTL only, because the kernel or other processes may change them. The TTL defaults to 0,
+// which means that files netd does not own are always read.
+//
+// Some files that netd writes are also changed by the kernel, so they are never owned: a DAD
+// failure sets disable_ipv6, a link MTU change updates the IPv6 mtu, and writing
+// conf/all/forwarding rewrites every conf/<iface>/forwarding. For the same reason, writing a file
+// in a conf/all directory forgets the other files in the same conf directory.
+class SysctlCache {
+  public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t entries = 0;
+        size_t owned = 0;
+    };
+
+    // The most entries that are kept for files netd does not own.
+    static constexpr size_t kMaxUnownedEntries = 512;
+
+    virtual ~SysctlCache() = default;
+
+    void setTtl(std::chrono::milliseconds ttl) EXCLUDES(mLock);
+
+    // Reads |path|, trimmed of surrounding whitespace, into |value|. Returns 0 or negative errno.
+    int read(const std::string& path, std::string* value) EXCLUDES(mLock);
+
+    // Called after netd writes |path|. The new value is read back on the next read(), because the
+    // kernel may format it differently from how it was written. If |path| is in a conf/all
+    // directory, every file in the same conf directory is read again too.
+    void onWritten(const std::string& path) EXCLUDES(mLock);
+
+    // Called when |path| was found to already hold |value| before a write.
+    void onUnchanged(const std::string& path, const std::string& value) EXCLUDES(mLock);
+
+    // Called when a write to |path| failed, leaving its value unknown.
+    void onWriteFailed(const std::string& path) EXCLUDES(mLock);
+
+    // Forgets every file in a per-interface directory of |ifName|, because a new interface with
+    // the same name starts out with default values.
+    void invalidateInterface(const std::string& ifName) EXCLUDES(mLock);
+
+    Stats stats() const EXCLUDES(mLock);
+    void dump(netdutils::DumpWriter& dw) const EXCLUDES(mLock);
+
+  protected:
+    // Overridden by tests.
+    virtual TimePoint now() const { return std::chrono::steady_clock::now(); }
+
+  private:
+    // Whether the kernel changes |path| on its own, so that it must not be owned.
+    static bool isChangedByKernel(const std::string& path);
+
+    void dropExpiredLocked() REQUIRES(mLock);
+    void dropLocked(const std::string& path) REQUIRES(mLock);
+    void invalidateConfLocked(const std::string& path) REQUIRES(mLock);
+
+    struct Entry {
+        bool owned = false;
+        // False for an owned file that was written but has not been read since.
+        bool known = false;
+        std::string value;
+        TimePoint readTime;
+    };
+
+    mutable std::mutex mLock;
+    std::chrono::milliseconds mTtl GUARDED_BY(mLock){0};
+    std::map<std::string, Entry> mEntries GUARDED_BY(mLock);
+    size_t mUnownedEntries GUARDED_BY(mLock) = 0;
+    // Incremented whenever an entry is written or dropped, so that a read that raced with a write
+    // does not store an old value.
+    uint64_t mChanges GUARDED_BY(mLock) = 0;
+    uint64_t mHits GUARDED_BY(mLock) = 0;
+    uint64_t mMisses GUARDED_BY(mLock) = 0;
+};
+
+// Used by SysctlBatch and InterfaceController::getParameter().
+extern SysctlCache gSysctlCache;
+
+}  // namespace android::net
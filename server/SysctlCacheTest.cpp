@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SysctlCacheTest.cpp - unit tests for SysctlCache.cpp
+ */
+
+#include <sys/stat.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include <netdutils/NetNativeTestBase.h>
+
+#include "SysctlBatch.h"
+#include "SysctlCache.h"
+
+using android::base::WriteStringToFile;
+using namespace std::chrono_literals;
+
+namespace android::net {
+
+class FakeClockSysctlCache : public SysctlCache {
+  public:
+    TimePoint now() const override { return mNow; }
+    TimePoint mNow;
+};
+
+class SysctlCacheTest : public NetNativeTestBase {
+  protected:
+    std::string path(const std::string& relative) const {
+        return std::string(mDir.path) + "/" + relative;
+    }
+
+    void makeFile(const std::string& relative, const std::string& contents) const {
+        ASSERT_TRUE(WriteStringToFile(contents, path(relative)));
+    }
+
+    std::string read(const std::string& relative) {
+        std::string value;
+        EXPECT_EQ(0, mCache.read(path(relative), &value));
+        return value;
+    }
+
+    TemporaryDir mDir;
+    FakeClockSysctlCache mCache;
+};
+
+TEST_F(SysctlCacheTest, UnownedValuesAreNotCachedByDefault) {
+    makeFile("hop_limit", "64\n");
+    EXPECT_EQ("64", read("hop_limit"));
+    makeFile("hop_limit", "255\n");
+    EXPECT_EQ("255", read("hop_limit"));
+    EXPECT_EQ(0U, mCache.stats().hits);
+    EXPECT_EQ(2U, mCache.stats().misses);
+    EXPECT_EQ(0U, mCache.stats().entries);
+}
+
+TEST_F(SysctlCacheTest, UnownedValuesExpire) {
+    mCache.setTtl(1000ms);
+    makeFile("hop_limit", "64\n");
+    EXPECT_EQ("64", read("hop_limit"));
+
+    makeFile("hop_limit", "255\n");
+    mCache.mNow += 999ms;
+    EXPECT_EQ("64", read("hop_limit"));
+    mCache.mNow += 1ms;
+    EXPECT_EQ("255", read("hop_limit"));
+    EXPECT_EQ(1U, mCache.stats().hits);
+    EXPECT_EQ(2U, mCache.stats().misses);
+}
+
+TEST_F(SysctlCacheTest, OwnedValuesAreReadBackOnce) {
+    makeFile("accept_ra", "1\n");
+    mCache.onWritten(path("accept_ra"));
+    EXPECT_EQ("1", read("accept_ra"));
+
+    // The value is netd's own, so it does not expire.
+    mCache.mNow += 1h;
+    EXPECT_EQ("1", read("accept_ra"));
+    EXPECT_EQ(1U, mCache.stats().hits);
+
+    // A new write is read back.
+    makeFile("accept_ra", "2\n");
+    mCache.onWritten(path("accept_ra"));
+    EXPECT_EQ("2", read("accept_ra"));
+    EXPECT_EQ(1U, mCache.stats().owned);
+}
+
+TEST_F(SysctlCacheTest, ValuesChangedByKernelAreNotOwned) {
+    // The kernel sets disable_ipv6 when DAD fails, updates the IPv6 mtu when the link MTU
+    // changes, and copies conf/all/forwarding to every interface.
+    for (const char* dir : {"ipv4", "ipv4/conf", "ipv4/conf/wlan0", "ipv6", "ipv6/conf",
+                            "ipv6/conf/wlan0"}) {
+        ASSERT_EQ(0, mkdir(path(dir).c_str(), 0700));
+    }
+    for (const char* file : {"ipv6/conf/wlan0/disable_ipv6", "ipv6/conf/wlan0/mtu",
+                             "ipv4/conf/wlan0/forwarding"}) {
+        mCache.onUnchanged(path(file), "0");
+        makeFile(file, "1\n");
+        EXPECT_EQ("1", read(file)) << file;
+        mCache.onWritten(path(file));
+        makeFile(file, "2\n");
+        EXPECT_EQ("2", read(file)) << file;
+    }
+    EXPECT_EQ(0U, mCache.stats().hits);
+    EXPECT_EQ(0U, mCache.stats().entries);
+
+    // The IPv4 mtu is only changed by netd.
+    mCache.onUnchanged(path("ipv4/conf/wlan0/mtu"), "1500");
+    EXPECT_EQ(1U, mCache.stats().owned);
+}
+
+TEST_F(SysctlCacheTest, WritingConfAllInvalidatesConf) {
+    for (const char* dir : {"conf", "conf/all", "conf/wlan0", "other", "other/wlan0"}) {
+        ASSERT_EQ(0, mkdir(path(dir).c_str(), 0700));
+    }
+    mCache.onUnchanged(path("conf/wlan0/accept_redirects"), "1");
+    mCache.onUnchanged(path("other/wlan0/accept_redirects"), "1");
+
+    // The kernel may copy values written to conf/all to every interface.
+    makeFile("conf/all/accept_redirects", "0\n");
+    makeFile("conf/wlan0/accept_redirects", "0\n");
+    mCache.onWritten(path("conf/all/accept_redirects"));
+    EXPECT_EQ("0", read("conf/wlan0/accept_redirects"));
+    EXPECT_EQ("1", read("other/wlan0/accept_redirects"));
+}
+
+TEST_F(SysctlCacheTest, UnchangedValuesAreKnown) {
+    mCache.onUnchanged(path("accept_ra"), "2");
+    EXPECT_EQ("2", read("accept_ra"));
+    EXPECT_EQ(1U, mCache.stats().hits);
+    EXPECT_EQ(0U, mCache.stats().misses);
+}
+
+TEST_F(SysctlCacheTest, FailedWritesAreForgotten) {
+    makeFile("accept_ra", "0\n");
+    mCache.onUnchanged(path("accept_ra"), "2");
+    mCache.onWriteFailed(path("accept_ra"));
+    EXPECT_EQ("0", read("accept_ra"));
+    EXPECT_EQ(0U, mCache.stats().entries);
+}
+
+TEST_F(SysctlCacheTest, InvalidateInterface) {
+    ASSERT_EQ(0, mkdir(path("wlan0").c_str(), 0700));
+    ASSERT_EQ(0, mkdir(path("wlan01").c_str(), 0700));
+    mCache.onUnchanged(path("wlan0/accept_ra"), "2");
+    mCache.onUnchanged(path("wlan01/accept_ra"), "2");
+
+    mCache.invalidateInterface("wlan0");
+    EXPECT_EQ(1U, mCache.stats().entries);
+    makeFile("wlan0/accept_ra", "1\n");
+    EXPECT_EQ("1", read("wlan0/accept_ra"));
+    EXPECT_EQ("2", read("wlan01/accept_ra"));
+}
+
+TEST_F(SysctlCacheTest, MissingFile) {
+    std::string value;
+    EXPECT_EQ(-ENOENT, mCache.read(path("nosuchfile"), &value));
+}
+
+TEST_F(SysctlCacheTest, SysctlBatchWritesThrough) {
+    makeFile("accept_ra", "1");
+    makeFile("accept_dad", "1");
+    SysctlBatch batch;
+    batch.add(mDir.path, {{"accept_ra", "2"}, {"accept_dad", "1"}});
+    EXPECT_EQ(0, batch.apply());
+
+    std::string value;
+    const SysctlCache::Stats before = gSysctlCache.stats();
+    EXPECT_EQ(0, gSysctlCache.read(path("accept_dad"), &value));
+    EXPECT_EQ("1", value);
+    EXPECT_EQ(before.hits + 1, gSysctlCache.stats().hits);
+    EXPECT_EQ(0, gSysctlCache.read(path("accept_ra"), &value));
+    EXPECT_EQ("2", value);
+    EXPECT_EQ(0, gSysctlCache.read(path("accept_ra"), &value));
+    EXPECT_EQ(before.hits + 2, gSysctlCache.stats().hits);
+    EXPECT_EQ(before.misses + 1, gSysctlCache.stats().misses);
+}
+
+}  // namespace android::net
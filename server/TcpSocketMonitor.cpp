@@ -102,38 +102,46 @@ const String16 TcpSocketMonitor::DUMP_KEYWORD = String16("tcp_socket_info");
 const milliseconds TcpSocketMonitor::kDefaultPollingInterval = milliseconds(30000);
 
 void TcpSocketMonitor::dump(DumpWriter& dw) {
-    std::lock_guard guard(mLock);
+    // Copy what is needed under the lock and format it afterwards, so that a slow dumpsys reader
+    // does not stall the polling thread.
+    bool isRunning;
+    bool isSuspended;
+    milliseconds sinceLastPoll;
+    std::vector<std::pair<uint32_t, TcpStats>> networkStats;
+    std::vector<std::pair<uint64_t, SocketEntry>> socketEntries;
+    {
+        std::lock_guard guard(mLock);
+        isRunning = mIsRunning;
+        isSuspended = mIsSuspended;
+        sinceLastPoll = duration_cast<milliseconds>(steady_clock::now() - mLastPoll);
+        networkStats.assign(mNetworkStats.begin(), mNetworkStats.end());
+        socketEntries.assign(mSocketEntries.begin(), mSocketEntries.end());
+    }
 
     dw.println("TcpSocketMonitor");
     ScopedIndent tcpSocketMonitorDetails(dw);
 
-    const auto now = steady_clock::now();
-    const auto d = duration_cast<milliseconds>(now - mLastPoll);
-    dw.println("running=%d, suspended=%d, last poll %lld ms ago",
-            mIsRunning, mIsSuspended, d.count());
+    dw.println("running=%d, suspended=%d, last poll %lld ms ago", isRunning, isSuspended,
+               sinceLastPoll.count());
 
-    if (!mNetworkStats.empty()) {
+    if (!networkStats.empty()) {
         dw.blankline();
         dw.println("Network stats:");
-        for (const std::pair<const uint32_t, TcpStats>& stats : mNetworkStats) {
-            if (stats.second.nSockets == 0) {
+        for (const auto& [netId, stats] : networkStats) {
+            if (stats.nSockets == 0) {
                 continue;
             }
-            dw.println("netId=%d sent=%d lost=%d rttMs=%gms sentAckDiff=%dms",
-                       stats.first,
-                       stats.second.sent,
-                       stats.second.lost,
-                       stats.second.rttUs / 1000.0 / stats.second.nSockets,
-                       stats.second.sentAckDiffMs / stats.second.nSockets);
+            dw.println("netId=%d sent=%d lost=%d rttMs=%gms sentAckDiff=%dms", netId, stats.sent,
+                       stats.lost, stats.rttUs / 1000.0 / stats.nSockets,
+                       stats.sentAckDiffMs / stats.nSockets);
         }
     }
 
-    if (!mSocketEntries.empty()) {
+    if (!socketEntries.empty()) {
         dw.blankline();
         dw.println("Socket entries:");
-        for (const std::pair<const uint64_t, SocketEntry>& stats : mSocketEntries) {
-            dw.println("netId=%u uid=%u cookie=%" PRIu64, stats.second.mark.netId, stats.second.uid,
-                       stats.first);
+        for (const auto& [cookie, entry] : socketEntries) {
+            dw.println("netId=%u uid=%u cookie=%" PRIu64, entry.mark.netId, entry.uid, cookie);
         }
     }
 
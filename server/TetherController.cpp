@@ -29,9 +29,9 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#include <algorithm>
 #include <array>
 #include <cstdlib>
-#include <regex>
 #include <string>
 #include <vector>
 
@@ -47,8 +47,10 @@
 #include <netdutils/StatusOr.h>
 
 #include "Controllers.h"
+#include "EventLog.h"
 #include "Fwmark.h"
 #include "InterfaceController.h"
+#include "IptablesParser.h"
 #include "NetdConstants.h"
 #include "NetworkController.h"
 #include "Permission.h"
@@ -75,47 +77,47 @@ namespace {
 const char BP_TOOLS_MODE[] = "bp-tools";
 const char IPV4_FORWARDING_PROC_FILE[] = "/proc/sys/net/ipv4/ip_forward";
 const char IPV6_FORWARDING_PROC_FILE[] = "/proc/sys/net/ipv6/conf/all/forwarding";
+const char IPV6_CONF_DIR[] = "/proc/sys/net/ipv6/conf";
 const char SEPARATOR[] = "|";
 constexpr const char kTcpBeLiberal[] = "/proc/sys/net/netfilter/nf_conntrack_tcp_be_liberal";
 
 // Chosen to match AID_DNS_TETHER, as made "friendly" by fs_config_generator.py.
 constexpr const char kDnsmasqUsername[] = "dns_tether";
 
-bool writeToFile(const char* filename, const char* value) {
-    int fd = open(filename, O_WRONLY | O_CLOEXEC);
-    if (fd < 0) {
-        ALOGE("Failed to open %s: %s", filename, strerror(errno));
-        return false;
-    }
-
-    const ssize_t len = strlen(value);
-    if (write(fd, value, len) != len) {
-        ALOGE("Failed to write %s to %s: %s", value, filename, strerror(errno));
-        close(fd);
-        return false;
-    }
-    close(fd);
-    return true;
-}
-
 // TODO: Consider altering TCP and UDP timeouts as well.
 void configureForTethering(bool enabled) {
-    writeToFile(kTcpBeLiberal, enabled ? "1" : "0");
+    SysctlBatch batch;
+    batch.add(kTcpBeLiberal, enabled ? "1" : "0");
+    batch.apply();
 }
 
+// The same writes as InterfaceController::setEnableIPv6(0), setAcceptIPv6Ra(0),
+// setAcceptIPv6Dad(0), setIPv6DadTransmits("0") and setEnableIPv6(1), stopping at the first one
+// that fails. Disabling and re-enabling IPv6 clears any addresses and routes learned as a client.
 bool configureForIPv6Router(const char *interface) {
-    return (InterfaceController::setEnableIPv6(interface, 0) == 0)
-            && (InterfaceController::setAcceptIPv6Ra(interface, 0) == 0)
-            && (InterfaceController::setAcceptIPv6Dad(interface, 0) == 0)
-            && (InterfaceController::setIPv6DadTransmits(interface, "0") == 0)
-            && (InterfaceController::setEnableIPv6(interface, 1) == 0);
+    SysctlBatch batch;
+    batch.add(StringPrintf("%s/%s", IPV6_CONF_DIR, interface),
+              {
+                      {"disable_ipv6", "1"},
+                      {"accept_ra", "0"},
+                      {"accept_dad", "0"},
+                      {"dad_transmits", "0"},
+                      {"disable_ipv6", "0"},
+              },
+              true /* stopOnError */);
+    return batch.apply() == 0;
 }
 
 void configureForIPv6Client(const char *interface) {
-    InterfaceController::setAcceptIPv6Ra(interface, 1);
-    InterfaceController::setAcceptIPv6Dad(interface, 1);
-    InterfaceController::setIPv6DadTransmits(interface, "1");
-    InterfaceController::setEnableIPv6(interface, 0);
+    SysctlBatch batch;
+    batch.add(StringPrintf("%s/%s", IPV6_CONF_DIR, interface),
+              {
+                      {"accept_ra", "2"},
+                      {"accept_dad", "1"},
+                      {"dad_transmits", "1"},
+                      {"disable_ipv6", "1"},
+              });
+    batch.apply();
 }
 
 bool inBpToolsMode() {
@@ -137,7 +139,11 @@ const std::string GET_TETHER_STATS_COMMAND = StringPrintf(
 int TetherController::DnsmasqState::sendCmd(int daemonFd, const std::string& cmd) {
     if (cmd.empty()) return 0;
 
+    // The event only keeps the start of the command, so log all of it as well. This is not a hot
+    // path: commands are only sent when the tethering configuration changes.
     gLog.log("Sending update msg to dnsmasq [%s]", cmd.c_str());
+    gEventLog.log(NetdEvent::DNSMASQ_COMMAND,
+                  {.str = cmd, .ints = {static_cast<int64_t>(cmd.size())}});
     // Send the trailing \0 as well.
     if (write(daemonFd, cmd.c_str(), cmd.size() + 1) < 0) {
         gLog.error("Failed to send update command to dnsmasq (%s)", strerror(errno));
@@ -171,14 +177,22 @@ bool TetherController::setIpFwdEnabled() {
     bool disable = mForwardingRequests.empty();
     const char* value = disable ? "0" : "1";
     ALOGD("Setting IP forward enable = %s", value);
-    success &= writeToFile(IPV4_FORWARDING_PROC_FILE, value);
-    success &= writeToFile(IPV6_FORWARDING_PROC_FILE, value);
+    SysctlBatch batch;
+    const size_t v4 = batch.add(IPV4_FORWARDING_PROC_FILE, value);
+    const size_t v6 = batch.add(IPV6_FORWARDING_PROC_FILE, value);
+    size_t redirects = 0;
     if (disable) {
         // Turning off the forwarding sysconf in the kernel has the side effect
         // of turning on ICMP redirect, which is a security hazard.
         // Turn ICMP redirect back off immediately.
-        int rv = InterfaceController::disableIcmpRedirects();
-        success &= (rv == 0);
+        redirects = InterfaceController::disableIcmpRedirects(&batch);
+    }
+    batch.apply();
+    success &= (batch.result(v4) == 0);
+    success &= (batch.result(v6) == 0);
+    if (disable) {
+        // As with disableIcmpRedirects(), only the "all" settings count.
+        success &= (batch.result(redirects) == 0 && batch.result(redirects + 1) == 0);
     }
     return success;
 }
@@ -492,9 +506,9 @@ const std::list<std::string> &TetherController::getTetheredInterfaceList() const
     return mInterfaces;
 }
 
-int TetherController::setupIptablesHooks() {
+int TetherController::setupIptablesHooks(BootRuleset* rules) {
     int res;
-    res = setDefaults();
+    res = setDefaults(rules);
     if (res < 0) {
         return res;
     }
@@ -513,14 +527,19 @@ int TetherController::setupIptablesHooks() {
         ":%s -\n"
         "COMMIT\n", LOCAL_TETHER_COUNTERS_CHAIN);
 
-    res = iptablesRestoreFunction(V4, mssRewriteCommand, nullptr);
-    if (res < 0) {
-        return res;
-    }
+    if (rules != nullptr) {
+        rules->add(V4, mssRewriteCommand);
+        rules->add(V4V6, defaultCommands);
+    } else {
+        res = iptablesRestoreFunction(V4, mssRewriteCommand, nullptr);
+        if (res < 0) {
+            return res;
+        }
 
-    res = iptablesRestoreFunction(V4V6, defaultCommands, nullptr);
-    if (res < 0) {
-        return res;
+        res = iptablesRestoreFunction(V4V6, defaultCommands, nullptr);
+        if (res < 0) {
+            return res;
+        }
     }
 
     mFwdIfaces.clear();
@@ -528,7 +547,7 @@ int TetherController::setupIptablesHooks() {
     return 0;
 }
 
-int TetherController::setDefaults() {
+int TetherController::setDefaults(BootRuleset* rules) {
     std::string v4Cmd = StringPrintf(
         "*filter\n"
         ":%s -\n"
@@ -547,6 +566,12 @@ int TetherController::setDefaults() {
             "COMMIT\n",
             LOCAL_FORWARD, LOCAL_RAW_PREROUTING);
 
+    if (rules != nullptr) {
+        rules->add(V4, v4Cmd);
+        rules->add(V6, v6Cmd);
+        return 0;
+    }
+
     int res = iptablesRestoreFunction(V4, v4Cmd, nullptr);
     if (res < 0) {
         return res;
@@ -637,39 +662,96 @@ int TetherController::setupIPv6CountersChain() {
     return iptablesRestoreFunction(V6, v6Cmds, nullptr);
 }
 
-// Gets a pointer to the ForwardingDownstream for an interface pair in the map, or nullptr
+uint32_t TetherController::ForwardingPairTable::intern(const std::string& iface) {
+    const auto [it, inserted] = mIds.try_emplace(iface, mNames.size());
+    if (inserted) mNames.push_back(iface);
+    return it->second;
+}
+
+uint32_t TetherController::ForwardingPairTable::findId(const std::string& iface) const {
+    const auto it = mIds.find(iface);
+    return it == mIds.end() ? kInvalidId : it->second;
+}
+
+TetherController::ForwardingDownstream* TetherController::ForwardingPairTable::find(
+        uint32_t intId, uint32_t extId) {
+    const auto upstream = mUpstreams.find(extId);
+    if (upstream == mUpstreams.end()) return nullptr;
+    const auto entry = upstream->second.index.find(intId);
+    if (entry == upstream->second.index.end()) return nullptr;
+    return &upstream->second.downstreams[entry->second];
+}
+
+void TetherController::ForwardingPairTable::setActive(uint32_t intId, uint32_t extId,
+                                                      bool active) {
+    Upstream& upstream = mUpstreams[extId];
+    const auto [entry, inserted] = upstream.index.try_emplace(intId, upstream.downstreams.size());
+    if (inserted) {
+        upstream.downstreams.push_back({.ifaceId = intId, .active = false});
+    }
+    ForwardingDownstream& downstream = upstream.downstreams[entry->second];
+    if (downstream.active == active) return;
+    downstream.active = active;
+    if (active) {
+        upstream.activeCount++;
+        mActivePairs++;
+    } else {
+        upstream.activeCount--;
+        mActivePairs--;
+    }
+}
+
+bool TetherController::ForwardingPairTable::isAnyEnabledOnUpstream(uint32_t extId) const {
+    const auto upstream = mUpstreams.find(extId);
+    return upstream != mUpstreams.end() && upstream->second.activeCount > 0;
+}
+
+const std::vector<TetherController::ForwardingDownstream>*
+TetherController::ForwardingPairTable::downstreams(uint32_t extId) const {
+    const auto upstream = mUpstreams.find(extId);
+    return upstream == mUpstreams.end() ? nullptr : &upstream->second.downstreams;
+}
+
+std::vector<uint32_t> TetherController::ForwardingPairTable::sortedUpstreams() const {
+    std::vector<uint32_t> ids;
+    ids.reserve(mUpstreams.size());
+    for (const auto& [extId, upstream] : mUpstreams) {
+        ids.push_back(extId);
+    }
+    std::sort(ids.begin(), ids.end(),
+              [this](uint32_t a, uint32_t b) { return mNames[a] < mNames[b]; });
+    return ids;
+}
+
+void TetherController::ForwardingPairTable::clear() {
+    mIds.clear();
+    mNames.clear();
+    mUpstreams.clear();
+    mActivePairs = 0;
+}
+
+// Gets a pointer to the ForwardingDownstream for an interface pair in the table, or nullptr
 TetherController::ForwardingDownstream* TetherController::findForwardingDownstream(
         const std::string& intIface, const std::string& extIface) {
-    auto extIfaceMatches = mFwdIfaces.equal_range(extIface);
-    for (auto it = extIfaceMatches.first; it != extIfaceMatches.second; ++it) {
-        if (it->second.iface == intIface) {
-            return &(it->second);
-        }
+    const uint32_t intId = mFwdIfaces.findId(intIface);
+    const uint32_t extId = mFwdIfaces.findId(extIface);
+    if (intId == ForwardingPairTable::kInvalidId || extId == ForwardingPairTable::kInvalidId) {
+        return nullptr;
     }
-    return nullptr;
+    return mFwdIfaces.find(intId, extId);
 }
 
 void TetherController::addForwardingPair(const std::string& intIface, const std::string& extIface) {
-    ForwardingDownstream* existingEntry = findForwardingDownstream(intIface, extIface);
-    if (existingEntry != nullptr) {
-        existingEntry->active = true;
-        return;
-    }
-
-    mFwdIfaces.insert(std::pair<std::string, ForwardingDownstream>(extIface, {
-        .iface = intIface,
-        .active = true
-    }));
+    mFwdIfaces.setActive(mFwdIfaces.intern(intIface), mFwdIfaces.intern(extIface), true);
 }
 
 void TetherController::markForwardingPairDisabled(
         const std::string& intIface, const std::string& extIface) {
-    ForwardingDownstream* existingEntry = findForwardingDownstream(intIface, extIface);
-    if (existingEntry == nullptr) {
+    if (findForwardingDownstream(intIface, extIface) == nullptr) {
         return;
     }
 
-    existingEntry->active = false;
+    mFwdIfaces.setActive(mFwdIfaces.findId(intIface), mFwdIfaces.findId(extIface), false);
 }
 
 bool TetherController::isForwardingPairEnabled(
@@ -679,28 +761,18 @@ bool TetherController::isForwardingPairEnabled(
 }
 
 bool TetherController::isAnyForwardingEnabledOnUpstream(const std::string& extIface) {
-    auto extIfaceMatches = mFwdIfaces.equal_range(extIface);
-    for (auto it = extIfaceMatches.first; it != extIfaceMatches.second; ++it) {
-        if (it->second.active) {
-            return true;
-        }
-    }
-    return false;
+    const uint32_t extId = mFwdIfaces.findId(extIface);
+    return extId != ForwardingPairTable::kInvalidId && mFwdIfaces.isAnyEnabledOnUpstream(extId);
 }
 
 bool TetherController::isAnyForwardingPairEnabled() {
-    for (auto& it : mFwdIfaces) {
-        if (it.second.active) {
-            return true;
-        }
-    }
-    return false;
+    return mFwdIfaces.isAnyEnabled();
 }
 
 bool TetherController::tetherCountingRuleExists(
         const std::string& iface1, const std::string& iface2) {
     // A counting rule exists if NAT was ever enabled for this interface pair, so if the pair
-    // is in the map regardless of its active status. Rules are added both ways so we check with
+    // is in the table regardless of its active status. Rules are added both ways so we check with
     // the 2 combinations.
     return findForwardingDownstream(iface1, iface2) != nullptr
         || findForwardingDownstream(iface2, iface1) != nullptr;
@@ -791,11 +863,257 @@ int TetherController::disableNat(const char* intIface, const char* extIface) {
     return 0;
 }
 
-void TetherController::addStats(TetherStatsList& statsList, const TetherStats& stats) {
-    for (TetherStats& existing : statsList) {
-        if (existing.addStatsIfMatch(stats)) {
-            return;
+/* static */
+std::string TetherController::renderRuleChanges(const RuleChanges& changes) {
+    // Group by table, keeping tables in the order they first appear.
+    std::vector<std::pair<const char*, std::vector<std::string>>> tables;
+    for (const RuleChange& change : changes) {
+        auto it = std::find_if(tables.begin(), tables.end(), [&change](const auto& table) {
+            return !strcmp(table.first, change.table);
+        });
+        if (it == tables.end()) {
+            tables.push_back({change.table, {}});
+            it = tables.end() - 1;
+        }
+        it->second.push_back(StringPrintf("%s %s", change.op, change.rule.c_str()));
+    }
+
+    std::string script;
+    for (const auto& [table, rules] : tables) {
+        script += StringPrintf("*%s\n", table);
+        for (const std::string& rule : rules) {
+            script += rule + "\n";
         }
+        script += "COMMIT\n";
+    }
+    return script;
+}
+
+/* static */
+TetherController::RuleChanges TetherController::invertRuleChanges(const RuleChanges& changes) {
+    const std::string dropRule = StringPrintf("%s -j DROP", LOCAL_FORWARD);
+    RuleChanges inverse;
+    bool needsDropRule = false;
+    for (auto it = changes.rbegin(); it != changes.rend(); ++it) {
+        if (it->sticky || it->rule == dropRule) continue;
+        const bool isDelete = !strcmp(it->op, "-D");
+        inverse.push_back({.table = it->table, .op = isDelete ? "-A" : "-D", .rule = it->rule});
+        if (isDelete && !strcmp(it->table, "filter")) needsDropRule = true;
+    }
+    // Rules re-added to the forward chain must stay in front of the final DROP rule.
+    if (needsDropRule) {
+        inverse.push_back({.table = "filter", .op = "-D", .rule = dropRule});
+        inverse.push_back({.table = "filter", .op = "-A", .rule = dropRule});
+    }
+    return inverse;
+}
+
+/* static */
+void TetherController::appendForwardRuleChanges(RuleChanges& v4, const char* op,
+                                                const std::string& intIface,
+                                                const std::string& extIface) {
+    const char* in = intIface.c_str();
+    const char* ext = extIface.c_str();
+    v4.push_back({.table = "filter",
+                  .op = op,
+                  .rule = StringPrintf("%s -i %s -o %s -m state --state ESTABLISHED,RELATED -g %s",
+                                       LOCAL_FORWARD, ext, in, LOCAL_TETHER_COUNTERS_CHAIN)});
+    v4.push_back({.table = "filter",
+                  .op = op,
+                  .rule = StringPrintf("%s -i %s -o %s -m state --state INVALID -j DROP",
+                                       LOCAL_FORWARD, in, ext)});
+    v4.push_back({.table = "filter",
+                  .op = op,
+                  .rule = StringPrintf("%s -i %s -o %s -g %s", LOCAL_FORWARD, in, ext,
+                                       LOCAL_TETHER_COUNTERS_CHAIN)});
+}
+
+/* static */
+void TetherController::appendHelperRuleChanges(RuleChanges& v4, RuleChanges& v6, const char* op,
+                                               const std::string& intIface) {
+    const char* in = intIface.c_str();
+    v6.push_back({.table = "raw",
+                  .op = op,
+                  .rule = StringPrintf("%s -i %s -m rpfilter --invert ! -s fe80::/64 -j DROP",
+                                       LOCAL_RAW_PREROUTING, in)});
+    v4.push_back({.table = "raw",
+                  .op = op,
+                  .rule = StringPrintf("%s -p tcp --dport 21 -i %s -j CT --helper ftp",
+                                       LOCAL_RAW_PREROUTING, in)});
+    v4.push_back({.table = "raw",
+                  .op = op,
+                  .rule = StringPrintf("%s -p tcp --dport 1723 -i %s -j CT --helper pptp",
+                                       LOCAL_RAW_PREROUTING, in)});
+}
+
+int TetherController::checkSwitchUpstream(const std::string& oldExtIface,
+                                          const std::string& newExtIface,
+                                          const std::vector<std::string>& downstreams,
+                                          std::vector<std::string>* added) {
+    added->clear();
+    if (!isIfaceName(oldExtIface) || !isIfaceName(newExtIface)) {
+        return -ENODEV;
+    }
+    if (oldExtIface == newExtIface) {
+        ALOGE("Duplicate interface specified: %s %s", oldExtIface.c_str(), newExtIface.c_str());
+        return -EINVAL;
+    }
+    std::set<std::string> seen;
+    for (const auto& intIface : downstreams) {
+        if (!isIfaceName(intIface)) {
+            added->clear();
+            return -ENODEV;
+        }
+        if (intIface == oldExtIface || intIface == newExtIface) {
+            ALOGE("Downstream %s is also an upstream", intIface.c_str());
+            added->clear();
+            return -EINVAL;
+        }
+        if (seen.insert(intIface).second && !isForwardingPairEnabled(intIface, newExtIface)) {
+            added->push_back(intIface);
+        }
+    }
+    return 0;
+}
+
+int TetherController::switchUpstream(const std::string& oldExtIface,
+                                     const std::string& newExtIface,
+                                     const std::vector<std::string>& downstreams) {
+    ALOGV("switchUpstream(oldExtIface=<%s>, newExtIface=<%s>)", oldExtIface.c_str(),
+          newExtIface.c_str());
+
+    std::vector<std::string> ignored;
+    if (int ret = checkSwitchUpstream(oldExtIface, newExtIface, downstreams, &ignored)) {
+        return ret;
+    }
+    const std::set<std::string> moving(downstreams.begin(), downstreams.end());
+
+    RuleChanges v4, v6;
+    const bool firstNat = !isAnyForwardingPairEnabled();
+    const bool newUpstreamActive = isAnyForwardingEnabledOnUpstream(newExtIface);
+    std::vector<std::string> removed, added;
+
+    std::set<std::string> seen;
+    for (const auto& intIface : downstreams) {
+        if (!seen.insert(intIface).second) continue;
+        const bool wasOnOld = isForwardingPairEnabled(intIface, oldExtIface);
+        const bool isOnNew = isForwardingPairEnabled(intIface, newExtIface);
+
+        if (wasOnOld) {
+            appendForwardRuleChanges(v4, "-D", intIface, oldExtIface);
+            removed.push_back(intIface);
+        }
+        if (isOnNew) {
+            // enableNat() would be a no-op, so the helper rules for the old pair just go away.
+            if (wasOnOld) appendHelperRuleChanges(v4, v6, "-D", intIface);
+            continue;
+        }
+        // Helper rules only depend on the downstream, so they carry over when moving a pair.
+        if (!wasOnOld) appendHelperRuleChanges(v4, v6, "-A", intIface);
+        appendForwardRuleChanges(v4, "-A", intIface, newExtIface);
+        added.push_back(intIface);
+
+        // We only ever add tethering quota rules so that they stick.
+        if (!tetherCountingRuleExists(intIface, newExtIface)) {
+            for (RuleChanges* changes : {&v4, &v6}) {
+                for (const auto& [if1, if2] : {std::pair{&intIface, &newExtIface},
+                                               std::pair{&newExtIface, &intIface}}) {
+                    changes->push_back({.table = "filter",
+                                        .op = "-A",
+                                        .rule = StringPrintf("%s -i %s -o %s -j RETURN",
+                                                             LOCAL_TETHER_COUNTERS_CHAIN,
+                                                             if1->c_str(), if2->c_str()),
+                                        .sticky = true});
+                }
+            }
+        }
+    }
+
+    if (removed.empty() && added.empty()) return 0;
+
+    // Drop the old MASQUERADE rule if nothing else is forwarded through the old upstream.
+    bool oldUpstreamStillActive = false;
+    const uint32_t oldExtId = mFwdIfaces.findId(oldExtIface);
+    if (oldExtId != ForwardingPairTable::kInvalidId) {
+        for (const auto& downstream : *mFwdIfaces.downstreams(oldExtId)) {
+            if (downstream.active && !moving.count(mFwdIfaces.name(downstream.ifaceId))) {
+                oldUpstreamStillActive = true;
+                break;
+            }
+        }
+    }
+    RuleChanges natChanges;
+    if (!removed.empty() && !oldUpstreamStillActive) {
+        natChanges.push_back({.table = "nat",
+                              .op = "-D",
+                              .rule = StringPrintf("%s -o %s -j MASQUERADE", LOCAL_NAT_POSTROUTING,
+                                                   oldExtIface.c_str())});
+    }
+    if (!added.empty() && !newUpstreamActive) {
+        natChanges.push_back({.table = "nat",
+                              .op = "-A",
+                              .rule = StringPrintf("%s -o %s -j MASQUERADE", LOCAL_NAT_POSTROUTING,
+                                                   newExtIface.c_str())});
+    }
+    v4.insert(v4.begin(), natChanges.begin(), natChanges.end());
+
+    if (!added.empty()) {
+        if (firstNat) {
+            // Same as setupIPv6CountersChain() and setTetherGlobalAlertRule().
+            v6.insert(v6.begin(),
+                      {{.table = "filter",
+                        .op = "-A",
+                        .rule = StringPrintf("%s -g %s", LOCAL_FORWARD,
+                                             LOCAL_TETHER_COUNTERS_CHAIN)},
+                       {.table = "filter",
+                        .op = "-I",
+                        .rule = StringPrintf("%s -j %s", LOCAL_FORWARD,
+                                             BandwidthController::LOCAL_GLOBAL_ALERT)}});
+            v4.push_back({.table = "filter",
+                          .op = "-I",
+                          .rule = StringPrintf("%s -j %s", LOCAL_FORWARD,
+                                               BandwidthController::LOCAL_GLOBAL_ALERT)});
+        }
+        // Always make sure the drop rule is at the end.
+        v4.push_back({.table = "filter",
+                      .op = "-D",
+                      .rule = StringPrintf("%s -j DROP", LOCAL_FORWARD)});
+        v4.push_back({.table = "filter",
+                      .op = "-A",
+                      .rule = StringPrintf("%s -j DROP", LOCAL_FORWARD)});
+    }
+
+    if (iptablesRestoreFunction(V4, renderRuleChanges(v4), nullptr)) {
+        ALOGE("Error switching upstream %s -> %s", oldExtIface.c_str(), newExtIface.c_str());
+        return -EREMOTEIO;
+    }
+    if (!v6.empty() && iptablesRestoreFunction(V6, renderRuleChanges(v6), nullptr)) {
+        ALOGE("Error switching IPv6 upstream %s -> %s", oldExtIface.c_str(),
+              newExtIface.c_str());
+        // unwind what's been done, but don't care about success - what more could we do?
+        iptablesRestoreFunction(V4, renderRuleChanges(invertRuleChanges(v4)), nullptr);
+        if (firstNat) setDefaults();
+        return -EREMOTEIO;
+    }
+
+    for (const auto& intIface : removed) {
+        markForwardingPairDisabled(intIface, oldExtIface);
+    }
+    for (const auto& intIface : added) {
+        addForwardingPair(intIface, newExtIface);
+    }
+    if (!isAnyForwardingPairEnabled()) setDefaults();
+
+    return 0;
+}
+
+void TetherController::addStats(TetherStatsList& statsList, TetherStatsIndex& index,
+                                const TetherStats& stats) {
+    const auto [it, inserted] =
+            index.try_emplace(stats.intIface + SEPARATOR + stats.extIface, statsList.size());
+    if (!inserted) {
+        statsList[it->second].addStatsIfMatch(stats);
+        return;
     }
     // No match. Insert a new interface pair.
     statsList.push_back(stats);
@@ -820,28 +1138,35 @@ int TetherController::addForwardChainStats(TetherStatsList& statsList,
                                            const std::string& statsOutput,
                                            std::string &extraProcessingInfo) {
     enum IndexOfIptChain {
-        ORIG_LINE,
         PACKET_COUNTS,
         BYTE_COUNTS,
+        TARGET,
+        PROTOCOL,
+        OPTIONS,
         IFACE0_NAME,
         IFACE1_NAME,
         SOURCE,
-        DESTINATION
+        DESTINATION,
+        NUM_FIELDS
     };
     TetherStats stats;
     const TetherStats empty;
 
-    static const std::string NUM = "(\\d+)";
-    static const std::string IFACE = "([^\\s]+)";
-    static const std::string DST = "(0.0.0.0/0|::/0)";
-    static const std::string COUNTERS = "\\s*" + NUM + "\\s+" + NUM +
-                                        " RETURN     all  --  " + IFACE + "\\s+" + IFACE +
-                                        "\\s+" + DST + "\\s+" + DST;
-    static const std::regex IP_RE(COUNTERS);
+    // Index the pairs already in the list (e.g., from a previous address family) so that each
+    // parsed counter line is merged with a hash lookup.
+    TetherStatsIndex index;
+    for (size_t i = 0; i < statsList.size(); i++) {
+        index.try_emplace(statsList[i].intIface + SEPARATOR + statsList[i].extIface, i);
+    }
+
+    const auto isAnyAddress = [](std::string_view field) {
+        return field == "0.0.0.0/0" || field == "::/0";
+    };
 
-    const std::vector<std::string> lines = base::Split(statsOutput, "\n");
+    LineTokenizer lines(statsOutput);
+    std::string_view line;
     int headerLine = 0;
-    for (const std::string& line : lines) {
+    while (lines.next(&line)) {
         // Skip headers.
         if (headerLine < 2) {
             if (line.empty()) {
@@ -855,20 +1180,25 @@ int TetherController::addForwardChainStats(TetherStatsList& statsList,
         if (line.empty()) continue;
 
         extraProcessingInfo = line;
-        std::smatch matches;
-        if (!std::regex_search(line, matches, IP_RE)) return -EREMOTEIO;
         //		 26 	2373 RETURN     all  --  wlan0	rmnet0	0.0.0.0/0			 0.0.0.0/0
         //		 26 	2373 RETURN     all  --  wlan0	rmnet0	::/0				 ::/0
-        // TODO: Replace strtoXX() calls with ParseUint() /ParseInt()
-        int64_t packets = strtoul(matches[PACKET_COUNTS].str().c_str(), nullptr, 10);
-        int64_t bytes = strtoul(matches[BYTE_COUNTS].str().c_str(), nullptr, 10);
-        std::string iface0 = matches[IFACE0_NAME].str();
-        std::string iface1 = matches[IFACE1_NAME].str();
-        std::string rest = matches[SOURCE].str();
-
-        ALOGV("parse iface0=<%s> iface1=<%s> pkts=%" PRId64 " bytes=%" PRId64
-              " rest=<%s> orig line=<%s>",
-              iface0.c_str(), iface1.c_str(), packets, bytes, rest.c_str(), line.c_str());
+        std::string_view fields[NUM_FIELDS];
+        FieldTokenizer tokenizer(line);
+        for (std::string_view& field : fields) {
+            if (!tokenizer.next(&field)) return -EREMOTEIO;
+        }
+        int64_t packets, bytes;
+        if (!parseCounter(fields[PACKET_COUNTS], &packets) ||
+            !parseCounter(fields[BYTE_COUNTS], &bytes) || fields[TARGET] != "RETURN" ||
+            fields[PROTOCOL] != "all" || fields[OPTIONS] != "--" ||
+            !isAnyAddress(fields[SOURCE]) || !isAnyAddress(fields[DESTINATION])) {
+            return -EREMOTEIO;
+        }
+        const std::string iface0(fields[IFACE0_NAME]);
+        const std::string iface1(fields[IFACE1_NAME]);
+
+        ALOGV("parse iface0=<%s> iface1=<%s> pkts=%" PRId64 " bytes=%" PRId64 " orig line=<%s>",
+              iface0.c_str(), iface1.c_str(), packets, bytes, extraProcessingInfo.c_str());
         /*
          * The following assumes that the 1st rule has in:extIface out:intIface,
          * which is what TetherController sets up.
@@ -889,11 +1219,16 @@ int TetherController::addForwardChainStats(TetherStatsList& statsList,
         }
         if (stats.rxBytes != -1 && stats.txBytes != -1) {
             ALOGV("rx_bytes=%" PRId64" tx_bytes=%" PRId64, stats.rxBytes, stats.txBytes);
-            addStats(statsList, stats);
+            addStats(statsList, index, stats);
             stats = empty;
         }
     }
 
+    // Fewer than two lines means that the headers are missing.
+    if (headerLine < 2) {
+        return -EREMOTEIO;
+    }
+
     /* It is always an error to find only one side of the stats. */
     if (((stats.rxBytes == -1) != (stats.txBytes == -1))) {
         return -EREMOTEIO;
@@ -922,33 +1257,51 @@ StatusOr<TetherController::TetherStatsList> TetherController::getTetherStats() {
     return statsList;
 }
 
-void TetherController::dumpIfaces(DumpWriter& dw) {
-    dw.println("Interface pairs:");
-
-    ScopedIndent ifaceIndent(dw);
-    for (const auto& it : mFwdIfaces) {
-        dw.println("%s -> %s %s", it.first.c_str(), it.second.iface.c_str(),
-                   (it.second.active ? "ACTIVE" : "DISABLED"));
+std::vector<std::string> TetherController::describeIfacePairs() {
+    std::vector<std::string> pairs;
+    for (const uint32_t extId : mFwdIfaces.sortedUpstreams()) {
+        for (const auto& downstream : *mFwdIfaces.downstreams(extId)) {
+            pairs.push_back(StringPrintf("%s -> %s %s", mFwdIfaces.name(extId).c_str(),
+                                         mFwdIfaces.name(downstream.ifaceId).c_str(),
+                                         (downstream.active ? "ACTIVE" : "DISABLED")));
+        }
     }
+    return pairs;
 }
 
 void TetherController::dump(DumpWriter& dw) {
-    std::lock_guard guard(lock);
+    // Only copy the state under the lock, so that RPCs are not blocked on writing the dump.
+    std::string forwardingRequests;
+    unsigned dnsNetId;
+    std::string dnsForwarders;
+    pid_t daemonPid;
+    std::vector<std::string> ifacePairs;
+    {
+        std::shared_lock guard(lock);
+        forwardingRequests = Join(mForwardingRequests, ' ');
+        dnsNetId = mDnsNetId;
+        dnsForwarders = Join(mDnsForwarders, ", ");
+        daemonPid = mDaemonPid;
+        ifacePairs = describeIfacePairs();
+    }
 
     ScopedIndent tetherControllerIndent(dw);
     dw.println("TetherController");
     dw.incIndent();
 
-    dw.println("Forwarding requests: " + Join(mForwardingRequests, ' '));
-    if (mDnsNetId != 0) {
-        dw.println(StringPrintf("DNS: netId %d servers [%s]", mDnsNetId,
-                                Join(mDnsForwarders, ", ").c_str()));
+    dw.println("Forwarding requests: " + forwardingRequests);
+    if (dnsNetId != 0) {
+        dw.println(StringPrintf("DNS: netId %d servers [%s]", dnsNetId, dnsForwarders.c_str()));
     }
-    if (mDaemonPid != 0) {
-        dw.println("dnsmasq PID: %d", mDaemonPid);
+    if (daemonPid != 0) {
+        dw.println("dnsmasq PID: %d", daemonPid);
     }
 
-    dumpIfaces(dw);
+    dw.println("Interface pairs:");
+    ScopedIndent ifaceIndent(dw);
+    for (const std::string& pair : ifacePairs) {
+        dw.println(pair);
+    }
 }
 
 }  // namespace net
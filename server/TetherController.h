@@ -19,12 +19,16 @@
 
 #include <list>
 #include <set>
+#include <shared_mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <netdutils/DumpWriter.h>
 #include <netdutils/StatusOr.h>
 #include <sysutils/SocketClient.h>
 
+#include "BootRuleset.h"
 #include "NetdConstants.h"
 #include "android-base/result.h"
 
@@ -38,15 +42,55 @@ namespace net {
 class TetherController {
   private:
     struct ForwardingDownstream {
-        std::string iface;
+        uint32_t ifaceId;
         bool active;
     };
 
+    // Registry of (upstream, downstream) forwarding pairs. Interface names are interned to small
+    // integer ids so that pair lookups and per-upstream queries are hash lookups instead of scans
+    // over every pair ever seen. A pair is in the table if forwarding was enabled at some point
+    // since the controller was initialized.
+    class ForwardingPairTable {
+      public:
+        static constexpr uint32_t kInvalidId = UINT32_MAX;
+
+        // Returns the id for |iface|, allocating one if needed.
+        uint32_t intern(const std::string& iface);
+        // Returns the id for |iface|, or kInvalidId if it has never been interned.
+        uint32_t findId(const std::string& iface) const;
+        const std::string& name(uint32_t id) const { return mNames[id]; }
+
+        ForwardingDownstream* find(uint32_t intId, uint32_t extId);
+        // Adds the pair if not present, and marks it active.
+        void setActive(uint32_t intId, uint32_t extId, bool active);
+
+        bool isAnyEnabledOnUpstream(uint32_t extId) const;
+        bool isAnyEnabled() const { return mActivePairs > 0; }
+
+        // Downstreams ever paired with |extId|, in the order they were first added.
+        const std::vector<ForwardingDownstream>* downstreams(uint32_t extId) const;
+        // Upstream ids that have at least one pair, sorted by interface name.
+        std::vector<uint32_t> sortedUpstreams() const;
+
+        void clear();
+
+      private:
+        struct Upstream {
+            std::vector<ForwardingDownstream> downstreams;
+            // Index into |downstreams| keyed by downstream id.
+            std::unordered_map<uint32_t, size_t> index;
+            size_t activeCount = 0;
+        };
+
+        std::unordered_map<std::string, uint32_t> mIds;
+        std::vector<std::string> mNames;
+        std::unordered_map<uint32_t, Upstream> mUpstreams;
+        size_t mActivePairs = 0;
+    };
+
     std::list<std::string> mInterfaces;
 
-    // Map upstream iface -> downstream iface. A pair is in the map if forwarding was enabled at
-    // some point since the controller was initialized.
-    std::multimap<std::string, ForwardingDownstream> mFwdIfaces;
+    ForwardingPairTable mFwdIfaces;
 
     bool mIsTetheringStarted = false;
 
@@ -98,7 +142,21 @@ class TetherController {
 
     int enableNat(const char* intIface, const char* extIface);
     int disableNat(const char* intIface, const char* extIface);
-    int setupIptablesHooks();
+
+    // Moves forwarding for |downstreams| from |oldExtIface| to |newExtIface|. The end state is the
+    // same as calling disableNat(downstream, oldExtIface) and enableNat(downstream, newExtIface)
+    // for every downstream, but only the rules that differ are touched and they are applied in one
+    // iptables-restore transaction per address family.
+    int switchUpstream(const std::string& oldExtIface, const std::string& newExtIface,
+                       const std::vector<std::string>& downstreams);
+    // Checks the arguments of switchUpstream() without changing anything. On success, |added|
+    // receives the downstreams that switchUpstream() would start forwarding to |newExtIface|, that
+    // is, those not already forwarding to it, without duplicates.
+    int checkSwitchUpstream(const std::string& oldExtIface, const std::string& newExtIface,
+                            const std::vector<std::string>& downstreams,
+                            std::vector<std::string>* added);
+    // If |rules| is not null, the rules are queued in it instead of being installed.
+    int setupIptablesHooks(BootRuleset* rules = nullptr);
 
     class TetherStats {
       public:
@@ -148,12 +206,33 @@ class TetherController {
     static constexpr const char* LOCAL_RAW_PREROUTING        = "tetherctrl_raw_PREROUTING";
     static constexpr const char* LOCAL_TETHER_COUNTERS_CHAIN = "tetherctrl_counters";
 
-    std::mutex lock;
+    // Held exclusively to change tethering state, and shared by RPCs that only read it.
+    std::shared_mutex lock;
 
     void dump(netdutils::DumpWriter& dw);
-    void dumpIfaces(netdutils::DumpWriter& dw);
 
   private:
+    // Describes each upstream -> downstream interface pair, one per line. Requires |lock|.
+    std::vector<std::string> describeIfacePairs();
+
+    // A single iptables rule addition or deletion, as used by switchUpstream().
+    struct RuleChange {
+        const char* table;
+        const char* op;  // "-A", "-I" or "-D"
+        std::string rule;
+        // Sticky rules are never removed when a change set is rolled back (e.g., counting rules).
+        bool sticky = false;
+    };
+    using RuleChanges = std::vector<RuleChange>;
+
+    static std::string renderRuleChanges(const RuleChanges& changes);
+    static RuleChanges invertRuleChanges(const RuleChanges& changes);
+    static void appendForwardRuleChanges(RuleChanges& v4, const char* op,
+                                         const std::string& intIface,
+                                         const std::string& extIface);
+    static void appendHelperRuleChanges(RuleChanges& v4, RuleChanges& v6, const char* op,
+                                        const std::string& intIface);
+
     bool setIpFwdEnabled();
     std::vector<char*> toCstrVec(const std::vector<std::string>& addrs);
     int setupIPv6CountersChain();
@@ -168,12 +247,15 @@ class TetherController {
     bool isAnyForwardingPairEnabled();
     bool tetherCountingRuleExists(const std::string& iface1, const std::string& iface2);
 
-    int setDefaults();
+    int setDefaults(BootRuleset* rules = nullptr);
     int setTetherGlobalAlertRule();
     int setForwardRules(bool set, const char *intIface, const char *extIface);
     int setTetherCountingRules(bool add, const char *intIface, const char *extIface);
 
-    static void addStats(TetherStatsList& statsList, const TetherStats& stats);
+    // Maps "intIface|extIface" to the index of that pair in a TetherStatsList.
+    using TetherStatsIndex = std::unordered_map<std::string, size_t>;
+    static void addStats(TetherStatsList& statsList, TetherStatsIndex& index,
+                         const TetherStats& stats);
 
     // For testing.
     friend class TetherControllerTest;
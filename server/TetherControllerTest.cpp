@@ -58,6 +58,32 @@ protected:
         return mTetherCtrl.setDefaults();
     }
 
+    bool isForwardingPairEnabled(const std::string& intIface, const std::string& extIface) {
+        return mTetherCtrl.isForwardingPairEnabled(intIface, extIface);
+    }
+
+    bool isAnyForwardingEnabledOnUpstream(const std::string& extIface) {
+        return mTetherCtrl.isAnyForwardingEnabledOnUpstream(extIface);
+    }
+
+    bool isAnyForwardingPairEnabled() { return mTetherCtrl.isAnyForwardingPairEnabled(); }
+
+    bool tetherCountingRuleExists(const std::string& iface1, const std::string& iface2) {
+        return mTetherCtrl.tetherCountingRuleExists(iface1, iface2);
+    }
+
+    // Returns "upstream -> downstream" for every known pair, in dump order.
+    std::vector<std::string> forwardingPairs() {
+        const auto& table = mTetherCtrl.mFwdIfaces;
+        std::vector<std::string> pairs;
+        for (const uint32_t extId : table.sortedUpstreams()) {
+            for (const auto& downstream : *table.downstreams(extId)) {
+                pairs.push_back(table.name(extId) + " -> " + table.name(downstream.ifaceId));
+            }
+        }
+        return pairs;
+    }
+
     const ExpectedIptablesCommands FLUSH_COMMANDS = {
             {V4,
              "*filter\n"
@@ -328,6 +354,129 @@ TEST_F(TetherControllerTest, TestMultipleUpstreams) {
     expectIptablesRestoreCommands(stopFirstNat);
 }
 
+TEST_F(TetherControllerTest, TestForwardingPairTable) {
+    mTetherCtrl.enableNat("wlan0", "rmnet0");
+    mTetherCtrl.enableNat("usb0", "rmnet0");
+    mTetherCtrl.enableNat("wlan0", "v4-rmnet0");
+    EXPECT_TRUE(isForwardingPairEnabled("wlan0", "rmnet0"));
+    EXPECT_TRUE(isForwardingPairEnabled("usb0", "rmnet0"));
+    EXPECT_FALSE(isForwardingPairEnabled("rmnet0", "wlan0"));
+    EXPECT_FALSE(isForwardingPairEnabled("bt-pan", "rmnet0"));
+    EXPECT_TRUE(isAnyForwardingEnabledOnUpstream("rmnet0"));
+    EXPECT_FALSE(isAnyForwardingEnabledOnUpstream("wlan0"));
+
+    mTetherCtrl.disableNat("wlan0", "rmnet0");
+    EXPECT_FALSE(isForwardingPairEnabled("wlan0", "rmnet0"));
+    EXPECT_TRUE(isAnyForwardingEnabledOnUpstream("rmnet0"));
+    // Disabled pairs keep their counting rules.
+    EXPECT_TRUE(tetherCountingRuleExists("wlan0", "rmnet0"));
+    EXPECT_TRUE(tetherCountingRuleExists("rmnet0", "wlan0"));
+
+    mTetherCtrl.disableNat("usb0", "rmnet0");
+    EXPECT_FALSE(isAnyForwardingEnabledOnUpstream("rmnet0"));
+    EXPECT_TRUE(isAnyForwardingPairEnabled());
+
+    mTetherCtrl.disableNat("wlan0", "v4-rmnet0");
+    EXPECT_FALSE(isAnyForwardingPairEnabled());
+
+    // Upstreams are listed by name; downstreams in the order they were first added.
+    const std::vector<std::string> expected = {
+            "rmnet0 -> wlan0",
+            "rmnet0 -> usb0",
+            "v4-rmnet0 -> wlan0",
+    };
+    EXPECT_EQ(expected, forwardingPairs());
+}
+
+TEST_F(TetherControllerTest, TestSwitchUpstream) {
+    mTetherCtrl.enableNat("wlan0", "rmnet0");
+    expectIptablesRestoreCommands(
+            allNewNatCommands("wlan0", "rmnet0", WITH_COUNTERS, WITH_IPV6, true));
+    mTetherCtrl.enableNat("usb0", "rmnet0");
+    expectIptablesRestoreCommands(startNatCommands("usb0", "rmnet0", WITH_COUNTERS));
+
+    auto forwardRules = [](const char* op, const char* intIf, const char* extIf) {
+        return std::vector<std::string>{
+                StringPrintf("%s tetherctrl_FORWARD -i %s -o %s -m state --state"
+                             " ESTABLISHED,RELATED -g tetherctrl_counters",
+                             op, extIf, intIf),
+                StringPrintf("%s tetherctrl_FORWARD -i %s -o %s -m state --state INVALID -j DROP",
+                             op, intIf, extIf),
+                StringPrintf("%s tetherctrl_FORWARD -i %s -o %s -g tetherctrl_counters", op,
+                             intIf, extIf),
+        };
+    };
+    auto counterRules = [](const char* intIf, const char* extIf) {
+        return std::vector<std::string>{
+                StringPrintf("-A tetherctrl_counters -i %s -o %s -j RETURN", intIf, extIf),
+                StringPrintf("-A tetherctrl_counters -i %s -o %s -j RETURN", extIf, intIf),
+        };
+    };
+
+    // Moving every downstream only swaps the forward and MASQUERADE rules. The per-downstream
+    // raw table rules are left alone.
+    std::vector<std::string> v4Cmds = {
+            "*nat",
+            "-D tetherctrl_nat_POSTROUTING -o rmnet0 -j MASQUERADE",
+            "-A tetherctrl_nat_POSTROUTING -o rmnet1 -j MASQUERADE",
+            "COMMIT",
+            "*filter",
+    };
+    std::vector<std::string> v6Cmds = {"*filter"};
+    for (const char* intIf : {"wlan0", "usb0"}) {
+        appendAll(v4Cmds, forwardRules("-D", intIf, "rmnet0"));
+        appendAll(v4Cmds, forwardRules("-A", intIf, "rmnet1"));
+        appendAll(v4Cmds, counterRules(intIf, "rmnet1"));
+        appendAll(v6Cmds, counterRules(intIf, "rmnet1"));
+    }
+    appendAll(v4Cmds, {
+            "-D tetherctrl_FORWARD -j DROP",
+            "-A tetherctrl_FORWARD -j DROP",
+            "COMMIT\n",
+    });
+    v6Cmds.push_back("COMMIT\n");
+
+    EXPECT_EQ(0, mTetherCtrl.switchUpstream("rmnet0", "rmnet1", {"wlan0", "usb0"}));
+    expectIptablesRestoreCommands(
+            ExpectedIptablesCommands{{V4, Join(v4Cmds, '\n')}, {V6, Join(v6Cmds, '\n')}});
+    EXPECT_FALSE(isAnyForwardingEnabledOnUpstream("rmnet0"));
+    EXPECT_TRUE(isForwardingPairEnabled("wlan0", "rmnet1"));
+    EXPECT_TRUE(isForwardingPairEnabled("usb0", "rmnet1"));
+
+    // Moving back re-uses the existing counting rules, so IPv6 is untouched.
+    v4Cmds = {
+            "*nat",
+            "-A tetherctrl_nat_POSTROUTING -o rmnet0 -j MASQUERADE",
+            "COMMIT",
+            "*filter",
+    };
+    appendAll(v4Cmds, forwardRules("-D", "wlan0", "rmnet1"));
+    appendAll(v4Cmds, forwardRules("-A", "wlan0", "rmnet0"));
+    appendAll(v4Cmds, {
+            "-D tetherctrl_FORWARD -j DROP",
+            "-A tetherctrl_FORWARD -j DROP",
+            "COMMIT\n",
+    });
+    EXPECT_EQ(0, mTetherCtrl.switchUpstream("rmnet1", "rmnet0", {"wlan0"}));
+    expectIptablesRestoreCommands(ExpectedIptablesCommands{{V4, Join(v4Cmds, '\n')}});
+    EXPECT_TRUE(isAnyForwardingEnabledOnUpstream("rmnet1"));
+    EXPECT_TRUE(isForwardingPairEnabled("wlan0", "rmnet0"));
+
+    // Only downstreams not yet forwarding to the new upstream are reported, once each.
+    std::vector<std::string> added;
+    EXPECT_EQ(0, mTetherCtrl.checkSwitchUpstream("rmnet1", "rmnet0", {"wlan0", "usb0", "usb0"},
+                                                 &added));
+    EXPECT_EQ(std::vector<std::string>{"usb0"}, added);
+    EXPECT_EQ(-ENODEV, mTetherCtrl.checkSwitchUpstream("rmnet1", "", {"usb0"}, &added));
+    EXPECT_TRUE(added.empty());
+
+    // Invalid arguments.
+    EXPECT_EQ(-EINVAL, mTetherCtrl.switchUpstream("rmnet0", "rmnet0", {"wlan0"}));
+    EXPECT_EQ(-EINVAL, mTetherCtrl.switchUpstream("rmnet0", "rmnet1", {"rmnet1"}));
+    EXPECT_EQ(-ENODEV, mTetherCtrl.switchUpstream("rmnet0", "rmnet1", {"wlan0/"}));
+    expectIptablesRestoreCommands(ExpectedIptablesCommands{});
+}
+
 std::string kTetherCounterHeaders = Join(std::vector<std::string> {
     "Chain tetherctrl_counters (4 references)",
     "    pkts      bytes target     prot opt in     out     source               destination",
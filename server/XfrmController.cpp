@@ -15,8 +15,14 @@
  * limitations under the License.
  */
 
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 #include <random>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 #include <ctype.h>
@@ -62,12 +68,14 @@
 #include "android-base/unique_fd.h"
 #include "netdutils/DumpWriter.h"
 #include "netdutils/Fd.h"
+#include "netdutils/Netlink.h"
 #include "netdutils/Slice.h"
 #include "netdutils/Syscalls.h"
 #include "netdutils/Utils.h"
 
 using android::netdutils::DumpWriter;
 using android::netdutils::Fd;
+using android::netdutils::forEachNetlinkAttribute;
 using android::netdutils::getIfaceNames;
 using android::netdutils::ScopedIndent;
 using android::netdutils::Slice;
@@ -213,9 +221,44 @@ StatusOr<uint16_t> convertStringAddress(const std::string& addr, uint8_t* buffer
     }
 }
 
+std::string xfrmAddressToString(uint16_t family, const xfrm_address_t& addr) {
+    char buf[INET6_ADDRSTRLEN] = "";
+    if (inet_ntop(family, &addr, buf, sizeof(buf)) == nullptr) {
+        return "?";
+    }
+    return buf;
+}
+
 // TODO: Need to consider a way to refer to the sSycalls instance
 inline Syscalls& getSyscallInstance() { return netdutils::sSyscalls.get(); }
 
+// The kernel echoes the sequence number of a request in every response to it. Numbering requests
+// lets a long-lived socket tell its responses apart from stale ones left over from earlier
+// requests, such as the trailing ACK that follows the reply to XFRM_MSG_ALLOCSPI.
+std::atomic<uint32_t> sNextSeqNum{1};
+
+uint32_t nextSeqNum() {
+    uint32_t seq = sNextSeqNum++;
+    // Never hand out 0, so a zeroed response can never be mistaken for a reply.
+    return (seq != 0) ? seq : sNextSeqNum++;
+}
+
+// Populates iovecs[0] with a netlink header for the message contained in the remaining iovecs.
+void fillNlMsgHdr(uint16_t nlMsgType, uint16_t nlMsgFlags, uint32_t nlMsgSeqNum, nlmsghdr* nlMsg,
+                  std::vector<iovec>* iovecs) {
+    *nlMsg = {
+            .nlmsg_type = nlMsgType,
+            .nlmsg_flags = nlMsgFlags,
+            .nlmsg_seq = (nlMsgSeqNum != 0) ? nlMsgSeqNum : nextSeqNum(),
+    };
+
+    (*iovecs)[0].iov_base = nlMsg;
+    (*iovecs)[0].iov_len = NLMSG_HDRLEN;
+    for (const iovec& iov : *iovecs) {
+        nlMsg->nlmsg_len += iov.iov_len;
+    }
+}
+
 class XfrmSocketImpl : public XfrmSocket {
 private:
     static constexpr int NLMSG_DEFAULTSIZE = 8192;
@@ -244,7 +287,9 @@ public:
         return netdutils::status::ok;
     }
 
-    static netdutils::Status validateResponse(NetlinkResponse response, size_t len) {
+    bool isOpen() const { return mSock >= 0; }
+
+    static netdutils::Status validateResponse(const NetlinkResponse& response, size_t len) {
         if (len < sizeof(nlmsghdr)) {
             ALOGW("Invalid response message received over netlink");
             return netdutils::statusFromErrno(EBADMSG, "Invalid message");
@@ -281,51 +326,136 @@ public:
 
     netdutils::Status sendMessage(uint16_t nlMsgType, uint16_t nlMsgFlags, uint16_t nlMsgSeqNum,
                                   std::vector<iovec>* iovecs) const override {
-        nlmsghdr nlMsg = {
-            .nlmsg_type = nlMsgType,
-            .nlmsg_flags = nlMsgFlags,
-            .nlmsg_seq = nlMsgSeqNum,
+        nlmsghdr nlMsg;
+        fillNlMsgHdr(nlMsgType, nlMsgFlags, nlMsgSeqNum, &nlMsg, iovecs);
+
+        ALOGD("Sending Netlink XFRM Message: %s", xfrmMsgTypeToString(nlMsgType));
+        LOG_IOV(*iovecs);
+
+        RETURN_IF_NOT_OK(writeMessages(*iovecs, nlMsg.nlmsg_len));
+
+        Status result;
+        RETURN_IF_NOT_OK(readResponse(nlMsg.nlmsg_seq, &result));
+        return result;
+    }
+
+    // Sends all the messages in |batch| with a single write, then collects the result of each
+    // message into |results| in the order the messages were added. The kernel processes every
+    // message in the batch even if an earlier one fails. Returns an error only if the batch could
+    // not be exchanged with the kernel. If |sent| is not null, it is set to whether the write
+    // succeeded, i.e. whether the kernel may have applied any of the messages.
+    netdutils::Status sendBatch(const XfrmMessageBatch& batch, std::vector<Status>* results,
+                                bool* sent) const {
+        results->clear();
+        if (sent) *sent = false;
+        if (batch.empty()) {
+            return netdutils::status::ok;
+        }
+
+        const std::vector<uint8_t>& buffer = batch.buffer();
+        const std::vector<iovec> iov = {
+                {const_cast<uint8_t*>(buffer.data()), buffer.size()},
         };
 
-        (*iovecs)[0].iov_base = &nlMsg;
-        (*iovecs)[0].iov_len = NLMSG_HDRLEN;
-        for (const iovec& iov : *iovecs) {
-            nlMsg.nlmsg_len += iov.iov_len;
+        ALOGD("Sending %zu batched Netlink XFRM Messages", batch.seqNums().size());
+        RETURN_IF_NOT_OK(writeMessages(iov, buffer.size()));
+        if (sent) *sent = true;
+
+        for (uint32_t seq : batch.seqNums()) {
+            Status result;
+            RETURN_IF_NOT_OK(readResponse(seq, &result));
+            results->push_back(result);
         }
 
-        ALOGD("Sending Netlink XFRM Message: %s", xfrmMsgTypeToString(nlMsgType));
-        LOG_IOV(*iovecs);
+        return netdutils::status::ok;
+    }
 
-        StatusOr<size_t> writeResult = getSyscallInstance().writev(mSock, *iovecs);
+private:
+    netdutils::Status writeMessages(const std::vector<iovec>& iovecs, size_t expectedLen) const {
+        StatusOr<size_t> writeResult = getSyscallInstance().writev(mSock, iovecs);
         if (!isOk(writeResult)) {
             ALOGE("netlink socket writev failed (%s)", toString(writeResult).c_str());
             return writeResult;
         }
 
-        if (nlMsg.nlmsg_len != writeResult.value()) {
+        if (expectedLen != writeResult.value()) {
             ALOGE("Invalid netlink message length sent %d", static_cast<int>(writeResult.value()));
             return netdutils::statusFromErrno(EBADMSG, "Invalid message length");
         }
 
+        return netdutils::status::ok;
+    }
+
+    // Reads the response to the request numbered |seq| into |result|, discarding any stale
+    // responses to earlier requests that are still queued on the socket. Returns an error only
+    // if reading from the socket failed.
+    netdutils::Status readResponse(uint32_t seq, Status* result) const {
         NetlinkResponse response = {};
 
-        StatusOr<Slice> readResult =
-            getSyscallInstance().read(Fd(mSock), netdutils::makeSlice(response));
-        if (!isOk(readResult)) {
-            ALOGE("netlink response error (%s)", toString(readResult).c_str());
-            return readResult;
+        while (true) {
+            StatusOr<Slice> readResult =
+                    getSyscallInstance().read(Fd(mSock), netdutils::makeSlice(response));
+            if (!isOk(readResult)) {
+                ALOGE("netlink response error (%s)", toString(readResult).c_str());
+                return readResult;
+            }
+
+            const size_t len = readResult.value().size();
+            LOG_HEX("netlink msg resp", reinterpret_cast<char*>(readResult.value().base()), len);
+
+            if (len >= sizeof(nlmsghdr) && response.hdr.nlmsg_seq != seq) {
+                ALOGD("Discarding stale netlink response (seq=%u, expected %u)",
+                      response.hdr.nlmsg_seq, seq);
+                continue;
+            }
+
+            *result = validateResponse(response, len);
+            if (!isOk(*result)) {
+                ALOGE("netlink response contains error (%s)", toString(*result).c_str());
+            }
+            return netdutils::status::ok;
         }
+    }
+};
 
-        LOG_HEX("netlink msg resp", reinterpret_cast<char*>(readResult.value().base()),
-                readResult.value().size());
+// A handle on the NETLINK_XFRM socket shared by all XfrmController operations, which saves a
+// socket(), connect() and close() per request. Netd does not serialize XFRM calls (IpSecService
+// does its own locking), so each handle holds the socket's lock for as long as it exists.
+class SharedXfrmSocket : public XfrmSocket {
+  public:
+    SharedXfrmSocket() : mLock(lock()) {}
 
-        Status validateStatus = validateResponse(response, readResult.value().size());
-        if (!isOk(validateStatus)) {
-            ALOGE("netlink response contains error (%s)", toString(validateStatus).c_str());
+    // Opens the shared socket unless a previous handle already did.
+    netdutils::Status open() override {
+        if (socket().isOpen()) {
+            return netdutils::status::ok;
         }
+        return socket().open();
+    }
 
-        return validateStatus;
+    netdutils::Status sendMessage(uint16_t nlMsgType, uint16_t nlMsgFlags, uint16_t nlMsgSeqNum,
+                                  std::vector<iovec>* iovecs) const override {
+        return socket().sendMessage(nlMsgType, nlMsgFlags, nlMsgSeqNum, iovecs);
     }
+
+    netdutils::Status sendBatch(const XfrmMessageBatch& batch, std::vector<Status>* results,
+                                bool* sent) const {
+        return socket().sendBatch(batch, results, sent);
+    }
+
+  private:
+    static std::mutex& lock() {
+        static std::mutex sLock;
+        return sLock;
+    }
+
+    // Intentionally leaked, so that the socket outlives any request still running at exit.
+    static XfrmSocketImpl& socket() {
+        static XfrmSocketImpl* sSocket = new XfrmSocketImpl();
+        return *sSocket;
+    }
+
+    std::lock_guard<std::mutex> mLock;
 };
 
 StatusOr<int> convertToXfrmAddr(const std::string& strAddr, xfrm_address_t* xfrmAddr) {
@@ -387,8 +517,42 @@ private:
     uint32_t mCount;
 };
 
+// Old SAs that are waiting for the grace period of a rekey to end, ordered by deadline.
+struct SaDeletionQueue {
+    std::mutex lock;
+    std::condition_variable cv;
+    std::multimap<std::chrono::steady_clock::time_point, XfrmSaInfo> sas;
+    bool workerStarted = false;
+};
+
+// Intentionally leaked, like the shared socket, so that the worker thread never outlives it.
+SaDeletionQueue& saDeletionQueue() {
+    static SaDeletionQueue* sQueue = new SaDeletionQueue();
+    return *sQueue;
+}
+
 } // namespace
 
+netdutils::Status XfrmMessageBatch::sendMessage(uint16_t nlMsgType, uint16_t nlMsgFlags,
+                                                uint16_t nlMsgSeqNum,
+                                                std::vector<iovec>* iovecs) const {
+    nlmsghdr nlMsg;
+    fillNlMsgHdr(nlMsgType, nlMsgFlags, nlMsgSeqNum, &nlMsg, iovecs);
+
+    ALOGD("Batching Netlink XFRM Message: %s", xfrmMsgTypeToString(nlMsgType));
+    LOG_IOV(*iovecs);
+
+    for (const iovec& iov : *iovecs) {
+        const uint8_t* base = reinterpret_cast<const uint8_t*>(iov.iov_base);
+        mBuffer.insert(mBuffer.end(), base, base + iov.iov_len);
+    }
+    // The kernel expects each message in a batch to start on an NLMSG_ALIGNTO boundary.
+    mBuffer.resize(NLMSG_ALIGN(mBuffer.size()), 0);
+    mSeqNums.push_back(nlMsg.nlmsg_seq);
+
+    return netdutils::status::ok;
+}
+
 //
 // Begin XfrmController Impl
 //
@@ -404,7 +568,7 @@ netdutils::Status XfrmController::Init() {
     RETURN_IF_NOT_OK(flushInterfaces());
     mIsXfrmIntfSupported = isXfrmIntfSupported();
 
-    XfrmSocketImpl sock;
+    SharedXfrmSocket sock;
     RETURN_IF_NOT_OK(sock.open());
     RETURN_IF_NOT_OK(flushSaDb(sock));
     return flushPolicyDb(sock);
@@ -502,7 +666,7 @@ netdutils::Status XfrmController::ipSecAllocateSpi(int32_t transformId,
         return ret;
     }
 
-    XfrmSocketImpl sock;
+    SharedXfrmSocket sock;
     netdutils::Status socketStatus = sock.open();
     if (!isOk(socketStatus)) {
         ALOGD("Sock open failed for XFRM, line=%d", __LINE__);
@@ -552,55 +716,43 @@ netdutils::Status XfrmController::ipSecAddSecurityAssociation(
     ALOGD("encapRemotePort=%d", encapRemotePort);
     ALOGD("xfrmInterfaceId=%d", xfrmInterfaceId);
 
+    const XfrmSaParams params = {
+            .transformId = transformId,
+            .mode = mode,
+            .sourceAddress = sourceAddress,
+            .destinationAddress = destinationAddress,
+            .underlyingNetId = underlyingNetId,
+            .spi = spi,
+            .markValue = markValue,
+            .markMask = markMask,
+            .authAlgo = authAlgo,
+            .authKey = authKey,
+            .authTruncBits = authTruncBits,
+            .cryptAlgo = cryptAlgo,
+            .cryptKey = cryptKey,
+            .cryptTruncBits = cryptTruncBits,
+            .aeadAlgo = aeadAlgo,
+            .aeadKey = aeadKey,
+            .aeadIcvBits = aeadIcvBits,
+            .encapType = encapType,
+            .encapLocalPort = encapLocalPort,
+            .encapRemotePort = encapRemotePort,
+            .xfrmInterfaceId = xfrmInterfaceId,
+    };
+
     XfrmSaInfo saInfo{};
-    netdutils::Status ret = fillXfrmCommonInfo(sourceAddress, destinationAddress, spi, markValue,
-                                               markMask, transformId, xfrmInterfaceId, &saInfo);
+    netdutils::Status ret = fillXfrmSaInfo(params, &saInfo);
     if (!isOk(ret)) {
         return ret;
     }
 
-    saInfo.auth = XfrmAlgo{
-        .name = authAlgo, .key = authKey, .truncLenBits = static_cast<uint16_t>(authTruncBits)};
-
-    saInfo.crypt = XfrmAlgo{
-        .name = cryptAlgo, .key = cryptKey, .truncLenBits = static_cast<uint16_t>(cryptTruncBits)};
-
-    saInfo.aead = XfrmAlgo{
-        .name = aeadAlgo, .key = aeadKey, .truncLenBits = static_cast<uint16_t>(aeadIcvBits)};
-
-    switch (static_cast<XfrmMode>(mode)) {
-        case XfrmMode::TRANSPORT:
-        case XfrmMode::TUNNEL:
-            saInfo.mode = static_cast<XfrmMode>(mode);
-            break;
-        default:
-            return netdutils::statusFromErrno(EINVAL, "Invalid xfrm mode");
-    }
-
-    XfrmSocketImpl sock;
+    SharedXfrmSocket sock;
     netdutils::Status socketStatus = sock.open();
     if (!isOk(socketStatus)) {
         ALOGD("Sock open failed for XFRM, line=%d", __LINE__);
         return socketStatus;
     }
 
-    switch (static_cast<XfrmEncapType>(encapType)) {
-        case XfrmEncapType::ESPINUDP:
-        case XfrmEncapType::ESPINUDP_NON_IKE:
-            // The ports are not used on input SAs, so this is OK to be wrong when
-            // direction is ultimately input.
-            saInfo.encap.srcPort = encapLocalPort;
-            saInfo.encap.dstPort = encapRemotePort;
-            [[fallthrough]];
-        case XfrmEncapType::NONE:
-            saInfo.encap.type = static_cast<XfrmEncapType>(encapType);
-            break;
-        default:
-            return netdutils::statusFromErrno(EINVAL, "Invalid encap type");
-    }
-
-    saInfo.netId = underlyingNetId;
-
     ret = updateSecurityAssociation(saInfo, sock);
     if (!isOk(ret)) {
         ALOGD("Failed updating a Security Association, line=%d", __LINE__);
@@ -629,7 +781,7 @@ netdutils::Status XfrmController::ipSecDeleteSecurityAssociation(
         return ret;
     }
 
-    XfrmSocketImpl sock;
+    SharedXfrmSocket sock;
     netdutils::Status socketStatus = sock.open();
     if (!isOk(socketStatus)) {
         ALOGD("Sock open failed for XFRM, line=%d", __LINE__);
@@ -661,7 +813,7 @@ netdutils::Status XfrmController::ipSecMigrate(int32_t transformId, int32_t selA
     ALOGD("newDestinationAddress=%s", newDestinationAddress.c_str());
     ALOGD("xfrmInterfaceId=%d", xfrmInterfaceId);
 
-    XfrmSocketImpl sock;
+    SharedXfrmSocket sock;
     Status socketStatus = sock.open();
     if (!socketStatus.ok()) {
         ALOGD("Sock open failed for XFRM, line=%d", __LINE__);
@@ -755,6 +907,54 @@ netdutils::Status XfrmController::fillXfrmCommonInfo(int32_t spi, int32_t markVa
     return netdutils::status::ok;
 }
 
+netdutils::Status XfrmController::fillXfrmSaInfo(const XfrmSaParams& params, XfrmSaInfo* info) {
+    netdutils::Status ret = fillXfrmCommonInfo(params.sourceAddress, params.destinationAddress,
+                                               params.spi, params.markValue, params.markMask,
+                                               params.transformId, params.xfrmInterfaceId, info);
+    if (!isOk(ret)) {
+        return ret;
+    }
+
+    info->auth = XfrmAlgo{.name = params.authAlgo,
+                          .key = params.authKey,
+                          .truncLenBits = static_cast<uint16_t>(params.authTruncBits)};
+
+    info->crypt = XfrmAlgo{.name = params.cryptAlgo,
+                           .key = params.cryptKey,
+                           .truncLenBits = static_cast<uint16_t>(params.cryptTruncBits)};
+
+    info->aead = XfrmAlgo{.name = params.aeadAlgo,
+                          .key = params.aeadKey,
+                          .truncLenBits = static_cast<uint16_t>(params.aeadIcvBits)};
+
+    switch (static_cast<XfrmMode>(params.mode)) {
+        case XfrmMode::TRANSPORT:
+        case XfrmMode::TUNNEL:
+            info->mode = static_cast<XfrmMode>(params.mode);
+            break;
+        default:
+            return netdutils::statusFromErrno(EINVAL, "Invalid xfrm mode");
+    }
+
+    switch (static_cast<XfrmEncapType>(params.encapType)) {
+        case XfrmEncapType::ESPINUDP:
+        case XfrmEncapType::ESPINUDP_NON_IKE:
+            // The ports are not used on input SAs, so this is OK to be wrong when
+            // direction is ultimately input.
+            info->encap.srcPort = params.encapLocalPort;
+            info->encap.dstPort = params.encapRemotePort;
+            [[fallthrough]];
+        case XfrmEncapType::NONE:
+            info->encap.type = static_cast<XfrmEncapType>(params.encapType);
+            break;
+        default:
+            return netdutils::statusFromErrno(EINVAL, "Invalid encap type");
+    }
+
+    info->netId = params.underlyingNetId;
+    return netdutils::status::ok;
+}
+
 netdutils::Status XfrmController::ipSecApplyTransportModeTransform(
         int socketFd, int32_t transformId, int32_t direction, const std::string& sourceAddress,
         const std::string& destinationAddress, int32_t spi) {
@@ -907,7 +1107,7 @@ netdutils::Status XfrmController::processSecurityPolicy(
     XfrmSpInfo spInfo{};
     spInfo.mode = XfrmMode::TUNNEL;
 
-    XfrmSocketImpl sock;
+    SharedXfrmSocket sock;
     RETURN_IF_NOT_OK(sock.open());
 
     // Set the correct address families. Tunnel mode policies use wildcard selectors, while
@@ -930,6 +1130,15 @@ netdutils::Status XfrmController::processSecurityPolicy(
     }
 }
 
+netdutils::Status XfrmController::sendBatch(const XfrmMessageBatch& batch,
+                                            std::vector<Status>* results, bool* sent) {
+    results->clear();
+    if (sent) *sent = false;
+    SharedXfrmSocket sock;
+    RETURN_IF_NOT_OK(sock.open());
+    return sock.sendBatch(batch, results, sent);
+}
+
 void XfrmController::fillXfrmSelector(const int selAddrFamily, xfrm_selector* selector) {
     selector->family = selAddrFamily;
     selector->proto = AF_UNSPEC; // TODO: do we need to match the protocol? it's
@@ -1742,12 +1951,448 @@ netdutils::Status XfrmController::ipSecRemoveTunnelInterface(const std::string&
     return netdutils::statusFromErrno(ret, "Error in deleting IpSec interface " + deviceName);
 }
 
+netdutils::Status XfrmController::ipSecApplyTunnelBundle(const XfrmTunnelBundle& bundle) {
+    ALOGD("XfrmController::%s, line=%d", __FUNCTION__, __LINE__);
+    ALOGD("deviceName=%s", bundle.deviceName.c_str());
+    ALOGD("localAddress=%s", bundle.localAddress.c_str());
+    ALOGD("remoteAddress=%s", bundle.remoteAddress.c_str());
+    ALOGD("ikey=%0.8x", bundle.ikey);
+    ALOGD("okey=%0.8x", bundle.okey);
+    ALOGD("interfaceId=%0.8x", bundle.interfaceId);
+
+    // Building the messages validates the remaining parameters, so do it before changing anything.
+    std::vector<XfrmSaInfo> sas;
+    std::vector<XfrmSpInfo> policies;
+    XfrmMessageBatch batch;
+    RETURN_IF_NOT_OK(buildTunnelBundle(bundle, &sas, &policies, &batch));
+
+    RETURN_IF_NOT_OK(ipSecAddTunnelInterface(bundle.deviceName, bundle.localAddress,
+                                             bundle.remoteAddress, bundle.ikey, bundle.okey,
+                                             bundle.interfaceId, false /* isUpdate */));
+
+    Status ret = sendTunnelBundle(batch, sas, policies);
+    if (!isOk(ret)) {
+        ipSecRemoveTunnelInterface(bundle.deviceName).ignoreError();
+    }
+    return ret;
+}
+
+netdutils::Status XfrmController::buildTunnelBundle(const XfrmTunnelBundle& bundle,
+                                                    std::vector<XfrmSaInfo>* sas,
+                                                    std::vector<XfrmSpInfo>* policies,
+                                                    XfrmMessageBatch* batch) {
+    if (bundle.deviceName.empty() || bundle.selAddrFamilies.empty()) {
+        return netdutils::statusFromErrno(EINVAL, "Required tunnel bundle parameter not provided");
+    }
+
+    // Tunnel mode SAs and policies are tied to the tunnel by XFRM interface id when XFRM-I is
+    // supported, and by using the VTI keys as marks otherwise.
+    const auto tunnelSaParams = [&bundle](const XfrmSaParams& sa, int32_t key) {
+        XfrmSaParams params = sa;
+        params.mode = static_cast<int32_t>(XfrmMode::TUNNEL);
+        params.markValue = mIsXfrmIntfSupported ? 0 : key;
+        params.markMask = mIsXfrmIntfSupported ? 0 : 0xffffffff;
+        params.xfrmInterfaceId = mIsXfrmIntfSupported ? bundle.interfaceId : 0;
+        return params;
+    };
+
+    // Outbound first; the policy directions below rely on this order.
+    sas->assign(2, XfrmSaInfo{});
+    RETURN_IF_NOT_OK(fillXfrmSaInfo(tunnelSaParams(bundle.outboundSa, bundle.okey), &(*sas)[0]));
+    RETURN_IF_NOT_OK(fillXfrmSaInfo(tunnelSaParams(bundle.inboundSa, bundle.ikey), &(*sas)[1]));
+    for (const XfrmSaInfo& sa : *sas) {
+        if (sa.spi == static_cast<int>(INVALID_SPI)) {
+            return netdutils::statusFromErrno(EINVAL, "SPI not allocated for tunnel bundle SA");
+        }
+    }
+
+    policies->clear();
+    for (int32_t selAddrFamily : bundle.selAddrFamilies) {
+        if (selAddrFamily != AF_INET && selAddrFamily != AF_INET6) {
+            return netdutils::statusFromErrno(EINVAL, "Invalid selector address family");
+        }
+        for (size_t i = 0; i < sas->size(); i++) {
+            XfrmSpInfo spInfo{};
+            static_cast<XfrmCommonInfo&>(spInfo) = (*sas)[i];
+            spInfo.selAddrFamily = selAddrFamily;
+            spInfo.direction = (i == 0) ? XfrmDirection::OUT : XfrmDirection::IN;
+            policies->push_back(spInfo);
+        }
+    }
+
+    // New policies are added with XFRM_MSG_NEWPOLICY, so a bundle never replaces existing ones and
+    // rolling back only ever removes state that this bundle created.
+    for (const XfrmSaInfo& sa : *sas) {
+        RETURN_IF_NOT_OK(updateSecurityAssociation(sa, *batch));
+    }
+    for (const XfrmSpInfo& policy : *policies) {
+        RETURN_IF_NOT_OK(updateTunnelModeSecurityPolicy(policy, *batch, XFRM_MSG_NEWPOLICY));
+    }
+    return netdutils::status::ok;
+}
+
+netdutils::Status XfrmController::sendTunnelBundle(const XfrmMessageBatch& batch,
+                                                   const std::vector<XfrmSaInfo>& sas,
+                                                   const std::vector<XfrmSpInfo>& policies) {
+    std::vector<Status> results;
+    bool sent = false;
+    Status ret = sendBatch(batch, &results, &sent);
+
+    // The batch holds the SAs followed by the policies. Undo every message that succeeded, and
+    // every message whose response was never read after the batch reached the kernel. If the write
+    // itself failed, the kernel applied nothing, and deleting by SPI or selector could remove state
+    // that this bundle does not own.
+    XfrmMessageBatch rollback;
+    for (size_t i = 0; sent && i < batch.size(); i++) {
+        if (i < results.size() && !isOk(results[i])) {
+            if (isOk(ret)) ret = results[i];
+            continue;
+        }
+        if (i < sas.size()) {
+            deleteSecurityAssociation(sas[i], rollback).ignoreError();
+        } else {
+            deleteTunnelModeSecurityPolicy(policies[i - sas.size()], rollback).ignoreError();
+        }
+    }
+
+    if (isOk(ret)) {
+        return ret;
+    }
+
+    ALOGE("Failed to apply tunnel bundle (%s), rolling back", toString(ret).c_str());
+    std::vector<Status> rollbackResults;
+    Status rollbackStatus = sendBatch(rollback, &rollbackResults);
+    for (const Status& result : rollbackResults) {
+        if (!isOk(result)) rollbackStatus = result;
+    }
+    if (!isOk(rollbackStatus)) {
+        ALOGE("Tunnel bundle rollback incomplete (%s)", toString(rollbackStatus).c_str());
+    }
+    return ret;
+}
+
+netdutils::Status XfrmController::ipSecRekey(const XfrmRekeyParams& rekey) {
+    ALOGD("XfrmController::%s, line=%d", __FUNCTION__, __LINE__);
+    ALOGD("transformId=%d", rekey.newSa.transformId);
+    ALOGD("oldTransformId=%d", rekey.oldTransformId);
+    ALOGD("spi=%0.8x", rekey.newSa.spi);
+    ALOGD("oldSpi=%0.8x", rekey.oldSpi);
+    ALOGD("direction=%d", rekey.direction);
+    ALOGD("gracePeriodMs=%lld", static_cast<long long>(rekey.gracePeriod.count()));
+
+    if (rekey.selAddrFamilies.empty() || rekey.gracePeriod.count() < 0) {
+        return netdutils::statusFromErrno(EINVAL, "Invalid rekey parameters");
+    }
+    if (rekey.direction != static_cast<int32_t>(XfrmDirection::IN) &&
+        rekey.direction != static_cast<int32_t>(XfrmDirection::OUT) &&
+        rekey.direction != static_cast<int32_t>(XfrmDirection::FORWARD)) {
+        return netdutils::statusFromErrno(EINVAL, "Invalid policy direction");
+    }
+
+    XfrmSaParams params = rekey.newSa;
+    params.mode = static_cast<int32_t>(XfrmMode::TUNNEL);
+    XfrmSaInfo newSa{};
+    RETURN_IF_NOT_OK(fillXfrmSaInfo(params, &newSa));
+    if (newSa.spi == static_cast<int>(INVALID_SPI) ||
+        rekey.oldSpi == static_cast<int>(INVALID_SPI) || rekey.newSa.spi == rekey.oldSpi) {
+        return netdutils::statusFromErrno(EINVAL, "Rekey requires two distinct allocated SPIs");
+    }
+
+    XfrmSaInfo oldSa{};
+    RETURN_IF_NOT_OK(fillXfrmCommonInfo(params.sourceAddress, params.destinationAddress,
+                                        rekey.oldSpi, params.markValue, params.markMask,
+                                        rekey.oldTransformId, params.xfrmInterfaceId, &oldSa));
+    oldSa.mode = XfrmMode::TUNNEL;
+
+    std::vector<XfrmSpInfo> newPolicies;
+    std::vector<XfrmSpInfo> oldPolicies;
+    for (int32_t selAddrFamily : rekey.selAddrFamilies) {
+        if (selAddrFamily != AF_INET && selAddrFamily != AF_INET6) {
+            return netdutils::statusFromErrno(EINVAL, "Invalid selector address family");
+        }
+        XfrmSpInfo spInfo{};
+        spInfo.selAddrFamily = selAddrFamily;
+        spInfo.direction = static_cast<XfrmDirection>(rekey.direction);
+        static_cast<XfrmCommonInfo&>(spInfo) = newSa;
+        newPolicies.push_back(spInfo);
+        static_cast<XfrmCommonInfo&>(spInfo) = oldSa;
+        oldPolicies.push_back(spInfo);
+    }
+
+    // The new SA goes first, so that the policies never reference an SA that does not exist yet.
+    // Without a grace period, the old SA is deleted at the end of the same batch.
+    XfrmMessageBatch batch;
+    RETURN_IF_NOT_OK(updateSecurityAssociation(newSa, batch));
+    for (const XfrmSpInfo& policy : newPolicies) {
+        RETURN_IF_NOT_OK(updateTunnelModeSecurityPolicy(policy, batch, XFRM_MSG_UPDPOLICY));
+    }
+    const bool deleteNow = rekey.gracePeriod.count() == 0;
+    if (deleteNow) {
+        RETURN_IF_NOT_OK(deleteSecurityAssociation(oldSa, batch));
+    }
+
+    std::vector<Status> results;
+    Status ret = sendBatch(batch, &results);
+
+    // Switching back is only needed if the new SA or a policy update did not take effect.
+    // Messages whose response was never read may or may not have been applied.
+    const size_t switchLen = 1 + newPolicies.size();
+    bool switched = isOk(ret) && results.size() >= switchLen;
+    for (size_t i = 0; i < switchLen && i < results.size(); i++) {
+        if (!isOk(results[i])) {
+            switched = false;
+            if (isOk(ret)) ret = results[i];
+        }
+    }
+
+    if (switched) {
+        if (deleteNow) {
+            // The rekey itself succeeded, so a failure here only means the old SA was already gone
+            // or must be removed by the caller.
+            return results.back();
+        }
+        scheduleSaDeletion(oldSa, rekey.gracePeriod);
+        return netdutils::status::ok;
+    }
+
+    ALOGE("Failed to rekey SA (%s), switching back", toString(ret).c_str());
+    XfrmMessageBatch rollback;
+    for (size_t i = 0; i < newPolicies.size(); i++) {
+        updateTunnelModeSecurityPolicy(oldPolicies[i], rollback, XFRM_MSG_UPDPOLICY).ignoreError();
+    }
+    if (results.empty() || isOk(results[0])) {
+        deleteSecurityAssociation(newSa, rollback).ignoreError();
+    }
+    std::vector<Status> rollbackResults;
+    Status rollbackStatus = sendBatch(rollback, &rollbackResults);
+    for (const Status& result : rollbackResults) {
+        if (!isOk(result)) rollbackStatus = result;
+    }
+    if (!isOk(rollbackStatus)) {
+        ALOGE("Rekey rollback incomplete (%s)", toString(rollbackStatus).c_str());
+    }
+    return ret;
+}
+
+void XfrmController::scheduleSaDeletion(const XfrmSaInfo& sa, std::chrono::milliseconds delay) {
+    SaDeletionQueue& queue = saDeletionQueue();
+    std::lock_guard<std::mutex> guard(queue.lock);
+    queue.sas.emplace(std::chrono::steady_clock::now() + delay, sa);
+    if (!queue.workerStarted) {
+        std::thread(runScheduledSaDeletions).detach();
+        queue.workerStarted = true;
+    }
+    queue.cv.notify_one();
+}
+
+void XfrmController::runScheduledSaDeletions() {
+    SaDeletionQueue& queue = saDeletionQueue();
+    std::unique_lock<std::mutex> guard(queue.lock);
+    while (true) {
+        if (queue.sas.empty()) {
+            queue.cv.wait(guard);
+            continue;
+        }
+        const auto now = std::chrono::steady_clock::now();
+        if (queue.sas.begin()->first > now) {
+            queue.cv.wait_until(guard, queue.sas.begin()->first);
+            continue;
+        }
+
+        XfrmMessageBatch batch;
+        const auto due = queue.sas.upper_bound(now);
+        for (auto it = queue.sas.begin(); it != due; ++it) {
+            deleteSecurityAssociation(it->second, batch).ignoreError();
+        }
+        queue.sas.erase(queue.sas.begin(), due);
+
+        // Don't hold up new rekeys while talking to the kernel.
+        guard.unlock();
+        std::vector<Status> results;
+        Status ret = sendBatch(batch, &results);
+        for (const Status& result : results) {
+            // ESRCH means the SA was already deleted, for example by the caller.
+            if (!isOk(result) && result.code() != ESRCH) ret = result;
+        }
+        if (!isOk(ret)) {
+            ALOGE("Failed to delete rekeyed SAs (%s)", toString(ret).c_str());
+        }
+        guard.lock();
+    }
+}
+
+size_t XfrmController::pendingSaDeletions() {
+    SaDeletionQueue& queue = saDeletionQueue();
+    std::lock_guard<std::mutex> guard(queue.lock);
+    return queue.sas.size();
+}
+
+netdutils::Status XfrmController::dumpXfrmState(uint16_t nlMsgType,
+                                                const std::function<void(nlmsghdr*)>& callback) {
+    // Use a socket of our own so that a long dump never holds up requests on the shared socket.
+    // processNetlinkDump() reads one datagram at a time into a fixed-size buffer, so memory use
+    // does not grow with the number of SAs or policies.
+    base::unique_fd sock(openNetlinkSocket(NETLINK_XFRM));
+    if (sock.get() < 0) {
+        return netdutils::statusFromErrno(-sock.get(), "Could not open netlink socket");
+    }
+
+    // The kernel cannot filter these dumps by mark or interface id, so no attributes are sent.
+    nlmsghdr nlMsg = {
+            .nlmsg_len = NLMSG_HDRLEN,
+            .nlmsg_type = nlMsgType,
+            .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+            .nlmsg_seq = nextSeqNum(),
+    };
+    if (write(sock.get(), &nlMsg, nlMsg.nlmsg_len) == -1) {
+        return netdutils::statusFromErrno(errno, "Failed to request XFRM dump");
+    }
+
+    int ret = processNetlinkDump(sock.get(), callback);
+    return netdutils::statusFromErrno(-ret, "Failed to dump XFRM state");
+}
+
+bool XfrmController::parseSaStats(const nlmsghdr& nlh, XfrmSaStats* stats) {
+    if (nlh.nlmsg_type != XFRM_MSG_NEWSA ||
+        nlh.nlmsg_len < NLMSG_SPACE(sizeof(xfrm_usersa_info))) {
+        return false;
+    }
+
+    const auto* usersa = reinterpret_cast<const xfrm_usersa_info*>(NLMSG_DATA(&nlh));
+    *stats = {
+            .spi = ntohl(usersa->id.spi),
+            .transformId = static_cast<int>(usersa->reqid),
+            .sourceAddress = xfrmAddressToString(usersa->family, usersa->saddr),
+            .destinationAddress = xfrmAddressToString(usersa->family, usersa->id.daddr),
+            .bytes = usersa->curlft.bytes,
+            .packets = usersa->curlft.packets,
+            .replayWindowSize = usersa->replay_window,
+            .replayWindowDrops = usersa->stats.replay_window,
+            .replayDrops = usersa->stats.replay,
+            .integrityFailures = usersa->stats.integrity_failed,
+    };
+
+    const Slice attrs(const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(&nlh)) +
+                              NLMSG_SPACE(sizeof(xfrm_usersa_info)),
+                      nlh.nlmsg_len - NLMSG_SPACE(sizeof(xfrm_usersa_info)));
+    forEachNetlinkAttribute(attrs, [stats](const nlattr& attr, const Slice& value) {
+        switch (attr.nla_type) {
+            case XFRMA_MARK:
+                netdutils::extract(value, stats->mark);
+                break;
+            case XFRMA_IF_ID:
+                netdutils::extract(value, stats->xfrmInterfaceId);
+                break;
+            case XFRMA_REPLAY_VAL: {
+                xfrm_replay_state replay{};
+                netdutils::extract(value, replay);
+                stats->inSeq = replay.seq;
+                stats->outSeq = replay.oseq;
+                break;
+            }
+            case XFRMA_REPLAY_ESN_VAL: {
+                // The bitmap that follows is not needed.
+                xfrm_replay_state_esn replay{};
+                netdutils::extract(value, replay);
+                stats->replayWindowSize = replay.replay_window;
+                stats->inSeq = replay.seq;
+                stats->outSeq = replay.oseq;
+                break;
+            }
+            default:
+                break;
+        }
+    });
+
+    return true;
+}
+
+StatusOr<std::vector<XfrmSaStats>> XfrmController::ipSecGetSaStats(uint32_t markValue,
+                                                                  uint32_t markMask,
+                                                                  uint32_t xfrmInterfaceId) {
+    std::vector<XfrmSaStats> sas;
+    XfrmSaStats stats;
+    Status ret = dumpXfrmState(XFRM_MSG_GETSA, [&](nlmsghdr* nlh) {
+        if (!parseSaStats(*nlh, &stats)) {
+            ALOGW("Ignoring malformed SA dump message type %d", nlh->nlmsg_type);
+            return;
+        }
+        if ((stats.mark.v & markMask) != (markValue & markMask)) return;
+        if (xfrmInterfaceId != 0 && stats.xfrmInterfaceId != xfrmInterfaceId) return;
+        sas.push_back(std::move(stats));
+    });
+    RETURN_IF_NOT_OK(ret);
+    return sas;
+}
+
+void XfrmController::dumpSaStats(DumpWriter& dw) {
+    // Totals per tunnel, that is, per XFRM interface id and mark. They are summed while the dumps
+    // are read, so memory use grows with the number of tunnels rather than the number of SAs.
+    using TunnelKey = std::tuple<uint32_t, uint32_t, uint32_t>;
+    struct TunnelTotals {
+        size_t sas = 0;
+        uint32_t policies = 0;
+        uint64_t bytes = 0;
+        uint64_t packets = 0;
+        uint64_t replayDrops = 0;
+        uint64_t integrityFailures = 0;
+    };
+    std::map<TunnelKey, TunnelTotals> tunnels;
+
+    XfrmSaStats sa;
+    Status ret = dumpXfrmState(XFRM_MSG_GETSA, [&tunnels, &sa](nlmsghdr* nlh) {
+        if (!parseSaStats(*nlh, &sa)) return;
+        TunnelTotals& totals = tunnels[{sa.xfrmInterfaceId, sa.mark.v, sa.mark.m}];
+        totals.sas++;
+        totals.bytes += sa.bytes;
+        totals.packets += sa.packets;
+        totals.replayDrops += sa.replayWindowDrops + sa.replayDrops;
+        totals.integrityFailures += sa.integrityFailures;
+    });
+    if (!isOk(ret)) {
+        dw.println("Failed to dump SAs: %s", toString(ret).c_str());
+        return;
+    }
+
+    ret = dumpXfrmState(XFRM_MSG_GETPOLICY, [&tunnels](nlmsghdr* nlh) {
+        if (nlh->nlmsg_type != XFRM_MSG_NEWPOLICY ||
+            nlh->nlmsg_len < NLMSG_SPACE(sizeof(xfrm_userpolicy_info))) {
+            return;
+        }
+        xfrm_mark mark{};
+        uint32_t ifId = 0;
+        const Slice attrs(reinterpret_cast<uint8_t*>(nlh) + NLMSG_SPACE(sizeof(xfrm_userpolicy_info)),
+                          nlh->nlmsg_len - NLMSG_SPACE(sizeof(xfrm_userpolicy_info)));
+        forEachNetlinkAttribute(attrs, [&](const nlattr& attr, const Slice& value) {
+            if (attr.nla_type == XFRMA_MARK) netdutils::extract(value, mark);
+            if (attr.nla_type == XFRMA_IF_ID) netdutils::extract(value, ifId);
+        });
+        tunnels[{ifId, mark.v, mark.m}].policies++;
+    });
+    if (!isOk(ret)) {
+        dw.println("Failed to dump policies: %s", toString(ret).c_str());
+    }
+
+    dw.println("SAs and policies by tunnel:");
+    ScopedIndent indentForTunnels(dw);
+    for (const auto& [key, totals] : tunnels) {
+        dw.println("if_id=0x%x mark=0x%x/0x%x: sas=%zu policies=%u bytes=%" PRIu64
+                   " packets=%" PRIu64 " replay_drops=%" PRIu64 " integrity_failures=%" PRIu64,
+                   std::get<0>(key), std::get<1>(key), std::get<2>(key), totals.sas,
+                   totals.policies, totals.bytes, totals.packets, totals.replayDrops,
+                   totals.integrityFailures);
+    }
+}
+
 void XfrmController::dump(DumpWriter& dw) {
     ScopedIndent indentForXfrmController(dw);
     dw.println("XfrmController");
 
     ScopedIndent indentForXfrmISupport(dw);
     dw.println("XFRM-I support: %d", mIsXfrmIntfSupported);
+    dw.println("SAs awaiting deletion after rekey: %zu", pendingSaDeletions());
+
+    dumpSaStats(dw);
 }
 
 } // namespace net
@@ -17,10 +17,13 @@
 #define _XFRM_CONTROLLER_H
 
 #include <atomic>
+#include <chrono>
+#include <functional>
 #include <list>
 #include <map>
 #include <string>
 #include <utility> // for pair
+#include <vector>
 
 #include <linux/if.h>
 #include <linux/if_link.h>
@@ -35,6 +38,7 @@
 #include "netdutils/DumpWriter.h"
 #include "netdutils/Slice.h"
 #include "netdutils/Status.h"
+#include "netdutils/StatusOr.h"
 #include "sysutils/SocketClient.h"
 
 namespace android {
@@ -76,7 +80,27 @@ public:
                                           std::vector<iovec>* iovecs) const = 0;
 
 protected:
-    int mSock;
+    int mSock = -1;
+};
+
+// Collects complete XFRM netlink messages so that they can be handed to the kernel in a single
+// write. The message builders take a const XfrmSocket&, so a batch stands in for the socket while
+// the messages are built: sendMessage() only copies the message into the batch.
+class XfrmMessageBatch : public XfrmSocket {
+  public:
+    netdutils::Status open() override { return netdutils::status::ok; }
+
+    netdutils::Status sendMessage(uint16_t nlMsgType, uint16_t nlMsgFlags, uint16_t nlMsgSeqNum,
+                                  std::vector<iovec>* iovecs) const override;
+
+    bool empty() const { return mSeqNums.empty(); }
+    size_t size() const { return mSeqNums.size(); }
+    const std::vector<uint8_t>& buffer() const { return mBuffer; }
+    const std::vector<uint32_t>& seqNums() const { return mSeqNums; }
+
+  private:
+    mutable std::vector<uint8_t> mBuffer;
+    mutable std::vector<uint32_t> mSeqNums;
 };
 
 enum struct XfrmDirection : uint8_t {
@@ -145,6 +169,78 @@ struct XfrmMigrateInfo : XfrmSpInfo {
     XfrmEndpointPair newEndpointInfo;
 };
 
+// The parameters of a single SA, as passed in by callers.
+struct XfrmSaParams {
+    int32_t transformId;
+    int32_t mode;
+    std::string sourceAddress;
+    std::string destinationAddress;
+    int32_t underlyingNetId;
+    int32_t spi;
+    int32_t markValue;
+    int32_t markMask;
+    std::string authAlgo;
+    std::vector<uint8_t> authKey;
+    int32_t authTruncBits;
+    std::string cryptAlgo;
+    std::vector<uint8_t> cryptKey;
+    int32_t cryptTruncBits;
+    std::string aeadAlgo;
+    std::vector<uint8_t> aeadKey;
+    int32_t aeadIcvBits;
+    int32_t encapType;
+    int32_t encapLocalPort;
+    int32_t encapRemotePort;
+    int32_t xfrmInterfaceId;
+};
+
+// Counters and replay state of one SA, as reported by an XFRM_MSG_GETSA dump.
+struct XfrmSaStats {
+    uint32_t spi;
+    int transformId;
+    std::string sourceAddress;
+    std::string destinationAddress;
+    xfrm_mark mark;
+    uint32_t xfrmInterfaceId;
+    uint64_t bytes;
+    uint64_t packets;
+    uint32_t replayWindowSize;
+    uint32_t inSeq;
+    uint32_t outSeq;
+    uint32_t replayWindowDrops;  // Packets that fell outside the replay window
+    uint32_t replayDrops;        // Replayed packets
+    uint32_t integrityFailures;
+};
+
+// Everything needed to bring up one IPsec tunnel: the tunnel interface, an SA in each direction
+// and the tunnel mode policies for each selector address family. The mode, marks and interface
+// ids of both SAs are derived from the tunnel interface, so those fields are ignored.
+struct XfrmTunnelBundle {
+    std::string deviceName;
+    std::string localAddress;
+    std::string remoteAddress;
+    int32_t ikey;
+    int32_t okey;
+    int32_t interfaceId;
+    std::vector<int32_t> selAddrFamilies;
+    XfrmSaParams outboundSa;
+    XfrmSaParams inboundSa;
+};
+
+// A make-before-break rekey of one tunnel mode SA. The old SA must have the same addresses, mark
+// and interface id as the new one.
+struct XfrmRekeyParams {
+    XfrmSaParams newSa;
+    int32_t oldTransformId;
+    int32_t oldSpi;
+    // The policies that are retargeted from the old SA to the new one.
+    int32_t direction;
+    std::vector<int32_t> selAddrFamilies;
+    // How long the old SA is kept after the switch, so that packets already in flight under it
+    // can still be processed. If zero, it is deleted as part of the rekey itself.
+    std::chrono::milliseconds gracePeriod;
+};
+
 /*
  * This is a workaround for a kernel bug in the 32bit netlink compat layer
  * that has been present on x86_64 kernels since 2010 with no fix on the
@@ -272,6 +368,33 @@ public:
 
     static netdutils::Status ipSecRemoveTunnelInterface(const std::string& deviceName);
 
+    // Brings up an IPsec tunnel: creates the tunnel interface, then installs both SAs and the
+    // policies for every selector address family in one batched netlink exchange. Everything is
+    // validated before anything is changed, and if any step fails, whatever the bundle created is
+    // removed again. The SPIs of both SAs must already have been allocated.
+    static netdutils::Status ipSecApplyTunnelBundle(const XfrmTunnelBundle& bundle);
+
+    // Validates |bundle| and builds the messages that install its SAs and policies into |batch|:
+    // the outbound SA, the inbound SA, then an outbound and an inbound policy per selector address
+    // family, in the order of |sas| and |policies|.
+    // Exposed for testing
+    static netdutils::Status buildTunnelBundle(const XfrmTunnelBundle& bundle,
+                                               std::vector<XfrmSaInfo>* sas,
+                                               std::vector<XfrmSpInfo>* policies,
+                                               XfrmMessageBatch* batch);
+
+    // Sends a batch built by buildTunnelBundle(). If any message fails, deletes whatever the
+    // kernel applied or may have applied, and returns the first error.
+    // Exposed for testing
+    static netdutils::Status sendTunnelBundle(const XfrmMessageBatch& batch,
+                                              const std::vector<XfrmSaInfo>& sas,
+                                              const std::vector<XfrmSpInfo>& policies);
+
+    // Installs the new SA and points the policies at it with XFRM_MSG_UPDPOLICY in one batched
+    // netlink exchange, then deletes the old SA once the grace period has passed. If the switch
+    // fails, the policies are pointed back at the old SA and the new SA is removed.
+    static netdutils::Status ipSecRekey(const XfrmRekeyParams& rekey);
+
     // Only available for Tunnel must already have a matching tunnel SA and policy
     static netdutils::Status ipSecMigrate(int32_t transformId, int32_t selAddrFamily,
                                           int32_t direction, const std::string& oldSourceAddress,
@@ -279,8 +402,18 @@ public:
                                           const std::string& newSourceAddress,
                                           const std::string& newDestinationAddress,
                                           int32_t xfrmInterfaceId);
+    // Returns the counters of every SA whose mark matches |markValue| under |markMask| and, unless
+    // |xfrmInterfaceId| is 0, whose XFRM interface id is |xfrmInterfaceId|.
+    static netdutils::StatusOr<std::vector<XfrmSaStats>> ipSecGetSaStats(uint32_t markValue,
+                                                                         uint32_t markMask,
+                                                                         uint32_t xfrmInterfaceId);
+
     void dump(netdutils::DumpWriter& dw);
 
+    // Parses one XFRM_MSG_NEWSA message from an SA dump. Returns false if it is malformed.
+    // Exposed for testing
+    static bool parseSaStats(const nlmsghdr& nlh, XfrmSaStats* stats);
+
     // Some XFRM netlink attributes comprise a header, a struct, and some data
     // after the struct. We wrap all of those in one struct for easier
     // marshalling. The structs below must be ABI compatible with the kernel and
@@ -389,6 +522,7 @@ public:
     static netdutils::Status fillXfrmCommonInfo(int32_t spi, int32_t markValue, int32_t markMask,
                                                 int32_t transformId, int32_t xfrmInterfaceId,
                                                 XfrmCommonInfo* info);
+    static netdutils::Status fillXfrmSaInfo(const XfrmSaParams& params, XfrmSaInfo* info);
 
     // Top level functions for managing a Transport Mode Transform
     static netdutils::Status addTransportModeTransform(const XfrmSaInfo& record);
@@ -441,7 +575,23 @@ public:
     static netdutils::Status deleteTunnelModeSecurityPolicy(const XfrmSpInfo& record,
                                                             const XfrmSocket& sock);
     static netdutils::Status migrate(const XfrmMigrateInfo& record, const XfrmSocket& sock);
+    // Deletes |sa| from a background thread once |delay| has passed. SAs that fall due together
+    // are deleted in a single batch.
+    static void scheduleSaDeletion(const XfrmSaInfo& sa, std::chrono::milliseconds delay);
+    static void runScheduledSaDeletions();
+    static size_t pendingSaDeletions();
+    // Sends a batch over the shared XFRM socket. On success, |results| holds the outcome of each
+    // message in the batch; an error means the batch could not be exchanged with the kernel, in
+    // which case |results| only covers the messages whose responses were read. If |sent| is not
+    // null, it is set to whether the batch was written to the kernel at all.
+    static netdutils::Status sendBatch(const XfrmMessageBatch& batch,
+                                       std::vector<netdutils::Status>* results,
+                                       bool* sent = nullptr);
     static netdutils::Status flushInterfaces();
+    // Streams an XFRM_MSG_GETSA or XFRM_MSG_GETPOLICY dump through |callback|.
+    static netdutils::Status dumpXfrmState(uint16_t nlMsgType,
+                                           const std::function<void(nlmsghdr*)>& callback);
+    static void dumpSaStats(netdutils::DumpWriter& dw);
     static netdutils::Status flushSaDb(const XfrmSocket& s);
     static netdutils::Status flushPolicyDb(const XfrmSocket& s);
 
@@ -16,7 +16,9 @@
  * xfrm_ctrl_test.cpp - unit tests for xfrm controllers.
  */
 
+#include <algorithm>
 #include <cerrno>
+#include <chrono>
 #include <cinttypes>
 #include <cstdint>
 #include <cstdlib>
@@ -59,6 +61,7 @@ using android::netdutils::Fd;
 using android::netdutils::MockSyscalls;
 using android::netdutils::Slice;
 using android::netdutils::Status;
+using android::netdutils::StatusOr;
 
 using ::testing::_;
 using ::testing::DoAll;
@@ -78,6 +81,18 @@ ACTION_TEMPLATE(SetArgSlice, HAS_1_TEMPLATE_PARAMS(int, N), AND_1_VALUE_PARAMS(v
     android::netdutils::copy(orig, value);
 }
 
+/**
+ * This gMock action works like SetArgSlice, but for netlink responses. It copies the supplied
+ * response into the N-th argument with its sequence number set to that of the flattened netlink
+ * request in |request|, as the kernel would.
+ */
+ACTION_TEMPLATE(SetArgSliceReplyTo, HAS_1_TEMPLATE_PARAMS(int, N),
+                AND_2_VALUE_PARAMS(response, request)) {
+    auto reply = response;
+    reply.hdr.nlmsg_seq = reinterpret_cast<const nlmsghdr*>(request->data())->nlmsg_seq;
+    android::netdutils::copy(::testing::get<N>(args), android::netdutils::makeSlice(reply));
+}
+
 /**
  * This gMock action works like SaveArg, but is specialized for vector<iovec>.
  * It copies the memory pointed to by each of the iovecs into a single vector<uint8_t>.
@@ -272,7 +287,7 @@ TEST_P(XfrmControllerParameterizedTest, TestIpSecAllocateSpi) {
     EXPECT_CALL(mockSyscalls, writev(_, _))
         .WillOnce(DoAll(SaveFlattenedIovecs<1>(&nlMsgBuf), Return(expectedMsgLength)));
     EXPECT_CALL(mockSyscalls, read(_, _))
-        .WillOnce(DoAll(SetArgSlice<1>(responseSlice), Return(responseSlice)));
+        .WillOnce(DoAll(SetArgSliceReplyTo<1>(response, &nlMsgBuf), Return(responseSlice)));
 
     XfrmController ctrl(params.xfrmInterfacesEnabled);
     int outSpi = 0;
@@ -297,6 +312,38 @@ TEST_P(XfrmControllerParameterizedTest, TestIpSecAllocateSpi) {
     EXPECT_EQ(DROID_SPI, static_cast<int>(userspi.max));
 }
 
+TEST_F(XfrmControllerTest, TestStaleResponsesAreDiscarded) {
+    // An error left over from an earlier request on the shared socket, which must not be taken
+    // as the response to this one.
+    NetlinkResponse staleResponse{};
+    staleResponse.hdr.nlmsg_type = NLMSG_ERROR;
+    staleResponse.hdr.nlmsg_seq = 0;
+    reinterpret_cast<nlmsgerr*>(staleResponse.buf)->error = -EEXIST;
+    Slice staleSlice = netdutils::makeSlice(staleResponse);
+
+    NetlinkResponse response{};
+    response.hdr.nlmsg_type = XFRM_MSG_ALLOCSPI;
+    Slice responseSlice = netdutils::makeSlice(response);
+
+    size_t expectedMsgLength = NLMSG_HDRLEN + NLMSG_ALIGN(sizeof(xfrm_userspi_info));
+
+    std::vector<uint8_t> nlMsgBuf;
+    EXPECT_CALL(mockSyscalls, writev(_, _))
+        .WillOnce(DoAll(SaveFlattenedIovecs<1>(&nlMsgBuf), Return(expectedMsgLength)));
+    EXPECT_CALL(mockSyscalls, read(_, _))
+        .WillOnce(DoAll(SetArgSlice<1>(staleSlice), Return(staleSlice)))
+        .WillOnce(DoAll(SetArgSliceReplyTo<1>(response, &nlMsgBuf), Return(responseSlice)));
+
+    XfrmController ctrl;
+    int outSpi = 0;
+    Status res = ctrl.ipSecAllocateSpi(1 /* resourceId */, LOCALHOST_V4, TEST_ADDR_V4, DROID_SPI,
+                                       &outSpi);
+
+    EXPECT_TRUE(isOk(res)) << res;
+    EXPECT_EQ(DROID_SPI, outSpi);
+    EXPECT_NE(0U, reinterpret_cast<const nlmsghdr*>(nlMsgBuf.data())->nlmsg_seq);
+}
+
 void verifyXfrmiArguments(uint32_t mark, uint32_t mask, uint32_t ifId) {
     // Check that correct arguments (and only those) are non-zero, and correct.
     EXPECT_EQ(0U, mark);
@@ -350,7 +397,7 @@ void testIpSecAddSecurityAssociation(testCaseParams params, const MockSyscalls&
     EXPECT_CALL(mockSyscalls, writev(_, _))
         .WillOnce(DoAll(SaveFlattenedIovecs<1>(&nlMsgBuf), Return(expectedMsgLength)));
     EXPECT_CALL(mockSyscalls, read(_, _))
-        .WillOnce(DoAll(SetArgSlice<1>(responseSlice), Return(responseSlice)));
+        .WillOnce(DoAll(SetArgSliceReplyTo<1>(response, &nlMsgBuf), Return(responseSlice)));
 
     XfrmController ctrl(params.xfrmInterfacesEnabled);
     Status res = ctrl.ipSecAddSecurityAssociation(
@@ -601,7 +648,7 @@ TEST_P(XfrmControllerParameterizedTest, TestIpSecDeleteSecurityAssociation) {
     EXPECT_CALL(mockSyscalls, writev(_, _))
         .WillOnce(DoAll(SaveFlattenedIovecs<1>(&nlMsgBuf), Return(expectedMsgLength)));
     EXPECT_CALL(mockSyscalls, read(_, _))
-        .WillOnce(DoAll(SetArgSlice<1>(responseSlice), Return(responseSlice)));
+        .WillOnce(DoAll(SetArgSliceReplyTo<1>(response, &nlMsgBuf), Return(responseSlice)));
 
     XfrmController ctrl(params.xfrmInterfacesEnabled);
     Status res = ctrl.ipSecDeleteSecurityAssociation(1 /* resourceId */, localAddr, remoteAddr,
@@ -652,7 +699,7 @@ TEST_P(XfrmControllerParameterizedTest, TestIpSecAddSecurityPolicy) {
     EXPECT_CALL(mockSyscalls, writev(_, _))
         .WillOnce(DoAll(SaveFlattenedIovecs<1>(&nlMsgBuf), Return(expectedMsgLength)));
     EXPECT_CALL(mockSyscalls, read(_, _))
-        .WillOnce(DoAll(SetArgSlice<1>(responseSlice), Return(responseSlice)));
+        .WillOnce(DoAll(SetArgSliceReplyTo<1>(response, &nlMsgBuf), Return(responseSlice)));
 
     XfrmController ctrl(params.xfrmInterfacesEnabled);
     Status res = ctrl.ipSecAddSecurityPolicy(
@@ -726,7 +773,7 @@ TEST_P(XfrmControllerParameterizedTest, TestIpSecUpdateSecurityPolicy) {
     EXPECT_CALL(mockSyscalls, writev(_, _))
         .WillOnce(DoAll(SaveFlattenedIovecs<1>(&nlMsgBuf), Return(expectedMsgLength)));
     EXPECT_CALL(mockSyscalls, read(_, _))
-        .WillOnce(DoAll(SetArgSlice<1>(responseSlice), Return(responseSlice)));
+        .WillOnce(DoAll(SetArgSliceReplyTo<1>(response, &nlMsgBuf), Return(responseSlice)));
 
     XfrmController ctrl(params.xfrmInterfacesEnabled);
     Status res = ctrl.ipSecUpdateSecurityPolicy(
@@ -761,7 +808,7 @@ TEST_P(XfrmControllerParameterizedTest, TestIpSecDeleteSecurityPolicy) {
     EXPECT_CALL(mockSyscalls, writev(_, _))
         .WillOnce(DoAll(SaveFlattenedIovecs<1>(&nlMsgBuf), Return(expectedMsgLength)));
     EXPECT_CALL(mockSyscalls, read(_, _))
-        .WillOnce(DoAll(SetArgSlice<1>(responseSlice), Return(responseSlice)));
+        .WillOnce(DoAll(SetArgSliceReplyTo<1>(response, &nlMsgBuf), Return(responseSlice)));
 
     XfrmController ctrl(params.xfrmInterfacesEnabled);
     Status res = ctrl.ipSecDeleteSecurityPolicy(1 /* resourceId */, family,
@@ -794,6 +841,387 @@ TEST_P(XfrmControllerParameterizedTest, TestIpSecDeleteSecurityPolicy) {
     }
 }
 
+XfrmTunnelBundle makeTunnelBundle() {
+    const XfrmSaParams sa = {
+            .transformId = 1,
+            .sourceAddress = LOCALHOST_V4,
+            .destinationAddress = TEST_ADDR_V4,
+            .underlyingNetId = TEST_XFRM_UNDERLYING_NET,
+            .spi = DROID_SPI,
+            .authAlgo = "hmac(sha256)",
+            .authKey = std::vector<uint8_t>(KEY_LENGTH, 0),
+            .authTruncBits = 128,
+            .cryptAlgo = "cbc(aes)",
+            .cryptKey = std::vector<uint8_t>(KEY_LENGTH, 1),
+            .cryptTruncBits = 0,
+            .encapType = static_cast<int32_t>(XfrmEncapType::NONE),
+    };
+
+    XfrmTunnelBundle bundle = {
+            .deviceName = "ipsec_test0",
+            .localAddress = LOCALHOST_V4,
+            .remoteAddress = TEST_ADDR_V4,
+            .ikey = TEST_XFRM_MARK,
+            .okey = TEST_XFRM_MARK + 1,
+            .interfaceId = TEST_XFRM_IF_ID,
+            .selAddrFamilies = {AF_INET, AF_INET6},
+            .outboundSa = sa,
+            .inboundSa = sa,
+    };
+    bundle.inboundSa.transformId = 2;
+    std::swap(bundle.inboundSa.sourceAddress, bundle.inboundSa.destinationAddress);
+    bundle.inboundSa.underlyingNetId = 0;
+    bundle.inboundSa.spi = DROID_SPI + 1;
+    return bundle;
+}
+
+// The StrictMock fails these tests if anything is sent to the kernel before validation is done.
+TEST_F(XfrmControllerTest, TestIpSecApplyTunnelBundleInvalidSelectorFamily) {
+    XfrmTunnelBundle bundle = makeTunnelBundle();
+    bundle.selAddrFamilies = {AF_INET, AF_UNSPEC};
+
+    Status res = XfrmController(true).ipSecApplyTunnelBundle(bundle);
+    EXPECT_EQ(EINVAL, res.code()) << res;
+}
+
+TEST_F(XfrmControllerTest, TestIpSecApplyTunnelBundleUnallocatedSpi) {
+    XfrmTunnelBundle bundle = makeTunnelBundle();
+    bundle.inboundSa.spi = 0;
+
+    Status res = XfrmController(true).ipSecApplyTunnelBundle(bundle);
+    EXPECT_EQ(EINVAL, res.code()) << res;
+}
+
+TEST_F(XfrmControllerTest, TestIpSecApplyTunnelBundleInvalidAlgorithms) {
+    XfrmTunnelBundle bundle = makeTunnelBundle();
+    // AEAD is mutually exclusive with authentication and encryption. This is only detected while
+    // building the SA messages, which must still happen before the tunnel interface is created.
+    bundle.inboundSa.aeadAlgo = "rfc4106(gcm(aes))";
+    bundle.inboundSa.aeadKey = std::vector<uint8_t>(KEY_LENGTH, 2);
+
+    Status res = XfrmController(true).ipSecApplyTunnelBundle(bundle);
+    EXPECT_EQ(EINVAL, res.code()) << res;
+}
+
+// Splits a flattened batch of netlink messages into the individual messages.
+std::vector<const nlmsghdr*> splitNlMsgs(const std::vector<uint8_t>& buf) {
+    std::vector<const nlmsghdr*> msgs;
+    for (size_t off = 0; off < buf.size(); off += NLMSG_ALIGN(msgs.back()->nlmsg_len)) {
+        msgs.push_back(reinterpret_cast<const nlmsghdr*>(buf.data() + off));
+    }
+    return msgs;
+}
+
+std::vector<uint16_t> nlMsgTypes(const std::vector<const nlmsghdr*>& msgs) {
+    std::vector<uint16_t> types;
+    for (const nlmsghdr* msg : msgs) types.push_back(msg->nlmsg_type);
+    return types;
+}
+
+// Replies to the |index|-th message in the flattened batch |request| with |error|, which is 0 for
+// an acknowledgement.
+Slice replyToNlMsg(const Slice buf, const std::vector<uint8_t>& request, size_t index, int error) {
+    NetlinkResponse response{};
+    response.hdr.nlmsg_type = NLMSG_ERROR;
+    response.hdr.nlmsg_seq = splitNlMsgs(request).at(index)->nlmsg_seq;
+    reinterpret_cast<nlmsgerr*>(response.buf)->error = error;
+    netdutils::copy(buf, netdutils::makeSlice(response));
+    return buf;
+}
+
+class XfrmTunnelBundleTest : public XfrmControllerTest {
+  protected:
+    void SetUp() override {
+        ASSERT_TRUE(isOk(XfrmController(true).buildTunnelBundle(makeTunnelBundle(), &mSas,
+                                                                &mPolicies, &mBatch)));
+    }
+
+    // Expects a write of the batch, saving it into |buf|.
+    void expectBatchWrite(std::vector<uint8_t>* buf) {
+        EXPECT_CALL(mockSyscalls, writev(_, _))
+                .WillOnce(Invoke([buf](Fd, const std::vector<iovec>& iovs) {
+                    for (const iovec& iov : iovs) {
+                        buf->insert(buf->end(), static_cast<uint8_t*>(iov.iov_base),
+                                    static_cast<uint8_t*>(iov.iov_base) + iov.iov_len);
+                    }
+                    return buf->size();
+                }));
+    }
+
+    std::vector<XfrmSaInfo> mSas;
+    std::vector<XfrmSpInfo> mPolicies;
+    XfrmMessageBatch mBatch;
+};
+
+TEST_F(XfrmTunnelBundleTest, TestSendTunnelBundle) {
+    std::vector<uint8_t> nlMsgBuf;
+    expectBatchWrite(&nlMsgBuf);
+    size_t responses = 0;
+    EXPECT_CALL(mockSyscalls, read(_, _)).Times(6).WillRepeatedly(Invoke([&](Fd, const Slice buf) {
+        return replyToNlMsg(buf, nlMsgBuf, responses++, 0);
+    }));
+
+    Status res = XfrmController::sendTunnelBundle(mBatch, mSas, mPolicies);
+    EXPECT_TRUE(isOk(res)) << res;
+
+    // Both SAs, then the outbound and inbound policy for each selector address family.
+    const std::vector<const nlmsghdr*> msgs = splitNlMsgs(nlMsgBuf);
+    const std::vector<uint16_t> expectedTypes = {XFRM_MSG_UPDSA,     XFRM_MSG_UPDSA,
+                                                 XFRM_MSG_NEWPOLICY, XFRM_MSG_NEWPOLICY,
+                                                 XFRM_MSG_NEWPOLICY, XFRM_MSG_NEWPOLICY};
+    ASSERT_EQ(expectedTypes, nlMsgTypes(msgs));
+
+    const std::vector<int> expectedSpis = {DROID_SPI, DROID_SPI + 1};
+    for (size_t i = 0; i < expectedSpis.size(); i++) {
+        const auto* usersa = reinterpret_cast<const xfrm_usersa_info*>(NLMSG_DATA(msgs[i]));
+        EXPECT_EQ(expectedSpis[i], static_cast<int>(ntohl(usersa->id.spi)));
+        EXPECT_EQ(static_cast<uint8_t>(XfrmMode::TUNNEL), usersa->mode);
+    }
+    const std::vector<std::pair<int, uint8_t>> expectedPolicies = {
+            {AF_INET, XFRM_POLICY_OUT},
+            {AF_INET, XFRM_POLICY_IN},
+            {AF_INET6, XFRM_POLICY_OUT},
+            {AF_INET6, XFRM_POLICY_IN},
+    };
+    for (size_t i = 0; i < expectedPolicies.size(); i++) {
+        const auto* usersp = reinterpret_cast<const xfrm_userpolicy_info*>(NLMSG_DATA(msgs[2 + i]));
+        EXPECT_EQ(expectedPolicies[i].first, usersp->sel.family);
+        EXPECT_EQ(expectedPolicies[i].second, usersp->dir);
+    }
+}
+
+TEST_F(XfrmTunnelBundleTest, TestSendTunnelBundleRollsBackAppliedMessages) {
+    // The outbound IPv4 policy already exists, so only the messages around it are undone.
+    testing::InSequence seq;
+    std::vector<uint8_t> nlMsgBuf;
+    expectBatchWrite(&nlMsgBuf);
+    size_t responses = 0;
+    EXPECT_CALL(mockSyscalls, read(_, _)).Times(6).WillRepeatedly(Invoke([&](Fd, const Slice buf) {
+        const size_t i = responses++;
+        return replyToNlMsg(buf, nlMsgBuf, i, (i == 2) ? -EEXIST : 0);
+    }));
+    std::vector<uint8_t> rollbackBuf;
+    expectBatchWrite(&rollbackBuf);
+    size_t rollbackResponses = 0;
+    EXPECT_CALL(mockSyscalls, read(_, _)).Times(5).WillRepeatedly(Invoke([&](Fd, const Slice buf) {
+        return replyToNlMsg(buf, rollbackBuf, rollbackResponses++, 0);
+    }));
+
+    Status res = XfrmController::sendTunnelBundle(mBatch, mSas, mPolicies);
+    EXPECT_EQ(EEXIST, res.code()) << res;
+
+    const std::vector<const nlmsghdr*> msgs = splitNlMsgs(rollbackBuf);
+    const std::vector<uint16_t> expectedTypes = {XFRM_MSG_DELSA, XFRM_MSG_DELSA,
+                                                 XFRM_MSG_DELPOLICY, XFRM_MSG_DELPOLICY,
+                                                 XFRM_MSG_DELPOLICY};
+    ASSERT_EQ(expectedTypes, nlMsgTypes(msgs));
+
+    const std::vector<int> expectedSpis = {DROID_SPI, DROID_SPI + 1};
+    for (size_t i = 0; i < expectedSpis.size(); i++) {
+        const auto* said = reinterpret_cast<const xfrm_usersa_id*>(NLMSG_DATA(msgs[i]));
+        EXPECT_EQ(expectedSpis[i], static_cast<int>(ntohl(said->spi)));
+    }
+    const std::vector<std::pair<int, uint8_t>> expectedPolicies = {
+            {AF_INET, XFRM_POLICY_IN},
+            {AF_INET6, XFRM_POLICY_OUT},
+            {AF_INET6, XFRM_POLICY_IN},
+    };
+    for (size_t i = 0; i < expectedPolicies.size(); i++) {
+        const auto* policyid = reinterpret_cast<const xfrm_userpolicy_id*>(NLMSG_DATA(msgs[2 + i]));
+        EXPECT_EQ(expectedPolicies[i].first, policyid->sel.family);
+        EXPECT_EQ(expectedPolicies[i].second, policyid->dir);
+    }
+}
+
+TEST_F(XfrmTunnelBundleTest, TestSendTunnelBundleRollsBackUnreadMessages) {
+    // Messages whose response was never read may have been applied, so they are undone as well.
+    testing::InSequence seq;
+    std::vector<uint8_t> nlMsgBuf;
+    expectBatchWrite(&nlMsgBuf);
+    size_t responses = 0;
+    EXPECT_CALL(mockSyscalls, read(_, _))
+            .WillOnce(Invoke([&](Fd, const Slice buf) {
+                return replyToNlMsg(buf, nlMsgBuf, responses++, 0);
+            }))
+            .WillOnce(Invoke([&](Fd, const Slice buf) {
+                return replyToNlMsg(buf, nlMsgBuf, responses++, -EEXIST);
+            }))
+            .WillOnce(Return(StatusOr<Slice>(netdutils::statusFromErrno(EINTR, "read"))));
+    std::vector<uint8_t> rollbackBuf;
+    expectBatchWrite(&rollbackBuf);
+    size_t rollbackResponses = 0;
+    EXPECT_CALL(mockSyscalls, read(_, _)).Times(5).WillRepeatedly(Invoke([&](Fd, const Slice buf) {
+        return replyToNlMsg(buf, rollbackBuf, rollbackResponses++, 0);
+    }));
+
+    Status res = XfrmController::sendTunnelBundle(mBatch, mSas, mPolicies);
+    EXPECT_EQ(EINTR, res.code()) << res;
+
+    // Everything but the inbound SA, which the kernel rejected.
+    const std::vector<const nlmsghdr*> msgs = splitNlMsgs(rollbackBuf);
+    const std::vector<uint16_t> expectedTypes = {XFRM_MSG_DELSA, XFRM_MSG_DELPOLICY,
+                                                 XFRM_MSG_DELPOLICY, XFRM_MSG_DELPOLICY,
+                                                 XFRM_MSG_DELPOLICY};
+    ASSERT_EQ(expectedTypes, nlMsgTypes(msgs));
+    const auto* said = reinterpret_cast<const xfrm_usersa_id*>(NLMSG_DATA(msgs[0]));
+    EXPECT_EQ(DROID_SPI, static_cast<int>(ntohl(said->spi)));
+}
+
+TEST_F(XfrmTunnelBundleTest, TestSendTunnelBundleWriteFailure) {
+    // Nothing reached the kernel, so nothing is deleted: the SPIs and selectors of the bundle may
+    // belong to state that already existed. The StrictMock fails the test on any further call.
+    EXPECT_CALL(mockSyscalls, writev(_, _))
+            .WillOnce(Return(StatusOr<size_t>(netdutils::statusFromErrno(ENOBUFS, "writev"))));
+
+    Status res = XfrmController::sendTunnelBundle(mBatch, mSas, mPolicies);
+    EXPECT_EQ(ENOBUFS, res.code()) << res;
+}
+
+XfrmRekeyParams makeRekeyParams() {
+    XfrmRekeyParams rekey = {
+            .newSa = makeTunnelBundle().outboundSa,
+            .oldTransformId = 1,
+            .oldSpi = DROID_SPI,
+            .direction = static_cast<int32_t>(XfrmDirection::OUT),
+            .selAddrFamilies = {AF_INET, AF_INET6},
+            .gracePeriod = std::chrono::milliseconds(0),
+    };
+    rekey.newSa.transformId = 3;
+    rekey.newSa.spi = DROID_SPI + 2;
+    rekey.newSa.xfrmInterfaceId = TEST_XFRM_IF_ID;
+    return rekey;
+}
+
+TEST_F(XfrmControllerTest, TestIpSecRekeyInvalidParameters) {
+    XfrmRekeyParams rekey = makeRekeyParams();
+    rekey.oldSpi = rekey.newSa.spi;
+    Status res = XfrmController(true).ipSecRekey(rekey);
+    EXPECT_EQ(EINVAL, res.code()) << res;
+
+    rekey = makeRekeyParams();
+    rekey.direction = static_cast<int32_t>(XfrmDirection::MASK);
+    res = XfrmController(true).ipSecRekey(rekey);
+    EXPECT_EQ(EINVAL, res.code()) << res;
+
+    rekey = makeRekeyParams();
+    rekey.gracePeriod = std::chrono::milliseconds(-1);
+    res = XfrmController(true).ipSecRekey(rekey);
+    EXPECT_EQ(EINVAL, res.code()) << res;
+}
+
+TEST_F(XfrmControllerTest, TestIpSecRekeyWithoutGracePeriod) {
+    std::vector<uint8_t> nlMsgBuf;
+    EXPECT_CALL(mockSyscalls, writev(_, _))
+            .WillOnce(Invoke([&nlMsgBuf](Fd, const std::vector<iovec>& iovs) {
+                for (const iovec& iov : iovs) {
+                    nlMsgBuf.insert(nlMsgBuf.end(), static_cast<uint8_t*>(iov.iov_base),
+                                    static_cast<uint8_t*>(iov.iov_base) + iov.iov_len);
+                }
+                return nlMsgBuf.size();
+            }));
+
+    // Acknowledge each message of the batch in turn.
+    std::vector<const nlmsghdr*> requests;
+    EXPECT_CALL(mockSyscalls, read(_, _))
+            .Times(4)
+            .WillRepeatedly(Invoke([&](Fd, const Slice buf) {
+                if (requests.empty()) {
+                    for (size_t off = 0; off < nlMsgBuf.size();) {
+                        requests.push_back(
+                                reinterpret_cast<const nlmsghdr*>(nlMsgBuf.data() + off));
+                        off += NLMSG_ALIGN(requests.back()->nlmsg_len);
+                    }
+                    std::reverse(requests.begin(), requests.end());
+                }
+                NetlinkResponse ack{};
+                ack.hdr.nlmsg_type = NLMSG_ERROR;
+                ack.hdr.nlmsg_seq = requests.back()->nlmsg_seq;
+                requests.pop_back();
+                netdutils::copy(buf, netdutils::makeSlice(ack));
+                return buf;
+            }));
+
+    Status res = XfrmController(true).ipSecRekey(makeRekeyParams());
+    EXPECT_TRUE(isOk(res)) << res;
+
+    // The new SA, then the policy for each selector family, then the deletion of the old SA.
+    std::vector<uint16_t> types;
+    const nlmsghdr* last = nullptr;
+    for (size_t off = 0; off < nlMsgBuf.size(); off += NLMSG_ALIGN(last->nlmsg_len)) {
+        last = reinterpret_cast<const nlmsghdr*>(nlMsgBuf.data() + off);
+        types.push_back(last->nlmsg_type);
+    }
+    const std::vector<uint16_t> expectedTypes = {XFRM_MSG_UPDSA, XFRM_MSG_UPDPOLICY,
+                                                 XFRM_MSG_UPDPOLICY, XFRM_MSG_DELSA};
+    EXPECT_EQ(expectedTypes, types);
+    ASSERT_NE(nullptr, last);
+    const auto* deletedSa = reinterpret_cast<const xfrm_usersa_id*>(NLMSG_DATA(last));
+    EXPECT_EQ(DROID_SPI, static_cast<int>(ntohl(deletedSa->spi)));
+}
+
+TEST_F(XfrmControllerTest, TestParseSaStats) {
+    struct {
+        nlmsghdr hdr;
+        xfrm_usersa_info usersa;
+        nlattr markAttr;
+        xfrm_mark mark;
+        nlattr ifIdAttr;
+        uint32_t ifId;
+        nlattr replayAttr;
+        xfrm_replay_state_esn replay;
+    } msg{};
+    static_assert(sizeof(msg) == NLMSG_SPACE(sizeof(xfrm_usersa_info)) + 3 * NLA_HDRLEN +
+                                         sizeof(xfrm_mark) + sizeof(uint32_t) +
+                                         sizeof(xfrm_replay_state_esn),
+                  "message must not contain padding");
+
+    msg.hdr = {.nlmsg_len = sizeof(msg), .nlmsg_type = XFRM_MSG_NEWSA};
+    msg.usersa.family = AF_INET6;
+    inet_pton(AF_INET6, "::1", &msg.usersa.saddr);
+    inet_pton(AF_INET6, "fe80::1", &msg.usersa.id.daddr);
+    msg.usersa.id.spi = htonl(DROID_SPI);
+    msg.usersa.reqid = 7;
+    msg.usersa.curlft.bytes = 123456;
+    msg.usersa.curlft.packets = 100;
+    msg.usersa.stats.replay_window = 2;
+    msg.usersa.stats.replay = 3;
+    msg.usersa.stats.integrity_failed = 4;
+    msg.markAttr = {.nla_len = NLA_HDRLEN + sizeof(xfrm_mark), .nla_type = XFRMA_MARK};
+    msg.mark = {.v = 0x1234, .m = 0xffff};
+    msg.ifIdAttr = {.nla_len = NLA_HDRLEN + sizeof(uint32_t), .nla_type = XFRMA_IF_ID};
+    msg.ifId = 42;
+    msg.replayAttr = {.nla_len = NLA_HDRLEN + sizeof(xfrm_replay_state_esn),
+                      .nla_type = XFRMA_REPLAY_ESN_VAL};
+    msg.replay.replay_window = 128;
+    msg.replay.seq = 10;
+    msg.replay.oseq = 20;
+
+    XfrmSaStats stats;
+    ASSERT_TRUE(XfrmController::parseSaStats(msg.hdr, &stats));
+    EXPECT_EQ(DROID_SPI, static_cast<int>(stats.spi));
+    EXPECT_EQ(7, stats.transformId);
+    EXPECT_EQ("::1", stats.sourceAddress);
+    EXPECT_EQ("fe80::1", stats.destinationAddress);
+    EXPECT_EQ(0x1234U, stats.mark.v);
+    EXPECT_EQ(0xffffU, stats.mark.m);
+    EXPECT_EQ(42U, stats.xfrmInterfaceId);
+    EXPECT_EQ(123456U, stats.bytes);
+    EXPECT_EQ(100U, stats.packets);
+    EXPECT_EQ(128U, stats.replayWindowSize);
+    EXPECT_EQ(10U, stats.inSeq);
+    EXPECT_EQ(20U, stats.outSeq);
+    EXPECT_EQ(2U, stats.replayWindowDrops);
+    EXPECT_EQ(3U, stats.replayDrops);
+    EXPECT_EQ(4U, stats.integrityFailures);
+
+    // Truncated messages and other message types are rejected.
+    msg.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(xfrm_usersa_info)) - 1;
+    EXPECT_FALSE(XfrmController::parseSaStats(msg.hdr, &stats));
+    msg.hdr.nlmsg_len = sizeof(msg);
+    msg.hdr.nlmsg_type = XFRM_MSG_NEWPOLICY;
+    EXPECT_FALSE(XfrmController::parseSaStats(msg.hdr, &stats));
+}
+
 // TODO: Add tests for VTIs, ensuring that we are sending the correct data over netlink.
 
 } // namespace net
@@ -27,8 +27,6 @@ using android::fuzzService;
 using android::net::gCtls;
 using android::net::NetdNativeService;
 
-std::mutex android::net::gBigNetdLock;
-
 extern "C" int LLVMFuzzerInitialize(int /**argc*/, char /****argv*/) {
     gCtls = new android::net::Controllers();
     gCtls->init();
@@ -73,8 +73,6 @@ using android::netdutils::Stopwatch;
 const char* const PID_FILE_PATH = "/data/misc/net/netd_pid";
 constexpr const char DNSPROXYLISTENER_SOCKET_NAME[] = "dnsproxyd";
 
-std::mutex android::net::gBigNetdLock;
-
 namespace {
 
 void getNetworkContextCallback(uint32_t netId, uint32_t uid, android_net_context* netcontext) {
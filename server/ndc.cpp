@@ -14,15 +14,21 @@
  * limitations under the License.
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "NdcDispatcher.h"
 
 namespace {
 
 void usage(char* progname) {
-    fprintf(stderr, "Usage: %s (<cmd> [arg ...])\n", progname);
+    fprintf(stderr,
+            "Usage: %s (<cmd> [arg ...])\n"
+            "       %s -f <file>  (run one command per line of <file>, or of stdin if <file> "
+            "is -)\n",
+            progname, progname);
     exit(1);
 }
 
@@ -33,6 +39,17 @@ int main(int argc, char** argv) {
         usage(argv[0]);
     }
 
+    if (!strcmp(argv[1], "-f")) {
+        if (argc != 3) usage(argv[0]);
+        FILE* in = strcmp(argv[2], "-") ? fopen(argv[2], "re") : stdin;
+        if (in == nullptr) {
+            fprintf(stderr, "Cannot open %s: %s\n", argv[2], strerror(errno));
+            exit(1);
+        }
+        android::net::NdcDispatcher nd;
+        exit(nd.dispatchBatch(in) ? 1 : 0);
+    }
+
     android::net::NdcDispatcher nd;
     exit(nd.dispatchCommand(argc - 1, argv + 1));
 }
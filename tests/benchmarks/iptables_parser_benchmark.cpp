@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the iptables output parsers in IptablesParser.cpp with the std::regex parsers they
+// replaced, on dumps the size of those seen on devices with many apps and interfaces.
+
+#include <regex>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+#include "IptablesParser.h"
+
+using android::base::StringAppendF;
+using android::net::FieldTokenizer;
+using android::net::LineTokenizer;
+using android::net::parseCounter;
+using android::net::parseJumpRule;
+using android::net::parseNewChain;
+
+namespace {
+
+// "iptables -S" output with |numRules| per-UID rules, plus the chains and jump rules of a device
+// with a handful of vendor chains and costly interfaces.
+std::string makeRuleDump(int numRules) {
+    std::string dump = "-P INPUT ACCEPT\n-P FORWARD ACCEPT\n-P OUTPUT ACCEPT\n";
+    for (const char* chain : {"bw_INPUT", "bw_OUTPUT", "bw_costly_shared", "bw_happy_box",
+                              "bw_penalty_box", "fw_INPUT", "fw_OUTPUT", "fw_standby",
+                              "oem_fwd", "oem_out", "st_OUTPUT", "tetherctrl_FORWARD"}) {
+        StringAppendF(&dump, "-N %s\n", chain);
+    }
+    for (int i = 0; i < 8; i++) {
+        StringAppendF(&dump, "-N bw_costly_rmnet_data%d\n", i);
+    }
+    dump += "-A INPUT -j bw_INPUT\n-A INPUT -j fw_INPUT\n";
+    dump += "-A FORWARD -j oem_fwd\n-A FORWARD -j fw_FORWARD\n-A FORWARD -j tetherctrl_FORWARD\n";
+    dump += "-A OUTPUT -j oem_out\n-A OUTPUT -j fw_OUTPUT\n-A OUTPUT -j st_OUTPUT\n";
+    dump += "-A OUTPUT -j bw_OUTPUT\n";
+    dump += "-A OUTPUT -o r_rmnet_data8 -p udp -m udp --dport 1900 -j DROP\n";
+    for (int i = 0; i < 8; i++) {
+        StringAppendF(&dump, "-A bw_OUTPUT -o rmnet_data%d -j bw_costly_rmnet_data%d\n", i, i);
+        StringAppendF(&dump, "-A bw_costly_rmnet_data%d -j bw_penalty_box\n", i);
+    }
+    for (int i = 0; i < numRules; i++) {
+        StringAppendF(&dump, "-A fw_standby -m owner --uid-owner %d -j DROP\n", 10000 + i);
+    }
+    return dump;
+}
+
+// "iptables -nvx -L tetherctrl_counters" output with |numPairs| interface pairs.
+std::string makeCounterDump(int numPairs) {
+    std::string dump =
+            "Chain tetherctrl_counters (4 references)\n"
+            "    pkts      bytes target     prot opt in     out     source               "
+            "destination\n";
+    for (int i = 0; i < numPairs; i++) {
+        StringAppendF(&dump,
+                      "      %d     %d RETURN     all  --  wlan%d  rmnet_data0  0.0.0.0/0"
+                      "            0.0.0.0/0\n",
+                      26 + i, 2373 + i, i);
+        StringAppendF(&dump,
+                      "      %d     %d RETURN     all  --  rmnet_data0  wlan%d  0.0.0.0/0"
+                      "            0.0.0.0/0\n",
+                      27 + i, 2374 + i, i);
+    }
+    return dump;
+}
+
+constexpr int kMinRules = 64;
+constexpr int kMaxRules = 8192;
+
+void BM_JumpRulesRegex(benchmark::State& state) {
+    const std::string dump = makeRuleDump(state.range(0));
+    const std::regex re("^-A ([^ ]+) -j ([^ ]+)$", std::regex_constants::extended);
+    for (auto _ : state) {  // NOLINT(clang-analyzer-deadcode.DeadStores)
+        int found = 0;
+        std::smatch matches;
+        std::stringstream stream(dump);
+        std::string rule;
+        while (std::getline(stream, rule, '\n')) {
+            if (std::regex_search(rule, matches, re)) found++;
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetBytesProcessed(state.iterations() * dump.size());
+}
+BENCHMARK(BM_JumpRulesRegex)->RangeMultiplier(4)->Range(kMinRules, kMaxRules);
+
+void BM_JumpRulesTokenizer(benchmark::State& state) {
+    const std::string dump = makeRuleDump(state.range(0));
+    for (auto _ : state) {  // NOLINT(clang-analyzer-deadcode.DeadStores)
+        int found = 0;
+        LineTokenizer lines(dump);
+        std::string_view line, parent, child;
+        while (lines.next(&line)) {
+            if (parseJumpRule(line, &parent, &child)) found++;
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetBytesProcessed(state.iterations() * dump.size());
+}
+BENCHMARK(BM_JumpRulesTokenizer)->RangeMultiplier(4)->Range(kMinRules, kMaxRules);
+
+void BM_NewChainsGetline(benchmark::State& state) {
+    const std::string dump = makeRuleDump(state.range(0));
+    for (auto _ : state) {  // NOLINT(clang-analyzer-deadcode.DeadStores)
+        int found = 0;
+        std::stringstream stream(dump);
+        std::string rule;
+        while (std::getline(stream, rule, '\n')) {
+            if (rule.rfind("-N ", 0) == 0) {
+                std::string chain = rule.substr(3);
+                benchmark::DoNotOptimize(chain);
+                found++;
+            }
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetBytesProcessed(state.iterations() * dump.size());
+}
+BENCHMARK(BM_NewChainsGetline)->RangeMultiplier(4)->Range(kMinRules, kMaxRules);
+
+void BM_NewChainsTokenizer(benchmark::State& state) {
+    const std::string dump = makeRuleDump(state.range(0));
+    for (auto _ : state) {  // NOLINT(clang-analyzer-deadcode.DeadStores)
+        int found = 0;
+        LineTokenizer lines(dump);
+        std::string_view line, chain;
+        while (lines.next(&line)) {
+            if (parseNewChain(line, &chain)) found++;
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetBytesProcessed(state.iterations() * dump.size());
+}
+BENCHMARK(BM_NewChainsTokenizer)->RangeMultiplier(4)->Range(kMinRules, kMaxRules);
+
+constexpr int kMinPairs = 4;
+constexpr int kMaxPairs = 1024;
+
+void BM_CountersRegex(benchmark::State& state) {
+    const std::string dump = makeCounterDump(state.range(0));
+    const std::regex re(
+            "\\s*(\\d+)\\s+(\\d+) RETURN     all  --  ([^\\s]+)\\s+([^\\s]+)"
+            "\\s+(0.0.0.0/0|::/0)\\s+(0.0.0.0/0|::/0)");
+    for (auto _ : state) {  // NOLINT(clang-analyzer-deadcode.DeadStores)
+        int64_t total = 0;
+        std::smatch matches;
+        std::stringstream stream(dump);
+        std::string line;
+        while (std::getline(stream, line, '\n')) {
+            if (std::regex_search(line, matches, re)) {
+                total += strtoul(matches[2].str().c_str(), nullptr, 10);
+            }
+        }
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetBytesProcessed(state.iterations() * dump.size());
+}
+BENCHMARK(BM_CountersRegex)->RangeMultiplier(4)->Range(kMinPairs, kMaxPairs);
+
+void BM_CountersTokenizer(benchmark::State& state) {
+    const std::string dump = makeCounterDump(state.range(0));
+    for (auto _ : state) {  // NOLINT(clang-analyzer-deadcode.DeadStores)
+        int64_t total = 0;
+        LineTokenizer lines(dump);
+        std::string_view line;
+        while (lines.next(&line)) {
+            std::string_view fields[9];
+            FieldTokenizer tokenizer(line);
+            bool complete = true;
+            for (std::string_view& field : fields) {
+                if (!tokenizer.next(&field)) {
+                    complete = false;
+                    break;
+                }
+            }
+            int64_t bytes;
+            if (complete && fields[2] == "RETURN" && parseCounter(fields[1], &bytes)) {
+                total += bytes;
+            }
+        }
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetBytesProcessed(state.iterations() * dump.size());
+}
+BENCHMARK(BM_CountersTokenizer)->RangeMultiplier(4)->Range(kMinPairs, kMaxPairs);
+
+}  // namespace
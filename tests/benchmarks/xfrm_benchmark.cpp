@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+#include "XfrmController.h"
+
+using android::base::StringPrintf;
+using android::net::XfrmController;
+using android::net::XfrmDirection;
+using android::net::XfrmEncapType;
+using android::net::XfrmMode;
+using android::net::XfrmRekeyParams;
+using android::net::XfrmSaParams;
+using android::netdutils::Status;
+
+namespace {
+
+constexpr char kLocalAddress[] = "192.0.2.1";
+constexpr char kRemoteAddress[] = "192.0.2.2";
+// The SA and policies are tied together by a mark, which works on every kernel. XFRM interface IDs
+// are only used once XfrmController::Init() has found that the kernel supports them.
+constexpr int32_t kMarkValue = 0x5a5a;
+constexpr int32_t kMarkMask = static_cast<int32_t>(0xffffffff);
+constexpr int32_t kFirstSpi = 0x1000;
+const std::vector<int32_t> kSelAddrFamilies = {AF_INET, AF_INET6};
+
+// Rekeys one outbound tunnel mode SA over and over, in a network namespace of its own so that
+// the host's IPsec state is never touched. Every rekey allocates the SPI of the new SA first, as
+// IpSecService does.
+class XfrmBenchmark : public ::benchmark::Fixture {
+  public:
+    void SetUp(const ::benchmark::State&) override {
+        mSpi = kFirstSpi;
+        mTransformId = 1;
+        mSetUpStatus = allocateSpi(mSpi);
+        if (!isOk(mSetUpStatus)) return;
+        mSetUpStatus = addSa(mSpi);
+        if (!isOk(mSetUpStatus)) return;
+        for (int32_t family : kSelAddrFamilies) {
+            mSetUpStatus = XfrmController::ipSecAddSecurityPolicy(
+                    mTransformId, family, static_cast<int32_t>(XfrmDirection::OUT),
+                    kLocalAddress, kRemoteAddress, mSpi, kMarkValue, kMarkMask, 0);
+            if (!isOk(mSetUpStatus)) return;
+        }
+    }
+
+    void TearDown(const ::benchmark::State&) override {
+        for (int32_t family : kSelAddrFamilies) {
+            XfrmController::ipSecDeleteSecurityPolicy(mTransformId, family,
+                                                      static_cast<int32_t>(XfrmDirection::OUT),
+                                                      kMarkValue, kMarkMask, 0)
+                    .ignoreError();
+        }
+        XfrmController::ipSecDeleteSecurityAssociation(mTransformId, kLocalAddress, kRemoteAddress,
+                                                       mSpi, kMarkValue, kMarkMask, 0)
+                .ignoreError();
+    }
+
+  protected:
+    Status allocateSpi(int32_t spi) {
+        int32_t outSpi;
+        return XfrmController::ipSecAllocateSpi(mTransformId, kLocalAddress, kRemoteAddress,
+                                                spi, &outSpi);
+    }
+
+    XfrmSaParams saParams(int32_t transformId, int32_t spi) {
+        return {
+                .transformId = transformId,
+                .mode = static_cast<int32_t>(XfrmMode::TUNNEL),
+                .sourceAddress = kLocalAddress,
+                .destinationAddress = kRemoteAddress,
+                .spi = spi,
+                .markValue = kMarkValue,
+                .markMask = kMarkMask,
+                .authAlgo = "hmac(sha256)",
+                .authKey = std::vector<uint8_t>(32, 0x11),
+                .authTruncBits = 128,
+                .cryptAlgo = "cbc(aes)",
+                .cryptKey = std::vector<uint8_t>(32, 0x22),
+                .encapType = static_cast<int32_t>(XfrmEncapType::NONE),
+        };
+    }
+
+    Status addSa(int32_t spi) {
+        const XfrmSaParams sa = saParams(mTransformId, spi);
+        return XfrmController::ipSecAddSecurityAssociation(
+                sa.transformId, sa.mode, sa.sourceAddress, sa.destinationAddress,
+                sa.underlyingNetId, sa.spi, sa.markValue, sa.markMask, sa.authAlgo, sa.authKey,
+                sa.authTruncBits, sa.cryptAlgo, sa.cryptKey, sa.cryptTruncBits, sa.aeadAlgo,
+                sa.aeadKey, sa.aeadIcvBits, sa.encapType, sa.encapLocalPort, sa.encapRemotePort,
+                sa.xfrmInterfaceId);
+    }
+
+    // The rekey as it is done without ipSecRekey: one netlink transaction per step.
+    Status rekeyOneByOne(int32_t oldSpi, int32_t newSpi) {
+        RETURN_IF_NOT_OK(addSa(newSpi));
+        for (int32_t family : kSelAddrFamilies) {
+            RETURN_IF_NOT_OK(XfrmController::ipSecUpdateSecurityPolicy(
+                    mTransformId, family, static_cast<int32_t>(XfrmDirection::OUT),
+                    kLocalAddress, kRemoteAddress, newSpi, kMarkValue, kMarkMask, 0));
+        }
+        return XfrmController::ipSecDeleteSecurityAssociation(
+                mTransformId, kLocalAddress, kRemoteAddress, oldSpi, kMarkValue, kMarkMask, 0);
+    }
+
+    Status rekey(int32_t oldSpi, int32_t newSpi, std::chrono::milliseconds gracePeriod) {
+        const XfrmRekeyParams rekey = {
+                .newSa = saParams(mTransformId, newSpi),
+                .oldTransformId = mTransformId,
+                .oldSpi = oldSpi,
+                .direction = static_cast<int32_t>(XfrmDirection::OUT),
+                .selAddrFamilies = kSelAddrFamilies,
+                .gracePeriod = gracePeriod,
+        };
+        return XfrmController::ipSecRekey(rekey);
+    }
+
+    template <typename RekeyFn>
+    void runRekeys(benchmark::State& state, RekeyFn rekeyFn) {
+        if (!isOk(mSetUpStatus)) {
+            state.SkipWithError(StringPrintf("Setup failed: %s", toString(mSetUpStatus).c_str())
+                                        .c_str());
+            return;
+        }
+        for (auto _ : state) {  // NOLINT(clang-analyzer-deadcode.DeadStores)
+            const int32_t newSpi = mSpi + 1;
+            Status ret = allocateSpi(newSpi);
+            if (isOk(ret)) ret = rekeyFn(mSpi, newSpi);
+            if (!isOk(ret)) {
+                state.SkipWithError(
+                        StringPrintf("Rekey failed: %s", toString(ret).c_str()).c_str());
+                break;
+            }
+            mSpi = newSpi;
+        }
+        state.counters["rekeys_per_sec"] =
+                benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+    }
+
+    int32_t mSpi;
+    int32_t mTransformId;
+    Status mSetUpStatus;
+};
+
+BENCHMARK_DEFINE_F(XfrmBenchmark, RekeyOneByOne)(benchmark::State& state) {
+    runRekeys(state, [this](int32_t oldSpi, int32_t newSpi) {
+        return rekeyOneByOne(oldSpi, newSpi);
+    });
+}
+
+BENCHMARK_DEFINE_F(XfrmBenchmark, Rekey)(benchmark::State& state) {
+    const std::chrono::milliseconds gracePeriod(state.range(0));
+    runRekeys(state, [this, gracePeriod](int32_t oldSpi, int32_t newSpi) {
+        return rekey(oldSpi, newSpi, gracePeriod);
+    });
+}
+
+BENCHMARK_REGISTER_F(XfrmBenchmark, RekeyOneByOne)->UseRealTime();
+// A grace period of 0 deletes the old SA in the same batch; otherwise it is deleted later by a
+// background thread.
+BENCHMARK_REGISTER_F(XfrmBenchmark, Rekey)->Arg(0)->Arg(10)->UseRealTime();
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (unshare(CLONE_NEWNET) != 0) {
+        fprintf(stderr, "Failed to enter a new network namespace: %s\n", strerror(errno));
+        return 1;
+    }
+    ::benchmark::Initialize(&argc, argv);
+    ::benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}